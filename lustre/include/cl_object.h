@@ -93,6 +93,7 @@
 #include <lu_object.h>
 #include <linux/atomic.h>
 #include <linux/mutex.h>
+#include <linux/percpu_counter.h>
 #include <linux/radix-tree.h>
 #include <linux/spinlock.h>
 #include <linux/wait.h>
@@ -100,6 +101,7 @@
 
 struct obd_info;
 struct inode;
+struct kiocb;
 
 struct cl_device;
 
@@ -1750,18 +1752,37 @@ enum cl_fsync_mode {
 struct cl_io_range {
 	loff_t cir_pos;
 	size_t cir_count;
+	/**
+	 * Parallel IO: the stripe the range belongs to. The ranges of a
+	 * stripe are done in order by the same task, see cl_io_loop().
+	 */
+	int    cir_lane;
 };
 
+/** A range of a parallel IO. */
 struct cl_io_pt {
+	/** next range of the IO, in file order */
 	struct cl_io_pt		*cip_next;
+	/** next range of the same lane, done by the same task */
+	struct cl_io_pt		*cip_lane_next;
+	/** last range of the lane, set on the first range of a lane only,
+	 * which owns the task of the lane */
+	struct cl_io_pt		*cip_lane_tail;
+	/** next lane in the same bucket of the lane table of the IO, set on
+	 * the first range of a lane only */
+	struct cl_io_pt		*cip_lane_hnext;
 	struct cfs_ptask	 cip_task;
 	struct kiocb		 cip_iocb;
 	struct iov_iter		 cip_iter;
 	struct file		*cip_file;
 	enum cl_io_type		 cip_iot;
+	int			 cip_lane;
 	loff_t			 cip_pos;
 	size_t			 cip_count;
+	/** bytes done in the range */
 	ssize_t			 cip_result;
+	/** error of the range, if it was not fully done */
+	int			 cip_rc;
 };
 
 /**
@@ -1889,11 +1910,21 @@ struct cl_io {
 	/** Set to 1 if parallel execution is allowed for current I/O? */
 			     ci_pio:1,
 	/* Tell sublayers not to expand LDLM locks requested for this IO */
-			     ci_lock_no_expand:1;
+			     ci_lock_no_expand:1,
+	/**
+	 * Read-ahead by a background worker on behalf of a reader, only
+	 * covered by the locks the reader already holds.
+	 */
+			     ci_async_readahead:1;
 	/**
 	 * Number of pages owned by this IO. For invariant checking.
 	 */
 	unsigned	     ci_owned_nr;
+	/**
+	 * Direct IO whose pages are not waited for by each chunk of the IO,
+	 * completed by the IO issuer once the IO loop is over.
+	 */
+	struct cl_dio_aio   *ci_aio;
 };
 
 /** @} cl_io */
@@ -1957,6 +1988,12 @@ struct cl_site {
 	 */
 	struct cache_stats	cs_pages;
 	atomic_t		cs_pages_state[CPS_NR];
+	/**
+	 * Memory used by the cl_page descriptors of the site and their
+	 * number, always accounted, see cl_site_stats_print().
+	 */
+	struct percpu_counter	cs_page_desc_bytes;
+	struct percpu_counter	cs_page_desc_nr;
 };
 
 int  cl_site_init(struct cl_site *s, struct cl_device *top);
@@ -2457,6 +2494,61 @@ void cl_sync_io_note(const struct lu_env *env, struct cl_sync_io *anchor,
 		     int ioret);
 void cl_sync_io_end(const struct lu_env *env, struct cl_sync_io *anchor);
 
+/**
+ * Something a layer keeps for a direct IO until all its pages are
+ * transferred, such as the pinned user pages or a reference on the DLM lock
+ * covering them, see cl_dio_hold_add().
+ */
+struct cl_dio_hold {
+	struct list_head	cdh_linkage;
+	/** layer object the hold was taken for, to look it up */
+	const void		*cdh_owner;
+	/** releases the hold, once all the pages of the IO are transferred */
+	void			(*cdh_release)(const struct lu_env *env,
+					       struct cl_dio_hold *hold);
+};
+
+/**
+ * Direct IO transferred asynchronously.
+ *
+ * The pages of all the chunks are submitted without waiting for the
+ * previous ones.  The locks of a chunk are released by the IO loop while its
+ * pages may still be in transfer, so the layers keep what the pages need
+ * until then as holds on the IO, e.g. osc keeps a reference on the DLM locks
+ * covering them.  The IO issuer holds a reference on cda_sync until it has
+ * submitted everything, then either waits for it or, for an AIO, lets the
+ * last page completion release the pages and the holds, and complete
+ * cda_iocb.
+ */
+struct cl_dio_aio {
+	/** pages in transfer, plus one reference of the IO issuer */
+	struct cl_sync_io	cda_sync;
+	/** transient pages submitted, released once all transferred */
+	struct cl_page_list	cda_pages;
+	/** list of struct cl_dio_hold, added by the IO issuer only */
+	struct list_head	cda_holds;
+	/** IO to complete, if not synchronous */
+	struct kiocb		*cda_iocb;
+	/** bytes submitted, result of an AIO without error */
+	ssize_t			cda_bytes;
+	/** submission time of the first page */
+	ktime_t			cda_start;
+	/** optional callback run once all the pages are transferred */
+	void			(*cda_done)(struct cl_dio_aio *aio,
+					    ssize_t result);
+	void			*cda_data;
+};
+
+struct cl_dio_aio *cl_aio_alloc(struct kiocb *iocb);
+void cl_aio_free(struct cl_dio_aio *aio);
+int cl_dio_submit(const struct lu_env *env, struct cl_io *io,
+		  enum cl_req_type iot, struct cl_2queue *queue,
+		  struct cl_dio_aio *aio);
+void cl_dio_hold_add(struct cl_dio_aio *aio, struct cl_dio_hold *hold,
+		     const void *owner,
+		     void (*release)(const struct lu_env *env,
+				     struct cl_dio_hold *hold));
+
 /** @} cl_sync_io */
 
 /** \defgroup cl_env cl_env
@@ -33,6 +33,7 @@
 #ifndef _LUSTRE_COMPAT_H
 #define _LUSTRE_COMPAT_H
 
+#include <linux/aio.h>
 #include <linux/fs_struct.h>
 #include <linux/namei.h>
 #include <linux/pagemap.h>
@@ -627,4 +628,12 @@ static inline struct timespec current_time(struct inode *inode)
 }
 #endif
 
+#ifndef HAVE_AIO_COMPLETE
+static inline void aio_complete(struct kiocb *iocb, ssize_t res, ssize_t res2)
+{
+	if (iocb->ki_complete)
+		iocb->ki_complete(iocb, res, res2);
+}
+#endif
+
 #endif /* _LUSTRE_COMPAT_H */
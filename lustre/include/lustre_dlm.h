@@ -65,6 +65,16 @@ extern struct kset *ldlm_svc_kset;
 #define LDLM_DEFAULT_MAX_ALIVE		3900	/* 3900 seconds ~65 min */
 #define LDLM_CTIME_AGE_LIMIT (10)
 #define LDLM_DEFAULT_PARALLEL_AST_LIMIT 1024
+/* Max locks in one blocking AST to a client with OBD_CONNECT2_BL_AST_BATCH,
+ * the reply listing the unknown handles must fit in LDLM_MAXREPSIZE. */
+#define LDLM_BL_AST_BATCH_MAX		64
+/* Max locks in one lock replay RPC to a server with
+ * OBD_CONNECT2_LOCK_REPLAY_BATCH, the request must fit in MDS_MAXREQSIZE. */
+#define LDLM_REPLAY_BATCH_MAX		32
+#define LDLM_REPLAY_MAX_INFLIGHT	32
+/* Max locks in one enqueue to a server with OBD_CONNECT2_MULTI_ENQUEUE, the
+ * request must fit in MDS_MAXREQSIZE. */
+#define LDLM_MULTI_ENQUEUE_MAX		32
 
 /**
  * LDLM non-error return states
@@ -180,7 +190,7 @@ static inline int lockmode_compat(enum ldlm_mode exist_mode,
  * lr_lock
  *
  * lr_lock
- *     waiting_locks_spinlock
+ *     ldlm_waiting_locks::wl_lock
  *
  * lr_lock
  *     led_lock
@@ -253,6 +263,9 @@ struct ldlm_pool {
 	/** Lock volume factor. SLV on client is calculated as following:
 	 *  server_slv * lock_volume_factor. */
 	atomic_t		pl_lock_volume_factor;
+	/** Average change of SLV between client recalcs, used to forecast
+	 *  the next SLV. Protected by pl_lock. */
+	__s64			pl_slv_trend;
 	/** Time when last SLV from server was obtained. */
 	time64_t		pl_recalc_time;
 	/** Recalculation period for pool. */
@@ -263,6 +276,8 @@ struct ldlm_pool {
 	int			pl_grant_plan;
 	/** Pool statistics. */
 	struct lprocfs_stats	*pl_stats;
+	/** Recently cancelled LRU locks, client only, to count re-enqueues. */
+	__u64			*pl_lru_ghosts;
 
 	/* sysfs object */
 	struct kobject		 pl_kobj;
@@ -310,12 +325,13 @@ enum ldlm_appetite {
 };
 
 /**
- * Default values for the "max_nolock_size", "contention_time" and
- * "contended_locks" namespace tunables.
+ * Default values for the "max_nolock_size", "contention_time",
+ * "contended_locks" and "contended_extent_align" namespace tunables.
  */
 #define NS_DEFAULT_MAX_NOLOCK_BYTES 0
 #define NS_DEFAULT_CONTENTION_SECONDS 2
 #define NS_DEFAULT_CONTENDED_LOCKS 32
+#define NS_DEFAULT_CONTENDED_EXTENT_ALIGN 1
 
 struct ldlm_ns_bucket {
 	/** back pointer to namespace */
@@ -369,6 +385,23 @@ enum ldlm_ns_type {
  * The locks held by server only without any reference to a client are called
  * local locks.
  */
+/**
+ * One shard of the LRU list of unused locks of a namespace.
+ *
+ * Locks are added to the shard of the CPU partition releasing them so that
+ * threads on different partitions do not contend on one lock.  A lock used
+ * again while in LRU is only flagged (l_lru_ref) and gets a second chance
+ * when the LRU is scanned, like the CLOCK algorithm.
+ */
+struct ldlm_lru_shard {
+	/** protects the fields below and l_lru of the locks on the list */
+	spinlock_t		lls_lock;
+	/** unused locks, in order of addition */
+	struct list_head	lls_list;
+	/** number of locks on lls_list */
+	int			lls_nr;
+};
+
 struct ldlm_namespace {
 	/** Backward link to OBD, required for LDLM pool to store new SLV. */
 	struct obd_device	*ns_obd;
@@ -404,18 +437,16 @@ struct ldlm_namespace {
 	struct list_head	ns_list_chain;
 
 	/**
-	 * List of unused locks for this namespace. This list is also called
-	 * LRU lock list.
+	 * Lists of unused locks for this namespace, one per CPU partition.
+	 * These lists are also called LRU lock lists.
 	 * Unused locks are locks with zero reader/writer reference counts.
-	 * This list is only used on clients for lock caching purposes.
+	 * These lists are only used on clients for lock caching purposes.
 	 * When we want to release some locks voluntarily or if server wants
 	 * us to release some locks due to e.g. memory pressure, we take locks
-	 * to release from the head of this list.
+	 * to release from the heads of these lists, oldest first.
 	 * Locks are linked via l_lru field in \see struct ldlm_lock.
 	 */
-	struct list_head	ns_unused_list;
-	/** Number of locks in the LRU list above */
-	int			ns_nr_unused;
+	struct ldlm_lru_shard	**ns_lru;
 
 	/**
 	 * Maximum number of locks permitted in the LRU. If 0, means locks
@@ -496,6 +527,13 @@ struct ldlm_namespace {
 	/** Limit of parallel AST RPC count. */
 	unsigned		ns_max_parallel_ast;
 
+	/**
+	 * Grant write extent locks on resources shared by several clients
+	 * aligned to the spacing of their recent requests, instead of
+	 * growing them as far as possible, see ldlm_extent_policy().
+	 */
+	unsigned		ns_contended_extent_align;
+
 	/**
 	 * Callback to check if a lock is good to be canceled by ELC or
 	 * during recovery.
@@ -607,6 +645,10 @@ struct ldlm_cb_set_arg {
 struct ldlm_cb_async_args {
 	struct ldlm_cb_set_arg	*ca_set_arg;
 	struct ldlm_lock	*ca_lock;
+	/* all locks of a batched blocking AST, ca_lock is the first one,
+	 * the array has LDLM_BL_AST_BATCH_MAX slots */
+	struct ldlm_lock	**ca_locks;
+	int			 ca_nr_locks;
 };
 
 /** The ldlm_glimpse_work was slab allocated & must be freed accordingly.*/
@@ -633,6 +675,23 @@ struct ldlm_interval_tree {
 	struct interval_node	*lit_root; /* actual ldlm_interval */
 };
 
+/** Number of write requests remembered per contended extent resource. */
+#define LDLM_EXTENT_HISTORY_SIZE	16
+
+struct ldlm_extent_history_entry {
+	/** handle cookie of the requesting export, 0 for an unused entry */
+	__u64			 leh_exp_cookie;
+	/** requested extent */
+	__u64			 leh_start;
+	__u64			 leh_end;
+	cfs_time_t		 leh_time;
+};
+
+struct ldlm_extent_history {
+	unsigned int			 leh_next;
+	struct ldlm_extent_history_entry leh_entries[LDLM_EXTENT_HISTORY_SIZE];
+};
+
 /** Whether to track references to exports by LDLM locks. */
 #define LUSTRE_TRACKS_LOCK_EXP_REFS (0)
 
@@ -700,6 +759,12 @@ struct ldlm_lock {
 	 * Must be first in the structure.
 	 */
 	struct portals_handle	l_handle;
+
+	/*
+	 * Members used by every lock match, reference and state change,
+	 * kept together so that they share a cache line right after l_handle.
+	 */
+
 	/**
 	 * Lock reference count.
 	 * This is how many users have pointers to actual structure, so that
@@ -717,10 +782,25 @@ struct ldlm_lock {
 	 */
 	struct ldlm_resource	*l_resource;
 	/**
-	 * List item for client side LRU list.
-	 * Protected by ns_lock in struct ldlm_namespace.
+	 * Lock state flags. Protected by lr_lock.
+	 * \see lustre_dlm_flags.h where the bits are defined.
 	 */
-	struct list_head	l_lru;
+	__u64			l_flags;
+	/**
+	 * Requested mode.
+	 * Protected by lr_lock.
+	 */
+	enum ldlm_mode		l_req_mode;
+	/**
+	 * Granted mode, also protected by lr_lock.
+	 */
+	enum ldlm_mode		l_granted_mode;
+	/**
+	 * Lock r/w usage counters.
+	 * Protected by lr_lock.
+	 */
+	__u32			l_readers;
+	__u32			l_writers;
 	/**
 	 * Linkage to resource's lock queues according to current lock state.
 	 * (could be granted, waiting or converting)
@@ -728,28 +808,78 @@ struct ldlm_lock {
 	 */
 	struct list_head	l_res_link;
 	/**
-	 * Tree node for ldlm_extent.
+	 * Representation of private data specific for a lock type.
+	 * Examples are: extent range for extent lock or bitmask for ibits locks
 	 */
-	struct ldlm_interval	*l_tree_node;
+	union ldlm_policy_data	l_policy_data;
 	/**
-	 * Per export hash of locks.
-	 * Protected by per-bucket exp->exp_lock_hash locks.
+	 * Time, in nanoseconds, last used by e.g. being matched by lock match.
 	 */
-	struct hlist_node	l_exp_hash;
+	ktime_t			l_last_used;
 	/**
-	 * Per export hash of flock locks.
-	 * Protected by per-bucket exp->exp_flock_hash locks.
+	 * List item for client side LRU list.
+	 * Protected by lls_lock of the LRU shard in struct ldlm_namespace.
 	 */
-	struct hlist_node	l_exp_flock_hash;
+	struct list_head	l_lru;
 	/**
-	 * Requested mode.
-	 * Protected by lr_lock.
+	 * LRU shard l_lru is linked on.
+	 * Protected by lr_lock in struct ldlm_resource.
 	 */
-	enum ldlm_mode		l_req_mode;
+	unsigned short		l_lru_cpt;
+	/** Lock was used while in LRU, \see struct ldlm_lru_shard */
+	unsigned char		l_lru_ref;
 	/**
-	 * Granted mode, also protected by lr_lock.
+	 * Saturating count of the times the lock was taken again from LRU,
+	 * weights the lock volume in the lru_resize cancel policy.
+	 * Protected by lr_lock in struct ldlm_resource.
 	 */
-	enum ldlm_mode		l_granted_mode;
+	unsigned char		l_lru_reuse;
+	/** Type of the LVB of the lock (enum lvb_type) */
+	unsigned char		l_lvb_type;
+	/**
+	 * Number of times blocking AST was sent for this lock, server side.
+	 * This is for debugging. Valid values are 0 and 1, if there is an
+	 * attempt to send blocking AST more than once, an assertion would be
+	 * hit. \see ldlm_work_bl_ast_lock
+	 */
+	unsigned char		l_bl_ast_run;
+
+	/*
+	 * Lock type specific members, only the ones of the type of the
+	 * resource the lock was created on are valid.
+	 */
+
+	/**
+	 * Protected by lr_lock, linkage to the "skip list" of locks with the
+	 * same policy for LDLM_PLAIN and LDLM_IBITS locks, or to the
+	 * li_group of the interval tree node for LDLM_EXTENT locks.
+	 * For more explanations of skip lists see ldlm/ldlm_inodebits.c
+	 */
+	struct list_head	l_sl_policy;
+	union {
+		/**
+		 * LDLM_PLAIN and LDLM_IBITS: protected by lr_lock, linkage
+		 * to the "skip list" of locks with the same mode.
+		 */
+		struct list_head	l_sl_mode;
+		/** LDLM_EXTENT */
+		struct {
+			/** Tree node for ldlm_extent. */
+			struct ldlm_interval	*l_tree_node;
+			/** Originally requested extent. */
+			struct ldlm_extent	 l_req_extent;
+		};
+		/**
+		 * LDLM_FLOCK: per export hash of flock locks.
+		 * Protected by per-bucket exp->exp_flock_hash locks.
+		 */
+		struct hlist_node	l_exp_flock_hash;
+	};
+
+	/*
+	 * Members used when the lock is enqueued, granted or canceled.
+	 */
+
 	/** Lock completion handler pointer. Called when lock is granted. */
 	ldlm_completion_callback l_completion_ast;
 	/**
@@ -789,51 +919,19 @@ struct ldlm_lock {
 	 */
 	struct lustre_handle	l_remote_handle;
 
-	/**
-	 * Representation of private data specific for a lock type.
-	 * Examples are: extent range for extent lock or bitmask for ibits locks
-	 */
-	union ldlm_policy_data	l_policy_data;
-
-	/**
-	 * Lock state flags. Protected by lr_lock.
-	 * \see lustre_dlm_flags.h where the bits are defined.
-	 */
-	__u64			l_flags;
-
-	/**
-	 * Lock r/w usage counters.
-	 * Protected by lr_lock.
-	 */
-	__u32			l_readers;
-	__u32			l_writers;
-	/**
-	 * If the lock is granted, a process sleeps on this waitq to learn when
-	 * it's no longer in use.  If the lock is not granted, a process sleeps
-	 * on this waitq to learn when it becomes granted.
-	 */
-	wait_queue_head_t	l_waitq;
-
 	/**
 	 * Seconds. It will be updated if there is any activity related to
 	 * the lock, e.g. enqueue the lock or send blocking AST.
 	 */
 	time64_t		l_last_activity;
 
-	/**
-	 * Time, in nanoseconds, last used by e.g. being matched by lock match.
-	 */
-	ktime_t			l_last_used;
-
-	/** Originally requested extent for the extent lock. */
-	struct ldlm_extent	l_req_extent;
+	/** Local PID of process which created this lock. */
+	__u32			l_pid;
 
 	/*
 	 * Client-side-only members.
 	 */
 
-	enum lvb_type	      l_lvb_type;
-
 	/**
 	 * Temporary storage for a LVB received during an enqueue operation.
 	 * May be vmalloc'd, so needs to be freed with OBD_FREE_LARGE().
@@ -848,6 +946,12 @@ struct ldlm_lock {
 	 * Server-side-only members.
 	 */
 
+	/**
+	 * Per export hash of locks.
+	 * Protected by per-bucket exp->exp_lock_hash locks.
+	 */
+	struct hlist_node	l_exp_hash;
+
 	/**
 	 * Connection cookie for the client originating the operation.
 	 * Used by Commit on Share (COS) code. Currently only used for
@@ -858,9 +962,9 @@ struct ldlm_lock {
 	/**
 	 * List item for locks waiting for cancellation from clients.
 	 * The lists this could be linked into are:
-	 * waiting_locks_list (protected by waiting_locks_spinlock),
-	 * then if the lock timed out, it is moved to
-	 * expired_lock_list for further processing.
+	 * a waiting locks timer wheel slot (protected by the wl_lock of
+	 * its CPU partition), then if the lock timed out, it is moved to
+	 * the wl_expired list of that partition for further processing.
 	 */
 	struct list_head	l_pending_chain;
 
@@ -873,16 +977,6 @@ struct ldlm_lock {
 	 */
 	cfs_time_t		l_callback_timeout;
 
-	/** Local PID of process which created this lock. */
-	__u32			l_pid;
-
-	/**
-	 * Number of times blocking AST was sent for this lock.
-	 * This is for debugging. Valid values are 0 and 1, if there is an
-	 * attempt to send blocking AST more than once, an assertion would be
-	 * hit. \see ldlm_work_bl_ast_lock
-	 */
-	int			l_bl_ast_run;
 	/** List item ldlm_add_ast_work_item() for case of blocking ASTs. */
 	struct list_head	l_bl_ast;
 	/** List item ldlm_add_ast_work_item() for case of completion ASTs. */
@@ -897,11 +991,12 @@ struct ldlm_lock {
 	struct ldlm_lock	*l_blocking_lock;
 
 	/**
-	 * Protected by lr_lock, linkages to "skip lists".
-	 * For more explanations of skip lists see ldlm/ldlm_inodebits.c
+	 * export blocking dlm lock list, protected by
+	 * l_export->exp_bl_list_lock.
+	 * Lock order of waiting_lists_spinlock, exp_bl_list_lock and res lock
+	 * is: res lock -> exp_bl_list_lock -> wanting_lists_spinlock.
 	 */
-	struct list_head	l_sl_mode;
-	struct list_head	l_sl_policy;
+	struct list_head	l_exp_list;
 
 	/** Reference tracking structure to debug leaked locks. */
 	struct lu_ref		l_reference;
@@ -914,13 +1009,6 @@ struct ldlm_lock {
 	/** referenced export object */
 	struct obd_export	*l_exp_refs_target;
 #endif
-	/**
-	 * export blocking dlm lock list, protected by
-	 * l_export->exp_bl_list_lock.
-	 * Lock order of waiting_lists_spinlock, exp_bl_list_lock and res lock
-	 * is: res lock -> exp_bl_list_lock -> wanting_lists_spinlock.
-	 */
-	struct list_head	l_exp_list;
 };
 
 /** For uncommitted cross-MDT lock, store transno this lock belongs to */
@@ -972,11 +1060,35 @@ struct ldlm_resource {
 	/** Resource name */
 	struct ldlm_res_id	lr_name;
 
+	/**
+	 * Granted lock matched last by ldlm_lock_match(), published with RCU
+	 * and not referenced. Cleared when the lock is unlinked from the
+	 * resource, which happens before the lock is freed.
+	 */
+	struct ldlm_lock	*lr_match_hint;
+
 	/**
 	 * Interval trees (only for extent locks) for all modes of this resource
 	 */
 	struct ldlm_interval_tree *lr_itree;
 
+	/**
+	 * Recent write requests from different clients, only for contended
+	 * extent resources on the server
+	 */
+	struct ldlm_extent_history *lr_ext_history;
+
+	/**
+	 * Decaying count of recent enqueues and matches on the resource and
+	 * when it was last decayed (seconds), and when one of its locks was
+	 * last revoked by lock reclaim. Server side only, updated without
+	 * locking, see ldlm_reclaim_hit().
+	 * @{ */
+	__u32			lr_reclaim_hits;
+	__u32			lr_reclaim_stamp;
+	__u32			lr_reclaim_time;
+	/** @} */
+
 	union {
 		/**
 		 * When the resource was considered as contended,
@@ -1129,6 +1241,19 @@ struct ldlm_enqueue_info {
 
 #define ei_res_id	ei_cb_gl
 
+/**
+ * One lock of a multi-resource enqueue, see ldlm_cli_enqueue_multi().
+ */
+struct ldlm_enqueue_item {
+	struct ldlm_res_id	lei_res_id;	/** resource to lock */
+	union ldlm_policy_data	lei_policy;	/** inodebits to lock */
+	enum ldlm_mode		lei_mode;	/** mode of the lock */
+	/** granted lock, referenced in lei_mode, valid if lei_rc is 0 */
+	struct lustre_handle	lei_lockh;
+	/** -EWOULDBLOCK if the lock conflicts with another one */
+	int			lei_rc;
+};
+
 extern struct obd_ops ldlm_obd_ops;
 
 extern char *ldlm_lockname[];
@@ -1540,6 +1665,11 @@ int ldlm_prep_elc_req(struct obd_export *exp, struct ptlrpc_request *req,
 		      int version, int opc, int canceloff,
 		      struct list_head *cancels, int count);
 
+int ldlm_cli_enqueue_multi(struct obd_export *exp,
+			   struct ldlm_enqueue_info *einfo,
+			   struct ldlm_enqueue_item *items, int count,
+			   __u64 flags);
+
 struct ptlrpc_request *ldlm_enqueue_pack(struct obd_export *exp, int lvb_len);
 int ldlm_handle_enqueue0(struct ldlm_namespace *ns, struct ptlrpc_request *req,
 			 const struct ldlm_request *dlm_req,
@@ -147,6 +147,14 @@
 #define ldlm_set_cos_incompat(_l)	LDLM_SET_FLAG((_l), 1ULL << 24)
 #define ldlm_clear_cos_incompat(_l)	LDLM_CLEAR_FLAG((_l), 1ULL << 24)
 
+/**
+ * Set on the first lock of a multi-resource enqueue: grant all the locks of
+ * the request or none of them (OBD_CONNECT2_MULTI_ENQUEUE). */
+#define LDLM_FL_ALL_OR_NOTHING		0x0000000002000000ULL /* bit  25 */
+#define ldlm_is_all_or_nothing(_l)	LDLM_TEST_FLAG((_l), 1ULL << 25)
+#define ldlm_set_all_or_nothing(_l)	LDLM_SET_FLAG((_l), 1ULL << 25)
+#define ldlm_clear_all_or_nothing(_l)	LDLM_CLEAR_FLAG((_l), 1ULL << 25)
+
 /**
  * Part of original lockahead implementation, OBD_CONNECT_LOCKAHEAD_OLD.
  * Reserved temporarily to allow those implementations to keep working.
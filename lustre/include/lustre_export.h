@@ -297,6 +297,10 @@ struct obd_export {
 
 	struct adaptive_timeout    exp_bl_lock_at;
 
+	/** recent lock usage of the export, see ldlm_reclaim_hit() */
+	__u32			   exp_reclaim_hits;
+	__u32			   exp_reclaim_stamp;
+
 	/** highest XID received by export client that has no
 	 * unreceived lower-numbered XID
 	 */
@@ -433,6 +437,56 @@ static inline int exp_connect_lockahead(struct obd_export *exp)
 	return !!(exp_connect_flags2(exp) & OBD_CONNECT2_LOCKAHEAD);
 }
 
+static inline int exp_connect_bl_ast_batch(struct obd_export *exp)
+{
+	return !!(exp_connect_flags2(exp) & OBD_CONNECT2_BL_AST_BATCH);
+}
+
+static inline int exp_connect_lock_replay_batch(struct obd_export *exp)
+{
+	return !!(exp_connect_flags2(exp) & OBD_CONNECT2_LOCK_REPLAY_BATCH);
+}
+
+static inline bool imp_connect_lock_replay_batch(struct obd_import *imp)
+{
+	struct obd_connect_data *ocd;
+
+	LASSERT(imp != NULL);
+	ocd = &imp->imp_connect_data;
+	return (ocd->ocd_connect_flags & OBD_CONNECT_FLAGS2) &&
+	       (ocd->ocd_connect_flags2 & OBD_CONNECT2_LOCK_REPLAY_BATCH);
+}
+
+static inline int exp_connect_multi_enqueue(struct obd_export *exp)
+{
+	return !!(exp_connect_flags2(exp) & OBD_CONNECT2_MULTI_ENQUEUE);
+}
+
+static inline bool imp_connect_multi_enqueue(struct obd_import *imp)
+{
+	struct obd_connect_data *ocd;
+
+	LASSERT(imp != NULL);
+	ocd = &imp->imp_connect_data;
+	return (ocd->ocd_connect_flags & OBD_CONNECT_FLAGS2) &&
+	       (ocd->ocd_connect_flags2 & OBD_CONNECT2_MULTI_ENQUEUE);
+}
+
+static inline int exp_connect_multi_brw(struct obd_export *exp)
+{
+	return !!(exp_connect_flags2(exp) & OBD_CONNECT2_MULTI_BRW);
+}
+
+static inline bool imp_connect_multi_brw(struct obd_import *imp)
+{
+	struct obd_connect_data *ocd;
+
+	LASSERT(imp != NULL);
+	ocd = &imp->imp_connect_data;
+	return (ocd->ocd_connect_flags & OBD_CONNECT_FLAGS2) &&
+	       (ocd->ocd_connect_flags2 & OBD_CONNECT2_MULTI_BRW);
+}
+
 extern struct obd_export *class_conn2export(struct lustre_handle *conn);
 extern struct obd_device *class_conn2obd(struct lustre_handle *conn);
 
@@ -167,6 +167,8 @@ struct obd_import {
         struct ptlrpc_client     *imp_client;
 	/** List element for linking into pinger chain */
 	struct list_head	  imp_pinger_chain;
+	/** List element for linking into pinger timer wheel slot */
+	struct list_head	  imp_pinger_wheel;
 	/** List element for linking into chain for destruction */
 	struct list_head	  imp_zombie_chain;
 
@@ -256,6 +258,8 @@ struct obd_import {
         struct lustre_handle      imp_remote_handle;
         /** When to perform next ping. time in jiffies. */
 	time64_t		imp_next_ping;
+	/** Pinger timer wheel slot the import is queued for */
+	time64_t		imp_pinger_wheel_time;
 	/** When we last successfully connected. time in 64bit jiffies */
         __u64                     imp_last_success_conn;
 
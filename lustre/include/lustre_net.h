@@ -99,6 +99,8 @@
 #define PTLRPC_MAX_BRW_BITS	(LNET_MTU_BITS + PTLRPC_BULK_OPS_BITS)
 #define PTLRPC_MAX_BRW_SIZE	(1U << PTLRPC_MAX_BRW_BITS)
 #define PTLRPC_MAX_BRW_PAGES	(PTLRPC_MAX_BRW_SIZE >> PAGE_SHIFT)
+/* maximum number of objects in one multi-object BRW write */
+#define PTLRPC_MAX_BRW_OBJS	16
 
 #define ONE_MB_BRW_SIZE		(1U << LNET_MTU_BITS)
 #define MD_MAX_BRW_SIZE		(1U << LNET_MTU_BITS)
@@ -403,6 +405,14 @@
 #define OUT_BUFSIZE		max(OUT_MAXREQSIZE + SPTLRPC_MAX_PAYLOAD, \
 				    24 * 1024)
 
+/**
+ * Incoming requests no larger than this can be copied out of the request
+ * buffer (see ptlrpc_service::srv_req_copy_size) so that the rqbd does not
+ * stay pinned by a single long-running small request.  Such requests are
+ * copied into a dedicated slab, so the size must stay small.
+ */
+#define PTLRPC_REQ_COPY_MAX	(4 * 1024)
+
 /** FLD_MAXREQSIZE == lustre_msg + __u32 padding + ptlrpc_body + opc */
 #define FLD_MAXREQSIZE  (160)
 
@@ -466,7 +476,7 @@
 
 /**
  * OST_IO_MAXREQSIZE ~=
- * 	lustre_msg + ptlrpc_body + obdo + obd_ioobj +
+ * 	lustre_msg + ptlrpc_body + PTLRPC_MAX_BRW_OBJS * (obdo + obd_ioobj) +
  * 	DT_MAX_BRW_PAGES * niobuf_remote
  *
  * - single object with 16 pages is 512 bytes
@@ -476,8 +486,8 @@
  */
 #define _OST_MAXREQSIZE_SUM (sizeof(struct lustre_msg) + \
 			     sizeof(struct ptlrpc_body) + \
-			     sizeof(struct obdo) + \
-			     sizeof(struct obd_ioobj) + \
+			     sizeof(struct obdo) * PTLRPC_MAX_BRW_OBJS + \
+			     sizeof(struct obd_ioobj) * PTLRPC_MAX_BRW_OBJS + \
 			     sizeof(struct niobuf_remote) * DT_MAX_BRW_PAGES)
 /**
  * FIEMAP request can be 4K+ for now
@@ -1007,7 +1017,8 @@ struct ptlrpc_request {
 	unsigned int
 		rq_hp:1,		/**< high priority RPC */
 		rq_at_linked:1,		/**< link into service's srv_at_array */
-		rq_packed_final:1;	/**< packed final reply */
+		rq_packed_final:1,	/**< packed final reply */
+		rq_reqbuf_copied:1;	/**< reqbuf copied out of the rqbd */
 	/** @} */
 
 	/** one of RQ_PHASE_* */
@@ -1479,6 +1490,8 @@ struct ptlrpc_bulk_desc {
 			 */
 			lnet_kiov_t *bd_enc_vec;
 			lnet_kiov_t *bd_vec;
+			/* CPT of the encryption pool bd_enc_vec comes from */
+			int	     bd_enc_cpt;
 		} bd_kiov;
 
 		struct {
@@ -1493,6 +1506,7 @@ struct ptlrpc_bulk_desc {
 #define BD_GET_KIOV(desc, i)		((desc)->bd_u.bd_kiov.bd_vec[i])
 #define GET_ENC_KIOV(desc)		((desc)->bd_u.bd_kiov.bd_enc_vec)
 #define BD_GET_ENC_KIOV(desc, i)	((desc)->bd_u.bd_kiov.bd_enc_vec[i])
+#define GET_ENC_CPT(desc)		((desc)->bd_u.bd_kiov.bd_enc_cpt)
 #define GET_KVEC(desc)			((desc)->bd_u.bd_kvec.bd_kvec)
 #define BD_GET_KVEC(desc, i)		((desc)->bd_u.bd_kvec.bd_kvec[i])
 #define GET_ENC_KVEC(desc)		((desc)->bd_u.bd_kvec.bd_enc_kvec)
@@ -1620,6 +1634,13 @@ struct ptlrpc_request_buffer_desc {
 	/** LNet descriptor */
 	struct lnet_handle_md		rqbd_md_h;
 	int				rqbd_refcount;
+	/**
+	 * # of requests copied out of this buffer which are still alive,
+	 * they only refer to the descriptor, not to the buffer itself
+	 */
+	int				rqbd_ncopied;
+	/** time the buffer was unlinked from LNet, for repost latency */
+	ktime_t				rqbd_unlink_time;
 	/** The buffer itself */
 	char				*rqbd_buffer;
 	struct ptlrpc_cb_id		rqbd_cbid;
@@ -1723,6 +1744,11 @@ struct ptlrpc_service {
 
 	/** max # request buffers in history per partition */
 	int				srv_hist_nrqbds_cpt_max;
+	/**
+	 * requests up to this size are copied out of the request buffer
+	 * so the buffer can be reposted sooner, 0 to disable
+	 */
+	int				srv_req_copy_size;
 	/** number of CPTs this service bound on */
 	int				srv_ncpts;
 	/** CPTs array this service bound on */
@@ -1813,6 +1839,15 @@ struct ptlrpc_service_part {
 	__u64				scp_hist_seq;
 	/** highest seq culled from history */
 	__u64				scp_hist_seq_culled;
+	/** # copied-out requests still being processed */
+	int				scp_nreqs_copied;
+	/** total # requests copied out of request buffers */
+	__u64				scp_nreqs_copied_total;
+	/** # rqbds reposted after being unlinked by LNet */
+	__u64				scp_rqbd_reposts;
+	/** total and max unlink-to-repost latency, in usecs */
+	__u64				scp_rqbd_repost_us;
+	__u64				scp_rqbd_repost_max_us;
 
 	/**
 	 * serialize the following fields, used for processing requests
@@ -1925,6 +1960,17 @@ struct ptlrpcd_ctl {
 	 * Error code if the thread failed to fully start.
 	 */
 	int				pc_error;
+	/**
+	 * # of times this thread took requests from a thread of the same
+	 * CPT, and from a thread of another CPT.  Only updated by the thread
+	 * itself.
+	 */
+	unsigned long			pc_steal_local;
+	unsigned long			pc_steal_remote;
+	/**
+	 * # of requests taken from other threads.
+	 */
+	unsigned long			pc_stolen_reqs;
 };
 
 /* Bits for pc_flags */
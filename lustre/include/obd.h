@@ -156,6 +156,38 @@ enum obd_cl_sem_lock_class {
 
 struct mdc_rpc_lock;
 struct obd_import;
+/**
+ * Shard of the LRU of the cached pages of a client_obd.
+ *
+ * Pages are added to the shard of the CPU partition of the thread finishing
+ * their transfer, so that IO threads running on different CPUs do not
+ * contend on one list lock.  Each shard is in LRU order by itself, the
+ * shrinker goes through all the shards starting from its local one.
+ */
+struct cl_lru_shard {
+	/** protects the fields below and ops_lru of the pages on the list */
+	spinlock_t		cls_lock;
+	/** unused pages, in order of addition */
+	struct list_head	cls_list;
+	/** number of pages on cls_list */
+	long			cls_nr;
+	/** stats: how many times cls_lock was found taken */
+	__u64			cls_contended;
+};
+
+/**
+ * Smoothed rate of a flow of bytes, used to pace writers before they run out
+ * of grant, see osc_pace_rate_add().
+ */
+struct cl_pace_rate {
+	/** start of the current sample */
+	ktime_t			cpr_stamp;
+	/** bytes of the current sample */
+	__u64			cpr_bytes;
+	/** smoothed bytes per second */
+	__u64			cpr_bps;
+};
+
 struct client_obd {
 	struct rw_semaphore	 cl_sem;
 	struct obd_uuid		 cl_target_uuid;
@@ -201,6 +233,27 @@ struct client_obd {
 	 * See osc_{reserve|unreserve}_grant for details. */
 	long			cl_reserved_grant;
 	struct list_head	cl_cache_waiters; /* waiting for cache/grant */
+
+	/* write pacing: writers are slowed down as grant runs out, rather
+	 * than stopped once it has, see osc_enter_cache_pace(). Protected by
+	 * loi_list_lock as the grant values. */
+	int			cl_write_pacing;
+	/* when the next writer may go */
+	ktime_t			cl_pace_next;
+	/* write RPC completions, which return grant */
+	struct cl_pace_rate	cl_pace_done;
+	/* grant consumption by writers */
+	struct cl_pace_rate	cl_pace_grant;
+	/* grant consumed since a writer was last paced, to be charged to
+	 * cl_pace_next */
+	__u64			cl_pace_charge;
+	/* stats: writers delayed, and for how long */
+	__u64			cl_pace_count;
+	__u64			cl_pace_us;
+	/* stats: writers which ran out of grant or cache space, and how
+	 * long they waited */
+	__u64			cl_starve_count;
+	__u64			cl_starve_us;
 	time64_t		cl_next_shrink_grant;	/* seconds */
 	struct list_head	cl_grant_shrink_list;  /* Timeout event list */
 	time64_t		cl_grant_shrink_interval; /* seconds */
@@ -249,6 +302,8 @@ struct client_obd {
 	struct obd_histogram	cl_write_page_hist;
 	struct obd_histogram	cl_read_offset_hist;
 	struct obd_histogram	cl_write_offset_hist;
+	/* objects per write RPC, see OBD_CONNECT2_MULTI_BRW */
+	struct obd_histogram	cl_write_objs_hist;
 
 	/** LRU for osc caching pages */
 	struct cl_client_cache  *cl_cache;
@@ -273,11 +328,14 @@ struct client_obd {
 	 * reclaim and shrink - shrink is async, voluntarily rebalancing;
 	 * reclaim is sync, initiated by IO thread when the LRU slots are
 	 * in shortage. */
-	__u64                    cl_lru_reclaim;
-	/** List of LRU pages for this client_obd */
-	struct list_head         cl_lru_list;
-	/** Lock for LRU page list */
-	spinlock_t		 cl_lru_list_lock;
+	atomic64_t		 cl_lru_reclaim;
+	/** stats: time spent by IO threads reclaiming LRU slots, in ns */
+	atomic64_t		 cl_lru_reclaim_ns;
+	atomic64_t		 cl_lru_reclaim_max_ns;
+	/** stats: how many times IO threads had to reclaim LRU slots */
+	atomic64_t		 cl_lru_reclaim_waits;
+	/** LRU pages for this client_obd, one shard per CPU partition */
+	struct cl_lru_shard	**cl_lru;
 	/** # of unstable pages in this client_obd.
 	 * An unstable page is a page state that WRITE RPC has finished but
 	 * the transaction has NOT yet committed. */
@@ -1026,6 +1084,9 @@ struct md_ops {
 			 const union ldlm_policy_data *, struct md_op_data *,
 			 struct lustre_handle *, __u64);
 
+	int (*m_enqueue_multi)(struct obd_export *, struct ldlm_enqueue_info *,
+			       struct ldlm_enqueue_item *, int, __u64);
+
 	int (*m_getattr)(struct obd_export *, struct md_op_data *,
 			 struct ptlrpc_request **);
 
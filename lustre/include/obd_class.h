@@ -1349,6 +1349,20 @@ static inline int md_enqueue(struct obd_export *exp,
         RETURN(rc);
 }
 
+static inline int md_enqueue_multi(struct obd_export *exp,
+				   struct ldlm_enqueue_info *einfo,
+				   struct ldlm_enqueue_item *items, int count,
+				   __u64 extra_lock_flags)
+{
+	int rc;
+	ENTRY;
+	EXP_CHECK_MD_OP(exp, enqueue_multi);
+	EXP_MD_COUNTER_INCREMENT(exp, enqueue_multi);
+	rc = MDP(exp->exp_obd, enqueue_multi)(exp, einfo, items, count,
+					      extra_lock_flags);
+	RETURN(rc);
+}
+
 static inline int md_getattr_name(struct obd_export *exp,
                                   struct md_op_data *op_data,
                                   struct ptlrpc_request **request)
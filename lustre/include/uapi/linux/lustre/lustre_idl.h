@@ -803,6 +803,10 @@ struct ptlrpc_body_v2 {
 /* ocd_connect_flags2 flags */
 #define OBD_CONNECT2_FILE_SECCTX	0x1ULL /* set file security context at create */
 #define OBD_CONNECT2_LOCKAHEAD	0x2ULL /* ladvise lockahead v2 */
+#define OBD_CONNECT2_BL_AST_BATCH	0x4ULL /* multiple locks per blocking AST */
+#define OBD_CONNECT2_LOCK_REPLAY_BATCH	0x8ULL /* multiple locks per replay */
+#define OBD_CONNECT2_MULTI_ENQUEUE	0x10ULL /* many resources per enqueue */
+#define OBD_CONNECT2_MULTI_BRW	0x20ULL /* many objects per BRW write */
 
 /* XXX README XXX:
  * Please DO NOT add flag values here before first ensuring that this same
@@ -851,7 +855,10 @@ struct ptlrpc_body_v2 {
 				OBD_CONNECT_SUBTREE | OBD_CONNECT_LARGE_ACL | \
 				OBD_CONNECT_FLAGS2)
 
-#define MDT_CONNECT_SUPPORTED2 OBD_CONNECT2_FILE_SECCTX
+#define MDT_CONNECT_SUPPORTED2 (OBD_CONNECT2_FILE_SECCTX | \
+				OBD_CONNECT2_BL_AST_BATCH | \
+				OBD_CONNECT2_LOCK_REPLAY_BATCH | \
+				OBD_CONNECT2_MULTI_ENQUEUE)
 
 #define OST_CONNECT_SUPPORTED  (OBD_CONNECT_SRVLOCK | OBD_CONNECT_GRANT | \
 				OBD_CONNECT_REQPORTAL | OBD_CONNECT_VERSION | \
@@ -871,7 +878,10 @@ struct ptlrpc_body_v2 {
 				OBD_CONNECT_BULK_MBITS | \
 				OBD_CONNECT_GRANT_PARAM | OBD_CONNECT_FLAGS2)
 
-#define OST_CONNECT_SUPPORTED2 OBD_CONNECT2_LOCKAHEAD
+#define OST_CONNECT_SUPPORTED2 (OBD_CONNECT2_LOCKAHEAD | \
+				OBD_CONNECT2_BL_AST_BATCH | \
+				OBD_CONNECT2_LOCK_REPLAY_BATCH | \
+				OBD_CONNECT2_MULTI_BRW)
 
 #define ECHO_CONNECT_SUPPORTED 0
 #define ECHO_CONNECT_SUPPORTED2 0
@@ -263,6 +263,160 @@ ldlm_extent_internal_policy_waiting(struct ldlm_lock *req,
         EXIT;
 }
 
+/* how many granted locks to look at for a write lock of another client */
+#define LDLM_EXTENT_HISTORY_SCAN	(LDLM_EXTENT_HISTORY_SIZE * 4)
+
+static inline bool ldlm_extent_is_write(enum ldlm_mode mode)
+{
+	return mode == LCK_PW || mode == LCK_CW;
+}
+
+static void ldlm_extent_history_add(struct ldlm_extent_history *hist,
+				    struct obd_export *exp,
+				    struct ldlm_extent *ext, cfs_time_t now)
+{
+	struct ldlm_extent_history_entry *entry;
+
+	entry = &hist->leh_entries[hist->leh_next];
+	hist->leh_next = (hist->leh_next + 1) % LDLM_EXTENT_HISTORY_SIZE;
+
+	/* the history outlives the locks, so the export is kept by its
+	 * cookie, which cannot dangle, rather than by reference */
+	entry->leh_exp_cookie = exp->exp_handle.h_cookie;
+	entry->leh_start = ext->start;
+	entry->leh_end = ext->end;
+	entry->leh_time = now;
+}
+
+/**
+ * Return the write request history of \a res, or start one if a write lock
+ * of another client than \a req is granted on it. The history is seeded from
+ * the granted write locks.
+ */
+static struct ldlm_extent_history *
+ldlm_extent_history_get(struct ldlm_resource *res, struct ldlm_lock *req,
+			cfs_time_t now)
+{
+	struct ldlm_extent_history *hist = res->lr_ext_history;
+	struct ldlm_lock *lock;
+	bool shared = false;
+	int scanned = 0;
+
+	if (hist != NULL)
+		return hist;
+
+	list_for_each_entry(lock, &res->lr_granted, l_res_link) {
+		if (++scanned > LDLM_EXTENT_HISTORY_SCAN)
+			break;
+		if (lock->l_export != NULL && lock->l_export != req->l_export &&
+		    ldlm_extent_is_write(lock->l_granted_mode)) {
+			shared = true;
+			break;
+		}
+	}
+	if (!shared)
+		return NULL;
+
+	/* called under the resource spinlock */
+	OBD_ALLOC_GFP(hist, sizeof(*hist), GFP_ATOMIC);
+	if (hist == NULL)
+		return NULL;
+
+	scanned = 0;
+	list_for_each_entry(lock, &res->lr_granted, l_res_link) {
+		if (++scanned > LDLM_EXTENT_HISTORY_SIZE)
+			break;
+		if (lock->l_export != NULL &&
+		    ldlm_extent_is_write(lock->l_granted_mode))
+			ldlm_extent_history_add(hist, lock->l_export,
+						&lock->l_req_extent, now);
+	}
+	res->lr_ext_history = hist;
+
+	return hist;
+}
+
+/**
+ * Contention-aware extent allocation for write locks.
+ *
+ * When clients write to different parts of a shared object (N-to-1 segmented
+ * or strided checkpoints), growing every write lock as far as the other
+ * granted locks allow makes each client take the next lock from its
+ * neighbour, and the locks ping-pong between the clients. Instead, once the
+ * resource has seen writes from several clients within ns_contention_time,
+ * trim the grant to the window around the request that is aligned to the
+ * distance to the nearest recent request of another client. With stripe
+ * sized requests this is the stripe size, and every client ends up with
+ * extents of its own part of the object which do not conflict with the
+ * other clients.
+ */
+static void ldlm_extent_contended_policy(struct ldlm_lock *req,
+					 struct ldlm_extent *new_ex)
+{
+	struct ldlm_resource *res = req->l_resource;
+	struct ldlm_namespace *ns = ldlm_res_to_ns(res);
+	struct ldlm_extent_history_entry *entry;
+	struct ldlm_extent_history *hist;
+	__u64 req_start = req->l_req_extent.start;
+	__u64 req_end = req->l_req_extent.end;
+	__u64 cookie = req->l_export->exp_handle.h_cookie;
+	cfs_time_t now = cfs_time_current();
+	__u64 unit = 0;
+	bool unit_set = false;
+	__u64 start;
+	__u64 end;
+	__u64 dist;
+	int i;
+
+	if (!ns->ns_contended_extent_align ||
+	    !ldlm_extent_is_write(req->l_req_mode))
+		return;
+
+	hist = ldlm_extent_history_get(res, req, now);
+	if (hist == NULL)
+		return;
+
+	for (i = 0; i < LDLM_EXTENT_HISTORY_SIZE; i++) {
+		entry = &hist->leh_entries[i];
+		if (entry->leh_exp_cookie == 0 || entry->leh_exp_cookie == cookie ||
+		    cfs_time_after(now, cfs_time_add(entry->leh_time,
+				   cfs_time_seconds(ns->ns_contention_time))))
+			continue;
+
+		dist = entry->leh_start > req_start ?
+		       entry->leh_start - req_start :
+		       req_start - entry->leh_start;
+		if (!unit_set || dist < unit) {
+			unit = dist;
+			unit_set = true;
+		}
+	}
+
+	ldlm_extent_history_add(hist, req->l_export, &req->l_req_extent, now);
+
+	/* no other writer recently */
+	if (!unit_set)
+		return;
+
+	/* another writer at the very same offset leaves only the pages of
+	 * the request */
+	unit = max_t(__u64, unit & PAGE_MASK, PAGE_SIZE);
+
+	start = div64_u64(req_start, unit) * unit;
+	if (req_end >= OBD_OBJECT_EOF - unit)
+		end = OBD_OBJECT_EOF;
+	else
+		end = div64_u64(req_end + unit, unit) * unit - 1;
+
+	if (start <= new_ex->start && end >= new_ex->end)
+		return;
+
+	LDLM_DEBUG(req, "contended extent [%llu, %llu] unit %llu",
+		   start, end, unit);
+	new_ex->start = max(new_ex->start, start);
+	new_ex->end = min(new_ex->end, end);
+	ldlm_extent_internal_policy_fixup(req, new_ex, 0);
+}
 
 /* In order to determine the largest possible extent we can grant, we need
  * to scan all of the queues. */
@@ -292,6 +446,7 @@ static void ldlm_extent_policy(struct ldlm_resource *res,
 	if (likely(!(lock->l_flags & LDLM_FL_NO_EXPANSION))) {
 		ldlm_extent_internal_policy_granted(lock, &new_ex);
 		ldlm_extent_internal_policy_waiting(lock, &new_ex);
+		ldlm_extent_contended_policy(lock, &new_ex);
 	} else {
 		LDLM_DEBUG(lock, "Not expanding manually requested lock.\n");
 		new_ex.start = lock->l_policy_data.l_extent.start;
@@ -233,9 +233,12 @@ restart:
 	rc += ldlm_inodebits_compat_queue(&res->lr_waiting, lock, &rpc_list);
 
 	if (rc != 2) {
-		/* if there were only bits to try and all are conflicting */
+		/* if there were only bits to try and all are conflicting,
+		 * or the lock is part of a multi-resource enqueue that must
+		 * not wait */
 		if ((lock->l_policy_data.l_inodebits.bits |
-		     lock->l_policy_data.l_inodebits.try_bits) == 0) {
+		     lock->l_policy_data.l_inodebits.try_bits) == 0 ||
+		    (*flags & LDLM_FL_BLOCK_NOWAIT)) {
 			rc = ELDLM_LOCK_WOULDBLOCK;
 		} else {
 			rc = ldlm_handle_conflict_lock(lock, flags,
@@ -30,6 +30,8 @@
  * Lustre is a trademark of Sun Microsystems, Inc.
  */
 
+#include <linux/hash.h>
+
 #define MAX_STRING_SIZE 128
 
 extern int ldlm_srv_namespace_nr;
@@ -40,6 +42,24 @@ extern struct mutex ldlm_cli_namespace_lock;
 extern struct list_head ldlm_cli_active_namespace_list;
 extern struct list_head ldlm_cli_inactive_namespace_list;
 extern unsigned int ldlm_cancel_unused_locks_before_replay;
+extern unsigned int ldlm_lock_replay_max_inflight;
+extern unsigned int ldlm_lock_replay_batch;
+
+/*
+ * Locks have no wait queue of their own to keep struct ldlm_lock small.
+ * If the lock is granted, a process sleeps on the wait queue of the lock to
+ * learn when it's no longer in use.  If the lock is not granted, a process
+ * sleeps on it to learn when it becomes granted.  The queues are shared by
+ * the locks hashing to them, so waiters must recheck their condition when
+ * woken up, and all the waiters must be woken up.
+ */
+#define LDLM_LOCK_WAITQ_BITS	8
+extern wait_queue_head_t ldlm_lock_waitqs[1 << LDLM_LOCK_WAITQ_BITS];
+
+static inline wait_queue_head_t *ldlm_lock_waitq(struct ldlm_lock *lock)
+{
+	return &ldlm_lock_waitqs[hash_ptr(lock, LDLM_LOCK_WAITQ_BITS)];
+}
 
 static inline int ldlm_namespace_nr_read(enum ldlm_side client)
 {
@@ -88,6 +108,19 @@ static inline int ldlm_ns_empty(struct ldlm_namespace *ns)
 	return atomic_read(&ns->ns_bref) == 0;
 }
 
+/* number of locks in all the LRU shards of the namespace, racy */
+static inline int ldlm_ns_nr_unused(struct ldlm_namespace *ns)
+{
+	struct ldlm_lru_shard *lls;
+	int nr = 0;
+	int i;
+
+	cfs_percpt_for_each(lls, i, ns->ns_lru)
+		nr += lls->lls_nr;
+
+	return nr;
+}
+
 void ldlm_namespace_move_to_active_locked(struct ldlm_namespace *,
 					  enum ldlm_side);
 void ldlm_namespace_move_to_inactive_locked(struct ldlm_namespace *,
@@ -117,6 +150,7 @@ int ldlm_cancel_lru_local(struct ldlm_namespace *ns,
 			  struct list_head *cancels, int count, int max,
 			  enum ldlm_cancel_flags cancel_flags,
 			  enum ldlm_lru_flags lru_flags);
+int ldlm_request_bufsize(int count, int type);
 extern unsigned int ldlm_enqueue_min;
 /* ldlm_resource.c */
 extern struct kmem_cache *ldlm_resource_slab;
@@ -169,6 +203,7 @@ int ldlm_lock_remove_from_lru_nolock(struct ldlm_lock *lock);
 void ldlm_lock_add_to_lru_nolock(struct ldlm_lock *lock);
 void ldlm_lock_add_to_lru(struct ldlm_lock *lock);
 void ldlm_lock_touch_in_lru(struct ldlm_lock *lock);
+void ldlm_lock_rotate_in_lru(struct ldlm_lock *lock);
 void ldlm_lock_destroy_nolock(struct ldlm_lock *lock);
 
 int ldlm_export_cancel_blocked_locks(struct obd_export *exp);
@@ -182,6 +217,12 @@ int ldlm_bl_to_thread_list(struct ldlm_namespace *ns,
 			   struct list_head *cancels, int count,
 			   enum ldlm_cancel_flags cancel_flags);
 int ldlm_bl_thread_wakeup(void);
+#ifdef HAVE_SERVER_SUPPORT
+int ldlm_server_blocking_ast_batch(struct ldlm_lock **locks, int count,
+				   struct ldlm_lock_desc *desc,
+				   struct ldlm_cb_set_arg *arg);
+int ldlm_waiting_locks_stats_seq_show(struct seq_file *m, void *v);
+#endif
 
 void ldlm_handle_bl_callback(struct ldlm_namespace *ns,
                              struct ldlm_lock_desc *ld, struct ldlm_lock *lock);
@@ -253,6 +294,12 @@ enum ldlm_policy_res {
         LDLM_POLICY_SKIP_LOCK
 };
 
+/* ldlm_pool.c */
+__u64 ldlm_pool_get_slv_forecast(struct ldlm_pool *pl);
+void ldlm_pool_lru_cancel_note(struct ldlm_pool *pl, struct ldlm_lock *lock);
+void ldlm_pool_enqueue_note(struct ldlm_pool *pl,
+			    const struct ldlm_res_id *res_id);
+
 #define LDLM_POOL_SYSFS_PRINT_int(v) sprintf(buf, "%d\n", v)
 #define LDLM_POOL_SYSFS_SET_int(a, b) { a = b; }
 #define LDLM_POOL_SYSFS_PRINT_u64(v) sprintf(buf, "%lld\n", v)
@@ -388,11 +435,15 @@ extern __u64 ldlm_lock_limit;
 extern __u64 ldlm_reclaim_threshold_mb;
 extern __u64 ldlm_lock_limit_mb;
 extern struct percpu_counter ldlm_granted_total;
+extern unsigned int ldlm_reclaim_budget_us;
+int ldlm_reclaim_stats_seq_show(struct seq_file *m, void *data);
 #endif
 int ldlm_reclaim_setup(void);
 void ldlm_reclaim_cleanup(void);
 void ldlm_reclaim_add(struct ldlm_lock *lock);
 void ldlm_reclaim_del(struct ldlm_lock *lock);
+void ldlm_reclaim_hit(struct ldlm_resource *res, struct obd_export *exp,
+		      bool enqueue);
 bool ldlm_reclaim_full(void);
 
 static inline bool ldlm_res_eq(const struct ldlm_res_id *res0,
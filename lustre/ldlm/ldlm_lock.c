@@ -47,6 +47,9 @@
 struct kmem_cache *ldlm_glimpse_work_kmem;
 EXPORT_SYMBOL(ldlm_glimpse_work_kmem);
 
+/* wait queues of the locks, see ldlm_lock_waitq() */
+wait_queue_head_t ldlm_lock_waitqs[1 << LDLM_LOCK_WAITQ_BITS];
+
 /* lock types */
 char *ldlm_lockname[] = {
 	[0] = "--",
@@ -206,6 +209,9 @@ void ldlm_lock_put(struct ldlm_lock *lock)
 
                 lprocfs_counter_decr(ldlm_res_to_ns(res)->ns_stats,
                                      LDLM_NSS_LOCKS);
+		/* l_tree_node is only valid for extent locks */
+		if (res->lr_type == LDLM_EXTENT)
+			ldlm_interval_free(ldlm_interval_detach(lock));
                 lu_ref_del(&res->lr_reference, "lock", lock);
                 ldlm_resource_putref(res);
                 lock->l_resource = NULL;
@@ -217,7 +223,6 @@ void ldlm_lock_put(struct ldlm_lock *lock)
                 if (lock->l_lvb_data != NULL)
                         OBD_FREE_LARGE(lock->l_lvb_data, lock->l_lvb_len);
 
-                ldlm_interval_free(ldlm_interval_detach(lock));
                 lu_ref_fini(&lock->l_reference);
 		OBD_FREE_RCU(lock, sizeof(*lock), &lock->l_handle);
         }
@@ -227,18 +232,21 @@ void ldlm_lock_put(struct ldlm_lock *lock)
 EXPORT_SYMBOL(ldlm_lock_put);
 
 /**
- * Removes LDLM lock \a lock from LRU. Assumes LRU is already locked.
+ * Removes LDLM lock \a lock from LRU. Assumes the LRU shard the lock is on
+ * is already locked.
  */
 int ldlm_lock_remove_from_lru_nolock(struct ldlm_lock *lock)
 {
 	int rc = 0;
 	if (!list_empty(&lock->l_lru)) {
 		struct ldlm_namespace *ns = ldlm_lock_to_ns(lock);
+		struct ldlm_lru_shard *lls = ns->ns_lru[lock->l_lru_cpt];
 
 		LASSERT(lock->l_resource->lr_type != LDLM_FLOCK);
+		assert_spin_locked(&lls->lls_lock);
 		list_del_init(&lock->l_lru);
-		LASSERT(ns->ns_nr_unused > 0);
-		ns->ns_nr_unused--;
+		LASSERT(lls->lls_nr > 0);
+		lls->lls_nr--;
 		rc = 1;
 	}
 	return rc;
@@ -250,6 +258,9 @@ int ldlm_lock_remove_from_lru_nolock(struct ldlm_lock *lock)
  * If \a last_use is non-zero, it will remove the lock from LRU only if
  * it matches lock's l_last_used.
  *
+ * Must be called with the resource of the lock locked, so that the lock
+ * cannot be added to LRU concurrently.
+ *
  * \retval 0 if \a last_use is set, the lock is not in LRU list or \a last_use
  *           doesn't match lock's l_last_used;
  *           otherwise, the lock hasn't been in the LRU list.
@@ -258,6 +269,7 @@ int ldlm_lock_remove_from_lru_nolock(struct ldlm_lock *lock)
 int ldlm_lock_remove_from_lru_check(struct ldlm_lock *lock, ktime_t last_use)
 {
 	struct ldlm_namespace *ns = ldlm_lock_to_ns(lock);
+	struct ldlm_lru_shard *lls;
 	int rc = 0;
 
 	ENTRY;
@@ -266,54 +278,102 @@ int ldlm_lock_remove_from_lru_check(struct ldlm_lock *lock, ktime_t last_use)
 		RETURN(0);
 	}
 
-	spin_lock(&ns->ns_lock);
+	/* only the LRU scan can remove the lock behind our back, no need
+	 * to take the LRU lock if it is not there already */
+	if (list_empty(&lock->l_lru))
+		RETURN(0);
+
+	lls = ns->ns_lru[lock->l_lru_cpt];
+	spin_lock(&lls->lls_lock);
 	if (!ktime_compare(last_use, ktime_set(0, 0)) ||
 	    !ktime_compare(last_use, lock->l_last_used))
 		rc = ldlm_lock_remove_from_lru_nolock(lock);
-	spin_unlock(&ns->ns_lock);
+	spin_unlock(&lls->lls_lock);
 
 	RETURN(rc);
 }
 
 /**
- * Adds LDLM lock \a lock to namespace LRU. Assumes LRU is already locked.
+ * Adds LDLM lock \a lock to namespace LRU. Assumes the LRU shard
+ * l_lru_cpt is already locked.
  */
 void ldlm_lock_add_to_lru_nolock(struct ldlm_lock *lock)
 {
 	struct ldlm_namespace *ns = ldlm_lock_to_ns(lock);
+	struct ldlm_lru_shard *lls = ns->ns_lru[lock->l_lru_cpt];
 
 	lock->l_last_used = ktime_get();
+	lock->l_lru_ref = 0;
 	LASSERT(list_empty(&lock->l_lru));
 	LASSERT(lock->l_resource->lr_type != LDLM_FLOCK);
-	list_add_tail(&lock->l_lru, &ns->ns_unused_list);
+	assert_spin_locked(&lls->lls_lock);
+	list_add_tail(&lock->l_lru, &lls->lls_list);
 	ldlm_clear_skipped(lock);
-	LASSERT(ns->ns_nr_unused >= 0);
-	ns->ns_nr_unused++;
+	LASSERT(lls->lls_nr >= 0);
+	lls->lls_nr++;
 }
 
 /**
- * Adds LDLM lock \a lock to namespace LRU. Obtains necessary LRU locks
- * first.
+ * Adds LDLM lock \a lock to the LRU shard of the current CPU partition.
+ * Obtains necessary LRU locks first.
  */
 void ldlm_lock_add_to_lru(struct ldlm_lock *lock)
 {
 	struct ldlm_namespace *ns = ldlm_lock_to_ns(lock);
+	struct ldlm_lru_shard *lls;
 
 	ENTRY;
-	spin_lock(&ns->ns_lock);
+	lock->l_lru_cpt = cfs_cpt_current(cfs_cpt_table, 1);
+	lls = ns->ns_lru[lock->l_lru_cpt];
+
+	spin_lock(&lls->lls_lock);
 	ldlm_lock_add_to_lru_nolock(lock);
-	spin_unlock(&ns->ns_lock);
+	spin_unlock(&lls->lls_lock);
 	EXIT;
 }
 
 /**
- * Moves LDLM lock \a lock that is already in namespace LRU to the tail of
- * the LRU. Performs necessary LRU locking
+ * Counts one more use of LDLM lock \a lock taken from LRU, saturating.
  */
-void ldlm_lock_touch_in_lru(struct ldlm_lock *lock)
+static inline void ldlm_lock_lru_reused(struct ldlm_lock *lock)
+{
+	if (lock->l_lru_reuse != (unsigned char)~0)
+		lock->l_lru_reuse++;
+}
+
+/**
+ * Moves LDLM lock \a lock to the tail of its LRU shard without changing its
+ * age, used by the LRU policies to skip a lock they decided to keep for now
+ * so that the scan does not stop on it.
+ *
+ * Must be called with the resource of the lock locked.
+ */
+void ldlm_lock_rotate_in_lru(struct ldlm_lock *lock)
 {
 	struct ldlm_namespace *ns = ldlm_lock_to_ns(lock);
+	struct ldlm_lru_shard *lls;
 
+	if (list_empty(&lock->l_lru))
+		return;
+
+	lls = ns->ns_lru[lock->l_lru_cpt];
+	spin_lock(&lls->lls_lock);
+	if (!list_empty(&lock->l_lru))
+		list_move_tail(&lock->l_lru, &lls->lls_list);
+	spin_unlock(&lls->lls_lock);
+}
+
+/**
+ * Marks LDLM lock \a lock that is already in namespace LRU as used again.
+ *
+ * The lock is not moved to the tail of the LRU here, which would need the
+ * LRU lock on every lock match, instead the LRU scan gives it a second
+ * chance, see ldlm_lru_shard_first().  l_last_used is updated so that the
+ * lock age seen by the LRU policies and ldlm_lock_remove_from_lru_check()
+ * are the same as if it had been moved.
+ */
+void ldlm_lock_touch_in_lru(struct ldlm_lock *lock)
+{
 	ENTRY;
 	if (ldlm_is_ns_srv(lock)) {
 		LASSERT(list_empty(&lock->l_lru));
@@ -321,12 +381,12 @@ void ldlm_lock_touch_in_lru(struct ldlm_lock *lock)
 		return;
 	}
 
-	spin_lock(&ns->ns_lock);
 	if (!list_empty(&lock->l_lru)) {
-		ldlm_lock_remove_from_lru_nolock(lock);
-		ldlm_lock_add_to_lru_nolock(lock);
+		lock->l_last_used = ktime_get();
+		lock->l_lru_ref = 1;
+		ldlm_lock_lru_reused(lock);
+		ldlm_clear_skipped(lock);
 	}
-	spin_unlock(&ns->ns_lock);
 	EXIT;
 }
 
@@ -369,6 +429,9 @@ static int ldlm_lock_destroy_internal(struct ldlm_lock *lock)
 		return 0;
 	}
 	ldlm_set_destroyed(lock);
+	/* flock locks are unlinked without ldlm_resource_unlink_lock() */
+	if (lock->l_resource->lr_match_hint == lock)
+		RCU_INIT_POINTER(lock->l_resource->lr_match_hint, NULL);
 
 	if (lock->l_export && lock->l_export->exp_lock_hash) {
 		/* NB: it's safe to call cfs_hash_del() even lock isn't
@@ -470,12 +533,24 @@ static struct ldlm_lock *ldlm_lock_new(struct ldlm_resource *resource)
 	INIT_LIST_HEAD(&lock->l_bl_ast);
 	INIT_LIST_HEAD(&lock->l_cp_ast);
 	INIT_LIST_HEAD(&lock->l_rk_ast);
-	init_waitqueue_head(&lock->l_waitq);
 	lock->l_blocking_lock = NULL;
-	INIT_LIST_HEAD(&lock->l_sl_mode);
 	INIT_LIST_HEAD(&lock->l_sl_policy);
 	INIT_HLIST_NODE(&lock->l_exp_hash);
-	INIT_HLIST_NODE(&lock->l_exp_flock_hash);
+
+	/* only initialize the members of the lock type, the others share
+	 * their memory, see struct ldlm_lock */
+	switch (resource->lr_type) {
+	case LDLM_PLAIN:
+	case LDLM_IBITS:
+		INIT_LIST_HEAD(&lock->l_sl_mode);
+		break;
+	case LDLM_FLOCK:
+		INIT_HLIST_NODE(&lock->l_exp_flock_hash);
+		break;
+	default:
+		/* LDLM_EXTENT: l_tree_node is attached by ldlm_lock_create() */
+		break;
+	}
 
         lprocfs_counter_incr(ldlm_res_to_ns(resource)->ns_stats,
                              LDLM_NSS_LOCKS);
@@ -732,7 +807,8 @@ EXPORT_SYMBOL(ldlm_lock_addref);
 void ldlm_lock_addref_internal_nolock(struct ldlm_lock *lock,
 				      enum ldlm_mode mode)
 {
-        ldlm_lock_remove_from_lru(lock);
+	if (ldlm_lock_remove_from_lru(lock))
+		ldlm_lock_lru_reused(lock);
         if (mode & (LCK_NL | LCK_CR | LCK_PR)) {
                 lock->l_readers++;
                 lu_ref_add_atomic(&lock->l_reference, "reader", lock);
@@ -1102,7 +1178,8 @@ void ldlm_grant_lock(struct ldlm_lock *lock, struct list_head *work_list)
 
         check_res_locked(res);
 
-        lock->l_granted_mode = lock->l_req_mode;
+	/* paired with the unlocked check of search_match_hint() */
+	smp_store_release(&lock->l_granted_mode, lock->l_req_mode);
 
 	if (work_list && lock->l_completion_ast != NULL)
 		ldlm_add_ast_work_item(lock, NULL, work_list);
@@ -1142,6 +1219,9 @@ struct lock_match_data {
 	union ldlm_policy_data	*lmd_policy;
 	__u64			 lmd_flags;
 	int			 lmd_unref;
+	/* only pin the lock found, the reference of a client lock is added
+	 * under its l_lock, see match_lock_nores() */
+	int			 lmd_pin;
 };
 
 /**
@@ -1215,6 +1295,8 @@ static int lock_matches(struct ldlm_lock *lock, struct lock_match_data *data)
 	if (data->lmd_flags & LDLM_FL_TEST_LOCK) {
 		LDLM_LOCK_GET(lock);
 		ldlm_lock_touch_in_lru(lock);
+	} else if (data->lmd_pin) {
+		LDLM_LOCK_GET(lock);
 	} else {
 		ldlm_lock_addref_internal_nolock(lock, match);
 	}
@@ -1295,11 +1377,102 @@ static struct ldlm_lock *search_queue(struct list_head *queue,
 	return NULL;
 }
 
+/**
+ * Check the client lock \a lock against \a data and add the reference
+ * without the resource lock. A client lock does not change but under its own
+ * l_lock, which lock_res_and_lock() takes first, and reader/writer references
+ * of client locks are only added and dropped under it. The caller holds a
+ * plain reference on \a lock.
+ *
+ * \param res      \a lock has to be a lock of this resource still
+ * \param granted  \a lock has to be granted still
+ *
+ * \retval a referenced lock or NULL.
+ */
+static struct ldlm_lock *match_lock_nores(struct ldlm_lock *lock,
+					  struct ldlm_resource *res,
+					  struct lock_match_data *data,
+					  bool granted)
+{
+	int pin = data->lmd_pin;
+
+	data->lmd_pin = 0;
+	data->lmd_lock = NULL;
+	spin_lock(&lock->l_lock);
+	if (lock->l_resource == res &&
+	    (!granted || (!ldlm_is_destroyed(lock) &&
+			  lock->l_granted_mode == lock->l_req_mode)))
+		lock_matches(lock, data);
+	spin_unlock(&lock->l_lock);
+	data->lmd_pin = pin;
+
+	return data->lmd_lock;
+}
+
+/**
+ * Try the granted lock which \a res has matched last, without searching the
+ * queues.
+ *
+ * The hint is read under RCU, ldlm locks are freed with RCU, and pinned with
+ * atomic_inc_not_zero() on its refcount. A client lock is then checked and
+ * referenced under its own l_lock, without the resource lock, see
+ * match_lock_nores(). Server locks have no l_lock, their state is only
+ * protected by the resource lock, which is still taken to check them.
+ *
+ * \param res      search for a lock in this resource
+ * \param data	   parameters
+ *
+ * \retval a referenced lock or NULL.
+ */
+static struct ldlm_lock *search_match_hint(struct ldlm_resource *res,
+					   struct lock_match_data *data)
+{
+	union ldlm_policy_data *lpol;
+	struct ldlm_lock *lock;
+
+	/* lmd_old needs the queue order */
+	if (data->lmd_old != NULL)
+		return NULL;
+
+	rcu_read_lock();
+	lock = rcu_dereference(res->lr_match_hint);
+	if (lock == NULL || !atomic_inc_not_zero(&lock->l_refc)) {
+		rcu_read_unlock();
+		return NULL;
+	}
+	rcu_read_unlock();
+
+	/* unlocked checks first, they are done again locked */
+	lpol = &lock->l_policy_data;
+	if (READ_ONCE(lock->l_resource) != res || ldlm_is_destroyed(lock) ||
+	    smp_load_acquire(&lock->l_granted_mode) != lock->l_req_mode ||
+	    !(lock->l_req_mode & *data->lmd_mode))
+		goto out;
+	if (res->lr_type == LDLM_EXTENT &&
+	    (lpol->l_extent.start > data->lmd_policy->l_extent.start ||
+	     lpol->l_extent.end < data->lmd_policy->l_extent.end))
+		goto out;
+
+	if (ns_is_client(ldlm_res_to_ns(res))) {
+		match_lock_nores(lock, res, data, true);
+		goto out;
+	}
+
+	lock_res(res);
+	if (lock->l_resource == res && !ldlm_is_destroyed(lock) &&
+	    lock->l_granted_mode == lock->l_req_mode)
+		lock_matches(lock, data);
+	unlock_res(res);
+out:
+	LDLM_LOCK_RELEASE(lock);
+	return data->lmd_lock;
+}
+
 void ldlm_lock_fail_match_locked(struct ldlm_lock *lock)
 {
 	if ((lock->l_flags & LDLM_FL_FAIL_NOTIFIED) == 0) {
 		lock->l_flags |= LDLM_FL_FAIL_NOTIFIED;
-		wake_up_all(&lock->l_waitq);
+		wake_up_all(ldlm_lock_waitq(lock));
 	}
 }
 EXPORT_SYMBOL(ldlm_lock_fail_match_locked);
@@ -1321,7 +1494,7 @@ void ldlm_lock_fail_match(struct ldlm_lock *lock)
 void ldlm_lock_allow_match_locked(struct ldlm_lock *lock)
 {
 	ldlm_set_lvb_ready(lock);
-	wake_up_all(&lock->l_waitq);
+	wake_up_all(ldlm_lock_waitq(lock));
 }
 EXPORT_SYMBOL(ldlm_lock_allow_match_locked);
 
@@ -1402,16 +1575,24 @@ enum ldlm_mode ldlm_lock_match(struct ldlm_namespace *ns, __u64 flags,
 		LASSERT(data.lmd_old == NULL);
 		RETURN(0);
 	}
+	data.lmd_pin = ns_is_client(ns) && !(flags & LDLM_FL_TEST_LOCK);
 
 	LDLM_RESOURCE_ADDREF(res);
+	lock = search_match_hint(res, &data);
+	if (lock != NULL)
+		GOTO(out_res, rc = 1);
+
 	lock_res(res);
 
 	if (res->lr_type == LDLM_EXTENT)
 		lock = search_itree(res, &data);
 	else
 		lock = search_queue(&res->lr_granted, &data);
-	if (lock != NULL)
+	if (lock != NULL) {
+		if (data.lmd_old == NULL)
+			rcu_assign_pointer(res->lr_match_hint, lock);
 		GOTO(out, rc = 1);
+	}
 	if (flags & LDLM_FL_BLOCK_GRANTED)
 		GOTO(out, rc = 0);
 	lock = search_queue(&res->lr_converting, &data);
@@ -1424,11 +1605,25 @@ enum ldlm_mode ldlm_lock_match(struct ldlm_namespace *ns, __u64 flags,
         EXIT;
  out:
         unlock_res(res);
+	if (lock != NULL && data.lmd_pin) {
+		struct ldlm_lock *found = lock;
+
+		/* as if it had been canceled before the search if it does
+		 * not match any more */
+		lock = match_lock_nores(found, res, &data, false);
+		LDLM_LOCK_RELEASE(found);
+		if (lock == NULL)
+			rc = 0;
+	}
+ out_res:
         LDLM_RESOURCE_DELREF(res);
         ldlm_resource_putref(res);
 
         if (lock) {
                 ldlm_lock2handle(lock, lockh);
+		if (ns_is_server(ns))
+			ldlm_reclaim_hit(lock->l_resource, lock->l_export,
+					 false);
                 if ((flags & LDLM_FL_LVB_READY) &&
 		    (!ldlm_is_lvb_ready(lock))) {
 			__u64 wait_flags = LDLM_FL_LVB_READY |
@@ -1453,7 +1648,7 @@ enum ldlm_mode ldlm_lock_match(struct ldlm_namespace *ns, __u64 flags,
                                                NULL, LWI_ON_SIGNAL_NOOP, NULL);
 
 			/* XXX FIXME see comment on CAN_MATCH in lustre_dlm.h */
-			l_wait_event(lock->l_waitq,
+			l_wait_event(*ldlm_lock_waitq(lock),
 				     lock->l_flags & wait_flags,
 				     &lwi);
 			if (!ldlm_is_lvb_ready(lock)) {
@@ -1670,7 +1865,6 @@ struct ldlm_lock *ldlm_lock_create(struct ldlm_namespace *ns,
 		lock->l_glimpse_ast = cbs->lcs_glimpse;
 	}
 
-	lock->l_tree_node = NULL;
 	/* if this is the extent lock, allocate the interval tree node */
 	if (type == LDLM_EXTENT)
 		if (ldlm_interval_alloc(lock) == NULL)
@@ -2001,6 +2195,104 @@ void ldlm_discard_bl_list(struct list_head *bl_list)
 
 #endif
 
+#ifdef HAVE_SERVER_SUPPORT
+/* how far down the ast_work list to look for locks to batch */
+#define LDLM_BL_AST_BATCH_SCAN	(LDLM_BL_AST_BATCH_MAX * 16)
+
+/**
+ * Move the locks from the ast_work list which can share one blocking AST RPC
+ * with \a first to \a locks: granted to the same client export with
+ * OBD_CONNECT2_BL_AST_BATCH, blocked by the same lock, with the same AST
+ * flags and not LDLM_FL_CANCEL_ON_BLOCK.
+ *
+ * \retval number of locks in \a locks, \a first included
+ */
+static int ldlm_bl_ast_batch_collect(struct ldlm_cb_set_arg *arg,
+				     struct ldlm_lock *first,
+				     struct ldlm_lock **locks)
+{
+	struct ldlm_lock *lock;
+	struct ldlm_lock *next;
+	__u64 ast_flags = first->l_flags & LDLM_FL_AST_MASK;
+	int scanned = 0;
+	int count = 1;
+
+	locks[0] = first;
+	list_for_each_entry_safe(lock, next, arg->list, l_bl_ast) {
+		if (count == LDLM_BL_AST_BATCH_MAX ||
+		    ++scanned > LDLM_BL_AST_BATCH_SCAN)
+			break;
+
+		if (lock->l_export != first->l_export ||
+		    lock->l_blocking_lock != first->l_blocking_lock ||
+		    lock->l_blocking_ast != first->l_blocking_ast)
+			continue;
+
+		lock_res_and_lock(lock);
+		if (ldlm_is_cancel_on_block(lock) ||
+		    (lock->l_flags & LDLM_FL_AST_MASK) != ast_flags) {
+			unlock_res_and_lock(lock);
+			continue;
+		}
+		list_del_init(&lock->l_bl_ast);
+
+		LASSERT(ldlm_is_ast_sent(lock));
+		LASSERT(lock->l_bl_ast_run == 0);
+		lock->l_bl_ast_run++;
+		unlock_res_and_lock(lock);
+
+		locks[count++] = lock;
+	}
+
+	return count;
+}
+
+/**
+ * Send one blocking AST for \a first and the locks of the ast_work list
+ * which can go along with it.
+ *
+ * \retval -EAGAIN if there is nothing to batch, the caller should send a
+ *		   plain blocking AST for \a first
+ */
+static int ldlm_work_bl_ast_batch(struct ldlm_cb_set_arg *arg,
+				  struct ldlm_lock *first,
+				  struct ldlm_lock_desc *desc)
+{
+	struct ldlm_lock **locks;
+	int count;
+	int rc;
+	int i;
+
+	if (first->l_export == NULL ||
+	    !exp_connect_bl_ast_batch(first->l_export) ||
+	    first->l_blocking_ast != ldlm_server_blocking_ast ||
+	    ldlm_is_cancel_on_block(first))
+		return -EAGAIN;
+
+	OBD_ALLOC(locks, LDLM_BL_AST_BATCH_MAX * sizeof(*locks));
+	if (locks == NULL)
+		return -EAGAIN;
+
+	count = ldlm_bl_ast_batch_collect(arg, first, locks);
+	if (count == 1) {
+		OBD_FREE(locks, LDLM_BL_AST_BATCH_MAX * sizeof(*locks));
+		return -EAGAIN;
+	}
+
+	rc = ldlm_server_blocking_ast_batch(locks, count, desc, arg);
+
+	/* first is released by the caller */
+	for (i = 1; i < count; i++) {
+		LDLM_LOCK_RELEASE(locks[i]->l_blocking_lock);
+		locks[i]->l_blocking_lock = NULL;
+		LDLM_LOCK_RELEASE(locks[i]);
+	}
+	OBD_FREE(locks, LDLM_BL_AST_BATCH_MAX * sizeof(*locks));
+
+	return rc;
+}
+#endif /* HAVE_SERVER_SUPPORT */
+
 /**
  * Process a call to blocking AST callback for a lock in ast_work list
  */
@@ -2030,7 +2322,12 @@ ldlm_work_bl_ast_lock(struct ptlrpc_request_set *rqset, void *opaq)
 
 	ldlm_lock2desc(lock->l_blocking_lock, &d);
 
-	rc = lock->l_blocking_ast(lock, &d, (void *)arg, LDLM_CB_BLOCKING);
+#ifdef HAVE_SERVER_SUPPORT
+	rc = ldlm_work_bl_ast_batch(arg, lock, &d);
+	if (rc == -EAGAIN)
+#endif
+		rc = lock->l_blocking_ast(lock, &d, (void *)arg,
+					  LDLM_CB_BLOCKING);
 	LDLM_LOCK_RELEASE(lock->l_blocking_lock);
 	lock->l_blocking_lock = NULL;
 	LDLM_LOCK_RELEASE(lock);
@@ -2336,14 +2633,14 @@ void ldlm_cancel_callback(struct ldlm_lock *lock)
 
 		/* only canceller can set bl_done bit */
 		ldlm_set_bl_done(lock);
-		wake_up_all(&lock->l_waitq);
+		wake_up_all(ldlm_lock_waitq(lock));
 	} else if (!ldlm_is_bl_done(lock)) {
 		struct l_wait_info lwi = { 0 };
 
 		/* The lock is guaranteed to have been canceled once
 		 * returning from this function. */
 		unlock_res_and_lock(lock);
-		l_wait_event(lock->l_waitq, is_bl_done(lock), &lwi);
+		l_wait_event(*ldlm_lock_waitq(lock), is_bl_done(lock), &lwi);
 		lock_res_and_lock(lock);
 	}
 }
@@ -64,11 +64,6 @@ struct kset *ldlm_svc_kset;
 
 static struct ldlm_state *ldlm_state;
 
-static inline cfs_time_t round_timeout(cfs_time_t timeout)
-{
-        return cfs_time_seconds((int)cfs_duration_sec(cfs_time_sub(timeout, 0)) + 1);
-}
-
 /* timeout for initial callback (AST) reply (bz10399) */
 static inline unsigned int ldlm_get_rq_timeout(void)
 {
@@ -116,25 +111,49 @@ struct ldlm_bl_work_item {
 
 #ifdef HAVE_SERVER_SUPPORT
 
-/**
- * Protects both waiting_locks_list and expired_lock_thread.
+/*
+ * Locks waiting for a callback reply from a client are queued on a
+ * hierarchical timer wheel, one per CPU partition, keyed by the second their
+ * callback timer expires.  Level 0 has one second slots, each next level has
+ * slots LDLM_WHEEL_SIZE times longer and is cascaded into the levels below
+ * when they wrap, so that adding, refreshing and removing a lock is O(1) and
+ * each timer run only looks at the locks expiring in the elapsed seconds.
+ * A lock is always queued on the same partition, picked from its handle.
  */
-static DEFINE_SPINLOCK(waiting_locks_spinlock); /* BH lock (timer) */
+#define LDLM_WHEEL_BITS		6
+#define LDLM_WHEEL_SIZE		(1 << LDLM_WHEEL_BITS)
+#define LDLM_WHEEL_MASK		(LDLM_WHEEL_SIZE - 1)
+#define LDLM_WHEEL_LEVELS	3
+/* ~73 hours, locks expiring later are queued at the end of the wheel and
+ * queued again when they get there */
+#define LDLM_WHEEL_SPAN		(1UL << (LDLM_WHEEL_BITS * LDLM_WHEEL_LEVELS))
+
+struct ldlm_waiting_locks {
+	/**
+	 * Protects this partition and l_pending_chain of its locks.
+	 * BH lock (timer).
+	 */
+	spinlock_t		wl_lock;
+	struct timer_list	wl_timer;
+	/** Last second the wheel was advanced to */
+	unsigned long		wl_time;
+	struct list_head	wl_wheel[LDLM_WHEEL_LEVELS][LDLM_WHEEL_SIZE];
+	/** Timed out locks, evicted by expired_lock_main() */
+	struct list_head	wl_expired;
+	/** Number of locks on the wheel and on wl_expired */
+	unsigned int		wl_count;
+	unsigned int		wl_count_max;
+	/** Number of locks ever added, refreshes excluded */
+	__u64			wl_added;
+	/** Statistics of the timer runs */
+	__u64			wl_timeouts;
+	__u64			wl_prolonged;
+	__u64			wl_runs;
+	__u64			wl_run_ns;
+	__u64			wl_run_ns_max;
+};
 
-/**
- * List for contended locks.
- *
- * As soon as a lock is contended, it gets placed on this list and
- * expected time to get a response is filled in the lock. A special
- * thread walks the list looking for locks that should be released and
- * schedules client evictions for those that have not been released in
- * time.
- *
- * All access to it should be under waiting_locks_spinlock.
- */
-static LIST_HEAD(waiting_locks_list);
-static void waiting_locks_callback(unsigned long unused);
-static DEFINE_TIMER(waiting_locks_timer, waiting_locks_callback, 0, 0);
+static struct ldlm_waiting_locks **ldlm_waiting_locks;
 
 enum elt_state {
 	ELT_STOPPED,
@@ -145,28 +164,113 @@ enum elt_state {
 static DECLARE_WAIT_QUEUE_HEAD(expired_lock_wait_queue);
 static enum elt_state expired_lock_thread_state = ELT_STOPPED;
 static int expired_lock_dump;
-static LIST_HEAD(expired_lock_list);
+
+static inline struct ldlm_waiting_locks *ldlm_lock2wl(struct ldlm_lock *lock)
+{
+	return ldlm_waiting_locks[(unsigned int)lock->l_handle.h_cookie %
+				  cfs_cpt_number(cfs_cpt_table)];
+}
+
+/* the second a timeout is rounded up to, to avoid floods of timer firings */
+static inline unsigned long ldlm_wheel_sec(cfs_time_t timeout)
+{
+	return cfs_duration_sec(timeout) + 1;
+}
 
 static inline int have_expired_locks(void)
 {
-	int need_to_run;
+	struct ldlm_waiting_locks *wl;
+	int need_to_run = 0;
+	int i;
 
 	ENTRY;
-	spin_lock_bh(&waiting_locks_spinlock);
-	need_to_run = !list_empty(&expired_lock_list);
-	spin_unlock_bh(&waiting_locks_spinlock);
+	cfs_percpt_for_each(wl, i, ldlm_waiting_locks) {
+		spin_lock_bh(&wl->wl_lock);
+		need_to_run = !list_empty(&wl->wl_expired);
+		spin_unlock_bh(&wl->wl_lock);
+		if (need_to_run)
+			break;
+	}
 
 	RETURN(need_to_run);
 }
 
+/**
+ * Time out the expired locks of one partition.
+ *
+ * \retval number of evicted exports
+ */
+static int expired_lock_process(struct ldlm_waiting_locks *wl)
+{
+	struct list_head *expired = &wl->wl_expired;
+	int do_dump = 0;
+
+	spin_lock_bh(&wl->wl_lock);
+	while (!list_empty(expired)) {
+		struct obd_export *export;
+		struct ldlm_lock *lock;
+
+		lock = list_entry(expired->next, struct ldlm_lock,
+				  l_pending_chain);
+		if ((void *)lock < LP_POISON + PAGE_SIZE &&
+		    (void *)lock >= LP_POISON) {
+			spin_unlock_bh(&wl->wl_lock);
+			CERROR("free lock on elt list %p\n", lock);
+			LBUG();
+		}
+		list_del_init(&lock->l_pending_chain);
+		wl->wl_count--;
+		if ((void *)lock->l_export <
+		     LP_POISON + PAGE_SIZE &&
+		    (void *)lock->l_export >= LP_POISON) {
+			CERROR("lock with free export on elt list %p\n",
+			       lock->l_export);
+			lock->l_export = NULL;
+			LDLM_ERROR(lock, "free export");
+			/* release extra ref grabbed by
+			 * ldlm_add_waiting_lock() or
+			 * ldlm_failed_ast() */
+			LDLM_LOCK_RELEASE(lock);
+			continue;
+		}
+
+		if (ldlm_is_destroyed(lock)) {
+			/* release the lock refcount where
+			 * waiting_locks_callback() founds */
+			LDLM_LOCK_RELEASE(lock);
+			continue;
+		}
+		export = class_export_lock_get(lock->l_export, lock);
+		spin_unlock_bh(&wl->wl_lock);
+
+		spin_lock_bh(&export->exp_bl_list_lock);
+		list_del_init(&lock->l_exp_list);
+		spin_unlock_bh(&export->exp_bl_list_lock);
+
+		do_dump++;
+		class_fail_export(export);
+		class_export_lock_put(export, lock);
+
+		/* release extra ref grabbed by ldlm_add_waiting_lock()
+		 * or ldlm_failed_ast() */
+		LDLM_LOCK_RELEASE(lock);
+
+		spin_lock_bh(&wl->wl_lock);
+	}
+	spin_unlock_bh(&wl->wl_lock);
+
+	return do_dump;
+}
+
 /**
  * Check expired lock list for expired locks and time them out.
  */
 static int expired_lock_main(void *arg)
 {
-	struct list_head *expired = &expired_lock_list;
+	struct ldlm_waiting_locks *wl;
 	struct l_wait_info lwi = { 0 };
 	int do_dump;
+	int i;
 
 	ENTRY;
 
@@ -179,70 +283,15 @@ static int expired_lock_main(void *arg)
 			     expired_lock_thread_state == ELT_TERMINATE,
 			     &lwi);
 
-		spin_lock_bh(&waiting_locks_spinlock);
 		if (expired_lock_dump) {
-			spin_unlock_bh(&waiting_locks_spinlock);
-
+			expired_lock_dump = 0;
 			/* from waiting_locks_callback, but not in timer */
 			libcfs_debug_dumplog();
-
-			spin_lock_bh(&waiting_locks_spinlock);
-			expired_lock_dump = 0;
 		}
 
 		do_dump = 0;
-
-		while (!list_empty(expired)) {
-			struct obd_export *export;
-			struct ldlm_lock *lock;
-
-			lock = list_entry(expired->next, struct ldlm_lock,
-					  l_pending_chain);
-			if ((void *)lock < LP_POISON + PAGE_SIZE &&
-			    (void *)lock >= LP_POISON) {
-				spin_unlock_bh(&waiting_locks_spinlock);
-				CERROR("free lock on elt list %p\n", lock);
-				LBUG();
-			}
-			list_del_init(&lock->l_pending_chain);
-			if ((void *)lock->l_export <
-			     LP_POISON + PAGE_SIZE &&
-			    (void *)lock->l_export >= LP_POISON) {
-				CERROR("lock with free export on elt list %p\n",
-				       lock->l_export);
-				lock->l_export = NULL;
-				LDLM_ERROR(lock, "free export");
-				/* release extra ref grabbed by
-				 * ldlm_add_waiting_lock() or
-				 * ldlm_failed_ast() */
-				LDLM_LOCK_RELEASE(lock);
-				continue;
-			}
-
-			if (ldlm_is_destroyed(lock)) {
-				/* release the lock refcount where
-				 * waiting_locks_callback() founds */
-				LDLM_LOCK_RELEASE(lock);
-				continue;
-			}
-			export = class_export_lock_get(lock->l_export, lock);
-			spin_unlock_bh(&waiting_locks_spinlock);
-
-			spin_lock_bh(&export->exp_bl_list_lock);
-			list_del_init(&lock->l_exp_list);
-			spin_unlock_bh(&export->exp_bl_list_lock);
-
-			do_dump++;
-			class_fail_export(export);
-			class_export_lock_put(export, lock);
-
-			/* release extra ref grabbed by ldlm_add_waiting_lock()
-			 * or ldlm_failed_ast() */
-			LDLM_LOCK_RELEASE(lock);
-
-			spin_lock_bh(&waiting_locks_spinlock);
-		}
-		spin_unlock_bh(&waiting_locks_spinlock);
+		cfs_percpt_for_each(wl, i, ldlm_waiting_locks)
+			do_dump += expired_lock_process(wl);
 
 		if (do_dump && obd_dump_on_eviction) {
 			CERROR("dump the log upon eviction\n");
@@ -259,7 +308,6 @@ static int expired_lock_main(void *arg)
 }
 
 static int ldlm_add_waiting_lock(struct ldlm_lock *lock);
-static int __ldlm_add_waiting_lock(struct ldlm_lock *lock, int seconds);
 
 /**
  * Check if there is a request in the export request list
@@ -287,79 +335,181 @@ static int ldlm_lock_busy(struct ldlm_lock *lock)
 	RETURN(match);
 }
 
-/* This is called from within a timer interrupt and cannot schedule */
-static void waiting_locks_callback(unsigned long unused)
-{
-	struct ldlm_lock	*lock;
-	int			need_dump = 0;
-
-	spin_lock_bh(&waiting_locks_spinlock);
-	while (!list_empty(&waiting_locks_list)) {
-		lock = list_entry(waiting_locks_list.next, struct ldlm_lock,
-                                      l_pending_chain);
-                if (cfs_time_after(lock->l_callback_timeout,
-                                   cfs_time_current()) ||
-                    (lock->l_req_mode == LCK_GROUP))
-                        break;
+/**
+ * Queue \a lock on the wheel slot of its l_callback_timeout, but not before
+ * the second \a base.
+ */
+static void ldlm_wheel_queue(struct ldlm_waiting_locks *wl,
+			     struct ldlm_lock *lock, unsigned long base)
+{
+	unsigned long expires = ldlm_wheel_sec(lock->l_callback_timeout);
+	unsigned long delta;
+	int shift = 0;
+	int level = 0;
+
+	if ((long)(expires - base) < 0)
+		expires = base;
+	delta = expires - wl->wl_time;
+	if (delta >= LDLM_WHEEL_SPAN) {
+		expires = wl->wl_time + LDLM_WHEEL_SPAN - 1;
+		delta = LDLM_WHEEL_SPAN - 1;
+	}
 
-                /* Check if we need to prolong timeout */
-                if (!OBD_FAIL_CHECK(OBD_FAIL_PTLRPC_HPREQ_TIMEOUT) &&
-                    ldlm_lock_busy(lock)) {
-                        int cont = 1;
+	while (delta >> (shift + LDLM_WHEEL_BITS)) {
+		shift += LDLM_WHEEL_BITS;
+		level++;
+	}
+	list_add_tail(&lock->l_pending_chain,
+		      &wl->wl_wheel[level][(expires >> shift) & LDLM_WHEEL_MASK]);
+}
 
-                        if (lock->l_pending_chain.next == &waiting_locks_list)
-                                cont = 0;
+/**
+ * Move the locks of the higher level slots ending at the second the wheel
+ * has just been advanced to into the levels below.
+ */
+static void ldlm_wheel_cascade(struct ldlm_waiting_locks *wl)
+{
+	struct ldlm_lock *lock;
+	struct ldlm_lock *next;
+	LIST_HEAD(cascade);
+	int shift;
+	int level;
+
+	for (level = 1; level < LDLM_WHEEL_LEVELS; level++) {
+		shift = LDLM_WHEEL_BITS * level;
+		if (wl->wl_time & ((1UL << shift) - 1))
+			break;
+		list_splice_init(&wl->wl_wheel[level][(wl->wl_time >> shift) &
+						      LDLM_WHEEL_MASK],
+				 &cascade);
+	}
 
-                        LDLM_LOCK_GET(lock);
+	list_for_each_entry_safe(lock, next, &cascade, l_pending_chain) {
+		list_del_init(&lock->l_pending_chain);
+		ldlm_wheel_queue(wl, lock, wl->wl_time);
+	}
+}
 
-			spin_unlock_bh(&waiting_locks_spinlock);
-			LDLM_DEBUG(lock, "prolong the busy lock");
-			ldlm_refresh_waiting_lock(lock,
-						  ldlm_bl_timeout(lock) >> 1);
-			spin_lock_bh(&waiting_locks_spinlock);
+/**
+ * Return the next second the wheel has to be advanced to: the first non
+ * empty level 0 slot, or the next cascade if it comes first.
+ */
+static unsigned long ldlm_wheel_next(struct ldlm_waiting_locks *wl)
+{
+	unsigned long next = (wl->wl_time | LDLM_WHEEL_MASK) + 1;
+	unsigned long time;
 
-                        if (!cont) {
-                                LDLM_LOCK_RELEASE(lock);
-                                break;
-                        }
+	for (time = wl->wl_time + 1; time != next; time++)
+		if (!list_empty(&wl->wl_wheel[0][time & LDLM_WHEEL_MASK]))
+			break;
 
-                        LDLM_LOCK_RELEASE(lock);
-                        continue;
-                }
-                ldlm_lock_to_ns(lock)->ns_timeouts++;
-		LDLM_ERROR(lock, "lock callback timer expired after %llds: "
-                           "evicting client at %s ",
-			   ktime_get_real_seconds() - lock->l_last_activity,
-                           libcfs_nid2str(
-                                   lock->l_export->exp_connection->c_peer.nid));
-
-                /* no needs to take an extra ref on the lock since it was in
-                 * the waiting_locks_list and ldlm_add_waiting_lock()
-                 * already grabbed a ref */
-		list_del(&lock->l_pending_chain);
-		list_add(&lock->l_pending_chain, &expired_lock_list);
-		need_dump = 1;
-	}
-
-	if (!list_empty(&expired_lock_list)) {
+	return time;
+}
+
+/**
+ * Set the callback timer of \a lock to expire in \a seconds, unless it
+ * already expires later, and queue it on the wheel.
+ */
+static void ldlm_wheel_add(struct ldlm_waiting_locks *wl,
+			   struct ldlm_lock *lock, int seconds)
+{
+	cfs_time_t timeout = cfs_time_shift(seconds);
+	cfs_time_t expires;
+
+	if (likely(cfs_time_after(timeout, lock->l_callback_timeout)))
+		lock->l_callback_timeout = timeout;
+
+	ldlm_wheel_queue(wl, lock, wl->wl_time + 1);
+
+	expires = cfs_time_seconds(ldlm_wheel_sec(lock->l_callback_timeout));
+	if (cfs_time_before(expires, wl->wl_timer.expires) ||
+	    !timer_pending(&wl->wl_timer))
+		mod_timer(&wl->wl_timer, expires);
+}
+
+/* This is called from within a timer interrupt and cannot schedule */
+static void waiting_locks_callback(unsigned long data)
+{
+	struct ldlm_waiting_locks *wl = (struct ldlm_waiting_locks *)data;
+	unsigned long now = cfs_duration_sec(cfs_time_current());
+	struct ldlm_lock *lock;
+	LIST_HEAD(due);
+	int need_dump = 0;
+	ktime_t start;
+	__u64 run_ns;
+
+	start = ktime_get();
+	spin_lock_bh(&wl->wl_lock);
+	while ((long)(now - wl->wl_time) > 0) {
+		wl->wl_time++;
+		ldlm_wheel_cascade(wl);
+		list_splice_init(&wl->wl_wheel[0][wl->wl_time &
+						  LDLM_WHEEL_MASK], &due);
+
+		while (!list_empty(&due)) {
+			lock = list_entry(due.next, struct ldlm_lock,
+					  l_pending_chain);
+			list_del_init(&lock->l_pending_chain);
+
+			/* queued at the end of the wheel */
+			if (cfs_time_after(lock->l_callback_timeout,
+					   cfs_time_current())) {
+				ldlm_wheel_queue(wl, lock, wl->wl_time + 1);
+				continue;
+			}
+
+			/* group locks are never timed out, check them again
+			 * after one more callback timeout */
+			if (lock->l_req_mode == LCK_GROUP) {
+				ldlm_wheel_add(wl, lock, ldlm_bl_timeout(lock));
+				continue;
+			}
+
+			/* Check if we need to prolong timeout */
+			if (!OBD_FAIL_CHECK(OBD_FAIL_PTLRPC_HPREQ_TIMEOUT) &&
+			    ldlm_lock_busy(lock)) {
+				LDLM_DEBUG(lock, "prolong the busy lock");
+				ldlm_wheel_add(wl, lock,
+					       ldlm_bl_timeout(lock) >> 1);
+				wl->wl_prolonged++;
+				continue;
+			}
+
+			ldlm_lock_to_ns(lock)->ns_timeouts++;
+			LDLM_ERROR(lock, "lock callback timer expired after "
+				   "%llds: evicting client at %s ",
+				   ktime_get_real_seconds() -
+				   lock->l_last_activity,
+				   libcfs_nid2str(
+				   lock->l_export->exp_connection->c_peer.nid));
+
+			/* no needs to take an extra ref on the lock since it
+			 * was on the wheel and ldlm_add_waiting_lock()
+			 * already grabbed a ref */
+			list_add(&lock->l_pending_chain, &wl->wl_expired);
+			wl->wl_timeouts++;
+			need_dump = 1;
+		}
+	}
+
+	if (!list_empty(&wl->wl_expired)) {
 		if (obd_dump_on_timeout && need_dump)
 			expired_lock_dump = __LINE__;
 
 		wake_up(&expired_lock_wait_queue);
 	}
 
-        /*
-         * Make sure the timer will fire again if we have any locks
-         * left.
-         */
-	if (!list_empty(&waiting_locks_list)) {
-                cfs_time_t timeout_rounded;
-		lock = list_entry(waiting_locks_list.next, struct ldlm_lock,
-                                      l_pending_chain);
-                timeout_rounded = (cfs_time_t)round_timeout(lock->l_callback_timeout);
-		mod_timer(&waiting_locks_timer, timeout_rounded);
-        }
-	spin_unlock_bh(&waiting_locks_spinlock);
+	/* Make sure the timer will fire again if we have any locks left. */
+	if (wl->wl_count > 0)
+		mod_timer(&wl->wl_timer,
+			  cfs_time_seconds(ldlm_wheel_next(wl)));
+
+	run_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	wl->wl_runs++;
+	wl->wl_run_ns += run_ns;
+	if (run_ns > wl->wl_run_ns_max)
+		wl->wl_run_ns_max = run_ns;
+	spin_unlock_bh(&wl->wl_lock);
 }
 
 /**
@@ -372,35 +522,37 @@ static void waiting_locks_callback(unsigned long unused)
  * As done by ldlm_add_waiting_lock(), the caller must grab a lock reference
  * if it has been added to the waiting list (1 is returned).
  *
- * Called with the namespace lock held.
+ * Called with the partition lock held.
+ */
+/**
+ * Accounts one more lock on the wheel or the expired list of \a wl.
+ *
+ * Called with the partition lock held.
  */
-static int __ldlm_add_waiting_lock(struct ldlm_lock *lock, int seconds)
+static void ldlm_wl_count_inc(struct ldlm_waiting_locks *wl)
 {
-        cfs_time_t timeout;
-        cfs_time_t timeout_rounded;
+	/* the wheel may have been idle for long, nothing is queued relative
+	 * to its time if it is empty */
+	if (wl->wl_count == 0)
+		wl->wl_time = cfs_duration_sec(cfs_time_current());
+	wl->wl_count++;
+	if (wl->wl_count > wl->wl_count_max)
+		wl->wl_count_max = wl->wl_count;
+}
 
+static int __ldlm_add_waiting_lock(struct ldlm_waiting_locks *wl,
+				   struct ldlm_lock *lock, int seconds)
+{
 	if (!list_empty(&lock->l_pending_chain))
-                return 0;
-
-        if (OBD_FAIL_CHECK(OBD_FAIL_PTLRPC_HPREQ_NOTIMEOUT) ||
-            OBD_FAIL_CHECK(OBD_FAIL_PTLRPC_HPREQ_TIMEOUT))
-                seconds = 1;
-
-        timeout = cfs_time_shift(seconds);
-        if (likely(cfs_time_after(timeout, lock->l_callback_timeout)))
-                lock->l_callback_timeout = timeout;
+		return 0;
 
-        timeout_rounded = round_timeout(lock->l_callback_timeout);
+	if (OBD_FAIL_CHECK(OBD_FAIL_PTLRPC_HPREQ_NOTIMEOUT) ||
+	    OBD_FAIL_CHECK(OBD_FAIL_PTLRPC_HPREQ_TIMEOUT))
+		seconds = 1;
 
-	if (cfs_time_before(timeout_rounded, waiting_locks_timer.expires) ||
-	    !timer_pending(&waiting_locks_timer)) {
-		mod_timer(&waiting_locks_timer, timeout_rounded);
-        }
-        /* if the new lock has a shorter timeout than something earlier on
-           the list, we'll wait the longer amount of time; no big deal. */
-        /* FIFO */
-	list_add_tail(&lock->l_pending_chain, &waiting_locks_list);
-        return 1;
+	ldlm_wl_count_inc(wl);
+	ldlm_wheel_add(wl, lock, seconds);
+	return 1;
 }
 
 static void ldlm_add_blocked_lock(struct ldlm_lock *lock)
@@ -427,6 +579,7 @@ static void ldlm_add_blocked_lock(struct ldlm_lock *lock)
 
 static int ldlm_add_waiting_lock(struct ldlm_lock *lock)
 {
+	struct ldlm_waiting_locks *wl = ldlm_lock2wl(lock);
 	int ret;
 	int timeout = ldlm_bl_timeout(lock);
 
@@ -440,16 +593,16 @@ static int ldlm_add_waiting_lock(struct ldlm_lock *lock)
 	    (exp_connect_flags(lock->l_export) & OBD_CONNECT_MDS_MDS))
 		return 0;
 
-	spin_lock_bh(&waiting_locks_spinlock);
+	spin_lock_bh(&wl->wl_lock);
 	if (ldlm_is_cancel(lock)) {
-		spin_unlock_bh(&waiting_locks_spinlock);
+		spin_unlock_bh(&wl->wl_lock);
 		return 0;
 	}
 
 	if (ldlm_is_destroyed(lock)) {
 		static cfs_time_t next;
 
-		spin_unlock_bh(&waiting_locks_spinlock);
+		spin_unlock_bh(&wl->wl_lock);
 		LDLM_ERROR(lock, "not waiting on destroyed lock (bug 5653)");
 		if (cfs_time_after(cfs_time_current(), next)) {
 			next = cfs_time_shift(14400);
@@ -460,13 +613,15 @@ static int ldlm_add_waiting_lock(struct ldlm_lock *lock)
 
 	ldlm_set_waited(lock);
 	lock->l_last_activity = ktime_get_real_seconds();
-	ret = __ldlm_add_waiting_lock(lock, timeout);
+	ret = __ldlm_add_waiting_lock(wl, lock, timeout);
 	if (ret) {
 		/* grab ref on the lock if it has been added to the
 		 * waiting list */
 		LDLM_LOCK_GET(lock);
+		/* refreshes are not counted */
+		wl->wl_added++;
 	}
-	spin_unlock_bh(&waiting_locks_spinlock);
+	spin_unlock_bh(&wl->wl_lock);
 
 	if (ret)
 		ldlm_add_blocked_lock(lock);
@@ -479,53 +634,44 @@ static int ldlm_add_waiting_lock(struct ldlm_lock *lock)
 
 /**
  * Remove a lock from the pending list, likely because it had its cancellation
- * callback arrive without incident.  This adjusts the lock-timeout timer if
- * needed.  Returns 0 if the lock wasn't pending after all, 1 if it was.
+ * callback arrive without incident.  The lock-timeout timer is left alone, it
+ * is stopped once no lock is left.  Returns 0 if the lock wasn't pending after
+ * all, 1 if it was.
  * As done by ldlm_del_waiting_lock(), the caller must release the lock
  * reference when the lock is removed from any list (1 is returned).
  *
- * Called with namespace lock held.
+ * Called with the partition lock held.
  */
-static int __ldlm_del_waiting_lock(struct ldlm_lock *lock)
+static int __ldlm_del_waiting_lock(struct ldlm_waiting_locks *wl,
+				   struct ldlm_lock *lock)
 {
-	struct list_head *list_next;
-
 	if (list_empty(&lock->l_pending_chain))
-                return 0;
+		return 0;
 
-        list_next = lock->l_pending_chain.next;
-        if (lock->l_pending_chain.prev == &waiting_locks_list) {
-                /* Removing the head of the list, adjust timer. */
-                if (list_next == &waiting_locks_list) {
-                        /* No more, just cancel. */
-			del_timer(&waiting_locks_timer);
-                } else {
-                        struct ldlm_lock *next;
-			next = list_entry(list_next, struct ldlm_lock,
-                                              l_pending_chain);
-			mod_timer(&waiting_locks_timer,
-				  round_timeout(next->l_callback_timeout));
-                }
-        }
 	list_del_init(&lock->l_pending_chain);
+	wl->wl_count--;
+	if (wl->wl_count == 0)
+		del_timer(&wl->wl_timer);
 
-        return 1;
+	return 1;
 }
 
 int ldlm_del_waiting_lock(struct ldlm_lock *lock)
 {
-        int ret;
+	struct ldlm_waiting_locks *wl;
+	int ret;
 
-        if (lock->l_export == NULL) {
-                /* We don't have a "waiting locks list" on clients. */
-                CDEBUG(D_DLMTRACE, "Client lock %p : no-op\n", lock);
-                return 0;
-        }
+	if (lock->l_export == NULL) {
+		/* We don't have a "waiting locks list" on clients. */
+		CDEBUG(D_DLMTRACE, "Client lock %p : no-op\n", lock);
+		return 0;
+	}
 
-	spin_lock_bh(&waiting_locks_spinlock);
-	ret = __ldlm_del_waiting_lock(lock);
+	wl = ldlm_lock2wl(lock);
+	spin_lock_bh(&wl->wl_lock);
+	ret = __ldlm_del_waiting_lock(wl, lock);
 	ldlm_clear_waited(lock);
-	spin_unlock_bh(&waiting_locks_spinlock);
+	spin_unlock_bh(&wl->wl_lock);
 
 	/* remove the lock out of export blocking list */
 	spin_lock_bh(&lock->l_export->exp_bl_list_lock);
@@ -549,6 +695,8 @@ int ldlm_del_waiting_lock(struct ldlm_lock *lock)
  */
 int ldlm_refresh_waiting_lock(struct ldlm_lock *lock, int timeout)
 {
+	struct ldlm_waiting_locks *wl;
+
 	if (lock->l_export == NULL) {
 		/* We don't have a "waiting locks list" on clients. */
 		LDLM_DEBUG(lock, "client lock: no-op");
@@ -561,25 +709,108 @@ int ldlm_refresh_waiting_lock(struct ldlm_lock *lock, int timeout)
 		return 0;
 	}
 
-	spin_lock_bh(&waiting_locks_spinlock);
+	wl = ldlm_lock2wl(lock);
+	spin_lock_bh(&wl->wl_lock);
 
 	if (list_empty(&lock->l_pending_chain)) {
-		spin_unlock_bh(&waiting_locks_spinlock);
+		spin_unlock_bh(&wl->wl_lock);
 		LDLM_DEBUG(lock, "wasn't waiting");
 		return 0;
 	}
 
 	/* we remove/add the lock to the waiting list, so no needs to
 	 * release/take a lock reference */
-	__ldlm_del_waiting_lock(lock);
-	__ldlm_add_waiting_lock(lock, timeout);
-	spin_unlock_bh(&waiting_locks_spinlock);
+	__ldlm_del_waiting_lock(wl, lock);
+	__ldlm_add_waiting_lock(wl, lock, timeout);
+	spin_unlock_bh(&wl->wl_lock);
 
 	LDLM_DEBUG(lock, "refreshed");
 	return 1;
 }
 EXPORT_SYMBOL(ldlm_refresh_waiting_lock);
 
+static int ldlm_waiting_locks_init(void)
+{
+	struct ldlm_waiting_locks *wl;
+	int level;
+	int i;
+	int j;
+
+	ldlm_waiting_locks = cfs_percpt_alloc(cfs_cpt_table, sizeof(*wl));
+	if (ldlm_waiting_locks == NULL)
+		return -ENOMEM;
+
+	cfs_percpt_for_each(wl, i, ldlm_waiting_locks) {
+		spin_lock_init(&wl->wl_lock);
+		setup_timer(&wl->wl_timer, waiting_locks_callback,
+			    (unsigned long)wl);
+		wl->wl_time = cfs_duration_sec(cfs_time_current());
+		for (level = 0; level < LDLM_WHEEL_LEVELS; level++)
+			for (j = 0; j < LDLM_WHEEL_SIZE; j++)
+				INIT_LIST_HEAD(&wl->wl_wheel[level][j]);
+		INIT_LIST_HEAD(&wl->wl_expired);
+	}
+
+	return 0;
+}
+
+static void ldlm_waiting_locks_fini(void)
+{
+	struct ldlm_waiting_locks *wl;
+	int i;
+
+	if (ldlm_waiting_locks == NULL)
+		return;
+
+	cfs_percpt_for_each(wl, i, ldlm_waiting_locks)
+		del_timer_sync(&wl->wl_timer);
+
+	cfs_percpt_free(ldlm_waiting_locks);
+	ldlm_waiting_locks = NULL;
+}
+
+int ldlm_waiting_locks_stats_seq_show(struct seq_file *m, void *v)
+{
+	struct ldlm_waiting_locks *wl;
+	int i;
+
+	seq_printf(m, "%-4s %10s %10s %12s %12s %12s %12s %8s %8s\n", "cpt",
+		   "waiting", "max_wait", "added", "timeouts", "prolonged",
+		   "runs", "avg_us", "max_us");
+	if (ldlm_waiting_locks == NULL)
+		return 0;
+
+	cfs_percpt_for_each(wl, i, ldlm_waiting_locks) {
+		unsigned int count;
+		unsigned int count_max;
+		__u64 added;
+		__u64 timeouts;
+		__u64 prolonged;
+		__u64 runs;
+		__u64 run_ns;
+		__u64 run_ns_max;
+
+		spin_lock_bh(&wl->wl_lock);
+		count = wl->wl_count;
+		count_max = wl->wl_count_max;
+		added = wl->wl_added;
+		timeouts = wl->wl_timeouts;
+		prolonged = wl->wl_prolonged;
+		runs = wl->wl_runs;
+		run_ns = wl->wl_run_ns;
+		run_ns_max = wl->wl_run_ns_max;
+		spin_unlock_bh(&wl->wl_lock);
+
+		seq_printf(m, "%-4d %10u %10u %12llu %12llu %12llu %12llu "
+			   "%8llu %8llu\n", i, count, count_max, added,
+			   timeouts, prolonged, runs, runs == 0 ? 0 :
+			   div64_u64(run_ns, runs * NSEC_PER_USEC),
+			   div_u64(run_ns_max, NSEC_PER_USEC));
+	}
+
+	return 0;
+}
+
 #else /* HAVE_SERVER_SUPPORT */
 
 int ldlm_del_waiting_lock(struct ldlm_lock *lock)
@@ -627,6 +858,8 @@ EXPORT_SYMBOL(ldlm_bl_timeout);
 static void ldlm_failed_ast(struct ldlm_lock *lock, int rc,
                             const char *ast_type)
 {
+	struct ldlm_waiting_locks *wl;
+
         LCONSOLE_ERROR_MSG(0x138, "%s: A client on nid %s was evicted due "
                            "to a lock %s callback time out: rc %d\n",
                            lock->l_export->exp_obd->obd_name,
@@ -634,14 +867,16 @@ static void ldlm_failed_ast(struct ldlm_lock *lock, int rc,
 
         if (obd_dump_on_timeout)
                 libcfs_debug_dumplog();
-	spin_lock_bh(&waiting_locks_spinlock);
-	if (__ldlm_del_waiting_lock(lock) == 0)
+	wl = ldlm_lock2wl(lock);
+	spin_lock_bh(&wl->wl_lock);
+	if (__ldlm_del_waiting_lock(wl, lock) == 0)
 		/* the lock was not in any list, grab an extra ref before adding
 		 * the lock to the expired list */
 		LDLM_LOCK_GET(lock);
-	list_add(&lock->l_pending_chain, &expired_lock_list);
+	list_add(&lock->l_pending_chain, &wl->wl_expired);
+	ldlm_wl_count_inc(wl);
 	wake_up(&expired_lock_wait_queue);
-	spin_unlock_bh(&waiting_locks_spinlock);
+	spin_unlock_bh(&wl->wl_lock);
 }
 
 /**
@@ -723,6 +958,63 @@ static int ldlm_handle_ast_error(struct ldlm_lock *lock,
 	return rc;
 }
 
+/**
+ * Handle the reply to a batched blocking AST, see
+ * ldlm_server_blocking_ast_batch().
+ *
+ * The client lists the handles it does not know anymore, those locks are
+ * cancelled like on -EINVAL from a single lock blocking AST.
+ */
+static int ldlm_cb_batch_interpret(struct ptlrpc_request *req,
+				   struct ldlm_cb_async_args *ca, int rc)
+{
+	struct ldlm_request *rep;
+	int restart = 0;
+	int i;
+	int j;
+
+	if (rc == -EINVAL) {
+		for (i = 0; i < ca->ca_nr_locks; i++)
+			if (ldlm_handle_ast_error(ca->ca_locks[i], req, rc,
+						  "blocking") == -ERESTART)
+				restart = 1;
+		return restart ? -ERESTART : 0;
+	}
+
+	/* any other error fails the whole export, the first lock is
+	 * enough to report it */
+	if (rc != 0)
+		return ldlm_handle_ast_error(ca->ca_lock, req, rc, "blocking");
+
+	if (!req_capsule_field_present(&req->rq_pill, &RMF_DLM_REQ,
+				       RCL_SERVER))
+		return 0;
+
+	rep = req_capsule_server_get(&req->rq_pill, &RMF_DLM_REQ);
+	if (rep == NULL || rep->lock_count > ca->ca_nr_locks ||
+	    req_capsule_get_size(&req->rq_pill, &RMF_DLM_REQ, RCL_SERVER) <
+	    ldlm_request_bufsize(rep->lock_count, LDLM_BL_CALLBACK)) {
+		DEBUG_REQ(D_ERROR, req, "bad batched blocking AST reply");
+		return ldlm_handle_ast_error(ca->ca_lock, req, -EPROTO,
+					     "blocking");
+	}
+
+	for (i = 0; i < rep->lock_count; i++) {
+		for (j = 0; j < ca->ca_nr_locks; j++) {
+			if (ca->ca_locks[j]->l_remote_handle.cookie !=
+			    rep->lock_handle[i].cookie)
+				continue;
+			if (ldlm_handle_ast_error(ca->ca_locks[j], req,
+						  -EINVAL, "blocking") ==
+			    -ERESTART)
+				restart = 1;
+			break;
+		}
+	}
+
+	return restart ? -ERESTART : 0;
+}
+
 static int ldlm_cb_interpret(const struct lu_env *env,
                              struct ptlrpc_request *req, void *data, int rc)
 {
@@ -756,7 +1048,9 @@ static int ldlm_cb_interpret(const struct lu_env *env,
 		}
 		break;
 	case LDLM_BL_CALLBACK:
-		if (rc != 0)
+		if (ca->ca_nr_locks > 0)
+			rc = ldlm_cb_batch_interpret(req, ca, rc);
+		else if (rc != 0)
 			rc = ldlm_handle_ast_error(lock, req, rc, "blocking");
 		break;
 	case LDLM_CP_CALLBACK:
@@ -769,8 +1063,18 @@ static int ldlm_cb_interpret(const struct lu_env *env,
 		LBUG();
 	}
 
-	/* release extra reference taken in ldlm_ast_fini() */
-        LDLM_LOCK_RELEASE(lock);
+	/* release extra reference taken in ldlm_ast_fini() or
+	 * ldlm_server_blocking_ast_batch() */
+	if (ca->ca_nr_locks > 0) {
+		int i;
+
+		for (i = 0; i < ca->ca_nr_locks; i++)
+			LDLM_LOCK_RELEASE(ca->ca_locks[i]);
+		OBD_FREE(ca->ca_locks,
+			 LDLM_BL_AST_BATCH_MAX * sizeof(*ca->ca_locks));
+	} else {
+		LDLM_LOCK_RELEASE(lock);
+	}
 
 	if (rc == -ERESTART)
 		atomic_inc(&arg->restart);
@@ -782,6 +1086,11 @@ static void ldlm_update_resend(struct ptlrpc_request *req, void *data)
 {
 	struct ldlm_cb_async_args *ca   = data;
 	struct ldlm_lock          *lock = ca->ca_lock;
+	int			   i;
+
+	for (i = 1; i < ca->ca_nr_locks; i++)
+		ldlm_refresh_waiting_lock(ca->ca_locks[i],
+					  ldlm_bl_timeout(ca->ca_locks[i]));
 
 	ldlm_refresh_waiting_lock(lock, ldlm_bl_timeout(lock));
 }
@@ -951,6 +1260,146 @@ int ldlm_server_blocking_ast(struct ldlm_lock *lock,
         RETURN(rc);
 }
 
+/**
+ * Send a single blocking AST RPC for several locks granted to the same client
+ * which conflict with the same lock, to a client which has negotiated
+ * OBD_CONNECT2_BL_AST_BATCH. See ldlm_work_bl_ast_lock().
+ *
+ * Every lock is handled as by ldlm_server_blocking_ast(), except that locks
+ * with LDLM_FL_CANCEL_ON_BLOCK are never passed here. The reply lists the
+ * handles unknown to the client, see ldlm_cb_batch_interpret().
+ *
+ * \param[in] locks	locks to send the blocking AST for
+ * \param[in] count	number of locks, no more than LDLM_BL_AST_BATCH_MAX
+ * \param[in] desc	description of the conflicting lock
+ * \param[in] arg	ldlm_cb_set_arg of ldlm_run_ast_work()
+ */
+int ldlm_server_blocking_ast_batch(struct ldlm_lock **locks, int count,
+				   struct ldlm_lock_desc *desc,
+				   struct ldlm_cb_set_arg *arg)
+{
+	struct obd_export *exp = locks[0]->l_export;
+	struct ldlm_cb_async_args *ca;
+	struct ldlm_request *body;
+	struct ptlrpc_request *req;
+	struct ldlm_lock **batch;
+	struct ldlm_lock *lock;
+	int nr = 0;
+	int rc;
+	int i;
+	ENTRY;
+
+	LASSERT(count > 0 && count <= LDLM_BL_AST_BATCH_MAX);
+
+	if (OBD_FAIL_PRECHECK(OBD_FAIL_LDLM_SRV_BL_AST)) {
+		LDLM_DEBUG(locks[0], "dropping BL AST");
+		RETURN(0);
+	}
+
+	if (exp->exp_obd->obd_recovering != 0)
+		LDLM_ERROR(locks[0], "BUG 6063: lock collide during recovery");
+
+	OBD_ALLOC(batch, LDLM_BL_AST_BATCH_MAX * sizeof(*batch));
+	if (batch == NULL)
+		RETURN(-ENOMEM);
+
+	req = ptlrpc_request_alloc(exp->exp_imp_reverse,
+				   &RQF_LDLM_BL_CALLBACK_BATCH);
+	if (req == NULL)
+		GOTO(out_free, rc = -ENOMEM);
+
+	req_capsule_set_size(&req->rq_pill, &RMF_DLM_REQ, RCL_CLIENT,
+			     ldlm_request_bufsize(count, LDLM_BL_CALLBACK));
+	req_capsule_set_size(&req->rq_pill, &RMF_DLM_REQ, RCL_SERVER,
+			     ldlm_request_bufsize(count, LDLM_BL_CALLBACK));
+	rc = ptlrpc_request_pack(req, LUSTRE_DLM_VERSION, LDLM_BL_CALLBACK);
+	if (rc) {
+		ptlrpc_request_free(req);
+		GOTO(out_free, rc);
+	}
+
+	body = req_capsule_client_get(&req->rq_pill, &RMF_DLM_REQ);
+	body->lock_desc = *desc;
+
+	for (i = 0; i < count; i++) {
+		lock = locks[i];
+		ldlm_lock_reorder_req(lock);
+
+		lock_res_and_lock(lock);
+		if (ldlm_is_destroyed(lock)) {
+			unlock_res_and_lock(lock);
+			continue;
+		}
+
+		if (lock->l_granted_mode != lock->l_req_mode) {
+			/* this blocking AST will be communicated as part of
+			 * the completion AST instead */
+			ldlm_add_blocked_lock(lock);
+			ldlm_set_waited(lock);
+			unlock_res_and_lock(lock);
+			LDLM_DEBUG(lock, "lock not granted, not sending "
+				   "blocking AST");
+			continue;
+		}
+
+		/* the caller only batches locks with the same AST flags */
+		if (nr == 0)
+			body->lock_flags |= ldlm_flags_to_wire(lock->l_flags &
+							LDLM_FL_AST_MASK);
+		body->lock_handle[nr] = lock->l_remote_handle;
+
+		LDLM_DEBUG(lock, "server preparing batched blocking AST");
+
+		ldlm_set_cbpending(lock);
+		ldlm_add_waiting_lock(lock);
+		unlock_res_and_lock(lock);
+
+		lock->l_last_activity = ktime_get_real_seconds();
+		if (exp->exp_nid_stats && exp->exp_nid_stats->nid_ldlm_stats)
+			lprocfs_counter_incr(exp->exp_nid_stats->nid_ldlm_stats,
+					     LDLM_BL_CALLBACK - LDLM_FIRST_OPC);
+
+		LDLM_LOCK_GET(lock);
+		batch[nr++] = lock;
+	}
+
+	if (nr == 0) {
+		ptlrpc_req_finished(req);
+		GOTO(out_free, rc = 0);
+	}
+
+	body->lock_count = nr;
+	if (nr < count)
+		req_capsule_shrink(&req->rq_pill, &RMF_DLM_REQ,
+				   ldlm_request_bufsize(nr, LDLM_BL_CALLBACK),
+				   RCL_CLIENT);
+	ptlrpc_request_set_replen(req);
+
+	CLASSERT(sizeof(*ca) <= sizeof(req->rq_async_args));
+	ca = ptlrpc_req_async_args(req);
+	ca->ca_set_arg = arg;
+	ca->ca_lock = batch[0];
+	ca->ca_locks = batch;
+	ca->ca_nr_locks = nr;
+
+	req->rq_interpret_reply = ldlm_cb_interpret;
+	/* Do not resend after lock callback timeout */
+	req->rq_delay_limit = ldlm_bl_timeout(batch[0]);
+	req->rq_resend_cb = ldlm_update_resend;
+	req->rq_send_state = LUSTRE_IMP_FULL;
+	/* ptlrpc_request_pack already set timeout */
+	if (AT_OFF)
+		req->rq_timeout = ldlm_get_rq_timeout();
+
+	ptlrpc_set_add_req(arg->set, req);
+
+	RETURN(0);
+
+out_free:
+	OBD_FREE(batch, LDLM_BL_AST_BATCH_MAX * sizeof(*batch));
+	RETURN(rc);
+}
+
 /**
  * ->l_completion_ast callback for a remote lock in server namespace.
  *
@@ -1141,86 +1590,678 @@ int ldlm_server_glimpse_ast(struct ldlm_lock *lock, void *data)
 
 	lock->l_last_activity = ktime_get_real_seconds();
 
-	req->rq_interpret_reply = ldlm_cb_interpret;
+	req->rq_interpret_reply = ldlm_cb_interpret;
+
+        if (lock->l_export && lock->l_export->exp_nid_stats &&
+            lock->l_export->exp_nid_stats->nid_ldlm_stats)
+                lprocfs_counter_incr(lock->l_export->exp_nid_stats->nid_ldlm_stats,
+                                     LDLM_GL_CALLBACK - LDLM_FIRST_OPC);
+
+	rc = ldlm_ast_fini(req, arg, lock, 0);
+
+	RETURN(rc);
+}
+
+int ldlm_glimpse_locks(struct ldlm_resource *res,
+		       struct list_head *gl_work_list)
+{
+	int	rc;
+	ENTRY;
+
+	rc = ldlm_run_ast_work(ldlm_res_to_ns(res), gl_work_list,
+			       LDLM_WORK_GL_AST);
+	if (rc == -ERESTART)
+		ldlm_reprocess_all(res);
+
+	RETURN(rc);
+}
+EXPORT_SYMBOL(ldlm_glimpse_locks);
+
+/* return LDLM lock associated with a lock callback request */
+struct ldlm_lock *ldlm_request_lock(struct ptlrpc_request *req)
+{
+	struct ldlm_cb_async_args	*ca;
+	struct ldlm_lock		*lock;
+	ENTRY;
+
+	ca = ptlrpc_req_async_args(req);
+	lock = ca->ca_lock;
+	if (lock == NULL)
+		RETURN(ERR_PTR(-EFAULT));
+
+	RETURN(lock);
+}
+EXPORT_SYMBOL(ldlm_request_lock);
+
+static void ldlm_svc_get_eopc(const struct ldlm_request *dlm_req,
+                       struct lprocfs_stats *srv_stats)
+{
+        int lock_type = 0, op = 0;
+
+        lock_type = dlm_req->lock_desc.l_resource.lr_type;
+
+        switch (lock_type) {
+        case LDLM_PLAIN:
+                op = PTLRPC_LAST_CNTR + LDLM_PLAIN_ENQUEUE;
+                break;
+        case LDLM_EXTENT:
+                if (dlm_req->lock_flags & LDLM_FL_HAS_INTENT)
+                        op = PTLRPC_LAST_CNTR + LDLM_GLIMPSE_ENQUEUE;
+                else
+                        op = PTLRPC_LAST_CNTR + LDLM_EXTENT_ENQUEUE;
+                break;
+        case LDLM_FLOCK:
+                op = PTLRPC_LAST_CNTR + LDLM_FLOCK_ENQUEUE;
+                break;
+        case LDLM_IBITS:
+                op = PTLRPC_LAST_CNTR + LDLM_IBITS_ENQUEUE;
+                break;
+        default:
+                op = 0;
+                break;
+        }
+
+        if (op)
+                lprocfs_counter_incr(srv_stats, op);
+
+        return;
+}
+
+/**
+ * Switch the capsule of lock replay request \a req to the batched format if
+ * the client packed more locks after the one in RMF_DLM_REQ, and size the
+ * reply for them.
+ *
+ * \retval number of extra locks to replay
+ * \retval negative errno if the batch is malformed
+ */
+static int ldlm_replay_batch_prep(struct ptlrpc_request *req)
+{
+	struct req_capsule *pill = &req->rq_pill;
+	int nr;
+
+	if (!exp_connect_lock_replay_batch(req->rq_export) ||
+	    pill->rc_fmt != &RQF_LDLM_ENQUEUE)
+		return 0;
+
+	req_capsule_extend(pill, &RQF_LDLM_ENQUEUE_REPLAY_BATCH);
+	if (!req_capsule_field_present(pill, &RMF_DLM_REPLAY_REQ, RCL_CLIENT)) {
+		req_capsule_set_size(pill, &RMF_DLM_REPLAY_REP, RCL_SERVER, 0);
+		return 0;
+	}
+
+	nr = req_capsule_get_size(pill, &RMF_DLM_REPLAY_REQ, RCL_CLIENT) /
+	     sizeof(struct ldlm_request);
+	if (nr <= 0 || nr >= LDLM_REPLAY_BATCH_MAX ||
+	    req_capsule_client_get(pill, &RMF_DLM_REPLAY_REQ) == NULL) {
+		DEBUG_REQ(D_ERROR, req, "bad lock replay batch of %d locks", nr);
+		return -EPROTO;
+	}
+
+	req_capsule_set_size(pill, &RMF_DLM_REPLAY_REP, RCL_SERVER,
+			     nr * sizeof(struct ldlm_reply));
+	return nr;
+}
+
+/**
+ * Check the resource type and the mode of lock request \a dlm_req of \a req.
+ */
+static int ldlm_enqueue_check(struct ptlrpc_request *req,
+			      const struct ldlm_request *dlm_req)
+{
+	enum ldlm_type type = dlm_req->lock_desc.l_resource.lr_type;
+	enum ldlm_mode mode = dlm_req->lock_desc.l_req_mode;
+
+	if (unlikely(type < LDLM_MIN_TYPE || type >= LDLM_MAX_TYPE)) {
+		DEBUG_REQ(D_ERROR, req, "invalid lock request type %d", type);
+		return -EFAULT;
+	}
+
+	if (unlikely(mode <= LCK_MINMODE || mode >= LCK_MAXMODE ||
+		     mode & (mode - 1))) {
+		DEBUG_REQ(D_ERROR, req, "invalid lock request mode %d", mode);
+		return -EFAULT;
+	}
+
+	if (exp_connect_flags(req->rq_export) & OBD_CONNECT_IBITS) {
+		if (unlikely(type == LDLM_PLAIN)) {
+			DEBUG_REQ(D_ERROR, req,
+				  "PLAIN lock request from IBITS client?");
+			return -EPROTO;
+		}
+	} else if (unlikely(type == LDLM_IBITS)) {
+		DEBUG_REQ(D_ERROR, req,
+			  "IBITS lock request from unaware client?");
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+/**
+ * Find or create the lock of request \a dlm_req of \a req, to be enqueued
+ * with \a flags.
+ *
+ * A replayed or resent lock already in the export hash is returned with
+ * LDLM_FL_RESENT set in \a flags, a new lock is added to the export
+ * otherwise.
+ *
+ * \param[out] lockp	the lock, referenced, also on error once created
+ */
+static int ldlm_enqueue_lock_get(struct ldlm_namespace *ns,
+				 struct ptlrpc_request *req,
+				 const struct ldlm_request *dlm_req,
+				 const struct ldlm_callback_suite *cbs,
+				 __u64 *flags, struct ldlm_lock **lockp)
+{
+	const struct ldlm_resource_desc *res_desc =
+					&dlm_req->lock_desc.l_resource;
+	struct obd_export *exp = req->rq_export;
+	struct ldlm_lock *lock;
+	int rc;
+	ENTRY;
+
+	*lockp = NULL;
+	if (unlikely((*flags & LDLM_FL_REPLAY) ||
+		     (lustre_msg_get_flags(req->rq_reqmsg) & MSG_RESENT))) {
+		/* Find an existing lock in the per-export lock hash */
+		/* In the function below, .hs_keycmp resolves to
+		 * ldlm_export_lock_keycmp() */
+		/* coverity[overrun-buffer-val] */
+		lock = cfs_hash_lookup(exp->exp_lock_hash,
+				       (void *)&dlm_req->lock_handle[0]);
+		if (lock != NULL) {
+			DEBUG_REQ(D_DLMTRACE, req, "found existing lock cookie %#llx",
+				  lock->l_handle.h_cookie);
+			*flags |= LDLM_FL_RESENT;
+			*lockp = lock;
+			RETURN(0);
+		}
+	} else {
+		if (ldlm_reclaim_full()) {
+			DEBUG_REQ(D_DLMTRACE, req, "Too many granted locks, "
+				  "reject current enqueue request and let the "
+				  "client retry later.\n");
+			RETURN(-EINPROGRESS);
+		}
+	}
+
+	/* The lock's callback data might be set in the policy function */
+	lock = ldlm_lock_create(ns, &res_desc->lr_name, res_desc->lr_type,
+				dlm_req->lock_desc.l_req_mode,
+				cbs, NULL, 0, LVB_T_NONE);
+	if (IS_ERR(lock))
+		RETURN(PTR_ERR(lock));
+
+	*lockp = lock;
+	lock->l_remote_handle = dlm_req->lock_handle[0];
+	LDLM_DEBUG(lock, "server-side enqueue handler, new lock created");
+
+	/* Initialize resource lvb but not for a lock being replayed since
+	 * Client already got lvb sent in this case.
+	 * This must occur early since some policy methods assume resource
+	 * lvb is available (lr_lvb_data != NULL).
+	 */
+	if (!(*flags & LDLM_FL_REPLAY)) {
+		ldlm_reclaim_hit(lock->l_resource, exp, true);
+
+		/* non-replayed lock, delayed lvb init may need to be done */
+		rc = ldlm_lvbo_init(lock->l_resource);
+		if (rc < 0) {
+			LDLM_DEBUG(lock, "delayed lvb init failed (rc %d)", rc);
+			RETURN(rc);
+		}
+	}
+
+	OBD_FAIL_TIMEOUT(OBD_FAIL_LDLM_ENQUEUE_BLOCKED, obd_timeout * 2);
+	/* Don't enqueue a lock onto the export if it is been disonnected
+	 * due to eviction (bug 3822) or server umount (bug 24324).
+	 * Cancel it now instead. */
+	if (exp->exp_disconnected) {
+		LDLM_ERROR(lock, "lock on disconnected export %p", exp);
+		RETURN(-ENOTCONN);
+	}
+
+	lock->l_export = class_export_lock_get(exp, lock);
+	if (lock->l_export->exp_lock_hash)
+		cfs_hash_add(lock->l_export->exp_lock_hash,
+			     &lock->l_remote_handle,
+			     &lock->l_exp_hash);
+
+	/* Inherit the enqueue flags before the operation, because we do not
+	 * keep the res lock on return and next operations (BL AST) may proceed
+	 * without them. */
+	lock->l_flags |= ldlm_flags_from_wire(dlm_req->lock_flags &
+					      LDLM_FL_INHERIT_MASK);
+
+	ldlm_convert_policy_to_local(exp, res_desc->lr_type,
+				     &dlm_req->lock_desc.l_policy_data,
+				     &lock->l_policy_data);
+	if (res_desc->lr_type == LDLM_EXTENT)
+		lock->l_req_extent = lock->l_policy_data.l_extent;
+
+	RETURN(0);
+}
+
+/**
+ * Fill the reply \a dlm_rep to lock request \a dlm_req of \a req once
+ * \a lock has been enqueued with \a flags.
+ */
+static int ldlm_enqueue_lock_reply(struct ptlrpc_request *req,
+				   const struct ldlm_request *dlm_req,
+				   struct ldlm_lock *lock, __u64 flags,
+				   struct ldlm_reply *dlm_rep)
+{
+	int rc = 0;
+
+	ldlm_lock2desc(lock, &dlm_rep->lock_desc);
+	ldlm_lock2handle(lock, &dlm_rep->lock_handle);
+
+	if (lock->l_resource->lr_type == LDLM_EXTENT)
+		OBD_FAIL_TIMEOUT(OBD_FAIL_LDLM_BL_EVICT, 6);
+
+	/* We never send a blocking AST until the lock is granted, but
+	 * we can tell it right now */
+	lock_res_and_lock(lock);
+
+	/* Now take into account flags to be inherited from original lock
+	   request both in reply to client and in our own lock flags. */
+	dlm_rep->lock_flags = ldlm_flags_to_wire(flags);
+	lock->l_flags |= flags & LDLM_FL_INHERIT_MASK;
+
+	/* Don't move a pending lock onto the export if it has already been
+	 * disconnected due to eviction (bug 5683) or server umount (bug 24324).
+	 * Cancel it now instead. */
+	if (unlikely(req->rq_export->exp_disconnected ||
+		     OBD_FAIL_CHECK(OBD_FAIL_LDLM_ENQUEUE_OLD_EXPORT))) {
+		LDLM_ERROR(lock, "lock on destroyed export %p", req->rq_export);
+		rc = -ENOTCONN;
+	} else if (ldlm_is_ast_sent(lock)) {
+		dlm_rep->lock_flags |= ldlm_flags_to_wire(LDLM_FL_AST_SENT);
+		if (lock->l_granted_mode == lock->l_req_mode) {
+			/*
+			 * Only cancel lock if it was granted, because it would
+			 * be destroyed immediately and would never be granted
+			 * in the future, causing timeouts on client.  Not
+			 * granted lock will be cancelled immediately after
+			 * sending completion AST.
+			 */
+			if (dlm_rep->lock_flags & LDLM_FL_CANCEL_ON_BLOCK) {
+				unlock_res_and_lock(lock);
+				ldlm_lock_cancel(lock);
+				lock_res_and_lock(lock);
+			} else
+				ldlm_add_waiting_lock(lock);
+		}
+	}
+	/* Make sure we never ever grant usual metadata locks to liblustre
+	   clients */
+	if ((dlm_req->lock_desc.l_resource.lr_type == LDLM_PLAIN ||
+	    dlm_req->lock_desc.l_resource.lr_type == LDLM_IBITS) &&
+	     req->rq_export->exp_libclient) {
+		if (unlikely(!ldlm_is_cancel_on_block(lock) ||
+			     !(dlm_rep->lock_flags & LDLM_FL_CANCEL_ON_BLOCK))){
+			CERROR("Granting sync lock to libclient. "
+			       "req fl %d, rep fl %d, lock fl %#llx\n",
+			       dlm_req->lock_flags, dlm_rep->lock_flags,
+			       lock->l_flags);
+			LDLM_ERROR(lock, "sync lock");
+			if (dlm_req->lock_flags & LDLM_FL_HAS_INTENT) {
+				struct ldlm_intent *it;
+
+				it = req_capsule_client_get(&req->rq_pill,
+							    &RMF_LDLM_INTENT);
+				if (it != NULL) {
+					CERROR("This is intent %s (%llu)\n",
+					       ldlm_it2str(it->opc), it->opc);
+				}
+			}
+		}
+	}
+
+	unlock_res_and_lock(lock);
+
+	return rc;
+}
+
+/**
+ * Drop \a lock of an enqueue with \a flags that failed, unless it is an
+ * existing lock found for a resent or replayed request.
+ */
+static void ldlm_enqueue_lock_fail(struct ldlm_lock *lock, __u64 flags)
+{
+	if (flags & LDLM_FL_RESENT)
+		return;
+
+	if (lock->l_export) {
+		ldlm_lock_cancel(lock);
+	} else {
+		lock_res_and_lock(lock);
+		ldlm_resource_unlink_lock(lock);
+		ldlm_lock_destroy_nolock(lock);
+		unlock_res_and_lock(lock);
+	}
+}
+
+/**
+ * Replay one lock \a dlm_req of a batched lock replay request \a req and
+ * fill its reply \a dlm_rep.
+ *
+ * This is ldlm_handle_enqueue0() for a replayed lock, without intent, LVB
+ * or reply packing that are done once for the request.
+ */
+static int ldlm_handle_replay_lock(struct ldlm_namespace *ns,
+				   struct ptlrpc_request *req,
+				   const struct ldlm_request *dlm_req,
+				   struct ldlm_reply *dlm_rep,
+				   const struct ldlm_callback_suite *cbs)
+{
+	enum ldlm_error err = ELDLM_OK;
+	struct ldlm_lock *lock = NULL;
+	__u64 flags;
+	int rc;
+	ENTRY;
+
+	flags = ldlm_flags_from_wire(dlm_req->lock_flags);
+	if (unlikely(!(flags & LDLM_FL_REPLAY) ||
+		     (flags & LDLM_FL_HAS_INTENT))) {
+		DEBUG_REQ(D_ERROR, req, "invalid batched lock replay flags %#x",
+			  dlm_req->lock_flags);
+		RETURN(-EPROTO);
+	}
+
+	rc = ldlm_enqueue_check(req, dlm_req);
+	if (rc != 0)
+		RETURN(rc);
+
+	if (ptlrpc_req2svc(req)->srv_stats != NULL)
+		ldlm_svc_get_eopc(dlm_req, ptlrpc_req2svc(req)->srv_stats);
+
+	rc = ldlm_enqueue_lock_get(ns, req, dlm_req, cbs, &flags, &lock);
+	if (rc != 0)
+		GOTO(out, rc);
+
+	err = ldlm_lock_enqueue(ns, &lock, NULL, &flags);
+	if (err != ELDLM_OK)
+		GOTO(out, rc = (int)err < 0 ? (int)err : -EPROTO);
+
+	rc = ldlm_enqueue_lock_reply(req, dlm_req, lock, flags, dlm_rep);
+
+	EXIT;
+out:
+	if (lock == NULL)
+		return rc;
+
+	LDLM_DEBUG(lock, "server-side replay of batched lock (err=%d, rc=%d)",
+		   err, rc);
+	if (rc != 0)
+		ldlm_enqueue_lock_fail(lock, flags);
+
+	if (err == ELDLM_OK &&
+	    dlm_req->lock_desc.l_resource.lr_type != LDLM_FLOCK)
+		ldlm_reprocess_all(lock->l_resource);
+
+	LDLM_LOCK_RELEASE(lock);
+	return rc;
+}
+
+/**
+ * Replay the \a nr locks packed in RMF_DLM_REPLAY_REQ of lock replay
+ * request \a req after the one in RMF_DLM_REQ.  Stops at the first lock
+ * that cannot be replayed, the client then reconnects as it does when a
+ * single lock replay fails.
+ */
+static int ldlm_handle_replay_batch(struct ldlm_namespace *ns,
+				    struct ptlrpc_request *req, int nr,
+				    const struct ldlm_callback_suite *cbs)
+{
+	struct ldlm_request *dlm_reqs;
+	struct ldlm_reply *dlm_reps;
+	int rc = 0;
+	int i;
+	ENTRY;
+
+	dlm_reqs = req_capsule_client_get(&req->rq_pill, &RMF_DLM_REPLAY_REQ);
+	dlm_reps = req_capsule_server_get(&req->rq_pill, &RMF_DLM_REPLAY_REP);
+	if (dlm_reqs == NULL || dlm_reps == NULL)
+		RETURN(-EPROTO);
+
+	for (i = 0; i < nr; i++) {
+		rc = ldlm_handle_replay_lock(ns, req, &dlm_reqs[i],
+					     &dlm_reps[i], cbs);
+		if (rc != 0) {
+			DEBUG_REQ(D_HA, req, "cannot replay lock %d/%d: rc = %d",
+				  i + 1, nr, rc);
+			break;
+		}
+	}
+
+	RETURN(rc);
+}
+
+/**
+ * Switch the capsule of enqueue request \a req to the multi-resource format
+ * if the client packed more locks after the one in RMF_DLM_REQ, and size the
+ * reply for them.
+ *
+ * \retval number of locks to enqueue, including the one in RMF_DLM_REQ
+ * \retval 0 for a single lock enqueue
+ * \retval negative errno if the request is malformed
+ */
+static int ldlm_multi_enqueue_prep(struct ptlrpc_request *req)
+{
+	struct req_capsule *pill = &req->rq_pill;
+	int nr;
+
+	/* a single lock enqueue has no buffer after the ldlm_request */
+	if (!exp_connect_multi_enqueue(req->rq_export) ||
+	    pill->rc_fmt != &RQF_LDLM_ENQUEUE ||
+	    lustre_msg_bufcount(req->rq_reqmsg) <= DLM_LOCKREQ_OFF + 1)
+		return 0;
+
+	req_capsule_extend(pill, &RQF_LDLM_ENQUEUE_MULTI);
+	nr = req_capsule_get_size(pill, &RMF_DLM_MULTI_REQ, RCL_CLIENT) /
+	     sizeof(struct ldlm_request);
+	if (nr < 0 || nr >= LDLM_MULTI_ENQUEUE_MAX ||
+	    (nr > 0 &&
+	     req_capsule_client_get(pill, &RMF_DLM_MULTI_REQ) == NULL)) {
+		DEBUG_REQ(D_ERROR, req, "bad multi-resource enqueue of %d locks",
+			  nr + 1);
+		return -EPROTO;
+	}
+
+	req_capsule_set_size(pill, &RMF_DLM_LVB, RCL_SERVER, 0);
+	req_capsule_set_size(pill, &RMF_DLM_MULTI_REP, RCL_SERVER,
+			     nr * sizeof(struct ldlm_reply));
+	return nr + 1;
+}
+
+/**
+ * Enqueue one lock \a dlm_req of multi-resource enqueue request \a req and
+ * fill its reply \a dlm_rep.
+ *
+ * This is ldlm_handle_enqueue0() for a new inodebits lock without intent,
+ * except the lock never waits: it is granted right away or fails with
+ * -EWOULDBLOCK.  The failure is returned to the client in lock_policy_res2
+ * of the reply.
+ *
+ * \param[out] lockp	the granted lock, referenced, on success
+ */
+static int ldlm_handle_multi_lock(struct ldlm_namespace *ns,
+				  struct ptlrpc_request *req,
+				  const struct ldlm_request *dlm_req,
+				  struct ldlm_reply *dlm_rep,
+				  const struct ldlm_callback_suite *cbs,
+				  struct ldlm_lock **lockp)
+{
+	const union ldlm_wire_policy_data *policy =
+					&dlm_req->lock_desc.l_policy_data;
+	enum ldlm_error err = ELDLM_OK;
+	struct ldlm_lock *lock = NULL;
+	__u64 flags;
+	int rc;
+	ENTRY;
+
+	flags = ldlm_flags_from_wire(dlm_req->lock_flags &
+				     ~LDLM_FL_ALL_OR_NOTHING);
+	flags |= LDLM_FL_BLOCK_NOWAIT;
+	rc = ldlm_enqueue_check(req, dlm_req);
+	if (rc != 0)
+		GOTO(out, rc);
+
+	if (unlikely(flags & (LDLM_FL_REPLAY | LDLM_FL_HAS_INTENT) ||
+		     dlm_req->lock_desc.l_resource.lr_type != LDLM_IBITS ||
+		     (policy->l_inodebits.bits |
+		      policy->l_inodebits.try_bits) == 0)) {
+		DEBUG_REQ(D_ERROR, req, "invalid lock type %d flags %#x in "
+			  "multi-resource enqueue",
+			  dlm_req->lock_desc.l_resource.lr_type,
+			  dlm_req->lock_flags);
+		GOTO(out, rc = -EPROTO);
+	}
+
+	rc = ldlm_enqueue_lock_get(ns, req, dlm_req, cbs, &flags, &lock);
+	if (rc != 0)
+		GOTO(out, rc);
+
+	err = ldlm_lock_enqueue(ns, &lock, NULL, &flags);
+	if (err == ELDLM_LOCK_WOULDBLOCK)
+		GOTO(out, rc = -EWOULDBLOCK);
+	if (err != ELDLM_OK)
+		GOTO(out, rc = (int)err < 0 ? (int)err : -EPROTO);
 
-        if (lock->l_export && lock->l_export->exp_nid_stats &&
-            lock->l_export->exp_nid_stats->nid_ldlm_stats)
-                lprocfs_counter_incr(lock->l_export->exp_nid_stats->nid_ldlm_stats,
-                                     LDLM_GL_CALLBACK - LDLM_FIRST_OPC);
+	rc = ldlm_enqueue_lock_reply(req, dlm_req, lock, flags, dlm_rep);
 
-	rc = ldlm_ast_fini(req, arg, lock, 0);
+	EXIT;
+out:
+	if (lock != NULL)
+		LDLM_DEBUG(lock, "server-side multi-resource enqueue (err=%d, "
+			   "rc=%d)", err, rc);
+	if (rc == 0) {
+		*lockp = lock;
+		return 0;
+	}
 
-	RETURN(rc);
+	memset(&dlm_rep->lock_handle, 0, sizeof(dlm_rep->lock_handle));
+	dlm_rep->lock_policy_res2 = ptlrpc_status_hton(rc);
+	if (lock != NULL) {
+		ldlm_enqueue_lock_fail(lock, flags);
+		LDLM_LOCK_RELEASE(lock);
+	}
+	return rc;
 }
 
-int ldlm_glimpse_locks(struct ldlm_resource *res,
-		       struct list_head *gl_work_list)
+/**
+ * Enqueue the \a nr locks of multi-resource enqueue request \a req, the
+ * first one in RMF_DLM_REQ and the others in RMF_DLM_MULTI_REQ, and reply
+ * for each of them.
+ *
+ * No lock waits for a conflicting one, so locks held by the client cannot
+ * deadlock with others whatever the order of the resources.  A lock that
+ * cannot be granted fails on its own, unless the client set
+ * LDLM_FL_ALL_OR_NOTHING on the first lock: the locks granted so far are then
+ * cancelled and the request fails with the error of that lock.
+ */
+static int ldlm_handle_enqueue_multi(struct ldlm_namespace *ns,
+				     struct ptlrpc_request *req,
+				     const struct ldlm_request *dlm_req,
+				     int nr,
+				     const struct ldlm_callback_suite *cbs)
 {
-	int	rc;
+	bool all = dlm_req->lock_flags & LDLM_FL_ALL_OR_NOTHING;
+	struct ldlm_request *dlm_reqs = NULL;
+	struct ldlm_reply *dlm_reps = NULL;
+	struct ldlm_reply *dlm_rep;
+	struct ldlm_lock **locks;
+	int status = 0;
+	int rc;
+	int i;
 	ENTRY;
 
-	rc = ldlm_run_ast_work(ldlm_res_to_ns(res), gl_work_list,
-			       LDLM_WORK_GL_AST);
-	if (rc == -ERESTART)
-		ldlm_reprocess_all(res);
+	if (ldlm_reclaim_full()) {
+		DEBUG_REQ(D_DLMTRACE, req, "Too many granted locks, reject "
+			  "multi-resource enqueue and let the client retry");
+		GOTO(out, rc = -EINPROGRESS);
+	}
 
-	RETURN(rc);
-}
-EXPORT_SYMBOL(ldlm_glimpse_locks);
+	OBD_ALLOC(locks, sizeof(*locks) * nr);
+	if (locks == NULL)
+		GOTO(out, rc = -ENOMEM);
 
-/* return LDLM lock associated with a lock callback request */
-struct ldlm_lock *ldlm_request_lock(struct ptlrpc_request *req)
-{
-	struct ldlm_cb_async_args	*ca;
-	struct ldlm_lock		*lock;
-	ENTRY;
+	rc = req_capsule_server_pack(&req->rq_pill);
+	if (rc != 0)
+		GOTO(out_free, rc);
+
+	dlm_rep = req_capsule_server_get(&req->rq_pill, &RMF_DLM_REP);
+	if (nr > 1) {
+		dlm_reqs = req_capsule_client_get(&req->rq_pill,
+						  &RMF_DLM_MULTI_REQ);
+		dlm_reps = req_capsule_server_get(&req->rq_pill,
+						  &RMF_DLM_MULTI_REP);
+		if (dlm_reqs == NULL || dlm_reps == NULL)
+			GOTO(out_free, rc = -EPROTO);
+	}
 
-	ca = ptlrpc_req_async_args(req);
-	lock = ca->ca_lock;
-	if (lock == NULL)
-		RETURN(ERR_PTR(-EFAULT));
+	for (i = 0; i < nr; i++) {
+		if (i > 0 && ptlrpc_req2svc(req)->srv_stats != NULL)
+			ldlm_svc_get_eopc(&dlm_reqs[i - 1],
+					  ptlrpc_req2svc(req)->srv_stats);
+
+		rc = ldlm_handle_multi_lock(ns, req,
+					    i == 0 ? dlm_req : &dlm_reqs[i - 1],
+					    i == 0 ? dlm_rep : &dlm_reps[i - 1],
+					    cbs, &locks[i]);
+		if (rc != 0 && all) {
+			status = rc;
+			break;
+		}
+	}
+	rc = 0;
 
-	RETURN(lock);
-}
-EXPORT_SYMBOL(ldlm_request_lock);
+	for (i = 0; i < nr; i++) {
+		struct ldlm_reply *rep = i == 0 ? dlm_rep : &dlm_reps[i - 1];
+		struct ldlm_lock *lock = locks[i];
 
-static void ldlm_svc_get_eopc(const struct ldlm_request *dlm_req,
-                       struct lprocfs_stats *srv_stats)
-{
-        int lock_type = 0, op = 0;
+		if (status != 0) {
+			memset(&rep->lock_handle, 0, sizeof(rep->lock_handle));
+			rep->lock_policy_res2 = ptlrpc_status_hton(status);
+		}
 
-        lock_type = dlm_req->lock_desc.l_resource.lr_type;
+		if (lock == NULL)
+			continue;
 
-        switch (lock_type) {
-        case LDLM_PLAIN:
-                op = PTLRPC_LAST_CNTR + LDLM_PLAIN_ENQUEUE;
-                break;
-        case LDLM_EXTENT:
-                if (dlm_req->lock_flags & LDLM_FL_HAS_INTENT)
-                        op = PTLRPC_LAST_CNTR + LDLM_GLIMPSE_ENQUEUE;
-                else
-                        op = PTLRPC_LAST_CNTR + LDLM_EXTENT_ENQUEUE;
-                break;
-        case LDLM_FLOCK:
-                op = PTLRPC_LAST_CNTR + LDLM_FLOCK_ENQUEUE;
-                break;
-        case LDLM_IBITS:
-                op = PTLRPC_LAST_CNTR + LDLM_IBITS_ENQUEUE;
-                break;
-        default:
-                op = 0;
-                break;
-        }
+		if (status != 0)
+			ldlm_lock_cancel(lock);
+		ldlm_reprocess_all(lock->l_resource);
+		LDLM_LOCK_RELEASE(lock);
+	}
 
-        if (op)
-                lprocfs_counter_incr(srv_stats, op);
+	EXIT;
+out_free:
+	OBD_FREE(locks, sizeof(*locks) * nr);
+out:
+	req->rq_status = rc ?: status;
+	if (!req->rq_packed_final) {
+		int err = lustre_pack_reply(req, 1, NULL, NULL);
 
-        return;
+		if (rc == 0)
+			rc = err;
+	}
+	LDLM_DEBUG_NOLOCK("server-side multi-resource enqueue of %d locks END "
+			  "(rc %d, status %d)", nr, rc, status);
+
+	return rc;
 }
 
 /**
  * Main server-side entry point into LDLM for enqueue. This is called by ptlrpc
  * service threads to carry out client lock enqueueing requests.
+ *
+ * A lock replay request from a client with OBD_CONNECT2_LOCK_REPLAY_BATCH
+ * may carry more locks to replay, they are handled after the first one by
+ * ldlm_handle_replay_batch().  An enqueue from a client with
+ * OBD_CONNECT2_MULTI_ENQUEUE may carry locks on several resources, they are
+ * all handled by ldlm_handle_enqueue_multi().
  */
 int ldlm_handle_enqueue0(struct ldlm_namespace *ns,
 			 struct ptlrpc_request *req,
@@ -1233,7 +2274,7 @@ int ldlm_handle_enqueue0(struct ldlm_namespace *ns,
 	struct ldlm_lock *lock = NULL;
 	void *cookie = NULL;
 	int rc = 0;
-	struct ldlm_resource *res = NULL;
+	int nr_batch = 0;
 	ENTRY;
 
 	LDLM_DEBUG_NOLOCK("server-side enqueue handler START");
@@ -1251,118 +2292,27 @@ int ldlm_handle_enqueue0(struct ldlm_namespace *ns,
                 lprocfs_counter_incr(req->rq_export->exp_nid_stats->nid_ldlm_stats,
                                      LDLM_ENQUEUE - LDLM_FIRST_OPC);
 
-        if (unlikely(dlm_req->lock_desc.l_resource.lr_type < LDLM_MIN_TYPE ||
-                     dlm_req->lock_desc.l_resource.lr_type >= LDLM_MAX_TYPE)) {
-                DEBUG_REQ(D_ERROR, req, "invalid lock request type %d",
-                          dlm_req->lock_desc.l_resource.lr_type);
-                GOTO(out, rc = -EFAULT);
-        }
-
-        if (unlikely(dlm_req->lock_desc.l_req_mode <= LCK_MINMODE ||
-                     dlm_req->lock_desc.l_req_mode >= LCK_MAXMODE ||
-                     dlm_req->lock_desc.l_req_mode &
-                     (dlm_req->lock_desc.l_req_mode-1))) {
-                DEBUG_REQ(D_ERROR, req, "invalid lock request mode %d",
-                          dlm_req->lock_desc.l_req_mode);
-                GOTO(out, rc = -EFAULT);
-        }
-
-	if (exp_connect_flags(req->rq_export) & OBD_CONNECT_IBITS) {
-                if (unlikely(dlm_req->lock_desc.l_resource.lr_type ==
-                             LDLM_PLAIN)) {
-                        DEBUG_REQ(D_ERROR, req,
-                                  "PLAIN lock request from IBITS client?");
-                        GOTO(out, rc = -EPROTO);
-                }
-        } else if (unlikely(dlm_req->lock_desc.l_resource.lr_type ==
-                            LDLM_IBITS)) {
-                DEBUG_REQ(D_ERROR, req,
-                          "IBITS lock request from unaware client?");
-                GOTO(out, rc = -EPROTO);
-        }
-
-	if (unlikely((flags & LDLM_FL_REPLAY) ||
-		     (lustre_msg_get_flags(req->rq_reqmsg) & MSG_RESENT))) {
-                /* Find an existing lock in the per-export lock hash */
-		/* In the function below, .hs_keycmp resolves to
-		 * ldlm_export_lock_keycmp() */
-		/* coverity[overrun-buffer-val] */
-                lock = cfs_hash_lookup(req->rq_export->exp_lock_hash,
-                                       (void *)&dlm_req->lock_handle[0]);
-                if (lock != NULL) {
-			DEBUG_REQ(D_DLMTRACE, req, "found existing lock cookie %#llx",
-				  lock->l_handle.h_cookie);
-			flags |= LDLM_FL_RESENT;
-                        GOTO(existing_lock, rc = 0);
-		}
-	} else {
-		if (ldlm_reclaim_full()) {
-			DEBUG_REQ(D_DLMTRACE, req, "Too many granted locks, "
-				  "reject current enqueue request and let the "
-				  "client retry later.\n");
-			GOTO(out, rc = -EINPROGRESS);
-		}
+	if (unlikely(flags & LDLM_FL_REPLAY)) {
+		nr_batch = ldlm_replay_batch_prep(req);
+		if (nr_batch < 0)
+			GOTO(out, rc = nr_batch);
+	} else if (!(flags & LDLM_FL_HAS_INTENT)) {
+		int nr_multi = ldlm_multi_enqueue_prep(req);
+
+		if (nr_multi < 0)
+			GOTO(out, rc = nr_multi);
+		if (nr_multi > 0)
+			RETURN(ldlm_handle_enqueue_multi(ns, req, dlm_req,
+							 nr_multi, cbs));
 	}
 
-	/* The lock's callback data might be set in the policy function */
-	lock = ldlm_lock_create(ns, &dlm_req->lock_desc.l_resource.lr_name,
-				dlm_req->lock_desc.l_resource.lr_type,
-				dlm_req->lock_desc.l_req_mode,
-				cbs, NULL, 0, LVB_T_NONE);
-	if (IS_ERR(lock)) {
-		rc = PTR_ERR(lock);
-		lock = NULL;
+	rc = ldlm_enqueue_check(req, dlm_req);
+	if (rc != 0)
 		GOTO(out, rc);
-	}
-
-        lock->l_remote_handle = dlm_req->lock_handle[0];
-        LDLM_DEBUG(lock, "server-side enqueue handler, new lock created");
-
-	/* Initialize resource lvb but not for a lock being replayed since
-	 * Client already got lvb sent in this case.
-	 * This must occur early since some policy methods assume resource
-	 * lvb is available (lr_lvb_data != NULL).
-	 */
-	res = lock->l_resource;
-	if (!(flags & LDLM_FL_REPLAY)) {
-		/* non-replayed lock, delayed lvb init may need to be done */
-		rc = ldlm_lvbo_init(res);
-		if (rc < 0) {
-			LDLM_DEBUG(lock, "delayed lvb init failed (rc %d)", rc);
-			GOTO(out, rc);
-		}
-	}
-
-        OBD_FAIL_TIMEOUT(OBD_FAIL_LDLM_ENQUEUE_BLOCKED, obd_timeout * 2);
-        /* Don't enqueue a lock onto the export if it is been disonnected
-         * due to eviction (bug 3822) or server umount (bug 24324).
-         * Cancel it now instead. */
-        if (req->rq_export->exp_disconnected) {
-                LDLM_ERROR(lock, "lock on disconnected export %p",
-                           req->rq_export);
-                GOTO(out, rc = -ENOTCONN);
-        }
-
-        lock->l_export = class_export_lock_get(req->rq_export, lock);
-        if (lock->l_export->exp_lock_hash)
-                cfs_hash_add(lock->l_export->exp_lock_hash,
-                             &lock->l_remote_handle,
-                             &lock->l_exp_hash);
-
-	/* Inherit the enqueue flags before the operation, because we do not
-	 * keep the res lock on return and next operations (BL AST) may proceed
-	 * without them. */
-	lock->l_flags |= ldlm_flags_from_wire(dlm_req->lock_flags &
-					      LDLM_FL_INHERIT_MASK);
 
-	ldlm_convert_policy_to_local(req->rq_export,
-				     dlm_req->lock_desc.l_resource.lr_type,
-				     &dlm_req->lock_desc.l_policy_data,
-				     &lock->l_policy_data);
-	if (dlm_req->lock_desc.l_resource.lr_type == LDLM_EXTENT)
-		lock->l_req_extent = lock->l_policy_data.l_extent;
-
-existing_lock:
+	rc = ldlm_enqueue_lock_get(ns, req, dlm_req, cbs, &flags, &lock);
+	if (rc != 0)
+		GOTO(out, rc);
 
         if (flags & LDLM_FL_HAS_INTENT) {
                 /* In this case, the reply buffer is allocated deep in
@@ -1391,73 +2341,10 @@ existing_lock:
 	}
 
         dlm_rep = req_capsule_server_get(&req->rq_pill, &RMF_DLM_REP);
+	rc = ldlm_enqueue_lock_reply(req, dlm_req, lock, flags, dlm_rep);
 
-        ldlm_lock2desc(lock, &dlm_rep->lock_desc);
-        ldlm_lock2handle(lock, &dlm_rep->lock_handle);
-
-	if (lock && lock->l_resource->lr_type == LDLM_EXTENT)
-		OBD_FAIL_TIMEOUT(OBD_FAIL_LDLM_BL_EVICT, 6);
-
-        /* We never send a blocking AST until the lock is granted, but
-         * we can tell it right now */
-        lock_res_and_lock(lock);
-
-        /* Now take into account flags to be inherited from original lock
-           request both in reply to client and in our own lock flags. */
-	dlm_rep->lock_flags = ldlm_flags_to_wire(flags);
-	lock->l_flags |= flags & LDLM_FL_INHERIT_MASK;
-
-        /* Don't move a pending lock onto the export if it has already been
-         * disconnected due to eviction (bug 5683) or server umount (bug 24324).
-         * Cancel it now instead. */
-        if (unlikely(req->rq_export->exp_disconnected ||
-                     OBD_FAIL_CHECK(OBD_FAIL_LDLM_ENQUEUE_OLD_EXPORT))) {
-                LDLM_ERROR(lock, "lock on destroyed export %p", req->rq_export);
-                rc = -ENOTCONN;
-	} else if (ldlm_is_ast_sent(lock)) {
-		dlm_rep->lock_flags |= ldlm_flags_to_wire(LDLM_FL_AST_SENT);
-                if (lock->l_granted_mode == lock->l_req_mode) {
-                        /*
-                         * Only cancel lock if it was granted, because it would
-                         * be destroyed immediately and would never be granted
-                         * in the future, causing timeouts on client.  Not
-                         * granted lock will be cancelled immediately after
-                         * sending completion AST.
-                         */
-                        if (dlm_rep->lock_flags & LDLM_FL_CANCEL_ON_BLOCK) {
-                                unlock_res_and_lock(lock);
-                                ldlm_lock_cancel(lock);
-                                lock_res_and_lock(lock);
-                        } else
-                                ldlm_add_waiting_lock(lock);
-                }
-        }
-        /* Make sure we never ever grant usual metadata locks to liblustre
-           clients */
-        if ((dlm_req->lock_desc.l_resource.lr_type == LDLM_PLAIN ||
-            dlm_req->lock_desc.l_resource.lr_type == LDLM_IBITS) &&
-             req->rq_export->exp_libclient) {
-		if (unlikely(!ldlm_is_cancel_on_block(lock) ||
-                             !(dlm_rep->lock_flags & LDLM_FL_CANCEL_ON_BLOCK))){
-                        CERROR("Granting sync lock to libclient. "
-			       "req fl %d, rep fl %d, lock fl %#llx\n",
-                               dlm_req->lock_flags, dlm_rep->lock_flags,
-                               lock->l_flags);
-                        LDLM_ERROR(lock, "sync lock");
-			if (dlm_req->lock_flags & LDLM_FL_HAS_INTENT) {
-				struct ldlm_intent *it;
-
-				it = req_capsule_client_get(&req->rq_pill,
-							    &RMF_LDLM_INTENT);
-				if (it != NULL) {
-					CERROR("This is intent %s (%llu)\n",
-					       ldlm_it2str(it->opc), it->opc);
-				}
-			}
-                }
-        }
-
-        unlock_res_and_lock(lock);
+	if (nr_batch > 0 && rc == 0)
+		rc = ldlm_handle_replay_batch(ns, req, nr_batch, cbs);
 
         EXIT;
  out:
@@ -1514,17 +2401,8 @@ existing_lock:
 			}
 		}
 
-		if (rc != 0 && !(flags & LDLM_FL_RESENT)) {
-			if (lock->l_export) {
-				ldlm_lock_cancel(lock);
-			} else {
-				lock_res_and_lock(lock);
-				ldlm_resource_unlink_lock(lock);
-				ldlm_lock_destroy_nolock(lock);
-				unlock_res_and_lock(lock);
-
-			}
-		}
+		if (rc != 0)
+			ldlm_enqueue_lock_fail(lock, flags);
 
                 if (!err && dlm_req->lock_desc.l_resource.lr_type != LDLM_FLOCK)
                         ldlm_reprocess_all(lock->l_resource);
@@ -1911,7 +2789,7 @@ out:
 		lock_res_and_lock(lock);
 		ldlm_set_failed(lock);
 		unlock_res_and_lock(lock);
-		wake_up(&lock->l_waitq);
+		wake_up_all(ldlm_lock_waitq(lock));
 	}
 	LDLM_LOCK_RELEASE(lock);
 }
@@ -2147,6 +3025,119 @@ static inline void ldlm_callback_errmsg(struct ptlrpc_request *req,
                 CWARN("Send reply failed, maybe cause bug 21636.\n");
 }
 
+/**
+ * Callback handler for blocking ASTs carrying several locks, sent to clients
+ * with OBD_CONNECT2_BL_AST_BATCH.
+ *
+ * Unused locks are marked for cancel and handed to a blocking thread as one
+ * list, so that they are cancelled with as few LDLM_CANCEL RPCs as possible.
+ * Locks still in use are cancelled on their last decref as usual. The reply
+ * lists the handles which are unknown or already cancelled here.
+ */
+static void ldlm_handle_bl_callback_batch(struct ptlrpc_request *req,
+					  struct ldlm_namespace *ns,
+					  struct ldlm_request *dlm_req)
+{
+	struct list_head cancels = LIST_HEAD_INIT(cancels);
+	struct lustre_handle *lockh;
+	struct ldlm_request *rep;
+	struct ldlm_lock *lock;
+	int count = dlm_req->lock_count;
+	int missed = 0;
+	int size;
+	int nr = 0;
+	int rc;
+	int i;
+	ENTRY;
+
+	size = ldlm_request_bufsize(count, LDLM_BL_CALLBACK);
+	if (req_capsule_get_size(&req->rq_pill, &RMF_DLM_REQ,
+				 RCL_CLIENT) < size) {
+		rc = ldlm_callback_reply(req, -EPROTO);
+		ldlm_callback_errmsg(req, "Operate with bad lock count", rc,
+				     NULL);
+		RETURN_EXIT;
+	}
+
+	req_capsule_extend(&req->rq_pill, &RQF_LDLM_BL_CALLBACK_BATCH);
+	req_capsule_set_size(&req->rq_pill, &RMF_DLM_REQ, RCL_SERVER, size);
+	rc = req_capsule_server_pack(&req->rq_pill);
+	if (rc != 0) {
+		ldlm_callback_errmsg(req, "Operate without reply buffer", rc,
+				     NULL);
+		RETURN_EXIT;
+	}
+	rep = req_capsule_server_get(&req->rq_pill, &RMF_DLM_REQ);
+
+	for (i = 0; i < count; i++) {
+		lockh = &dlm_req->lock_handle[i];
+
+		lock = ldlm_handle2lock_long(lockh, 0);
+		if (lock == NULL) {
+			CDEBUG(D_DLMTRACE, "callback on lock %#llx - lock "
+			       "disappeared\n", lockh->cookie);
+			rep->lock_handle[missed++] = *lockh;
+			continue;
+		}
+
+		LDLM_DEBUG(lock, "client batched blocking AST handler");
+
+		lock_res_and_lock(lock);
+		lock->l_flags |= ldlm_flags_from_wire(dlm_req->lock_flags &
+						      LDLM_FL_AST_MASK);
+		/* see ldlm_callback_handler() */
+		if ((ldlm_is_canceling(lock) && ldlm_is_bl_done(lock)) ||
+		    ldlm_is_failed(lock)) {
+			LDLM_DEBUG(lock, "callback on lock %llx - lock "
+				   "disappeared", lockh->cookie);
+			unlock_res_and_lock(lock);
+			LDLM_LOCK_RELEASE(lock);
+			rep->lock_handle[missed++] = *lockh;
+			continue;
+		}
+		ldlm_lock_remove_from_lru(lock);
+		ldlm_set_bl_ast(lock);
+		ldlm_set_cbpending(lock);
+		if (ldlm_is_cancel_on_block(lock))
+			ldlm_set_cancel(lock);
+
+		if (lock->l_readers || lock->l_writers ||
+		    ldlm_is_canceling(lock)) {
+			unlock_res_and_lock(lock);
+			LDLM_DEBUG(lock, "lock is referenced or being "
+				   "cancelled, will be cancelled later");
+			LDLM_LOCK_RELEASE(lock);
+			continue;
+		}
+
+		/* as in ldlm_prepare_lru_list(), the reference is dropped
+		 * once the cancel is sent */
+		ldlm_set_canceling(lock);
+		LASSERT(list_empty(&lock->l_bl_ast));
+		list_add_tail(&lock->l_bl_ast, &cancels);
+		unlock_res_and_lock(lock);
+		nr++;
+	}
+
+	rep->lock_count = missed;
+	req_capsule_shrink(&req->rq_pill, &RMF_DLM_REQ,
+			   ldlm_request_bufsize(missed, LDLM_BL_CALLBACK),
+			   RCL_SERVER);
+	rc = ldlm_callback_reply(req, 0);
+	if (req->rq_no_reply || rc)
+		ldlm_callback_errmsg(req, "Normal process", rc, NULL);
+
+	CDEBUG(D_DLMTRACE, "batched blocking AST for %d locks: %d to cancel, "
+	       "%d unknown\n", count, nr, missed);
+
+	if (nr > 0 && ldlm_bl_to_thread_list(ns, &dlm_req->lock_desc,
+					     &cancels, nr, LCF_ASYNC) != 0) {
+		nr = ldlm_cli_cancel_list_local(&cancels, nr, LCF_BL_AST);
+		ldlm_cli_cancel_list(&cancels, nr, NULL, 0);
+	}
+	EXIT;
+}
+
 /* TODO: handle requests in a similar way as MDT: see mdt_handle_common() */
 static int ldlm_callback_handler(struct ptlrpc_request *req)
 {
@@ -2246,6 +3237,13 @@ static int ldlm_callback_handler(struct ptlrpc_request *req)
                 RETURN(0);
         }
 
+	if (lustre_msg_get_opc(req->rq_reqmsg) == LDLM_BL_CALLBACK &&
+	    dlm_req->lock_count > 1) {
+		CDEBUG(D_INODE, "batched blocking ast\n");
+		ldlm_handle_bl_callback_batch(req, ns, dlm_req);
+		RETURN(0);
+	}
+
         /* Force a known safe race, send a cancel to the server for a lock
          * which the server has already started a blocking callback on. */
         if (OBD_FAIL_CHECK(OBD_FAIL_LDLM_CANCEL_BL_CB_RACE) &&
@@ -2948,8 +3946,66 @@ static ssize_t cancel_unused_locks_before_replay_store(struct kobject *kobj,
 }
 LUSTRE_RW_ATTR(cancel_unused_locks_before_replay);
 
+static ssize_t lock_replay_max_inflight_show(struct kobject *kobj,
+					     struct attribute *attr,
+					     char *buf)
+{
+	return sprintf(buf, "%u\n", ldlm_lock_replay_max_inflight);
+}
+
+static ssize_t lock_replay_max_inflight_store(struct kobject *kobj,
+					      struct attribute *attr,
+					      const char *buffer,
+					      size_t count)
+{
+	int rc;
+	unsigned long val;
+
+	rc = kstrtoul(buffer, 10, &val);
+	if (rc)
+		return rc;
+
+	if (val == 0 || val > INT_MAX)
+		return -ERANGE;
+
+	ldlm_lock_replay_max_inflight = val;
+
+	return count;
+}
+LUSTRE_RW_ATTR(lock_replay_max_inflight);
+
+static ssize_t lock_replay_batch_show(struct kobject *kobj,
+				      struct attribute *attr,
+				      char *buf)
+{
+	return sprintf(buf, "%u\n", ldlm_lock_replay_batch);
+}
+
+static ssize_t lock_replay_batch_store(struct kobject *kobj,
+				       struct attribute *attr,
+				       const char *buffer,
+				       size_t count)
+{
+	int rc;
+	unsigned long val;
+
+	rc = kstrtoul(buffer, 10, &val);
+	if (rc)
+		return rc;
+
+	if (val == 0 || val > LDLM_REPLAY_BATCH_MAX)
+		return -ERANGE;
+
+	ldlm_lock_replay_batch = val;
+
+	return count;
+}
+LUSTRE_RW_ATTR(lock_replay_batch);
+
 static struct attribute *ldlm_attrs[] = {
 	&lustre_attr_cancel_unused_locks_before_replay.attr,
+	&lustre_attr_lock_replay_max_inflight.attr,
+	&lustre_attr_lock_replay_batch.attr,
 	NULL,
 };
 
@@ -3110,6 +4166,12 @@ static int ldlm_setup(void)
 	}
 
 #ifdef HAVE_SERVER_SUPPORT
+	rc = ldlm_waiting_locks_init();
+	if (rc) {
+		CERROR("Cannot allocate ldlm waiting locks: rc = %d\n", rc);
+		GOTO(out, rc);
+	}
+
 	task = kthread_run(expired_lock_main, NULL, "ldlm_elt");
 	if (IS_ERR(task)) {
 		rc = PTR_ERR(task);
@@ -3196,6 +4258,7 @@ static int ldlm_cleanup(void)
 		wait_event(expired_lock_wait_queue,
 			   expired_lock_thread_state == ELT_STOPPED);
 	}
+	ldlm_waiting_locks_fini();
 #endif
 
         OBD_FREE(ldlm_state, sizeof(*ldlm_state));
@@ -3206,6 +4269,11 @@ static int ldlm_cleanup(void)
 
 int ldlm_init(void)
 {
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ldlm_lock_waitqs); i++)
+		init_waitqueue_head(&ldlm_lock_waitqs[i]);
+
 	ldlm_resource_slab = kmem_cache_create("ldlm_resources",
 					       sizeof(struct ldlm_resource), 0,
 					       SLAB_HWCACHE_ALIGN, NULL);
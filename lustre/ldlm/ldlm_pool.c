@@ -93,6 +93,7 @@
 
 #define DEBUG_SUBSYSTEM S_LDLM
 
+#include <linux/hash.h>
 #include <linux/kthread.h>
 #include <lustre_dlm.h>
 #include <cl_object.h>
@@ -138,6 +139,13 @@
  */
 #define LDLM_POOL_SLV_SHIFT (10)
 
+/*
+ * Number of recently cancelled LRU locks remembered by a client pool, and
+ * for how long, in seconds, an enqueue of one of them counts as re-enqueue.
+ */
+#define LDLM_POOL_GHOST_BITS (8)
+#define LDLM_POOL_GHOST_AGE (60)
+
 extern struct proc_dir_entry *ldlm_ns_proc_dir;
 
 static inline __u64 dru(__u64 val, __u32 shift, int round_up)
@@ -173,6 +181,8 @@ enum {
         LDLM_POOL_SHRINK_FREED_STAT,
         LDLM_POOL_RECALC_STAT,
         LDLM_POOL_TIMING_STAT,
+	LDLM_POOL_LRU_CANCEL_STAT,
+	LDLM_POOL_LRU_REENQUEUE_STAT,
         LDLM_POOL_LAST_STAT
 };
 
@@ -474,6 +484,8 @@ static void ldlm_cli_pool_pop_slv(struct ldlm_pool *pl)
 static int ldlm_cli_pool_recalc(struct ldlm_pool *pl)
 {
 	time64_t recalc_interval_sec;
+	__u64 old_slv;
+	__u64 new_slv;
 	int ret;
         ENTRY;
 
@@ -494,7 +506,20 @@ static int ldlm_cli_pool_recalc(struct ldlm_pool *pl)
         /*
          * Make sure that pool knows last SLV and Limit from obd.
          */
+	old_slv = pl->pl_server_lock_volume;
         ldlm_cli_pool_pop_slv(pl);
+	new_slv = pl->pl_server_lock_volume;
+
+	/*
+	 * Keep a moving average of the SLV change per period, the LRU
+	 * policy uses it to anticipate the next SLV instead of chasing
+	 * the last one and oscillating around the target.
+	 */
+	if (old_slv != 0 && new_slv != 0)
+		pl->pl_slv_trend += ((__s64)new_slv - (__s64)old_slv -
+				     pl->pl_slv_trend) / 4;
+	else
+		pl->pl_slv_trend = 0;
 	spin_unlock(&pl->pl_lock);
 
         /*
@@ -549,9 +574,7 @@ static int ldlm_cli_pool_shrink(struct ldlm_pool *pl,
          */
         ldlm_cli_pool_pop_slv(pl);
 
-	spin_lock(&ns->ns_lock);
-	unused = ns->ns_nr_unused;
-	spin_unlock(&ns->ns_lock);
+	unused = ldlm_ns_nr_unused(ns);
 
 	if (nr == 0)
 		return (unused / 100) * sysctl_vfs_cache_pressure;
@@ -663,11 +686,13 @@ static int lprocfs_pool_state_seq_show(struct seq_file *m, void *unused)
 	int grant_speed, grant_plan, lvf;
 	struct ldlm_pool *pl = m->private;
 	__u64 slv, clv;
+	__s64 trend;
 	__u32 limit;
 
 	spin_lock(&pl->pl_lock);
 	slv = pl->pl_server_lock_volume;
 	clv = pl->pl_client_lock_volume;
+	trend = pl->pl_slv_trend;
 	limit = ldlm_pool_get_limit(pl);
 	grant_plan = pl->pl_grant_plan;
 	granted = ldlm_pool_granted(pl);
@@ -687,6 +712,8 @@ static int lprocfs_pool_state_seq_show(struct seq_file *m, void *unused)
 	if (ns_is_server(ldlm_pl2ns(pl))) {
 		seq_printf(m, "  GSP: %d%%\n", grant_step);
 		seq_printf(m, "  GP:  %d\n", grant_plan);
+	} else {
+		seq_printf(m, "  SLVT: %lld\n", trend);
 	}
 
 	seq_printf(m, "  GR:  %d\n  CR:  %d\n  GS:  %d\n  G:   %d\n  L:   %d\n",
@@ -852,6 +879,10 @@ static int ldlm_pool_proc_init(struct ldlm_pool *pl)
         lprocfs_counter_init(pl->pl_stats, LDLM_POOL_TIMING_STAT,
                              LPROCFS_CNTR_AVGMINMAX | LPROCFS_CNTR_STDDEV,
                              "recalc_timing", "sec");
+	lprocfs_counter_init(pl->pl_stats, LDLM_POOL_LRU_CANCEL_STAT, 0,
+			     "lru_cancel", "locks");
+	lprocfs_counter_init(pl->pl_stats, LDLM_POOL_LRU_REENQUEUE_STAT, 0,
+			     "lru_reenqueue", "locks");
 	rc = lprocfs_register_stats(pl->pl_proc_dir, "stats", pl->pl_stats);
 
         EXIT;
@@ -895,6 +926,7 @@ int ldlm_pool_init(struct ldlm_pool *pl, struct ldlm_namespace *ns,
 
 	snprintf(pl->pl_name, sizeof(pl->pl_name), "ldlm-pool-%s-%d",
 		 ldlm_ns_name(ns), idx);
+	pl->pl_lru_ghosts = NULL;
 
         if (client == LDLM_NAMESPACE_SERVER) {
                 pl->pl_ops = &ldlm_srv_pool_ops;
@@ -906,19 +938,31 @@ int ldlm_pool_init(struct ldlm_pool *pl, struct ldlm_namespace *ns,
                 pl->pl_server_lock_volume = 0;
                 pl->pl_ops = &ldlm_cli_pool_ops;
                 pl->pl_recalc_period = LDLM_POOL_CLI_DEF_RECALC_PERIOD;
+		OBD_ALLOC(pl->pl_lru_ghosts,
+			  sizeof(__u64) << LDLM_POOL_GHOST_BITS);
+		if (pl->pl_lru_ghosts == NULL)
+			RETURN(-ENOMEM);
         }
         pl->pl_client_lock_volume = 0;
+	pl->pl_slv_trend = 0;
         rc = ldlm_pool_proc_init(pl);
         if (rc)
-                RETURN(rc);
+		GOTO(out_ghosts, rc);
 
 	rc = ldlm_pool_sysfs_init(pl);
 	if (rc)
-		RETURN(rc);
+		GOTO(out_ghosts, rc);
 
 	CDEBUG(D_DLMTRACE, "Lock pool %s is initialized\n", pl->pl_name);
 
 	RETURN(rc);
+out_ghosts:
+	if (pl->pl_lru_ghosts != NULL) {
+		OBD_FREE(pl->pl_lru_ghosts,
+			 sizeof(__u64) << LDLM_POOL_GHOST_BITS);
+		pl->pl_lru_ghosts = NULL;
+	}
+	return rc;
 }
 
 void ldlm_pool_fini(struct ldlm_pool *pl)
@@ -926,6 +970,9 @@ void ldlm_pool_fini(struct ldlm_pool *pl)
 	ENTRY;
 	ldlm_pool_sysfs_fini(pl);
 	ldlm_pool_proc_fini(pl);
+	if (pl->pl_lru_ghosts != NULL)
+		OBD_FREE(pl->pl_lru_ghosts,
+			 sizeof(__u64) << LDLM_POOL_GHOST_BITS);
 
         /*
          * Pool should not be used after this point. We can't free it here as
@@ -1008,6 +1055,81 @@ __u64 ldlm_pool_get_slv(struct ldlm_pool *pl)
 	return slv;
 }
 
+/**
+ * Returns the SLV expected for the next period of client pool \a pl, that
+ * is the current SLV moved by its recent trend.  The correction is bounded
+ * to half and twice the current SLV so that one big jump of the SLV does
+ * not make the LRU drop or keep everything.
+ *
+ * \pre ->pl_lock is not locked.
+ */
+__u64 ldlm_pool_get_slv_forecast(struct ldlm_pool *pl)
+{
+	__u64 slv;
+	__s64 trend;
+
+	spin_lock(&pl->pl_lock);
+	slv = pl->pl_server_lock_volume;
+	trend = pl->pl_slv_trend;
+	spin_unlock(&pl->pl_lock);
+
+	if (trend < 0)
+		return slv - min_t(__u64, -trend, slv / 2);
+	return slv + min_t(__u64, trend, slv);
+}
+
+static inline __u64 ldlm_pool_ghost_key(const struct ldlm_res_id *res_id)
+{
+	return hash_64(res_id->name[0] ^ hash_64(res_id->name[1], 64) ^
+		       res_id->name[2], 64);
+}
+
+/**
+ * Remembers that LRU lock \a lock of client pool \a pl is being cancelled
+ * so that an enqueue on the same resource shortly after is counted as a
+ * re-enqueue, see ldlm_pool_enqueue_note().
+ *
+ * The table is lossy and not locked: two resources may share a slot and
+ * racing updates may lose an entry, which only affects the statistics.
+ */
+void ldlm_pool_lru_cancel_note(struct ldlm_pool *pl, struct ldlm_lock *lock)
+{
+	__u64 key;
+
+	lprocfs_counter_incr(pl->pl_stats, LDLM_POOL_LRU_CANCEL_STAT);
+	if (pl->pl_lru_ghosts == NULL)
+		return;
+
+	key = ldlm_pool_ghost_key(&lock->l_resource->lr_name);
+	ACCESS_ONCE(pl->pl_lru_ghosts[key >> (64 - LDLM_POOL_GHOST_BITS)]) =
+		(key & 0xffffffff00000000ULL) | (__u32)ktime_get_seconds();
+}
+
+/**
+ * Checks whether the lock being enqueued on \a res_id in client pool \a pl
+ * replaces one recently cancelled from LRU, and counts it if so.
+ */
+void ldlm_pool_enqueue_note(struct ldlm_pool *pl,
+			    const struct ldlm_res_id *res_id)
+{
+	__u64 *slot;
+	__u64 ghost;
+	__u64 key;
+
+	if (pl->pl_lru_ghosts == NULL)
+		return;
+
+	key = ldlm_pool_ghost_key(res_id);
+	slot = &pl->pl_lru_ghosts[key >> (64 - LDLM_POOL_GHOST_BITS)];
+	ghost = ACCESS_ONCE(*slot);
+	if (ghost == 0 || (ghost ^ key) >> 32 != 0 ||
+	    (__u32)ktime_get_seconds() - (__u32)ghost > LDLM_POOL_GHOST_AGE)
+		return;
+
+	ACCESS_ONCE(*slot) = 0;
+	lprocfs_counter_incr(pl->pl_stats, LDLM_POOL_LRU_REENQUEUE_STAT);
+}
+
 /**
  * Sets passed \a slv to \a pl.
  *
@@ -1574,6 +1696,22 @@ __u64 ldlm_pool_get_slv(struct ldlm_pool *pl)
         return 1;
 }
 
+__u64 ldlm_pool_get_slv_forecast(struct ldlm_pool *pl)
+{
+	return 1;
+}
+
+void ldlm_pool_lru_cancel_note(struct ldlm_pool *pl, struct ldlm_lock *lock)
+{
+	return;
+}
+
+void ldlm_pool_enqueue_note(struct ldlm_pool *pl,
+			    const struct ldlm_res_id *res_id)
+{
+	return;
+}
+
 void ldlm_pool_set_slv(struct ldlm_pool *pl, __u64 slv)
 {
         return;
@@ -48,6 +48,14 @@
  * ldlm_reclaim_threshold & ldlm_lock_limit is set to 20% & 30% of the
  * total memory by default. It is tunable via proc entry, when it's set
  * to 0, the feature is disabled.
+ *
+ * The locks to revoke are ranked by the cost of losing them: each resource
+ * and each export keeps a decaying count of the recent enqueues and matches
+ * on it, and the locks of the least used resources and exports, then the
+ * longest idle ones, are revoked first. A reclaim pass only scans the
+ * namespaces for ldlm_reclaim_budget_us, and an enqueue on a resource soon
+ * after one of its locks was revoked is counted as a re-enqueue, which also
+ * makes the resource more expensive to reclaim next time.
  */
 
 #ifdef HAVE_SERVER_SUPPORT
@@ -61,19 +69,57 @@ __u64 ldlm_lock_limit;
 __u64 ldlm_reclaim_threshold_mb;
 __u64 ldlm_lock_limit_mb;
 
+#define LDLM_RECLAIM_BUDGET_DEFAULT	2000
+
+/* Max time spent scanning for locks in a reclaim pass (usec), 0 for no
+ * limit */
+unsigned int ldlm_reclaim_budget_us = LDLM_RECLAIM_BUDGET_DEFAULT;
+
 struct percpu_counter		ldlm_granted_total;
 static atomic_t			ldlm_nr_reclaimer;
 static s64			ldlm_last_reclaim_age_ns;
 static ktime_t			ldlm_last_reclaim_time;
 
+/* Reclaim statistics, see ldlm_reclaim_stats_seq_show() */
+static atomic64_t		ldlm_reclaim_revoked;
+static atomic64_t		ldlm_reclaim_reenqueued;
+static atomic64_t		ldlm_reclaim_passes;
+static atomic64_t		ldlm_reclaim_over_budget;
+
+#define LDLM_RECLAIM_BATCH	512
+
+/* Usage counts are halved every LDLM_RECLAIM_DECAY seconds */
+#define LDLM_RECLAIM_DECAY		30
+#define LDLM_RECLAIM_HITS_MAX		(1U << 24)
+/* An enqueue this soon after a lock reclaim on the resource is counted as a
+ * re-enqueue, and weights as much as LDLM_RECLAIM_REENQUEUE_HITS hits. */
+#define LDLM_RECLAIM_REENQUEUE_WINDOW	60
+#define LDLM_RECLAIM_REENQUEUE_HITS	16
+/* Locks looked at per lock to revoke, before the cheapest ones are picked */
+#define LDLM_RECLAIM_SCAN_FACTOR	4
+
+/* Lock picked for revocation, ranked by ldlm_reclaim_cost() */
+struct ldlm_reclaim_cand {
+	__u64			lrc_cost;
+	struct lustre_handle	lrc_handle;
+};
+
+/* Max-heap of the cheapest locks found by the running reclaim pass, only
+ * one pass runs at a time, see ldlm_nr_reclaimer. */
+static struct ldlm_reclaim_cand ldlm_reclaim_cands[LDLM_RECLAIM_BATCH];
+
 struct ldlm_reclaim_cb_data {
-	struct list_head	 rcd_rpc_list;
+	struct ldlm_reclaim_cand *rcd_cands;
 	int			 rcd_added;
 	int			 rcd_total;
+	int			 rcd_seen;
 	int			 rcd_cursor;
 	int			 rcd_start;
 	bool			 rcd_skip;
+	bool			 rcd_over_budget;
 	s64			 rcd_age_ns;
+	ktime_t			 rcd_now;
+	ktime_t			 rcd_deadline;
 	struct cfs_hash_bd	*rcd_prev_bd;
 };
 
@@ -92,8 +138,145 @@ static inline bool ldlm_lock_reclaimable(struct ldlm_lock *lock)
 	return false;
 }
 
+static inline __u32 ldlm_reclaim_decayed(__u32 hits, __u32 stamp, __u32 now)
+{
+	__u32 periods = (now - stamp) / LDLM_RECLAIM_DECAY;
+
+	return periods >= 32 ? 0 : hits >> periods;
+}
+
+/* The usage counts are updated without locking, a lost update only makes
+ * the ranking slightly less accurate. */
+static void ldlm_reclaim_hits_add(__u32 *hits, __u32 *stamp, __u32 now,
+				  __u32 nr)
+{
+	__u32 last = ACCESS_ONCE(*stamp);
+	__u32 val;
+
+	val = ldlm_reclaim_decayed(ACCESS_ONCE(*hits), last, now) + nr;
+	if (now - last >= LDLM_RECLAIM_DECAY)
+		ACCESS_ONCE(*stamp) = now;
+	ACCESS_ONCE(*hits) = min_t(__u32, val, LDLM_RECLAIM_HITS_MAX);
+}
+
 /**
- * Callback function for revoking locks from certain resource.
+ * Record a use of the resource \a res by the export \a exp on the server,
+ * \a enqueue is set for new lock requests, and unset for lock matches.
+ *
+ * \param [in] res	resource being used
+ * \param [in] exp	export using it, NULL for local locks
+ * \param [in] enqueue	whether a lock is being requested on \a res
+ */
+void ldlm_reclaim_hit(struct ldlm_resource *res, struct obd_export *exp,
+		      bool enqueue)
+{
+	__u32 now = ktime_get_seconds();
+	__u32 reclaimed = ACCESS_ONCE(res->lr_reclaim_time);
+	__u32 nr = 1;
+
+	if (unlikely(reclaimed != 0) && enqueue) {
+		if (now - reclaimed <= LDLM_RECLAIM_REENQUEUE_WINDOW) {
+			atomic64_inc(&ldlm_reclaim_reenqueued);
+			nr = LDLM_RECLAIM_REENQUEUE_HITS;
+		}
+		ACCESS_ONCE(res->lr_reclaim_time) = 0;
+	}
+
+	ldlm_reclaim_hits_add(&res->lr_reclaim_hits, &res->lr_reclaim_stamp,
+			      now, nr);
+	if (exp != NULL)
+		ldlm_reclaim_hits_add(&exp->exp_reclaim_hits,
+				      &exp->exp_reclaim_stamp, now, nr);
+}
+
+/**
+ * Cost of revoking \a lock: the recent usage of its resource and export in
+ * the upper 32 bits, then how recently it was used, so that among equally
+ * used locks the longest idle one is the cheapest.
+ */
+static __u64 ldlm_reclaim_cost(struct ldlm_lock *lock, ktime_t now)
+{
+	struct ldlm_resource *res = lock->l_resource;
+	struct obd_export *exp = lock->l_export;
+	__u32 sec = ktime_get_seconds();
+	__u64 hits;
+	s64 idle;
+
+	hits = ldlm_reclaim_decayed(res->lr_reclaim_hits,
+				    res->lr_reclaim_stamp, sec);
+	if (exp != NULL)
+		hits += ldlm_reclaim_decayed(exp->exp_reclaim_hits,
+					     exp->exp_reclaim_stamp, sec);
+
+	/* idle time in units of ~1s, it doesn't have to be exact */
+	idle = ktime_to_ns(ktime_sub(now, lock->l_last_used)) >> 30;
+	if (idle < 0)
+		idle = 0;
+	else if (idle > 0xffffffffLL)
+		idle = 0xffffffffLL;
+
+	return (hits << 32) | (0xffffffffULL - idle);
+}
+
+static void ldlm_reclaim_heap_down(struct ldlm_reclaim_cand *heap, int nr)
+{
+	struct ldlm_reclaim_cand tmp;
+	int i = 0;
+	int child;
+
+	while ((child = 2 * i + 1) < nr) {
+		if (child + 1 < nr &&
+		    heap[child + 1].lrc_cost > heap[child].lrc_cost)
+			child++;
+		if (heap[i].lrc_cost >= heap[child].lrc_cost)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+static void ldlm_reclaim_heap_up(struct ldlm_reclaim_cand *heap, int i)
+{
+	struct ldlm_reclaim_cand tmp;
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (heap[parent].lrc_cost >= heap[i].lrc_cost)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
+	}
+}
+
+/**
+ * Keep \a lock among the candidates if it is one of the rcd_total cheapest
+ * locks seen so far.
+ */
+static void ldlm_reclaim_cand_add(struct ldlm_reclaim_cb_data *data,
+				  struct ldlm_lock *lock)
+{
+	struct ldlm_reclaim_cand *heap = data->rcd_cands;
+	__u64 cost = ldlm_reclaim_cost(lock, data->rcd_now);
+
+	if (data->rcd_added < data->rcd_total) {
+		heap[data->rcd_added].lrc_cost = cost;
+		ldlm_lock2handle(lock, &heap[data->rcd_added].lrc_handle);
+		ldlm_reclaim_heap_up(heap, data->rcd_added);
+		data->rcd_added++;
+	} else if (cost < heap[0].lrc_cost) {
+		heap[0].lrc_cost = cost;
+		ldlm_lock2handle(lock, &heap[0].lrc_handle);
+		ldlm_reclaim_heap_down(heap, data->rcd_added);
+	}
+}
+
+/**
+ * Callback function for picking the locks to revoke from certain resource.
  *
  * \param [in] hs	ns_rs_hash
  * \param [in] bd	current bucket of ns_rsh_hash
@@ -111,13 +294,21 @@ static int ldlm_reclaim_lock_cb(struct cfs_hash *hs, struct cfs_hash_bd *bd,
 	struct ldlm_reclaim_cb_data	*data;
 	struct ldlm_lock		*lock;
 	struct ldlm_ns_bucket		*nsb;
-	int				 rc = 0;
 
 	data = (struct ldlm_reclaim_cb_data *)arg;
 
-	LASSERTF(data->rcd_added < data->rcd_total, "added:%d >= total:%d\n",
+	LASSERTF(data->rcd_added <= data->rcd_total, "added:%d > total:%d\n",
 		 data->rcd_added, data->rcd_total);
 
+	if (data->rcd_seen >= data->rcd_total * LDLM_RECLAIM_SCAN_FACTOR)
+		return 1;
+
+	if (ktime_to_ns(data->rcd_deadline) != 0 &&
+	    ktime_after(ktime_get(), data->rcd_deadline)) {
+		data->rcd_over_budget = true;
+		return 1;
+	}
+
 	nsb = cfs_hash_bd_extra_get(hs, bd);
 	res = cfs_hash_object(hs, hnode);
 
@@ -143,30 +334,66 @@ static int ldlm_reclaim_lock_cb(struct cfs_hash *hs, struct cfs_hash_bd *bd,
 			continue;
 
 		if (!OBD_FAIL_CHECK(OBD_FAIL_LDLM_WATERMARK_LOW) &&
-		    ktime_before(ktime_get(),
+		    ktime_before(data->rcd_now,
 				 ktime_add_ns(lock->l_last_used,
 					      data->rcd_age_ns)))
 			continue;
 
 		if (!ldlm_is_ast_sent(lock)) {
+			ldlm_reclaim_cand_add(data, lock);
+			data->rcd_seen++;
+		}
+	}
+	unlock_res(res);
+
+	return 0;
+}
+
+/**
+ * Revoke the locks picked by ldlm_reclaim_lock_cb(), skipping the ones which
+ * were canceled or revoked since.
+ *
+ * \retval number of locks revoked
+ */
+static int ldlm_reclaim_revoke(struct ldlm_namespace *ns,
+			       struct ldlm_reclaim_cb_data *data)
+{
+	struct list_head rpc_list = LIST_HEAD_INIT(rpc_list);
+	struct ldlm_lock *lock;
+	__u32 now = max_t(__u32, ktime_get_seconds(), 1);
+	int revoked = 0;
+	int i;
+
+	for (i = 0; i < data->rcd_added; i++) {
+		lock = ldlm_handle2lock(&data->rcd_cands[i].lrc_handle);
+		if (lock == NULL)
+			continue;
+
+		lock_res_and_lock(lock);
+		if (lock->l_granted_mode == lock->l_req_mode &&
+		    !ldlm_is_ast_sent(lock)) {
 			ldlm_set_ast_sent(lock);
 			LASSERT(list_empty(&lock->l_rk_ast));
-			list_add(&lock->l_rk_ast, &data->rcd_rpc_list);
-			LDLM_LOCK_GET(lock);
-			if (++data->rcd_added == data->rcd_total) {
-				rc = 1; /* stop the iteration */
-				break;
-			}
+			/* the reference is dropped by ldlm_run_ast_work() */
+			list_add(&lock->l_rk_ast, &rpc_list);
+			ACCESS_ONCE(lock->l_resource->lr_reclaim_time) = now;
+			unlock_res_and_lock(lock);
+			revoked++;
+			continue;
 		}
+		unlock_res_and_lock(lock);
+		LDLM_LOCK_PUT(lock);
 	}
-	unlock_res(res);
 
-	return rc;
+	ldlm_run_ast_work(ns, &rpc_list, LDLM_WORK_REVOKE_AST);
+	atomic64_add(revoked, &ldlm_reclaim_revoked);
+
+	return revoked;
 }
 
 /**
  * Revoke locks from the resources of a namespace in a roundrobin
- * manner.
+ * manner, the cheapest ones to lose among those found first.
  *
  * \param[in] ns	namespace to do the lock revoke on
  * \param[in] count	count of lock to be revoked
@@ -174,54 +401,57 @@ static int ldlm_reclaim_lock_cb(struct cfs_hash *hs, struct cfs_hash_bd *bd,
  * \param[in] skip	scan from the first lock on resource if the
  *			'skip' is false, otherwise, continue scan
  *			from the last scanned position
+ * \param[in] deadline	stop scanning at that time, 0 for no limit
  * \param[out] count	count of lock still to be revoked
+ *
+ * \retval true	the time budget of the reclaim pass was exceeded
  */
-static void ldlm_reclaim_res(struct ldlm_namespace *ns, int *count,
-			     s64 age_ns, bool skip)
+static bool ldlm_reclaim_res(struct ldlm_namespace *ns, int *count,
+			     s64 age_ns, bool skip, ktime_t deadline)
 {
 	struct ldlm_reclaim_cb_data	data;
-	int				idx, type, start;
+	int				idx, type, start, revoked;
 	ENTRY;
 
-	LASSERT(*count != 0);
+	LASSERT(*count != 0 && *count <= LDLM_RECLAIM_BATCH);
 
 	if (ns->ns_obd) {
 		type = server_name2index(ns->ns_obd->obd_name, &idx, NULL);
-		if (type != LDD_F_SV_TYPE_MDT && type != LDD_F_SV_TYPE_OST) {
-			EXIT;
-			return;
-		}
+		if (type != LDD_F_SV_TYPE_MDT && type != LDD_F_SV_TYPE_OST)
+			RETURN(false);
 	}
 
-	if (atomic_read(&ns->ns_bref) == 0) {
-		EXIT;
-		return;
-	}
+	if (atomic_read(&ns->ns_bref) == 0)
+		RETURN(false);
 
-	INIT_LIST_HEAD(&data.rcd_rpc_list);
+	data.rcd_cands = ldlm_reclaim_cands;
 	data.rcd_added = 0;
 	data.rcd_total = *count;
+	data.rcd_seen = 0;
 	data.rcd_age_ns = age_ns;
 	data.rcd_skip = skip;
+	data.rcd_over_budget = false;
+	data.rcd_now = ktime_get();
+	data.rcd_deadline = deadline;
 	data.rcd_prev_bd = NULL;
 	start = ns->ns_reclaim_start % CFS_HASH_NBKT(ns->ns_rs_hash);
 
 	cfs_hash_for_each_nolock(ns->ns_rs_hash, ldlm_reclaim_lock_cb, &data,
 				 start);
 
-	CDEBUG(D_DLMTRACE, "NS(%s): %d locks to be reclaimed, found %d/%d "
-	       "locks.\n", ldlm_ns_name(ns), *count, data.rcd_added,
-	       data.rcd_total);
+	revoked = ldlm_reclaim_revoke(ns, &data);
 
-	LASSERTF(*count >= data.rcd_added, "count:%d, added:%d\n", *count,
-		 data.rcd_added);
+	CDEBUG(D_DLMTRACE, "NS(%s): %d locks to be reclaimed, revoked %d of "
+	       "%d candidates among %d locks%s.\n", ldlm_ns_name(ns), *count,
+	       revoked, data.rcd_added, data.rcd_seen,
+	       data.rcd_over_budget ? ", over budget" : "");
 
-	ldlm_run_ast_work(ns, &data.rcd_rpc_list, LDLM_WORK_REVOKE_AST);
-	*count -= data.rcd_added;
-	EXIT;
+	LASSERTF(*count >= revoked, "count:%d, revoked:%d\n", *count, revoked);
+
+	*count -= revoked;
+	RETURN(data.rcd_over_budget);
 }
 
-#define LDLM_RECLAIM_BATCH	512
 #define LDLM_RECLAIM_AGE_MIN	(300 * NSEC_PER_SEC)
 #define LDLM_RECLAIM_AGE_MAX	(LDLM_DEFAULT_MAX_ALIVE * NSEC_PER_SEC * 3 / 4)
 
@@ -252,7 +482,10 @@ static void ldlm_reclaim_ns(void)
 	int			 ns_nr, nr_processed;
 	enum ldlm_side		 ns_cli = LDLM_NAMESPACE_SERVER;
 	s64 age_ns;
+	ktime_t			 deadline = ktime_set(0, 0);
+	unsigned int		 budget_us;
 	bool			 skip = true;
+	bool			 over_budget = false;
 	ENTRY;
 
 	if (!atomic_add_unless(&ldlm_nr_reclaimer, 1, 1)) {
@@ -260,11 +493,17 @@ static void ldlm_reclaim_ns(void)
 		return;
 	}
 
+	atomic64_inc(&ldlm_reclaim_passes);
+	budget_us = ACCESS_ONCE(ldlm_reclaim_budget_us);
+	if (budget_us != 0)
+		deadline = ktime_add_ns(ktime_get(),
+					(u64)budget_us * NSEC_PER_USEC);
+
 	age_ns = ldlm_reclaim_age();
 again:
 	nr_processed = 0;
 	ns_nr = ldlm_namespace_nr_read(ns_cli);
-	while (count > 0 && nr_processed < ns_nr) {
+	while (count > 0 && nr_processed < ns_nr && !over_budget) {
 		mutex_lock(ldlm_namespace_lock(ns_cli));
 
 		if (list_empty(ldlm_namespace_list(ns_cli))) {
@@ -276,12 +515,16 @@ again:
 		ldlm_namespace_move_to_active_locked(ns, ns_cli);
 		mutex_unlock(ldlm_namespace_lock(ns_cli));
 
-		ldlm_reclaim_res(ns, &count, age_ns, skip);
+		over_budget = ldlm_reclaim_res(ns, &count, age_ns, skip,
+					       deadline);
 		ldlm_namespace_put(ns);
 		nr_processed++;
 	}
 
-	if (count > 0 && age_ns > LDLM_RECLAIM_AGE_MIN) {
+	if (over_budget)
+		atomic64_inc(&ldlm_reclaim_over_budget);
+
+	if (count > 0 && age_ns > LDLM_RECLAIM_AGE_MIN && !over_budget) {
 		age_ns >>= 1;
 		if (age_ns < (LDLM_RECLAIM_AGE_MIN * 2))
 			age_ns = LDLM_RECLAIM_AGE_MIN;
@@ -342,6 +585,19 @@ bool ldlm_reclaim_full(void)
 	return false;
 }
 
+int ldlm_reclaim_stats_seq_show(struct seq_file *m, void *data)
+{
+	seq_printf(m, "revoked: %lld\n"
+		   "reenqueued: %lld\n"
+		   "passes: %lld\n"
+		   "over_budget: %lld\n",
+		   (long long)atomic64_read(&ldlm_reclaim_revoked),
+		   (long long)atomic64_read(&ldlm_reclaim_reenqueued),
+		   (long long)atomic64_read(&ldlm_reclaim_passes),
+		   (long long)atomic64_read(&ldlm_reclaim_over_budget));
+	return 0;
+}
+
 static inline __u64 ldlm_ratio2locknr(int ratio)
 {
 	__u64 locknr;
@@ -363,6 +619,10 @@ static inline __u64 ldlm_locknr2mb(__u64 locknr)
 int ldlm_reclaim_setup(void)
 {
 	atomic_set(&ldlm_nr_reclaimer, 0);
+	atomic64_set(&ldlm_reclaim_revoked, 0);
+	atomic64_set(&ldlm_reclaim_reenqueued, 0);
+	atomic64_set(&ldlm_reclaim_passes, 0);
+	atomic64_set(&ldlm_reclaim_over_budget, 0);
 
 	ldlm_reclaim_threshold = ldlm_ratio2locknr(LDLM_WM_RATIO_LOW_DEFAULT);
 	ldlm_reclaim_threshold_mb = ldlm_locknr2mb(ldlm_reclaim_threshold);
@@ -399,6 +659,11 @@ void ldlm_reclaim_del(struct ldlm_lock *lock)
 {
 }
 
+void ldlm_reclaim_hit(struct ldlm_resource *res, struct obd_export *exp,
+		      bool enqueue)
+{
+}
+
 int ldlm_reclaim_setup(void)
 {
 	return 0;
@@ -71,6 +71,12 @@ MODULE_PARM_DESC(ldlm_enqueue_min, "lock enqueue timeout minimum");
 /* in client side, whether the cached locks will be canceled before replay */
 unsigned int ldlm_cancel_unused_locks_before_replay = 1;
 
+/* in client side, max lock replay RPCs in flight per import */
+unsigned int ldlm_lock_replay_max_inflight = LDLM_REPLAY_MAX_INFLIGHT;
+
+/* in client side, max locks per replay RPC if the server supports it */
+unsigned int ldlm_lock_replay_batch = LDLM_REPLAY_BATCH_MAX;
+
 static void interrupted_completion_wait(void *data)
 {
 }
@@ -80,10 +86,6 @@ struct lock_wait_data {
         __u32             lwd_conn_cnt;
 };
 
-struct ldlm_async_args {
-        struct lustre_handle lock_handle;
-};
-
 /**
  * ldlm_request_bufsize
  *
@@ -216,7 +218,7 @@ int ldlm_completion_ast_async(struct ldlm_lock *lock, __u64 flags, void *data)
 	}
 
 	if (!(flags & LDLM_FL_BLOCKED_MASK)) {
-		wake_up(&lock->l_waitq);
+		wake_up_all(ldlm_lock_waitq(lock));
 		RETURN(ldlm_completion_tail(lock, data));
 	}
 
@@ -265,7 +267,7 @@ int ldlm_completion_ast(struct ldlm_lock *lock, __u64 flags, void *data)
         }
 
 	if (!(flags & LDLM_FL_BLOCKED_MASK)) {
-		wake_up(&lock->l_waitq);
+		wake_up_all(ldlm_lock_waitq(lock));
 		RETURN(0);
 	}
 
@@ -308,7 +310,7 @@ noreproc:
                 rc = -EINTR;
         } else {
                 /* Go to sleep until the lock is granted or cancelled. */
-                rc = l_wait_event(lock->l_waitq,
+                rc = l_wait_event(*ldlm_lock_waitq(lock),
                                   is_granted_or_cancelled(lock), &lwi);
         }
 
@@ -925,6 +927,7 @@ int ldlm_cli_enqueue(struct obd_export *exp, struct ptlrpc_request **reqp,
 					lvb_len, lvb_type);
 		if (IS_ERR(lock))
 			RETURN(PTR_ERR(lock));
+		ldlm_pool_enqueue_note(&ns->ns_pool, res_id);
                 /* for the local lock, add the reference */
                 ldlm_lock_addref_internal(lock, einfo->ei_mode);
                 ldlm_lock2handle(lock, lockh);
@@ -1006,6 +1009,221 @@ int ldlm_cli_enqueue(struct obd_export *exp, struct ptlrpc_request **reqp,
 }
 EXPORT_SYMBOL(ldlm_cli_enqueue);
 
+/**
+ * Finish the client-side enqueue of \a lock of a multi-resource enqueue
+ * after the server replied \a reply for it.
+ *
+ * This is ldlm_cli_enqueue_fini() for a lock without intent nor LVB that the
+ * server granted right away or refused.
+ */
+static int ldlm_cli_enqueue_multi_fini(struct obd_export *exp,
+				       struct ldlm_lock *lock,
+				       struct ldlm_reply *reply)
+{
+	struct ldlm_namespace *ns = exp->exp_obd->obd_namespace;
+	__u64 flags;
+	int rc;
+	ENTRY;
+
+	if (!lustre_handle_is_used(&reply->lock_handle)) {
+		rc = ptlrpc_status_ntoh((int)reply->lock_policy_res2);
+		LDLM_DEBUG(lock, "client-side multi-resource enqueue END "
+			   "(FAILED %d)", rc);
+		RETURN(rc ?: -EPROTO);
+	}
+
+	lock_res_and_lock(lock);
+	if (exp->exp_lock_hash) {
+		/* In the function below, .hs_keycmp resolves to
+		 * ldlm_export_lock_keycmp() */
+		/* coverity[overrun-buffer-val] */
+		cfs_hash_rehash_key(exp->exp_lock_hash,
+				    &lock->l_remote_handle,
+				    &reply->lock_handle,
+				    &lock->l_exp_hash);
+	} else {
+		lock->l_remote_handle = reply->lock_handle;
+	}
+
+	flags = ldlm_flags_from_wire(reply->lock_flags);
+	lock->l_flags |= ldlm_flags_from_wire(reply->lock_flags &
+					      LDLM_FL_INHERIT_MASK);
+	unlock_res_and_lock(lock);
+
+	/* the server never makes a lock of such an enqueue wait */
+	if (flags & LDLM_FL_BLOCKED_MASK) {
+		LDLM_ERROR(lock, "blocked lock in multi-resource enqueue");
+		RETURN(-EPROTO);
+	}
+
+	/* try_bits granted */
+	if (flags & LDLM_FL_LOCK_CHANGED)
+		ldlm_convert_policy_to_local(exp, LDLM_IBITS,
+					     &reply->lock_desc.l_policy_data,
+					     &lock->l_policy_data);
+
+	if (flags & LDLM_FL_AST_SENT) {
+		lock_res_and_lock(lock);
+		lock->l_flags |= LDLM_FL_CBPENDING | LDLM_FL_BL_AST;
+		unlock_res_and_lock(lock);
+		LDLM_DEBUG(lock, "enqueue reply includes blocking AST");
+	}
+
+	rc = ldlm_lock_enqueue(ns, &lock, NULL, &flags);
+	if (rc == ELDLM_OK && lock->l_completion_ast != NULL)
+		rc = lock->l_completion_ast(lock, flags, NULL);
+
+	LDLM_DEBUG(lock, "client-side multi-resource enqueue END");
+	RETURN(rc);
+}
+
+/**
+ * Client-side enqueue of inodebits locks on \a count resources in one RPC.
+ *
+ * The locks of \a items are enqueued on the server of \a exp without
+ * waiting for conflicting locks: a lock that cannot be granted right away
+ * fails with -EWOULDBLOCK in its lei_rc, and the caller may enqueue it again
+ * the usual way.  With LDLM_FL_ALL_OR_NOTHING in \a flags the server grants
+ * all the locks or none of them, otherwise each lock is granted or refused
+ * on its own.  Granted locks are referenced in their lei_mode and returned in
+ * lei_lockh, the callbacks and callback data are taken from \a einfo.
+ *
+ * \retval 0 if the server handled the request, check lei_rc of each item
+ * \retval -EOPNOTSUPP if the server does not support OBD_CONNECT2_MULTI_ENQUEUE
+ * \retval -EWOULDBLOCK if a lock of an all-or-nothing request conflicts
+ * \retval negative errno on failure, no lock is granted then
+ */
+int ldlm_cli_enqueue_multi(struct obd_export *exp,
+			   struct ldlm_enqueue_info *einfo,
+			   struct ldlm_enqueue_item *items, int count,
+			   __u64 flags)
+{
+	const struct ldlm_callback_suite cbs = {
+		.lcs_completion = einfo->ei_cb_cp,
+		.lcs_blocking	= einfo->ei_cb_bl,
+		.lcs_glimpse	= einfo->ei_cb_gl
+	};
+	struct ldlm_namespace *ns = exp->exp_obd->obd_namespace;
+	struct obd_import *imp = class_exp2cliimp(exp);
+	struct ldlm_request *bodies = NULL;
+	struct ldlm_reply *replies = NULL;
+	struct ldlm_reply *reply = NULL;
+	struct ldlm_request *body;
+	struct ptlrpc_request *req = NULL;
+	struct ldlm_lock **locks;
+	int rc;
+	int i;
+	ENTRY;
+
+	LASSERT(einfo->ei_type == LDLM_IBITS);
+	if (count <= 0 || count > LDLM_MULTI_ENQUEUE_MAX)
+		RETURN(-EINVAL);
+
+	if (imp == NULL || !imp_connect_multi_enqueue(imp))
+		RETURN(-EOPNOTSUPP);
+
+	OBD_ALLOC(locks, sizeof(*locks) * count);
+	if (locks == NULL)
+		RETURN(-ENOMEM);
+
+	/* create all the locks before packing the request, since the ELC
+	 * handles packed by ldlm_prep_enqueue_req() must be sent once they
+	 * are cancelled locally */
+	for (i = 0; i < count; i++) {
+		struct ldlm_enqueue_item *item = &items[i];
+		struct ldlm_lock *lock;
+
+		lock = ldlm_lock_create(ns, &item->lei_res_id, LDLM_IBITS,
+					item->lei_mode, &cbs, einfo->ei_cbdata,
+					0, LVB_T_NONE);
+		if (IS_ERR(lock))
+			GOTO(out_req, rc = PTR_ERR(lock));
+
+		ldlm_pool_enqueue_note(&ns->ns_pool, &item->lei_res_id);
+		/* for the local lock, add the reference */
+		ldlm_lock_addref_internal(lock, item->lei_mode);
+		ldlm_lock2handle(lock, &item->lei_lockh);
+		lock->l_policy_data = item->lei_policy;
+		lock->l_conn_export = exp;
+		lock->l_export = NULL;
+		lock->l_blocking_ast = einfo->ei_cb_bl;
+		lock->l_last_activity = cfs_time_current_sec();
+		locks[i] = lock;
+	}
+
+	req = ptlrpc_request_alloc(imp, &RQF_LDLM_ENQUEUE_MULTI);
+	if (req == NULL)
+		GOTO(out_req, rc = -ENOMEM);
+
+	req_capsule_set_size(&req->rq_pill, &RMF_DLM_MULTI_REQ, RCL_CLIENT,
+			     (count - 1) * sizeof(*body));
+	rc = ldlm_prep_enqueue_req(exp, req, NULL, 0);
+	if (rc != 0) {
+		ptlrpc_request_free(req);
+		req = NULL;
+		GOTO(out_req, rc);
+	}
+
+	req_capsule_set_size(&req->rq_pill, &RMF_DLM_LVB, RCL_SERVER, 0);
+	req_capsule_set_size(&req->rq_pill, &RMF_DLM_MULTI_REP, RCL_SERVER,
+			     (count - 1) * sizeof(*reply));
+	ptlrpc_request_set_replen(req);
+
+	if (count > 1)
+		bodies = req_capsule_client_get(&req->rq_pill,
+						&RMF_DLM_MULTI_REQ);
+
+	for (i = 0; i < count; i++) {
+		/* the first lock goes where a single lock enqueue puts it,
+		 * after which the ELC handles may follow */
+		if (i == 0)
+			body = req_capsule_client_get(&req->rq_pill,
+						      &RMF_DLM_REQ);
+		else
+			body = &bodies[i - 1];
+		ldlm_lock2desc(locks[i], &body->lock_desc);
+		body->lock_flags = ldlm_flags_to_wire(LDLM_FL_BLOCK_NOWAIT |
+				(i == 0 ? flags & LDLM_FL_ALL_OR_NOTHING : 0));
+		body->lock_handle[0] = items[i].lei_lockh;
+		LDLM_DEBUG(locks[i], "client-side multi-resource enqueue START, "
+			   "lock %d/%d", i + 1, count);
+	}
+
+	rc = ptlrpc_queue_wait(req);
+	if (rc == 0) {
+		reply = req_capsule_server_get(&req->rq_pill, &RMF_DLM_REP);
+		if (count > 1)
+			replies = req_capsule_server_sized_get(&req->rq_pill,
+					&RMF_DLM_MULTI_REP,
+					(count - 1) * sizeof(*reply));
+		if (reply == NULL || (count > 1 && replies == NULL))
+			rc = -EPROTO;
+	}
+
+	for (i = 0; i < count && rc == 0; i++)
+		items[i].lei_rc = ldlm_cli_enqueue_multi_fini(exp, locks[i],
+					i == 0 ? reply : &replies[i - 1]);
+	EXIT;
+out_req:
+	for (i = 0; i < count; i++) {
+		if (rc != 0)
+			items[i].lei_rc = rc;
+		if (items[i].lei_rc == 0)
+			continue;
+
+		if (locks[i] != NULL)
+			failed_lock_cleanup(ns, locks[i], items[i].lei_mode);
+		memset(&items[i].lei_lockh, 0, sizeof(items[i].lei_lockh));
+	}
+	for (i = 0; i < count && locks[i] != NULL; i++)
+		LDLM_LOCK_RELEASE(locks[i]);
+	ptlrpc_req_finished(req);
+	OBD_FREE(locks, sizeof(*locks) * count);
+
+	return rc;
+}
+EXPORT_SYMBOL(ldlm_cli_enqueue_multi);
+
 static int ldlm_cli_convert_local(struct ldlm_lock *lock, int new_mode,
                                   __u32 *flags)
 {
@@ -1493,8 +1711,17 @@ ldlm_cancel_no_wait_policy(struct ldlm_namespace *ns, struct ldlm_lock *lock,
  * \a lock in LRU for current \a LRU size \a unused, added in current
  * scan \a added and number of locks to be preferably canceled \a count.
  *
+ * The lock volume is compared with the SLV forecast for the next period
+ * rather than the last SLV received, so the client starts to shrink its LRU
+ * while the SLV is still falling and does not overshoot when it recovers.
+ * Among the locks old enough to be canceled, those which were often taken
+ * again from LRU are expected to be reused and are skipped once, with their
+ * reuse count halved, in favour of the ones behind them.
+ *
  * \retval LDLM_POLICY_KEEP_LOCK keep lock in LRU in stop scanning
  *
+ * \retval LDLM_POLICY_SKIP_LOCK keep lock in LRU for now, look at next one
+ *
  * \retval LDLM_POLICY_CANCEL_LOCK cancel lock from LRU
  */
 static enum ldlm_policy_res ldlm_cancel_lrur_policy(struct ldlm_namespace *ns,
@@ -1519,7 +1746,7 @@ static enum ldlm_policy_res ldlm_cancel_lrur_policy(struct ldlm_namespace *ns,
 			ktime_add(lock->l_last_used, ns->ns_max_age)))
 		return LDLM_POLICY_CANCEL_LOCK;
 
-	slv = ldlm_pool_get_slv(pl);
+	slv = ldlm_pool_get_slv_forecast(pl);
 	lvf = ldlm_pool_get_lvf(pl);
 	la = ktime_to_ns(ktime_sub(cur, lock->l_last_used)) / NSEC_PER_SEC;
 	lv = lvf * la * unused;
@@ -1532,7 +1759,16 @@ static enum ldlm_policy_res ldlm_cancel_lrur_policy(struct ldlm_namespace *ns,
 	if (slv == 0 || lv < slv)
 		return LDLM_POLICY_KEEP_LOCK;
 
-	return LDLM_POLICY_CANCEL_LOCK;
+	/* l_lru_reuse is read racily, it is only a hint */
+	if (div_u64(lv, 1 + lock->l_lru_reuse) >= slv)
+		return LDLM_POLICY_CANCEL_LOCK;
+
+	lock_res_and_lock(lock);
+	lock->l_lru_reuse >>= 1;
+	ldlm_lock_rotate_in_lru(lock);
+	unlock_res_and_lock(lock);
+
+	return LDLM_POLICY_SKIP_LOCK;
 }
 
 static enum ldlm_policy_res
@@ -1544,7 +1780,7 @@ ldlm_cancel_lrur_no_wait_policy(struct ldlm_namespace *ns,
 	enum ldlm_policy_res result;
 
 	result = ldlm_cancel_lrur_policy(ns, lock, unused, added, count);
-	if (result == LDLM_POLICY_KEEP_LOCK)
+	if (result != LDLM_POLICY_CANCEL_LOCK)
 		return result;
 
 	return ldlm_cancel_no_wait_policy(ns, lock, unused, added, count);
@@ -1660,6 +1896,92 @@ ldlm_cancel_lru_policy(struct ldlm_namespace *ns, enum ldlm_lru_flags lru_flags)
 	return ldlm_cancel_default_policy;
 }
 
+/**
+ * Return the first lock of LRU shard \a lls that may be canceled, called
+ * with lls_lock held.
+ *
+ * Locks used since they were added to LRU are moved to the tail of the
+ * shard, once, instead of being canceled. Locks being canceled already
+ * are removed from LRU on the way.
+ */
+static struct ldlm_lock *ldlm_lru_shard_first(struct ldlm_lru_shard *lls,
+					      bool no_wait)
+{
+	struct ldlm_lock *lock, *next;
+	int nr = lls->lls_nr;
+
+	list_for_each_entry_safe(lock, next, &lls->lls_list, l_lru) {
+		/* No locks which got blocking requests. */
+		LASSERT(!ldlm_is_bl_ast(lock));
+
+		if (no_wait && ldlm_is_skipped(lock))
+			/* already processed */
+			continue;
+
+		/* Somebody is already doing CANCEL. No need for this
+		 * lock in LRU, do not traverse it again. */
+		if (ldlm_is_canceling(lock)) {
+			ldlm_lock_remove_from_lru_nolock(lock);
+			continue;
+		}
+
+		/* Give recently used locks a second chance, rotated locks
+		 * are seen again at the end of the list so only do that
+		 * until the whole list was looked at once */
+		if (lock->l_lru_ref && nr-- > 0) {
+			lock->l_lru_ref = 0;
+			list_move_tail(&lock->l_lru, &lls->lls_list);
+			continue;
+		}
+
+		return lock;
+	}
+
+	return NULL;
+}
+
+/**
+ * Find the least recently used lock of namespace \a ns which may be
+ * canceled, that is the oldest of the first locks of every LRU shard.
+ *
+ * \retval lock with a reference held, its l_last_used is returned in
+ *	   \a last_use
+ * \retval NULL if there are no locks left to look at
+ */
+static struct ldlm_lock *ldlm_lru_first(struct ldlm_namespace *ns,
+					bool no_wait, ktime_t *last_use)
+{
+	struct ldlm_lock *oldest = NULL;
+	struct ldlm_lru_shard *lls;
+	struct ldlm_lock *lock;
+	ktime_t used;
+	int i;
+
+	cfs_percpt_for_each(lls, i, ns->ns_lru) {
+		if (lls->lls_nr == 0)
+			continue;
+
+		spin_lock(&lls->lls_lock);
+		lock = ldlm_lru_shard_first(lls, no_wait);
+		if (lock == NULL ||
+		    (oldest != NULL &&
+		     !ktime_before(lock->l_last_used, *last_use))) {
+			spin_unlock(&lls->lls_lock);
+			continue;
+		}
+		used = lock->l_last_used;
+		LDLM_LOCK_GET(lock);
+		spin_unlock(&lls->lls_lock);
+
+		if (oldest != NULL)
+			LDLM_LOCK_RELEASE(oldest);
+		oldest = lock;
+		*last_use = used;
+	}
+
+	return oldest;
+}
+
 /**
  * - Free space in LRU for \a count new locks,
  *   redundant unused locks are canceled locally;
@@ -1702,13 +2024,12 @@ static int ldlm_prepare_lru_list(struct ldlm_namespace *ns,
 				 enum ldlm_lru_flags lru_flags)
 {
 	ldlm_cancel_lru_policy_t pf;
-	struct ldlm_lock *lock, *next;
+	struct ldlm_lock *lock;
 	int added = 0, unused, remained;
-	int no_wait = lru_flags & LDLM_LRU_FLAG_NO_WAIT;
+	bool no_wait = lru_flags & LDLM_LRU_FLAG_NO_WAIT;
 	ENTRY;
 
-	spin_lock(&ns->ns_lock);
-	unused = ns->ns_nr_unused;
+	unused = ldlm_ns_nr_unused(ns);
 	remained = unused;
 
 	if (!ns_connect_lru_resize(ns))
@@ -1717,7 +2038,7 @@ static int ldlm_prepare_lru_list(struct ldlm_namespace *ns,
 	pf = ldlm_cancel_lru_policy(ns, lru_flags);
 	LASSERT(pf != NULL);
 
-	while (!list_empty(&ns->ns_unused_list)) {
+	while (1) {
 		enum ldlm_policy_res result;
 		ktime_t last_use = ktime_set(0, 0);
 
@@ -1729,29 +2050,10 @@ static int ldlm_prepare_lru_list(struct ldlm_namespace *ns,
 		if (max && added >= max)
 			break;
 
-		list_for_each_entry_safe(lock, next, &ns->ns_unused_list,
-					 l_lru) {
-			/* No locks which got blocking requests. */
-			LASSERT(!ldlm_is_bl_ast(lock));
-
-			if (no_wait && ldlm_is_skipped(lock))
-				/* already processed */
-				continue;
-
-			last_use = lock->l_last_used;
-
-			/* Somebody is already doing CANCEL. No need for this
-			 * lock in LRU, do not traverse it again. */
-			if (!ldlm_is_canceling(lock))
-				break;
-
-			ldlm_lock_remove_from_lru_nolock(lock);
-		}
-		if (&lock->l_lru == &ns->ns_unused_list)
+		lock = ldlm_lru_first(ns, no_wait, &last_use);
+		if (lock == NULL)
 			break;
 
-		LDLM_LOCK_GET(lock);
-		spin_unlock(&ns->ns_lock);
 		lu_ref_add(&lock->l_reference, __FUNCTION__, current);
 
 		/* Pass the lock through the policy filter and see if it
@@ -1772,14 +2074,12 @@ static int ldlm_prepare_lru_list(struct ldlm_namespace *ns,
 			lu_ref_del(&lock->l_reference,
 				   __FUNCTION__, current);
 			LDLM_LOCK_RELEASE(lock);
-			spin_lock(&ns->ns_lock);
 			break;
 		}
 		if (result == LDLM_POLICY_SKIP_LOCK) {
 			lu_ref_del(&lock->l_reference,
 				   __func__, current);
 			LDLM_LOCK_RELEASE(lock);
-			spin_lock(&ns->ns_lock);
 			continue;
 		}
 
@@ -1796,7 +2096,6 @@ static int ldlm_prepare_lru_list(struct ldlm_namespace *ns,
 			unlock_res_and_lock(lock);
 			lu_ref_del(&lock->l_reference, __FUNCTION__, current);
 			LDLM_LOCK_RELEASE(lock);
-			spin_lock(&ns->ns_lock);
 			continue;
 		}
 		LASSERT(!lock->l_readers && !lock->l_writers);
@@ -1831,11 +2130,10 @@ static int ldlm_prepare_lru_list(struct ldlm_namespace *ns,
 		list_add(&lock->l_bl_ast, cancels);
 		unlock_res_and_lock(lock);
 		lu_ref_del(&lock->l_reference, __FUNCTION__, current);
-		spin_lock(&ns->ns_lock);
+		ldlm_pool_lru_cancel_note(&ns->ns_pool, lock);
 		added++;
 		unused--;
 	}
-	spin_unlock(&ns->ns_lock);
 	RETURN(added);
 }
 
@@ -2205,80 +2503,136 @@ static int ldlm_chain_lock_for_replay(struct ldlm_lock *lock, void *closure)
         return LDLM_ITER_CONTINUE;
 }
 
-static int replay_lock_interpret(const struct lu_env *env,
-				 struct ptlrpc_request *req,
-				 struct ldlm_async_args *aa, int rc)
+/**
+ * Lock replay of one import, the locks are sent in up to
+ * ldlm_lock_replay_max_inflight RPCs at a time, each new one being sent
+ * when a reply comes back.
+ */
+struct ldlm_replay_set {
+	struct obd_import	*lrs_imp;
+	spinlock_t		 lrs_lock;
+	/* locks left to replay, linked by l_pending_chain */
+	struct list_head	 lrs_list;
+	/* max locks per RPC, 1 if the server cannot take more */
+	int			 lrs_batch;
+	/* replay RPCs in flight */
+	int			 lrs_inflight;
+	/* threads in ldlm_replay_next() */
+	int			 lrs_users;
+	/* first error, no more locks are sent once it is set */
+	int			 lrs_rc;
+	/* lrs_list is empty, the import replay reference is dropped */
+	unsigned int		 lrs_drained:1;
+};
+
+struct ldlm_replay_args {
+	struct ldlm_replay_set	*ra_set;
+	/* handle of the lock in RMF_DLM_REQ */
+	struct lustre_handle	 ra_handle;
+};
+
+static int ldlm_replay_next(struct ldlm_replay_set *set, bool rpc_done,
+			    int rc);
+
+/**
+ * Records the server handle \a reply of the replayed lock \a lockh.
+ */
+static int replay_lock_update(struct ptlrpc_request *req,
+			      const struct lustre_handle *lockh,
+			      const struct ldlm_reply *reply)
 {
 	struct ldlm_lock     *lock;
-	struct ldlm_reply    *reply;
 	struct obd_export    *exp;
 
-	ENTRY;
-	atomic_dec(&req->rq_import->imp_replay_inflight);
-	if (rc != ELDLM_OK)
-		GOTO(out, rc);
-
-        reply = req_capsule_server_get(&req->rq_pill, &RMF_DLM_REP);
-        if (reply == NULL)
-                GOTO(out, rc = -EPROTO);
-
-        lock = ldlm_handle2lock(&aa->lock_handle);
-        if (!lock) {
+	lock = ldlm_handle2lock(lockh);
+	if (!lock) {
 		CERROR("received replay ack for unknown local cookie %#llx"
 		       " remote cookie %#llx from server %s id %s\n",
-                       aa->lock_handle.cookie, reply->lock_handle.cookie,
-                       req->rq_export->exp_client_uuid.uuid,
-                       libcfs_id2str(req->rq_peer));
-                GOTO(out, rc = -ESTALE);
-        }
+		       lockh->cookie, reply->lock_handle.cookie,
+		       req->rq_export->exp_client_uuid.uuid,
+		       libcfs_id2str(req->rq_peer));
+		return -ESTALE;
+	}
 
-        /* Key change rehash lock in per-export hash with new key */
-        exp = req->rq_export;
-        if (exp && exp->exp_lock_hash) {
+	/* Key change rehash lock in per-export hash with new key */
+	exp = req->rq_export;
+	if (exp && exp->exp_lock_hash) {
 		/* In the function below, .hs_keycmp resolves to
 		 * ldlm_export_lock_keycmp() */
 		/* coverity[overrun-buffer-val] */
-                cfs_hash_rehash_key(exp->exp_lock_hash,
-                                    &lock->l_remote_handle,
-                                    &reply->lock_handle,
-                                    &lock->l_exp_hash);
-        } else {
-                lock->l_remote_handle = reply->lock_handle;
-        }
-
-        LDLM_DEBUG(lock, "replayed lock:");
-        ptlrpc_import_recovery_state_machine(req->rq_import);
-        LDLM_LOCK_PUT(lock);
-out:
-        if (rc != ELDLM_OK)
-                ptlrpc_connect_import(req->rq_import);
+		cfs_hash_rehash_key(exp->exp_lock_hash,
+				    &lock->l_remote_handle,
+				    &reply->lock_handle,
+				    &lock->l_exp_hash);
+	} else {
+		lock->l_remote_handle = reply->lock_handle;
+	}
 
-        RETURN(rc);
+	LDLM_DEBUG(lock, "replayed lock:");
+	LDLM_LOCK_PUT(lock);
+	return 0;
 }
 
-static int replay_one_lock(struct obd_import *imp, struct ldlm_lock *lock)
+static int replay_lock_interpret(const struct lu_env *env,
+				 struct ptlrpc_request *req,
+				 struct ldlm_replay_args *ra, int rc)
 {
-        struct ptlrpc_request *req;
-        struct ldlm_async_args *aa;
-        struct ldlm_request   *body;
-        int flags;
-        ENTRY;
+	struct obd_import    *imp = req->rq_import;
+	struct ldlm_request  *reqs;
+	struct ldlm_reply    *reply;
+	struct ldlm_reply    *replies;
+	int		      nr = 0;
+	int		      i;
 
+	ENTRY;
+	atomic_dec(&imp->imp_replay_inflight);
+	if (rc != ELDLM_OK)
+		GOTO(out, rc);
 
-        /* Bug 11974: Do not replay a lock which is actively being canceled */
-	if (ldlm_is_bl_done(lock)) {
-                LDLM_DEBUG(lock, "Not replaying canceled lock:");
-                RETURN(0);
-        }
+	reply = req_capsule_server_get(&req->rq_pill, &RMF_DLM_REP);
+	if (reply == NULL)
+		GOTO(out, rc = -EPROTO);
 
-        /* If this is reply-less callback lock, we cannot replay it, since
-         * server might have long dropped it, but notification of that event was
-         * lost by network. (and server granted conflicting lock already) */
-	if (ldlm_is_cancel_on_block(lock)) {
-                LDLM_DEBUG(lock, "Not replaying reply-less lock:");
-                ldlm_lock_cancel(lock);
-                RETURN(0);
-        }
+	rc = replay_lock_update(req, &ra->ra_handle, reply);
+	if (rc != 0)
+		GOTO(out, rc);
+
+	if (req_capsule_has_field(&req->rq_pill, &RMF_DLM_REPLAY_REQ,
+				  RCL_CLIENT))
+		nr = req_capsule_get_size(&req->rq_pill, &RMF_DLM_REPLAY_REQ,
+					  RCL_CLIENT) / sizeof(*reqs);
+	if (nr == 0)
+		GOTO(out, rc);
+
+	reqs = req_capsule_client_get(&req->rq_pill, &RMF_DLM_REPLAY_REQ);
+	replies = req_capsule_server_sized_get(&req->rq_pill,
+					       &RMF_DLM_REPLAY_REP,
+					       nr * sizeof(*replies));
+	if (reqs == NULL || replies == NULL)
+		GOTO(out, rc = -EPROTO);
+
+	for (i = 0; i < nr; i++) {
+		rc = replay_lock_update(req, &reqs[i].lock_handle[0],
+					&replies[i]);
+		if (rc != 0)
+			break;
+	}
+out:
+	rc = ldlm_replay_next(ra->ra_set, true, rc);
+	if (rc != ELDLM_OK)
+		ptlrpc_connect_import(imp);
+	else
+		ptlrpc_import_recovery_state_machine(imp);
+
+	RETURN(rc);
+}
+
+/**
+ * Fills the replay request \a body for \a lock.
+ */
+static void replay_lock_pack(struct ldlm_lock *lock, struct ldlm_request *body)
+{
+	int flags;
 
         /*
          * If granted mode matches the requested mode, this lock is granted.
@@ -2303,23 +2657,101 @@ static int replay_one_lock(struct obd_import *imp, struct ldlm_lock *lock)
         else
                 flags = LDLM_FL_REPLAY;
 
-        req = ptlrpc_request_alloc_pack(imp, &RQF_LDLM_ENQUEUE,
-                                        LUSTRE_DLM_VERSION, LDLM_ENQUEUE);
-        if (req == NULL)
-                RETURN(-ENOMEM);
+        ldlm_lock2desc(lock, &body->lock_desc);
+	body->lock_flags = ldlm_flags_to_wire(flags);
+        ldlm_lock2handle(lock, &body->lock_handle[0]);
+
+	LDLM_DEBUG(lock, "replaying lock:");
+}
+
+/**
+ * Checks whether \a lock still needs to be replayed.
+ */
+static bool replay_lock_needed(struct ldlm_lock *lock)
+{
+        /* Bug 11974: Do not replay a lock which is actively being canceled */
+	if (ldlm_is_bl_done(lock)) {
+                LDLM_DEBUG(lock, "Not replaying canceled lock:");
+		return false;
+        }
+
+        /* If this is reply-less callback lock, we cannot replay it, since
+         * server might have long dropped it, but notification of that event was
+         * lost by network. (and server granted conflicting lock already) */
+	if (ldlm_is_cancel_on_block(lock)) {
+                LDLM_DEBUG(lock, "Not replaying reply-less lock:");
+                ldlm_lock_cancel(lock);
+		return false;
+        }
+
+	return true;
+}
+
+/**
+ * Sends one replay RPC for the \a nr locks in \a locks of \a set, all in one
+ * RPC if the server supports OBD_CONNECT2_LOCK_REPLAY_BATCH.  The lock
+ * references are dropped.
+ *
+ * \retval 1 the RPC was sent
+ * \retval 0 no lock needed to be replayed
+ * \retval negative errno
+ */
+static int replay_lock_batch(struct ldlm_replay_set *set,
+			     struct ldlm_lock **locks, int nr)
+{
+	struct obd_import *imp = set->lrs_imp;
+	struct ptlrpc_request *req;
+	struct ldlm_replay_args *ra;
+	struct ldlm_request *body;
+	int rc = 0;
+	int i, j;
+	ENTRY;
+
+	for (i = 0, j = 0; i < nr; i++) {
+		if (replay_lock_needed(locks[i]))
+			locks[j++] = locks[i];
+		else
+			LDLM_LOCK_RELEASE(locks[i]);
+	}
+	nr = j;
+	if (nr == 0)
+		RETURN(0);
+
+	req = ptlrpc_request_alloc(imp, nr > 1 ?
+				   &RQF_LDLM_ENQUEUE_REPLAY_BATCH :
+				   &RQF_LDLM_ENQUEUE);
+	if (req == NULL)
+		GOTO(out, rc = -ENOMEM);
+
+	if (nr > 1) {
+		req_capsule_set_size(&req->rq_pill, &RMF_DLM_REPLAY_REQ,
+				     RCL_CLIENT, (nr - 1) * sizeof(*body));
+		req_capsule_set_size(&req->rq_pill, &RMF_DLM_REPLAY_REP,
+				     RCL_SERVER,
+				     (nr - 1) * sizeof(struct ldlm_reply));
+	}
+
+	rc = ptlrpc_request_pack(req, LUSTRE_DLM_VERSION, LDLM_ENQUEUE);
+	if (rc) {
+		ptlrpc_request_free(req);
+		GOTO(out, rc);
+	}
 
         /* We're part of recovery, so don't wait for it. */
         req->rq_send_state = LUSTRE_IMP_REPLAY_LOCKS;
 
-        body = req_capsule_client_get(&req->rq_pill, &RMF_DLM_REQ);
-        ldlm_lock2desc(lock, &body->lock_desc);
-	body->lock_flags = ldlm_flags_to_wire(flags);
-
-        ldlm_lock2handle(lock, &body->lock_handle[0]);
-	if (lock->l_lvb_len > 0)
+	body = req_capsule_client_get(&req->rq_pill, &RMF_DLM_REQ);
+	replay_lock_pack(locks[0], body);
+	if (nr > 1) {
+		body = req_capsule_client_get(&req->rq_pill,
+					      &RMF_DLM_REPLAY_REQ);
+		for (i = 1; i < nr; i++)
+			replay_lock_pack(locks[i], &body[i - 1]);
+	} else if (locks[0]->l_lvb_len > 0) {
 		req_capsule_extend(&req->rq_pill, &RQF_LDLM_ENQUEUE_LVB);
+	}
 	req_capsule_set_size(&req->rq_pill, &RMF_DLM_LVB, RCL_SERVER,
-			     lock->l_lvb_len);
+			     locks[0]->l_lvb_len);
         ptlrpc_request_set_replen(req);
         /* notify the server we've replayed all requests.
          * also, we mark the request to be put on a dedicated
@@ -2327,16 +2759,104 @@ static int replay_one_lock(struct obd_import *imp, struct ldlm_lock *lock)
          * bug 6063 */
 	lustre_msg_set_flags(req->rq_reqmsg, MSG_REQ_REPLAY_DONE);
 
-	LDLM_DEBUG(lock, "replaying lock:");
-
-	atomic_inc(&req->rq_import->imp_replay_inflight);
-	CLASSERT(sizeof(*aa) <= sizeof(req->rq_async_args));
-	aa = ptlrpc_req_async_args(req);
-	aa->lock_handle = body->lock_handle[0];
+	atomic_inc(&imp->imp_replay_inflight);
+	CLASSERT(sizeof(*ra) <= sizeof(req->rq_async_args));
+	ra = ptlrpc_req_async_args(req);
+	ra->ra_set = set;
+	ldlm_lock2handle(locks[0], &ra->ra_handle);
 	req->rq_interpret_reply = (ptlrpc_interpterer_t)replay_lock_interpret;
 	ptlrpcd_add_req(req);
+	rc = 1;
+	EXIT;
+out:
+	for (i = 0; i < nr; i++)
+		LDLM_LOCK_RELEASE(locks[i]);
 
-	RETURN(0);
+	return rc;
+}
+
+/**
+ * Sends replay RPCs for the locks left in \a set until
+ * ldlm_lock_replay_max_inflight of them are in flight.  Called when the
+ * replay starts, and with \a rpc_done set when the reply of a replay RPC
+ * came back with status \a rc.
+ *
+ * When all the locks were sent the import replay reference held by \a set
+ * is dropped, and \a set is freed once the last reply has been handled.
+ *
+ * \retval 0 or the first error of the lock replay
+ */
+static int ldlm_replay_next(struct ldlm_replay_set *set, bool rpc_done,
+			    int rc)
+{
+	struct ldlm_lock *locks[LDLM_REPLAY_BATCH_MAX];
+	struct list_head drop = LIST_HEAD_INIT(drop);
+	struct obd_import *imp = set->lrs_imp;
+	struct ldlm_lock *lock, *next;
+	bool drained = false;
+	bool done;
+	int nr;
+
+	spin_lock(&set->lrs_lock);
+	if (rpc_done)
+		set->lrs_inflight--;
+	if (rc != 0 && set->lrs_rc == 0)
+		set->lrs_rc = rc;
+	set->lrs_users++;
+
+	while (set->lrs_rc == 0 && !list_empty(&set->lrs_list) &&
+	       set->lrs_inflight < max_t(int, ldlm_lock_replay_max_inflight,
+					 1)) {
+		/* don't replay more if we disconnected in the middle */
+		if (imp->imp_state != LUSTRE_IMP_REPLAY_LOCKS) {
+			set->lrs_rc = -ENOTCONN;
+			break;
+		}
+
+		for (nr = 0; nr < set->lrs_batch &&
+			     !list_empty(&set->lrs_list); nr++) {
+			lock = list_entry(set->lrs_list.next, struct ldlm_lock,
+					  l_pending_chain);
+			list_del_init(&lock->l_pending_chain);
+			locks[nr] = lock;
+		}
+		set->lrs_inflight++;
+		spin_unlock(&set->lrs_lock);
+
+		rc = replay_lock_batch(set, locks, nr);
+
+		spin_lock(&set->lrs_lock);
+		if (rc <= 0)
+			set->lrs_inflight--;
+		if (rc < 0 && set->lrs_rc == 0)
+			set->lrs_rc = rc;
+	}
+
+	if (set->lrs_rc != 0)
+		list_splice_init(&set->lrs_list, &drop);
+	if (list_empty(&set->lrs_list) && !set->lrs_drained) {
+		set->lrs_drained = 1;
+		drained = true;
+	}
+	rc = set->lrs_rc;
+	set->lrs_users--;
+	done = set->lrs_drained && set->lrs_inflight == 0 &&
+	       set->lrs_users == 0;
+	spin_unlock(&set->lrs_lock);
+
+	list_for_each_entry_safe(lock, next, &drop, l_pending_chain) {
+		list_del_init(&lock->l_pending_chain);
+		LDLM_LOCK_RELEASE(lock);
+	}
+
+	if (drained)
+		atomic_dec(&imp->imp_replay_inflight);
+	if (done) {
+		class_import_put(imp);
+		OBD_FREE_PTR(set);
+	}
+
+	return rc;
 }
 
 /**
@@ -2356,13 +2876,13 @@ static void ldlm_cancel_unused_locks_for_replay(struct ldlm_namespace *ns)
 
 	CDEBUG(D_DLMTRACE, "Dropping as many unused locks as possible before"
 			   "replay for namespace %s (%d)\n",
-			   ldlm_ns_name(ns), ns->ns_nr_unused);
+			   ldlm_ns_name(ns), ldlm_ns_nr_unused(ns));
 
 	/* We don't need to care whether or not LRU resize is enabled
 	 * because the LDLM_LRU_FLAG_NO_WAIT policy doesn't use the
 	 * count parameter */
-	canceled = ldlm_cancel_lru_local(ns, &cancels, ns->ns_nr_unused, 0,
-					 LCF_LOCAL, LDLM_LRU_FLAG_NO_WAIT);
+	canceled = ldlm_cancel_lru_local(ns, &cancels, ldlm_ns_nr_unused(ns),
+					 0, LCF_LOCAL, LDLM_LRU_FLAG_NO_WAIT);
 
 	CDEBUG(D_DLMTRACE, "Canceled %d unused locks from namespace %s\n",
 			   canceled, ldlm_ns_name(ns));
@@ -2371,9 +2891,10 @@ static void ldlm_cancel_unused_locks_for_replay(struct ldlm_namespace *ns)
 int ldlm_replay_locks(struct obd_import *imp)
 {
 	struct ldlm_namespace *ns = imp->imp_obd->obd_namespace;
-	struct list_head list = LIST_HEAD_INIT(list);
-	struct ldlm_lock *lock, *next;
-	int rc = 0;
+	struct ldlm_replay_set *set;
+	struct ldlm_lock *lock;
+	int nr = 0;
+	int rc;
 
 	ENTRY;
 
@@ -2383,25 +2904,33 @@ int ldlm_replay_locks(struct obd_import *imp)
 	if (imp->imp_vbr_failed)
 		RETURN(0);
 
-	/* ensure this doesn't fall to 0 before all have been queued */
+	OBD_ALLOC_PTR(set);
+	if (set == NULL)
+		RETURN(-ENOMEM);
+
+	spin_lock_init(&set->lrs_lock);
+	INIT_LIST_HEAD(&set->lrs_list);
+	set->lrs_imp = class_import_get(imp);
+	set->lrs_batch = 1;
+	if (imp_connect_lock_replay_batch(imp))
+		set->lrs_batch = clamp_t(int, ldlm_lock_replay_batch, 1,
+					 LDLM_REPLAY_BATCH_MAX);
+
+	/* ensure this doesn't fall to 0 before all have been queued,
+	 * dropped by ldlm_replay_next() once the list is empty */
 	atomic_inc(&imp->imp_replay_inflight);
 
 	if (ldlm_cancel_unused_locks_before_replay)
 		ldlm_cancel_unused_locks_for_replay(ns);
 
-	ldlm_namespace_foreach(ns, ldlm_chain_lock_for_replay, &list);
+	ldlm_namespace_foreach(ns, ldlm_chain_lock_for_replay, &set->lrs_list);
+	list_for_each_entry(lock, &set->lrs_list, l_pending_chain)
+		nr++;
 
-	list_for_each_entry_safe(lock, next, &list, l_pending_chain) {
-		list_del_init(&lock->l_pending_chain);
-		if (rc) {
-			LDLM_LOCK_RELEASE(lock);
-			continue; /* or try to do the rest? */
-		}
-		rc = replay_one_lock(imp, lock);
-		LDLM_LOCK_RELEASE(lock);
-	}
+	CDEBUG(D_HA, "%s: replaying %d locks, up to %d per RPC\n",
+	       imp->imp_obd->obd_name, nr, set->lrs_batch);
 
-	atomic_dec(&imp->imp_replay_inflight);
+	rc = ldlm_replay_next(set, false, 0);
 
 	RETURN(rc);
 }
@@ -176,6 +176,9 @@ static const struct file_operations ldlm_granted_fops = {
 	.release = seq_release,
 };
 
+LPROC_SEQ_FOPS_RO(ldlm_waiting_locks_stats);
+LPROC_SEQ_FOPS_RO(ldlm_reclaim_stats);
+
 #endif /* HAVE_SERVER_SUPPORT */
 
 int ldlm_proc_setup(void)
@@ -198,6 +201,13 @@ int ldlm_proc_setup(void)
 		{ .name =	"lock_granted_count",
 		  .fops =	&ldlm_granted_fops,
 		  .data =	&ldlm_granted_total },
+		{ .name =	"waiting_locks_stats",
+		  .fops =	&ldlm_waiting_locks_stats_fops },
+		{ .name =	"lock_reclaim_budget_us",
+		  .fops =	&ldlm_rw_uint_fops,
+		  .data =	&ldlm_reclaim_budget_us },
+		{ .name =	"lock_reclaim_stats",
+		  .fops =	&ldlm_reclaim_stats_fops },
 #endif
 		{ NULL }};
 	ENTRY;
@@ -297,7 +307,7 @@ static ssize_t lock_unused_count_show(struct kobject *kobj,
 	struct ldlm_namespace *ns = container_of(kobj, struct ldlm_namespace,
 						 ns_kobj);
 
-	return sprintf(buf, "%d\n", ns->ns_nr_unused);
+	return sprintf(buf, "%d\n", ldlm_ns_nr_unused(ns));
 }
 LUSTRE_RO_ATTR(lock_unused_count);
 
@@ -306,11 +316,11 @@ static ssize_t lru_size_show(struct kobject *kobj, struct attribute *attr,
 {
 	struct ldlm_namespace *ns = container_of(kobj, struct ldlm_namespace,
 						 ns_kobj);
-	__u32 *nr = &ns->ns_max_unused;
+	__u32 nr = ns->ns_max_unused;
 
 	if (ns_connect_lru_resize(ns))
-		nr = &ns->ns_nr_unused;
-	return sprintf(buf, "%u\n", *nr);
+		nr = ldlm_ns_nr_unused(ns);
+	return sprintf(buf, "%u\n", nr);
 }
 
 static ssize_t lru_size_store(struct kobject *kobj, struct attribute *attr,
@@ -327,8 +337,8 @@ static ssize_t lru_size_store(struct kobject *kobj, struct attribute *attr,
                        "dropping all unused locks from namespace %s\n",
                        ldlm_ns_name(ns));
                 if (ns_connect_lru_resize(ns)) {
-			/* Try to cancel all @ns_nr_unused locks. */
-			ldlm_cancel_lru(ns, ns->ns_nr_unused, 0,
+			/* Try to cancel all unused locks. */
+			ldlm_cancel_lru(ns, ldlm_ns_nr_unused(ns), 0,
 					LDLM_LRU_FLAG_PASSED |
 					LDLM_LRU_FLAG_CLEANUP);
 		} else {
@@ -349,17 +359,18 @@ static ssize_t lru_size_store(struct kobject *kobj, struct attribute *attr,
 	lru_resize = (tmp == 0);
 
 	if (ns_connect_lru_resize(ns)) {
+		int unused = ldlm_ns_nr_unused(ns);
+
 		if (!lru_resize)
 			ns->ns_max_unused = (unsigned int)tmp;
 
-		if (tmp > ns->ns_nr_unused)
-			tmp = ns->ns_nr_unused;
-		tmp = ns->ns_nr_unused - tmp;
+		if (tmp > unused)
+			tmp = unused;
+		tmp = unused - tmp;
 
 		CDEBUG(D_DLMTRACE,
 		       "changing namespace %s unused locks from %u to %u\n",
-		       ldlm_ns_name(ns), ns->ns_nr_unused,
-		       (unsigned int)tmp);
+		       ldlm_ns_name(ns), unused, (unsigned int)tmp);
 		ldlm_cancel_lru(ns, tmp, LCF_ASYNC, LDLM_LRU_FLAG_PASSED);
 
 		if (!lru_resize) {
@@ -587,6 +598,34 @@ static ssize_t contended_locks_store(struct kobject *kobj,
 }
 LUSTRE_RW_ATTR(contended_locks);
 
+static ssize_t contended_extent_align_show(struct kobject *kobj,
+					   struct attribute *attr, char *buf)
+{
+	struct ldlm_namespace *ns = container_of(kobj, struct ldlm_namespace,
+						 ns_kobj);
+
+	return sprintf(buf, "%u\n", ns->ns_contended_extent_align);
+}
+
+static ssize_t contended_extent_align_store(struct kobject *kobj,
+					    struct attribute *attr,
+					    const char *buffer, size_t count)
+{
+	struct ldlm_namespace *ns = container_of(kobj, struct ldlm_namespace,
+						 ns_kobj);
+	unsigned long tmp;
+	int err;
+
+	err = kstrtoul(buffer, 10, &tmp);
+	if (err != 0)
+		return -EINVAL;
+
+	ns->ns_contended_extent_align = !!tmp;
+
+	return count;
+}
+LUSTRE_RW_ATTR(contended_extent_align);
+
 static ssize_t max_parallel_ast_show(struct kobject *kobj,
 				     struct attribute *attr, char *buf)
 {
@@ -631,6 +670,7 @@ static struct attribute *ldlm_ns_attrs[] = {
 	&lustre_attr_max_nolock_bytes.attr,
 	&lustre_attr_contention_seconds.attr,
 	&lustre_attr_contended_locks.attr,
+	&lustre_attr_contended_extent_align.attr,
 	&lustre_attr_max_parallel_ast.attr,
 #endif
 	NULL,
@@ -877,6 +917,7 @@ struct ldlm_namespace *ldlm_namespace_new(struct obd_device *obd, char *name,
 					  enum ldlm_ns_type ns_type)
 {
 	struct ldlm_namespace *ns = NULL;
+	struct ldlm_lru_shard *lls;
 	struct ldlm_ns_bucket *nsb;
 	struct ldlm_ns_hash_def *nsd;
 	struct cfs_hash_bd bd;
@@ -907,6 +948,15 @@ struct ldlm_namespace *ldlm_namespace_new(struct obd_device *obd, char *name,
         if (!ns)
                 GOTO(out_ref, NULL);
 
+	ns->ns_lru = cfs_percpt_alloc(cfs_cpt_table, sizeof(*lls));
+	if (ns->ns_lru == NULL)
+		GOTO(out_ns, NULL);
+
+	cfs_percpt_for_each(lls, idx, ns->ns_lru) {
+		spin_lock_init(&lls->lls_lock);
+		INIT_LIST_HEAD(&lls->lls_list);
+	}
+
         ns->ns_rs_hash = cfs_hash_create(name,
                                          nsd->nsd_all_bits, nsd->nsd_all_bits,
                                          nsd->nsd_bkt_bits, sizeof(*nsb),
@@ -932,7 +982,6 @@ struct ldlm_namespace *ldlm_namespace_new(struct obd_device *obd, char *name,
         ns->ns_client   = client;
 
 	INIT_LIST_HEAD(&ns->ns_list_chain);
-	INIT_LIST_HEAD(&ns->ns_unused_list);
 	spin_lock_init(&ns->ns_lock);
 	atomic_set(&ns->ns_bref, 0);
 	init_waitqueue_head(&ns->ns_waitq);
@@ -940,9 +989,9 @@ struct ldlm_namespace *ldlm_namespace_new(struct obd_device *obd, char *name,
 	ns->ns_max_nolock_size    = NS_DEFAULT_MAX_NOLOCK_BYTES;
 	ns->ns_contention_time    = NS_DEFAULT_CONTENTION_SECONDS;
 	ns->ns_contended_locks    = NS_DEFAULT_CONTENDED_LOCKS;
+	ns->ns_contended_extent_align = NS_DEFAULT_CONTENDED_EXTENT_ALIGN;
 
         ns->ns_max_parallel_ast   = LDLM_DEFAULT_PARALLEL_AST_LIMIT;
-        ns->ns_nr_unused          = 0;
         ns->ns_max_unused         = LDLM_DEFAULT_LRU_SIZE;
 	ns->ns_max_age            = ktime_set(LDLM_DEFAULT_MAX_ALIVE, 0);
         ns->ns_ctime_age_limit    = LDLM_CTIME_AGE_LIMIT;
@@ -981,6 +1030,8 @@ out_sysfs:
 out_hash:
         cfs_hash_putref(ns->ns_rs_hash);
 out_ns:
+	if (ns->ns_lru != NULL)
+		cfs_percpt_free(ns->ns_lru);
         OBD_FREE_PTR(ns);
 out_ref:
         ldlm_put_ref();
@@ -1248,6 +1299,7 @@ void ldlm_namespace_free_post(struct ldlm_namespace *ns)
 	 * this will cause issues related to using freed \a ns in poold
 	 * thread. */
 	LASSERT(list_empty(&ns->ns_list_chain));
+	cfs_percpt_free(ns->ns_lru);
 	OBD_FREE_PTR(ns);
 	ldlm_put_ref();
 	EXIT;
@@ -1533,6 +1585,8 @@ int ldlm_resource_putref(struct ldlm_resource *res)
 		if (res->lr_itree != NULL)
 			OBD_SLAB_FREE(res->lr_itree, ldlm_interval_tree_slab,
 				      sizeof(*res->lr_itree) * LCK_MODE_NUM);
+		if (res->lr_ext_history != NULL)
+			OBD_FREE_PTR(res->lr_ext_history);
 		OBD_SLAB_FREE(res, ldlm_resource_slab, sizeof *res);
 		return 1;
 	}
@@ -1596,6 +1650,9 @@ void ldlm_resource_unlink_lock(struct ldlm_lock *lock)
         else if (type == LDLM_EXTENT)
                 ldlm_extent_unlink_lock(lock);
 	list_del_init(&lock->l_res_link);
+
+	if (lock->l_resource->lr_match_hint == lock)
+		RCU_INIT_POINTER(lock->l_resource->lr_match_hint, NULL);
 }
 EXPORT_SYMBOL(ldlm_resource_unlink_lock);
 
@@ -335,6 +335,13 @@ int ll_file_release(struct inode *inode, struct file *file)
 		lli->lli_async_rc = 0;
 	}
 
+	if (fd->fd_dio_bytes != 0)
+		CDEBUG(D_VFSTRACE, DFID": direct IO %llu bytes in %llu usecs, "
+		       "%llu MB/s\n", PFID(ll_inode2fid(inode)),
+		       fd->fd_dio_bytes, fd->fd_dio_usecs,
+		       div64_u64(fd->fd_dio_bytes, max_t(__u64,
+				 fd->fd_dio_usecs, 1)));
+
 	rc = ll_md_close(inode, file);
 
 	if (CFS_FAIL_TIMEOUT_MS(OBD_FAIL_PTLRPC_DUMP_LOG, cfs_fail_val))
@@ -1113,21 +1120,15 @@ static void ll_io_init(struct cl_io *io, struct file *file, enum cl_io_type iot)
 		io->ci_pio = 0;
 }
 
-static int ll_file_io_ptask(struct cfs_ptask *ptask)
+/* Does the range \a pt of a parallel IO. */
+static int ll_file_io_pt(const struct lu_env *env, struct cl_io_pt *pt)
 {
-	struct cl_io_pt *pt = ptask->pt_cbdata;
 	struct file *file = pt->cip_file;
-	struct lu_env *env;
 	struct cl_io *io;
 	loff_t pos = pt->cip_pos;
 	int rc;
-	__u16 refcheck;
 	ENTRY;
 
-	env = cl_env_get(&refcheck);
-	if (IS_ERR(env))
-		RETURN(PTR_ERR(env));
-
 	CDEBUG(D_VFSTRACE, "%s: %s range: [%llu, %llu)\n",
 		file_dentry(file)->d_name.name,
 		pt->cip_iot == CIT_READ ? "read" : "write",
@@ -1193,24 +1194,201 @@ restart:
 		pt->cip_iot == CIT_READ ? "read" : "write",
 		pt->cip_result, rc);
 
-	cl_env_put(env, &refcheck);
 	RETURN(pt->cip_result > 0 ? 0 : rc);
 }
 
+/*
+ * Does the ranges of a lane of a parallel IO, that is of a stripe, in file
+ * order. The lane stops at the first range not fully done, as the IO is
+ * short from there, see cl_io_loop().
+ */
+static int ll_file_io_ptask(struct cfs_ptask *ptask)
+{
+	struct cl_io_pt *pt = ptask->pt_cbdata;
+	struct lu_env *env;
+	__u16 refcheck;
+	int rc = 0;
+	ENTRY;
+
+	env = cl_env_get(&refcheck);
+	if (IS_ERR(env)) {
+		pt->cip_rc = PTR_ERR(env);
+		RETURN(pt->cip_rc);
+	}
+
+	for (; pt != NULL; pt = pt->cip_lane_next) {
+		rc = ll_file_io_pt(env, pt);
+		pt->cip_rc = rc;
+		if (rc != 0 || pt->cip_result < pt->cip_count)
+			break;
+	}
+
+	cl_env_put(env, &refcheck);
+	RETURN(rc);
+}
+
+/*
+ * Accounts a direct IO of the file once all its pages are transferred, in
+ * the file and in the direct_io_usecs stats of the mount.  This may run
+ * from the last page completion, so the stats are not filtered by the
+ * process they track.
+ */
+static void ll_dio_done(struct cl_dio_aio *aio, ssize_t result)
+{
+	struct ll_file_data *fd = aio->cda_data;
+	struct ll_sb_info *sbi = ll_i2sbi(file_inode(fd->fd_file));
+	__u64 usecs = ktime_us_delta(ktime_get(), aio->cda_start);
+
+	if (result <= 0)
+		return;
+
+	if (sbi->ll_stats != NULL)
+		lprocfs_counter_add(sbi->ll_stats, LPROC_LL_DIO_USECS, usecs);
+
+	write_lock(&fd->fd_lock);
+	fd->fd_dio_bytes += result;
+	fd->fd_dio_usecs += usecs;
+	write_unlock(&fd->fd_lock);
+}
+
+/* range lock of an AIO, released once all its pages are transferred */
+struct ll_dio_range {
+	struct cl_dio_hold	 ldr_hold;
+	struct range_lock_tree	*ldr_tree;
+	struct range_lock	 ldr_range;
+};
+
+static void ll_dio_range_release(const struct lu_env *env,
+				 struct cl_dio_hold *hold)
+{
+	struct ll_dio_range *ldr = container_of(hold, struct ll_dio_range,
+						ldr_hold);
+
+	CDEBUG(D_VFSTRACE, "Range unlock "RL_FMT"\n", RL_PARA(&ldr->ldr_range));
+	range_unlock(ldr->ldr_tree, &ldr->ldr_range);
+	OBD_FREE_PTR(ldr);
+}
+
+/**
+ * Drops the reference of the IO issuer on the direct IO state \a aio.
+ *
+ * If \a may_queue is set and the IO is asynchronous, the last page transfer
+ * completes the IO and releases the range lock \a ldr if any, and
+ * -EIOCBQUEUED is returned. The transfers are waited for otherwise, and
+ * their result returned; \a io does not account any byte if they failed, as
+ * which ones did is unknown.
+ */
+static ssize_t ll_dio_finish(const struct lu_env *env, struct cl_io *io,
+			     struct cl_dio_aio *aio, bool may_queue,
+			     struct ll_dio_range *ldr)
+{
+	ssize_t rc;
+
+	io->ci_aio = NULL;
+	aio->cda_bytes = io->ci_nob;
+	if (!may_queue || io->ci_nob == 0 || io->ci_need_restart)
+		aio->cda_iocb = NULL;
+
+	if (aio->cda_iocb != NULL) {
+		if (ldr != NULL)
+			cl_dio_hold_add(aio, &ldr->ldr_hold, ldr->ldr_tree,
+					ll_dio_range_release);
+		/* @aio may be freed by the time this returns */
+		cl_sync_io_note(env, &aio->cda_sync, 0);
+		return -EIOCBQUEUED;
+	}
+
+	cl_sync_io_note(env, &aio->cda_sync, 0);
+	rc = cl_sync_io_wait(env, &aio->cda_sync, 0);
+	cl_aio_free(aio);
+	if (rc < 0)
+		io->ci_nob = 0;
+
+	return rc;
+}
+
+/**
+ * Whether a buffered IO is large enough, and continues the previous IO of its
+ * file descriptor, to go through the direct IO path, see ll_hybrid_io().
+ */
+static bool ll_hybrid_io_eligible(struct file *file, enum cl_io_type iot,
+				  struct vvp_io_args *args, loff_t pos,
+				  size_t count)
+{
+#if defined(HAVE_DIRECTIO_ITER) || defined(HAVE_IOV_ITER_RW)
+	struct inode *inode = file_inode(file);
+	struct ll_sb_info *sbi = ll_i2sbi(inode);
+	struct ll_file_data *fd = LUSTRE_FPRIVATE(file);
+	unsigned long threshold;
+
+	threshold = iot == CIT_READ ? sbi->ll_hybrid_io_read_threshold :
+				      sbi->ll_hybrid_io_write_threshold;
+	if (threshold == 0 || count < threshold)
+		return false;
+
+	if (args->via_io_subtype != IO_NORMAL ||
+	    file->f_flags & (O_DIRECT | O_APPEND) ||
+	    sbi->ll_flags & LL_SBI_PIO)
+		return false;
+
+	/* keep the pages of mapped files in the page cache */
+	if (mapping_mapped(inode->i_mapping))
+		return false;
+
+	/* ll_hybrid_io() does not drop the setuid bits */
+	if (iot == CIT_WRITE && !IS_NOSEC(inode))
+		return false;
+
+	/* the pages written are not in the OSC cache, so a sync would not
+	 * wait for them */
+	if (iot == CIT_WRITE &&
+	    (file->f_flags & (O_SYNC | O_DSYNC) || IS_SYNC(inode)))
+		return false;
+
+	return pos == fd->fd_hybrid_pos;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Returns the bytes of the next pass of a hybrid IO at \a pos: the partial
+ * pages at the head and the tail go through the page cache, the full pages
+ * in between through the direct IO path, in which case \a direct is set.
+ */
+static size_t ll_hybrid_io_pass(loff_t pos, size_t count, bool *direct)
+{
+	size_t head = (PAGE_SIZE - (pos & ~PAGE_MASK)) & ~PAGE_MASK;
+
+	*direct = head == 0 && count >= PAGE_SIZE;
+	if (head != 0)
+		return min(head, count);
+
+	return *direct ? count & PAGE_MASK : count;
+}
+
 static ssize_t
 ll_file_io_generic(const struct lu_env *env, struct vvp_io_args *args,
 		   struct file *file, enum cl_io_type iot,
 		   loff_t *ppos, size_t count)
 {
 	struct range_lock	range;
+	struct range_lock	hybrid_range;
 	struct vvp_io		*vio = vvp_env_io(env);
 	struct inode		*inode = file_inode(file);
 	struct ll_inode_info	*lli = ll_i2info(inode);
 	struct ll_file_data	*fd  = LUSTRE_FPRIVATE(file);
 	struct cl_io		*io;
+	struct cl_dio_aio	*aio = NULL;
+	struct ll_dio_range	*ldr = NULL;
 	loff_t			pos = *ppos;
 	ssize_t			result = 0;
+	size_t			pass = count;
 	int			rc = 0;
+	bool			queued = false;
+	bool			hybrid;
+	bool			hybrid_locked = false;
+	bool			direct = false;
 
 	ENTRY;
 
@@ -1218,6 +1396,19 @@ ll_file_io_generic(const struct lu_env *env, struct vvp_io_args *args,
 		file_dentry(file)->d_name.name,
 		iot == CIT_READ ? "read" : "write", pos, pos + count);
 
+	hybrid = ll_hybrid_io_eligible(file, iot, args, pos, count);
+	/* the passes of a hybrid write are atomic against the other IOs of
+	 * the file, as a single pass would be */
+	if (hybrid && iot == CIT_WRITE &&
+	    !(fd->fd_flags & LL_FILE_GROUP_LOCKED)) {
+		range_lock_init(&hybrid_range, pos, pos + count - 1);
+		CDEBUG(D_VFSTRACE, "Range lock "RL_FMT"\n",
+		       RL_PARA(&hybrid_range));
+		rc = range_lock(&lli->lli_write_tree, &hybrid_range);
+		if (rc < 0)
+			RETURN(rc);
+		hybrid_locked = true;
+	}
 restart:
 	io = vvp_env_thread_io(env);
 	ll_io_init(io, file, iot);
@@ -1227,17 +1418,53 @@ restart:
 	} else {
 		io->ci_pio = 0;
 	}
+	if (hybrid)
+		pass = ll_hybrid_io_pass(pos, count, &direct);
+	else
+		pass = count;
+
+	/* The pages of a direct IO are not waited for chunk by chunk, but
+	 * once the IO loop is over, or not at all for an AIO, see
+	 * cl_dio_aio.  A parallel IO does its chunks from separate tasks,
+	 * waiting for them, and a sync write syncs each chunk once written. */
+	if (args->via_io_subtype == IO_NORMAL && !io->ci_pio &&
+	    ((file->f_flags & O_DIRECT) || (direct && iot == CIT_WRITE)) &&
+	    !(iot == CIT_WRITE &&
+	      (file->f_flags & O_DSYNC || IS_SYNC(inode)))) {
+		aio = cl_aio_alloc(args->u.normal.via_iocb);
+		if (aio != NULL) {
+			aio->cda_done = ll_dio_done;
+			aio->cda_data = fd;
+		}
+		io->ci_aio = aio;
+	}
 
-	if (cl_io_rw_init(env, io, iot, pos, count) == 0) {
+	if (cl_io_rw_init(env, io, iot, pos, pass) == 0) {
+		struct range_lock *rl = &range;
 		bool range_locked = false;
+		/* an AIO can complete by itself only if this pass of the IO
+		 * transfers all of it, and is not part of a hybrid IO */
+		bool may_queue = result == 0 && pass == count && !hybrid;
+
+		/* the range lock of an AIO is held until it is transferred */
+		if (aio != NULL && aio->cda_iocb != NULL && may_queue) {
+			OBD_ALLOC_PTR(ldr);
+			if (ldr != NULL) {
+				ldr->ldr_tree = &lli->lli_write_tree;
+				rl = &ldr->ldr_range;
+			} else {
+				may_queue = false;
+			}
+		}
 
 		if (file->f_flags & O_APPEND)
-			range_lock_init(&range, 0, LUSTRE_EOF);
+			range_lock_init(rl, 0, LUSTRE_EOF);
 		else
-			range_lock_init(&range, pos, pos + count - 1);
+			range_lock_init(rl, pos, pos + pass - 1);
 
 		vio->vui_fd  = LUSTRE_FPRIVATE(file);
 		vio->vui_io_subtype = args->via_io_subtype;
+		vio->vui_hybrid = direct;
 
 		switch (vio->vui_io_subtype) {
 		case IO_NORMAL:
@@ -1246,10 +1473,11 @@ restart:
 			 * See LU-6227 for details. */
 			if (((iot == CIT_WRITE) ||
 			    (iot == CIT_READ && (file->f_flags & O_DIRECT))) &&
-			    !(vio->vui_fd->fd_flags & LL_FILE_GROUP_LOCKED)) {
+			    !(vio->vui_fd->fd_flags & LL_FILE_GROUP_LOCKED) &&
+			    !hybrid_locked) {
 				CDEBUG(D_VFSTRACE, "Range lock "RL_FMT"\n",
-				       RL_PARA(&range));
-				rc = range_lock(&lli->lli_write_tree, &range);
+				       RL_PARA(rl));
+				rc = range_lock(&lli->lli_write_tree, rl);
 				if (rc < 0)
 					GOTO(out, rc);
 
@@ -1278,10 +1506,32 @@ restart:
 		}
 		ll_cl_remove(file, env);
 
+		if (aio != NULL) {
+			ssize_t rc2;
+
+			rc2 = ll_dio_finish(env, io, aio, may_queue,
+					    range_locked ? ldr : NULL);
+			if (rc2 == -EIOCBQUEUED) {
+				queued = true;
+				/* the last transfer unlocks the range */
+				if (range_locked) {
+					range_locked = false;
+					ldr = NULL;
+				}
+			} else if (rc2 < 0 && rc == 0) {
+				rc = rc2;
+			}
+			aio = NULL;
+		}
+
 		if (range_locked) {
 			CDEBUG(D_VFSTRACE, "Range unlock "RL_FMT"\n",
-			       RL_PARA(&range));
-			range_unlock(&lli->lli_write_tree, &range);
+			       RL_PARA(rl));
+			range_unlock(&lli->lli_write_tree, rl);
+		}
+		if (ldr != NULL) {
+			OBD_FREE_PTR(ldr);
+			ldr = NULL;
 		}
 	} else {
 		/* cl_io_rw_init() handled IO */
@@ -1307,9 +1557,19 @@ restart:
 		}
 	}
 out:
+	if (aio != NULL) {
+		/* the IO loop was not run, nothing was submitted */
+		ll_dio_finish(env, io, aio, false, NULL);
+		aio = NULL;
+	}
+	if (ldr != NULL) {
+		OBD_FREE_PTR(ldr);
+		ldr = NULL;
+	}
 	cl_io_fini(env, io);
 
-	if ((rc == 0 || rc == -ENODATA) && count > 0 && io->ci_need_restart) {
+	if ((rc == 0 || rc == -ENODATA) && count > 0 &&
+	    (io->ci_need_restart || (hybrid && io->ci_nob == pass))) {
 		CDEBUG(D_VFSTRACE,
 			"%s: restart %s range: [%llu, %llu) ret: %zd, rc: %d\n",
 			file_dentry(file)->d_name.name,
@@ -1318,6 +1578,18 @@ out:
 		goto restart;
 	}
 
+	if (hybrid_locked) {
+		CDEBUG(D_VFSTRACE, "Range unlock "RL_FMT"\n",
+		       RL_PARA(&hybrid_range));
+		range_unlock(&lli->lli_write_tree, &hybrid_range);
+	}
+
+	if (result > 0 && args->via_io_subtype == IO_NORMAL &&
+	    (file->f_flags & O_DIRECT))
+		ll_stats_ops_tally(ll_i2sbi(inode), iot == CIT_READ ?
+				   LPROC_LL_DIO_READ_BYTES :
+				   LPROC_LL_DIO_WRITE_BYTES, result);
+
 	if (iot == CIT_READ) {
 		if (result > 0)
 			ll_stats_ops_tally(ll_i2sbi(inode),
@@ -1343,6 +1615,12 @@ out:
 		iot == CIT_READ ? "read" : "write", *ppos, pos, result, rc);
 
 	*ppos = pos;
+	if (args->via_io_subtype == IO_NORMAL)
+		fd->fd_hybrid_pos = pos;
+
+	/* the AIO is completed with the bytes transferred by its pages */
+	if (queued)
+		RETURN(-EIOCBQUEUED);
 
 	RETURN(result > 0 ? result : rc);
 }
@@ -1365,7 +1643,9 @@ out:
  *   - If the page exists and is uptodate, kernel VM will provide the data and
  *     CLIO won't be intervened;
  *   - If the page was brought into memory by read ahead, it will be exported
- *     and read ahead parameters will be updated;
+ *     and read ahead parameters will be updated. If the read ahead window
+ *     has to be extended, it is read ahead with a cl_io of its own, which
+ *     needs no DLM lock, see ll_ra_fast(), so that the read stays fast;
  *   - Otherwise the page is not in memory, we can't do fast read. Therefore,
  *     it will go back and invoke normal read, i.e., a cl_io will be created
  *     and DLM lock will be requested.
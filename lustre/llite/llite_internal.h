@@ -337,14 +337,31 @@ enum ra_stat {
         RA_STAT_MAX_IN_FLIGHT,
         RA_STAT_WRONG_GRAB_PAGE,
 	RA_STAT_FAILED_REACH_END,
+	RA_STAT_HISTORY_HIT,
+	RA_STAT_HISTORY_MISS,
+	RA_STAT_HISTORY_PAGES,
+	RA_STAT_ASYNC,
+	RA_STAT_ASYNC_PAGES,
+	RA_STAT_ASYNC_HIT,
+	RA_STAT_FAST_WINDOW,
 	_NR_RA_STAT,
 };
 
+/* read-ahead policies, see ll_ra_policies[] in rw.c */
+enum ll_ra_policy {
+	/* sequential and single stride read-ahead windows */
+	LL_RA_POLICY_DEFAULT	= 0,
+	/* default, plus the reads predicted from the read history */
+	LL_RA_POLICY_HISTORY,
+	LL_RA_POLICY_MAX,
+};
+
 struct ll_ra_info {
 	atomic_t	ra_cur_pages;
 	unsigned long	ra_max_pages;
 	unsigned long	ra_max_pages_per_file;
 	unsigned long	ra_max_read_ahead_whole_pages;
+	enum ll_ra_policy ra_policy;
 };
 
 /* ra_io_arg will be filled in the beginning of ll_readahead with
@@ -431,6 +448,7 @@ enum stats_track_type {
 #define LL_SBI_FAST_READ     0x400000 /* fast read support */
 #define LL_SBI_FILE_SECCTX   0x800000 /* set file security context at create */
 #define LL_SBI_PIO          0x1000000 /* parallel IO support */
+#define LL_SBI_RA_ASYNC     0x2000000 /* read-ahead by background workers */
 
 #define LL_SBI_FLAGS { 	\
 	"nolck",	\
@@ -458,6 +476,7 @@ enum stats_track_type {
 	"fast_read",	\
 	"file_secctx",	\
 	"pio",		\
+	"ra_async",	\
 }
 
 /* This is embedded into llite super-blocks to keep track of connect
@@ -538,11 +557,23 @@ struct ll_sb_info {
 
 	/* st_blksize returned by stat(2), when non-zero */
 	unsigned int		  ll_stat_blksize;
+
+	/* buffered reads and writes of at least these many bytes, continuing
+	 * the previous IO of their file descriptor, go through the direct IO
+	 * path, when non-zero */
+	unsigned long		  ll_hybrid_io_read_threshold;
+	unsigned long		  ll_hybrid_io_write_threshold;
 };
 
 /*
  * per file-descriptor read-ahead data.
  */
+/* read requests remembered and predicted by the history read-ahead policy */
+#define LL_RA_HIST_DELTAS	16
+#define LL_RA_HIST_PRED		8
+#define LL_RA_HIST_CONF_MIN	2
+#define LL_RA_HIST_CONF_MAX	8
+
 struct ll_readahead_state {
 	spinlock_t  ras_lock;
         /*
@@ -623,6 +654,35 @@ struct ll_readahead_state {
          * stride read-ahead will be enable
          */
         unsigned long   ras_consecutive_stride_requests;
+	/*
+	 * Read history of the history read-ahead policy, see
+	 * ras_hist_update(). The offsets between the start of the last
+	 * LL_RA_HIST_DELTAS read requests are kept in a ring, the last two
+	 * are searched for in the older ones, the offsets which followed
+	 * them predict the next requests.
+	 */
+	long		ras_hist_delta[LL_RA_HIST_DELTAS];
+	/* number of offsets recorded, ring position is modulo the size */
+	unsigned long	ras_hist_count;
+	/* first and last page of the current request */
+	pgoff_t		ras_hist_start;
+	pgoff_t		ras_hist_end;
+	/* pages of the last complete request, size of the predicted ones */
+	unsigned long	ras_hist_pages;
+	/* start of the next requests as predicted */
+	pgoff_t		ras_hist_pred[LL_RA_HIST_PRED];
+	/* number of usable predictions, and those already read ahead */
+	unsigned int	ras_hist_nr;
+	unsigned int	ras_hist_issued;
+	/*
+	 * Confidence in the predictions, raised when a request starts where
+	 * predicted and lowered otherwise. Nothing is read ahead below
+	 * LL_RA_HIST_CONF_MIN.
+	 */
+	unsigned int	ras_hist_confidence;
+	/* a read-ahead window is read ahead outside of the IO of the reader,
+	 * see ll_ra_window_claim() */
+	bool		ras_async_pending;
 };
 
 extern struct kmem_cache *ll_file_data_slab;
@@ -643,8 +703,13 @@ struct ll_file_data {
 	 * false: unknown failure, should report. */
 	bool fd_write_failed;
 	bool ll_lock_no_expand;
-	rwlock_t fd_lock; /* protect lcc list */
+	rwlock_t fd_lock; /* protect lcc list and direct IO stats */
 	struct list_head fd_lccs; /* list of ll_cl_context */
+	/* bytes of direct IO transferred, and time spent transferring them */
+	__u64 fd_dio_bytes;
+	__u64 fd_dio_usecs;
+	/* end of the last read or write, to detect streaming IO */
+	loff_t fd_hybrid_pos;
 };
 
 extern struct proc_dir_entry *proc_lustre_fs_root;
@@ -716,6 +781,11 @@ enum {
 	LPROC_LL_DIRTY_MISSES,
 	LPROC_LL_READ_BYTES,
 	LPROC_LL_WRITE_BYTES,
+	LPROC_LL_DIO_READ_BYTES,
+	LPROC_LL_DIO_WRITE_BYTES,
+	LPROC_LL_DIO_USECS,
+	LPROC_LL_HYBRID_READ_BYTES,
+	LPROC_LL_HYBRID_WRITE_BYTES,
 	LPROC_LL_BRW_READ,
 	LPROC_LL_BRW_WRITE,
 	LPROC_LL_IOCTL,
@@ -804,6 +874,9 @@ struct ll_cl_context *ll_cl_find(struct file *file);
 
 extern const struct address_space_operations ll_aops;
 
+/* llite/rw26.c */
+ssize_t ll_hybrid_io(const struct lu_env *env, struct cl_io *io, int rw);
+
 /* llite/file.c */
 extern struct file_operations ll_file_operations;
 extern struct file_operations ll_file_operations_flock;
@@ -1153,6 +1226,10 @@ enum ras_update_flags {
 };
 void ll_ra_count_put(struct ll_sb_info *sbi, unsigned long len);
 void ll_ra_stats_inc(struct inode *inode, enum ra_stat which);
+const char *ll_ra_policy_name(enum ll_ra_policy policy);
+int ll_ra_policy_parse(const char *name);
+int ll_ra_async_init(void);
+void ll_ra_async_fini(void);
 
 /* statahead.c */
 
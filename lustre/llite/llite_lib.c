@@ -101,6 +101,7 @@ static struct ll_sb_info *ll_init_sbi(void)
 	sbi->ll_ra_info.ra_max_pages = sbi->ll_ra_info.ra_max_pages_per_file;
 	sbi->ll_ra_info.ra_max_read_ahead_whole_pages =
 					   SBI_DEFAULT_READAHEAD_WHOLE_MAX;
+	sbi->ll_ra_info.ra_policy = LL_RA_POLICY_DEFAULT;
 
         ll_generate_random_uuid(uuid);
         class_uuid_unparse(uuid, &sbi->ll_sb_uuid);
@@ -262,6 +263,9 @@ static int client_common_fill_super(struct super_block *sb, char *md, char *dt,
 #ifdef HAVE_SECURITY_DENTRY_INIT_SECURITY
 	data->ocd_connect_flags2 |= OBD_CONNECT2_FILE_SECCTX;
 #endif /* HAVE_SECURITY_DENTRY_INIT_SECURITY */
+	data->ocd_connect_flags2 |= OBD_CONNECT2_BL_AST_BATCH |
+				    OBD_CONNECT2_LOCK_REPLAY_BATCH |
+				    OBD_CONNECT2_MULTI_ENQUEUE;
 
 	data->ocd_brw_size = MD_MAX_BRW_SIZE;
 
@@ -419,7 +423,10 @@ static int client_common_fill_super(struct super_block *sb, char *md, char *dt,
 	data->ocd_connect_flags |= OBD_CONNECT_LOCKAHEAD_OLD;
 #endif
 
-	data->ocd_connect_flags2 = OBD_CONNECT2_LOCKAHEAD;
+	data->ocd_connect_flags2 = OBD_CONNECT2_LOCKAHEAD |
+				   OBD_CONNECT2_BL_AST_BATCH |
+				   OBD_CONNECT2_LOCK_REPLAY_BATCH |
+				   OBD_CONNECT2_MULTI_BRW;
 
 	if (!OBD_FAIL_CHECK(OBD_FAIL_OSC_CONNECT_GRANT_PARAM))
 		data->ocd_connect_flags |= OBD_CONNECT_GRANT_PARAM;
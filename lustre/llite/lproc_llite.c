@@ -423,6 +423,45 @@ ll_max_read_ahead_whole_mb_seq_write(struct file *file,
 }
 LPROC_SEQ_FOPS(ll_max_read_ahead_whole_mb);
 
+static int ll_read_ahead_policy_seq_show(struct seq_file *m, void *v)
+{
+	struct super_block *sb = m->private;
+	struct ll_sb_info *sbi = ll_s2sbi(sb);
+
+	seq_printf(m, "%s\n", ll_ra_policy_name(sbi->ll_ra_info.ra_policy));
+	return 0;
+}
+
+static ssize_t
+ll_read_ahead_policy_seq_write(struct file *file, const char __user *buffer,
+			       size_t count, loff_t *off)
+{
+	struct seq_file *m = file->private_data;
+	struct super_block *sb = m->private;
+	struct ll_sb_info *sbi = ll_s2sbi(sb);
+	char kernbuf[16];
+	int policy;
+
+	if (count == 0 || count >= sizeof(kernbuf))
+		return -EINVAL;
+
+	if (copy_from_user(kernbuf, buffer, count))
+		return -EFAULT;
+	kernbuf[count] = 0;
+	if (kernbuf[count - 1] == '\n')
+		kernbuf[count - 1] = 0;
+
+	policy = ll_ra_policy_parse(kernbuf);
+	if (policy < 0)
+		return policy;
+
+	spin_lock(&sbi->ll_lock);
+	sbi->ll_ra_info.ra_policy = policy;
+	spin_unlock(&sbi->ll_lock);
+	return count;
+}
+LPROC_SEQ_FOPS(ll_read_ahead_policy);
+
 static int ll_max_cached_mb_seq_show(struct seq_file *m, void *v)
 {
 	struct super_block     *sb    = m->private;
@@ -960,6 +999,126 @@ static ssize_t ll_pio_seq_write(struct file *file, const char __user *buffer,
 }
 LPROC_SEQ_FOPS(ll_pio);
 
+static int ll_read_ahead_async_seq_show(struct seq_file *m, void *v)
+{
+	struct super_block *sb = m->private;
+	struct ll_sb_info *sbi = ll_s2sbi(sb);
+
+	seq_printf(m, "%u\n", !!(sbi->ll_flags & LL_SBI_RA_ASYNC));
+	return 0;
+}
+
+static ssize_t
+ll_read_ahead_async_seq_write(struct file *file, const char __user *buffer,
+			      size_t count, loff_t *off)
+{
+	struct seq_file *m = file->private_data;
+	struct super_block *sb = m->private;
+	struct ll_sb_info *sbi = ll_s2sbi(sb);
+	int rc;
+	__s64 val;
+
+	rc = lprocfs_str_to_s64(buffer, count, &val);
+	if (rc)
+		return rc;
+
+	if (val == 1) {
+		rc = ll_ra_async_init();
+		if (rc)
+			return rc;
+	}
+
+	spin_lock(&sbi->ll_lock);
+	if (val == 1)
+		sbi->ll_flags |= LL_SBI_RA_ASYNC;
+	else
+		sbi->ll_flags &= ~LL_SBI_RA_ASYNC;
+	spin_unlock(&sbi->ll_lock);
+
+	return count;
+}
+LPROC_SEQ_FOPS(ll_read_ahead_async);
+
+static int ll_hybrid_io_threshold_show(struct seq_file *m,
+				       unsigned long *threshold)
+{
+	seq_printf(m, "%lu\n", *threshold);
+	return 0;
+}
+
+static ssize_t ll_hybrid_io_threshold_write(struct ll_sb_info *sbi,
+					    unsigned long *threshold,
+					    const char __user *buffer,
+					    size_t count)
+{
+	int rc;
+	__s64 val;
+
+	rc = lprocfs_str_with_units_to_s64(buffer, count, &val, '1');
+	if (rc)
+		return rc;
+
+	/* 0 disables, any other value is rounded up to full pages */
+	if (val < 0 || val > MAX_LFS_FILESIZE)
+		return -ERANGE;
+
+	spin_lock(&sbi->ll_lock);
+	*threshold = round_up(val, PAGE_SIZE);
+	spin_unlock(&sbi->ll_lock);
+
+	return count;
+}
+
+static int ll_hybrid_io_read_threshold_bytes_seq_show(struct seq_file *m,
+						      void *v)
+{
+	struct super_block *sb = m->private;
+	struct ll_sb_info *sbi = ll_s2sbi(sb);
+
+	return ll_hybrid_io_threshold_show(m,
+					   &sbi->ll_hybrid_io_read_threshold);
+}
+
+static ssize_t
+ll_hybrid_io_read_threshold_bytes_seq_write(struct file *file,
+					    const char __user *buffer,
+					    size_t count, loff_t *off)
+{
+	struct seq_file *m = file->private_data;
+	struct super_block *sb = m->private;
+	struct ll_sb_info *sbi = ll_s2sbi(sb);
+
+	return ll_hybrid_io_threshold_write(sbi,
+					    &sbi->ll_hybrid_io_read_threshold,
+					    buffer, count);
+}
+LPROC_SEQ_FOPS(ll_hybrid_io_read_threshold_bytes);
+
+static int ll_hybrid_io_write_threshold_bytes_seq_show(struct seq_file *m,
+						       void *v)
+{
+	struct super_block *sb = m->private;
+	struct ll_sb_info *sbi = ll_s2sbi(sb);
+
+	return ll_hybrid_io_threshold_show(m,
+					   &sbi->ll_hybrid_io_write_threshold);
+}
+
+static ssize_t
+ll_hybrid_io_write_threshold_bytes_seq_write(struct file *file,
+					     const char __user *buffer,
+					     size_t count, loff_t *off)
+{
+	struct seq_file *m = file->private_data;
+	struct super_block *sb = m->private;
+	struct ll_sb_info *sbi = ll_s2sbi(sb);
+
+	return ll_hybrid_io_threshold_write(sbi,
+					    &sbi->ll_hybrid_io_write_threshold,
+					    buffer, count);
+}
+LPROC_SEQ_FOPS(ll_hybrid_io_write_threshold_bytes);
+
 static int ll_unstable_stats_seq_show(struct seq_file *m, void *v)
 {
 	struct super_block	*sb    = m->private;
@@ -1107,6 +1266,8 @@ struct lprocfs_vars lprocfs_llite_obd_vars[] = {
 	  .fops	=	&ll_max_readahead_per_file_mb_fops	},
 	{ .name	=	"max_read_ahead_whole_mb",
 	  .fops	=	&ll_max_read_ahead_whole_mb_fops	},
+	{ .name	=	"read_ahead_policy",
+	  .fops	=	&ll_read_ahead_policy_fops		},
 	{ .name	=	"max_cached_mb",
 	  .fops	=	&ll_max_cached_mb_fops			},
 	{ .name	=	"checksum_pages",
@@ -1143,6 +1304,12 @@ struct lprocfs_vars lprocfs_llite_obd_vars[] = {
 	  .fops =	&ll_fast_read_fops,			},
 	{ .name =	"pio",
 	  .fops =	&ll_pio_fops,				},
+	{ .name =	"read_ahead_async",
+	  .fops =	&ll_read_ahead_async_fops,		},
+	{ .name =	"hybrid_io_read_threshold_bytes",
+	  .fops =	&ll_hybrid_io_read_threshold_bytes_fops	},
+	{ .name =	"hybrid_io_write_threshold_bytes",
+	  .fops =	&ll_hybrid_io_write_threshold_bytes_fops },
 	{ NULL }
 };
 
@@ -1160,6 +1327,16 @@ static const struct llite_file_opcode {
                                    "read_bytes" },
         { LPROC_LL_WRITE_BYTES,    LPROCFS_CNTR_AVGMINMAX|LPROCFS_TYPE_BYTES,
                                    "write_bytes" },
+	{ LPROC_LL_DIO_READ_BYTES, LPROCFS_CNTR_AVGMINMAX|LPROCFS_TYPE_BYTES,
+				   "direct_read_bytes" },
+	{ LPROC_LL_DIO_WRITE_BYTES, LPROCFS_CNTR_AVGMINMAX|LPROCFS_TYPE_BYTES,
+				   "direct_write_bytes" },
+	{ LPROC_LL_DIO_USECS,	   LPROCFS_CNTR_AVGMINMAX|LPROCFS_TYPE_USECS,
+				   "direct_io_usecs" },
+	{ LPROC_LL_HYBRID_READ_BYTES, LPROCFS_CNTR_AVGMINMAX|LPROCFS_TYPE_BYTES,
+				   "hybrid_read_bytes" },
+	{ LPROC_LL_HYBRID_WRITE_BYTES, LPROCFS_CNTR_AVGMINMAX|LPROCFS_TYPE_BYTES,
+				   "hybrid_write_bytes" },
         { LPROC_LL_BRW_READ,       LPROCFS_CNTR_AVGMINMAX|LPROCFS_TYPE_PAGES,
                                    "brw_read" },
         { LPROC_LL_BRW_WRITE,      LPROCFS_CNTR_AVGMINMAX|LPROCFS_TYPE_PAGES,
@@ -1230,7 +1407,14 @@ static const char *ra_stat_string[] = {
 	[RA_STAT_EOF] = "read-ahead to EOF",
 	[RA_STAT_MAX_IN_FLIGHT] = "hit max r-a issue",
 	[RA_STAT_WRONG_GRAB_PAGE] = "wrong page from grab_cache_page",
-	[RA_STAT_FAILED_REACH_END] = "failed to reach end"
+	[RA_STAT_FAILED_REACH_END] = "failed to reach end",
+	[RA_STAT_HISTORY_HIT] = "history prediction hits",
+	[RA_STAT_HISTORY_MISS] = "history prediction misses",
+	[RA_STAT_HISTORY_PAGES] = "history read-ahead pages",
+	[RA_STAT_ASYNC] = "async read-ahead windows",
+	[RA_STAT_ASYNC_PAGES] = "async read-ahead pages",
+	[RA_STAT_ASYNC_HIT] = "async read-ahead hits",
+	[RA_STAT_FAST_WINDOW] = "fast read read-ahead windows",
 };
 
 LPROC_SEQ_FOPS_RO_TYPE(llite, name);
@@ -1305,6 +1489,8 @@ int lprocfs_ll_register_mountpoint(struct proc_dir_entry *parent,
 			ptr = "bytes";
 		else if (type & LPROCFS_TYPE_PAGES)
 			ptr = "pages";
+		else if (type & LPROCFS_TYPE_USECS)
+			ptr = "usecs";
 		lprocfs_counter_init(sbi->ll_stats,
 				     llite_opcode_table[id].opcode,
 				     (type & LPROCFS_CNTR_AVGMINMAX),
@@ -211,6 +211,7 @@ static int ll_read_ahead_page(const struct lu_env *env, struct cl_io *io,
 	if (!vpg->vpg_defer_uptodate && !PageUptodate(vmpage)) {
 		vpg->vpg_defer_uptodate = 1;
 		vpg->vpg_ra_used = 0;
+		vpg->vpg_ra_async = io->ci_async_readahead;
 		cl_page_list_add(queue, page);
 	} else {
 		/* skip completed pages */
@@ -424,9 +425,342 @@ ll_read_ahead_pages(const struct lu_env *env, struct cl_io *io,
 	return count;
 }
 
+/* read-ahead workers of each CPU partition, see ll_ra_async_init() */
+static struct cfs_wi_sched **ll_ra_scheds;
+static DEFINE_MUTEX(ll_ra_scheds_mutex);
+
+/* a read-ahead window handed over to a worker by ll_ra_async() */
+struct ll_ra_work {
+	struct cfs_workitem	 lrw_wi;
+	struct cfs_wi_sched	*lrw_sched;
+	/* reference on the file of the reader */
+	struct file		*lrw_file;
+	struct ra_io_arg	 lrw_ria;
+};
+
+/*
+ * Read ahead the window \a win with a cl_io of its own, outside of the IO of
+ * the reader, from a worker thread when \a async is set. The IO is not
+ * locked, the pages are only read ahead where cl_io_read_ahead() finds a
+ * lock held by the reader, as it does for the read-ahead of the reader
+ * itself.
+ *
+ * Returns the number of pages read ahead, up to \a ra_end.
+ */
+static int ll_ra_window(struct file *file, const struct ra_io_arg *win,
+			bool async, pgoff_t *ra_end)
+{
+	struct inode *inode = file_inode(file);
+	struct ll_sb_info *sbi = ll_i2sbi(inode);
+	struct ll_readahead_state *ras = &LUSTRE_FPRIVATE(file)->fd_ras;
+	pgoff_t end = win->ria_end;
+	struct ra_io_arg *ria;
+	struct cl_2queue *queue;
+	struct lu_env *env;
+	struct cl_io *io;
+	unsigned long len;
+	__u16 refcheck;
+	int count = 0;
+	int rc;
+	ENTRY;
+
+	*ra_end = 0;
+	env = cl_env_get(&refcheck);
+	if (IS_ERR(env))
+		GOTO(out, rc = PTR_ERR(env));
+
+	ria = &ll_env_info(env)->lti_ria;
+	*ria = *win;
+	len = ria_page_count(ria);
+
+	io = vvp_env_thread_io(env);
+	io->ci_obj = ll_i2info(inode)->lli_clob;
+	io->ci_async_readahead = async;
+	/* the reader holds the layout the window was computed with */
+	io->ci_ignore_layout = 1;
+	rc = cl_io_rw_init(env, io, CIT_READ,
+			   cl_offset(io->ci_obj, ria->ria_start),
+			   cl_offset(io->ci_obj, end - ria->ria_start + 1));
+	if (rc != 0)
+		GOTO(out_fini, rc);
+	vvp_env_io(env)->vui_fd = LUSTRE_FPRIVATE(file);
+	io->ci_state = CIS_LOCKED;
+
+	ria->ria_reserved = ll_ra_count_get(sbi, ria, len, 0);
+	if (ria->ria_reserved < len)
+		ll_ra_stats_inc_sbi(sbi, RA_STAT_MAX_IN_FLIGHT);
+
+	queue = &io->ci_queue;
+	cl_2queue_init(queue);
+	count = ll_read_ahead_pages(env, io, &queue->c2_qin, ras, ria, ra_end);
+	if (ria->ria_reserved != 0)
+		ll_ra_count_put(sbi, ria->ria_reserved);
+	if (*ra_end != end)
+		ll_ra_stats_inc_sbi(sbi, RA_STAT_FAILED_REACH_END);
+
+	if (queue->c2_qin.pl_nr > 0)
+		rc = cl_io_submit_rw(env, io, CRT_READ, queue);
+	cl_page_list_disown(env, io, &queue->c2_qin);
+	cl_2queue_fini(env, queue);
+	EXIT;
+out_fini:
+	cl_io_fini(env, io);
+	cl_env_put(env, &refcheck);
+out:
+	CDEBUG(D_READA, DFID": %d pages read ahead in %lu-%lu, end %lu: "
+	       "rc = %d\n", PFID(ll_inode2fid(inode)), count,
+	       win->ria_start, end, *ra_end, rc);
+
+	return count;
+}
+
+/*
+ * Claim the window \a ria for a read-ahead outside of the IO of the reader,
+ * which goes on from the end of the window.
+ */
+static int ll_ra_window_claim(struct ll_readahead_state *ras,
+			      const struct ra_io_arg *ria)
+{
+	spin_lock(&ras->ras_lock);
+	if (ras->ras_async_pending) {
+		spin_unlock(&ras->ras_lock);
+		return -EALREADY;
+	}
+	ras->ras_async_pending = true;
+	ras->ras_next_readahead = ria->ria_end + 1;
+	spin_unlock(&ras->ras_lock);
+
+	return 0;
+}
+
+/*
+ * The read-ahead of the window \a ria claimed by ll_ra_window_claim() is
+ * over, up to \a ra_end.
+ */
+static void ll_ra_window_done(struct ll_readahead_state *ras,
+			      const struct ra_io_arg *ria, pgoff_t ra_end)
+{
+	spin_lock(&ras->ras_lock);
+	/* let the reader retry what could not be read ahead */
+	if (ra_end != ria->ria_end &&
+	    ras->ras_next_readahead == ria->ria_end + 1)
+		ras->ras_next_readahead = ra_end > 0 ? ra_end + 1 :
+					  ria->ria_start;
+	ras->ras_async_pending = false;
+	spin_unlock(&ras->ras_lock);
+}
+
+/* read ahead a window in a worker thread, see ll_ra_async() */
+static int ll_ra_async_work(struct cfs_workitem *wi)
+{
+	struct ll_ra_work *work = container_of(wi, struct ll_ra_work, lrw_wi);
+	struct file *file = work->lrw_file;
+	struct ll_sb_info *sbi = ll_i2sbi(file_inode(file));
+	pgoff_t ra_end;
+	int count;
+
+	count = ll_ra_window(file, &work->lrw_ria, true, &ra_end);
+	ll_ra_window_done(&LUSTRE_FPRIVATE(file)->fd_ras, &work->lrw_ria,
+			  ra_end);
+	if (count > 0)
+		lprocfs_counter_add(sbi->ll_ra_stats, RA_STAT_ASYNC_PAGES,
+				    count);
+
+	cfs_wi_exit(work->lrw_sched, wi);
+	fput(file);
+	OBD_FREE_PTR(work);
+
+	return 1;
+}
+
+/**
+ * Hand the read-ahead window \a ria over to a worker of the current CPU
+ * partition, so that the reader does not wait for the pages to be prepared
+ * and sent.
+ *
+ * \retval 0		the window is read ahead by a worker
+ * \retval -EALREADY	the previous window is still being read ahead
+ * \retval -ve		the reader has to read ahead the window itself
+ */
+static int ll_ra_async(struct file *file, struct ll_readahead_state *ras,
+		       struct ra_io_arg *ria)
+{
+	struct cfs_wi_sched **scheds = ll_ra_scheds;
+	struct ll_ra_work *work;
+	int cpt;
+	int rc;
+
+	if (scheds == NULL)
+		return -EOPNOTSUPP;
+
+	OBD_ALLOC_PTR(work);
+	if (work == NULL)
+		return -ENOMEM;
+
+	rc = ll_ra_window_claim(ras, ria);
+	if (rc != 0) {
+		OBD_FREE_PTR(work);
+		return rc;
+	}
+
+	cpt = cfs_cpt_current(cfs_cpt_table, 0);
+	work->lrw_sched = scheds[cpt];
+	work->lrw_file = get_file(file);
+	work->lrw_ria = *ria;
+
+	ll_ra_stats_inc_sbi(ll_i2sbi(file_inode(file)), RA_STAT_ASYNC);
+	cfs_wi_init(&work->lrw_wi, work, ll_ra_async_work);
+	cfs_wi_schedule(work->lrw_sched, &work->lrw_wi);
+
+	return 0;
+}
+
+/**
+ * Find the next read-ahead window of a fast read. A fast read has no cl_io
+ * to read ahead with, the window is read ahead by ll_ra_fast() once the page
+ * read is unlocked.
+ *
+ * Stride read-ahead is left to the normal read path.
+ *
+ * \retval 1		\a ria is to be read ahead
+ * \retval 0		nothing to read ahead
+ * \retval -ve		the reader has to fall back to the normal read path
+ */
+static int ll_ra_fast_window(const struct lu_env *env, struct file *file,
+			     struct ll_readahead_state *ras,
+			     struct ra_io_arg *ria)
+{
+	struct inode *inode = file_inode(file);
+	struct cl_object *clob = ll_i2info(inode)->lli_clob;
+	struct cl_attr *attr = vvp_env_thread_attr(env);
+	unsigned long end_index;
+	int rc;
+
+	cl_object_attr_lock(clob);
+	rc = cl_object_attr_get(env, clob, attr);
+	cl_object_attr_unlock(clob);
+	if (rc != 0)
+		return rc;
+	if (attr->cat_kms == 0)
+		return 0;
+
+	memset(ria, 0, sizeof(*ria));
+	spin_lock(&ras->ras_lock);
+	if (stride_io_mode(ras)) {
+		spin_unlock(&ras->ras_lock);
+		return -EOPNOTSUPP;
+	}
+	ria->ria_start = ras->ras_next_readahead;
+	ria->ria_end = ras->ras_window_start + ras->ras_window_len - 1;
+	spin_unlock(&ras->ras_lock);
+
+	end_index = (unsigned long)((attr->cat_kms - 1) >> PAGE_SHIFT);
+	if (end_index <= ria->ria_end) {
+		ria->ria_end = end_index;
+		ria->ria_eof = true;
+	}
+
+	return ria->ria_end >= ria->ria_start;
+}
+
+/**
+ * Read ahead the window \a ria of a fast read, found by ll_ra_fast_window(),
+ * with a cl_io of its own, or in a worker if read_ahead_async is set.
+ */
+static void ll_ra_fast(struct file *file, struct ll_readahead_state *ras,
+		       struct ra_io_arg *ria)
+{
+	struct inode *inode = file_inode(file);
+	pgoff_t ra_end;
+	int rc;
+
+	if (ll_i2sbi(inode)->ll_flags & LL_SBI_RA_ASYNC) {
+		rc = ll_ra_async(file, ras, ria);
+		if (rc == 0)
+			ll_ra_stats_inc(inode, RA_STAT_FAST_WINDOW);
+		if (rc == 0 || rc == -EALREADY)
+			return;
+	}
+
+	/* a worker or another reader is busy with the window already */
+	if (ll_ra_window_claim(ras, ria) != 0)
+		return;
+
+	ll_ra_window(file, ria, false, &ra_end);
+	ll_ra_window_done(ras, ria, ra_end);
+	ll_ra_stats_inc(inode, RA_STAT_FAST_WINDOW);
+}
+
+static void ll_ra_scheds_destroy(struct cfs_wi_sched **scheds)
+{
+	int nscheds = cfs_cpt_number(cfs_cpt_table);
+	int i;
+
+	for (i = 0; i < nscheds; i++) {
+		if (scheds[i] != NULL)
+			cfs_wi_sched_destroy(scheds[i]);
+	}
+	OBD_FREE(scheds, sizeof(scheds[0]) * nscheds);
+}
+
+/**
+ * Start the read-ahead workers. They are only needed once read_ahead_async
+ * is enabled on some mount, which it is not by default, so they are created
+ * then rather than at module load.
+ */
+int ll_ra_async_init(void)
+{
+	int nscheds = cfs_cpt_number(cfs_cpt_table);
+	struct cfs_wi_sched **scheds;
+	int nthrs;
+	int rc = 0;
+	int i;
+	ENTRY;
+
+	mutex_lock(&ll_ra_scheds_mutex);
+	if (ll_ra_scheds != NULL)
+		GOTO(out, rc = 0);
+
+	OBD_ALLOC(scheds, sizeof(scheds[0]) * nscheds);
+	if (scheds == NULL)
+		GOTO(out, rc = -ENOMEM);
+
+	for (i = 0; i < nscheds; i++) {
+		/* read-ahead mostly waits for locks and RPC slots */
+		nthrs = max(cfs_cpt_weight(cfs_cpt_table, i) / 4, 1);
+		rc = cfs_wi_sched_create("ll_ra", cfs_cpt_table, i, nthrs,
+					 &scheds[i]);
+		if (rc != 0) {
+			CERROR("cannot create read-ahead scheduler %d: "
+			       "rc = %d\n", i, rc);
+			ll_ra_scheds_destroy(scheds);
+			GOTO(out, rc);
+		}
+	}
+
+	/* ll_ra_async() may look at the array without the mutex */
+	smp_wmb();
+	ll_ra_scheds = scheds;
+	EXIT;
+out:
+	mutex_unlock(&ll_ra_scheds_mutex);
+
+	return rc;
+}
+
+void ll_ra_async_fini(void)
+{
+	if (ll_ra_scheds == NULL)
+		return;
+
+	ll_ra_scheds_destroy(ll_ra_scheds);
+	ll_ra_scheds = NULL;
+}
+
 static int ll_readahead(const struct lu_env *env, struct cl_io *io,
 			struct cl_page_list *queue,
-			struct ll_readahead_state *ras, bool hit)
+			struct ll_readahead_state *ras, bool hit,
+			struct file *file)
 {
 	struct vvp_io *vio = vvp_env_io(env);
 	struct ll_thread_info *lti = ll_env_info(env);
@@ -530,6 +864,16 @@ static int ll_readahead(const struct lu_env *env, struct cl_io *io,
 		ria->ria_end_min = ria->ria_start + mlen;
 	}
 
+	/* a window the current read does not wait for, and worth an RPC,
+	 * is read ahead in the background */
+	if (mlen == 0 && len >= ras->ras_rpc_size && io->ci_type == CIT_READ &&
+	    file != NULL && ll_i2sbi(inode)->ll_flags & LL_SBI_RA_ASYNC) {
+		ret = ll_ra_async(file, ras, ria);
+		if (ret == 0 || ret == -EALREADY)
+			RETURN(0);
+		ret = 0;
+	}
+
 	ria->ria_reserved = ll_ra_count_get(ll_i2sbi(inode), ria, len, mlen);
 	if (ria->ria_reserved < len)
 		ll_ra_stats_inc(inode, RA_STAT_MAX_IN_FLIGHT);
@@ -599,6 +943,11 @@ void ll_readahead_init(struct inode *inode, struct ll_readahead_state *ras)
 	ras->ras_rpc_size = PTLRPC_MAX_BRW_PAGES;
 	ras_reset(inode, ras, 0);
 	ras->ras_requests = 0;
+	ras->ras_hist_count = 0;
+	ras->ras_hist_pages = 0;
+	ras->ras_hist_nr = 0;
+	ras->ras_hist_issued = 0;
+	ras->ras_hist_confidence = 0;
 }
 
 /*
@@ -720,17 +1069,16 @@ static void ras_increase_window(struct inode *inode,
 	}
 }
 
-static void ras_update(struct ll_sb_info *sbi, struct inode *inode,
-		       struct ll_readahead_state *ras, unsigned long index,
-		       enum ras_update_flags flags)
+/* called with the ras_lock held */
+static void ras_update_window(struct ll_sb_info *sbi, struct inode *inode,
+			      struct ll_readahead_state *ras,
+			      unsigned long index, enum ras_update_flags flags)
 {
 	struct ll_ra_info *ra = &sbi->ll_ra_info;
 	bool hit = flags & LL_RAS_HIT;
 	int zero = 0, stride_detect = 0, ra_miss = 0;
 	ENTRY;
 
-	spin_lock(&ras->ras_lock);
-
 	if (!hit)
 		CDEBUG(D_READA, DFID " pages at %lu miss.\n",
 		       PFID(ll_inode2fid(inode)), index);
@@ -773,7 +1121,7 @@ static void ras_update(struct ll_sb_info *sbi, struct inode *inode,
 			ras->ras_next_readahead = index + 1;
                         ras->ras_window_len = min(ra->ra_max_pages_per_file,
                                 ra->ra_max_read_ahead_whole_pages);
-                        GOTO(out_unlock, 0);
+                        GOTO(out, 0);
                 }
         }
 	if (zero) {
@@ -788,7 +1136,7 @@ static void ras_update(struct ll_sb_info *sbi, struct inode *inode,
 			}
 			ras_reset(inode, ras, index);
 			ras->ras_consecutive_pages++;
-			GOTO(out_unlock, 0);
+			GOTO(out, 0);
 		} else {
 			ras->ras_consecutive_pages = 0;
 			ras->ras_consecutive_requests = 0;
@@ -820,7 +1168,7 @@ static void ras_update(struct ll_sb_info *sbi, struct inode *inode,
 				ras_reset(inode, ras, index);
 				ras->ras_consecutive_pages++;
 				ras_stride_reset(ras);
-				GOTO(out_unlock, 0);
+				GOTO(out, 0);
 			}
 		} else if (stride_io_mode(ras)) {
 			/* If this is contiguous read but in stride I/O mode
@@ -861,7 +1209,7 @@ static void ras_update(struct ll_sb_info *sbi, struct inode *inode,
 		/* reset consecutive pages so that the readahead window can
 		 * grow gradually. */
 		ras->ras_consecutive_pages = 0;
-		GOTO(out_unlock, 0);
+		GOTO(out, 0);
 	}
 
 	/* Initially reset the stride window offset to next_readahead*/
@@ -882,11 +1230,286 @@ static void ras_update(struct ll_sb_info *sbi, struct inode *inode,
 	    !ras->ras_request_index)
 		ras_increase_window(inode, ras, ra);
 	EXIT;
-out_unlock:
+out:
 	RAS_CDEBUG(ras);
 	ras->ras_request_index++;
+}
+
+#define RAS_HIST_DELTA(ras, i) \
+	((ras)->ras_hist_delta[(i) % LL_RA_HIST_DELTAS])
+
+/* number of predicted requests to read ahead, with the ras_lock held */
+static unsigned int ras_hist_ready(struct ll_readahead_state *ras)
+{
+	if (ras->ras_hist_confidence < LL_RA_HIST_CONF_MIN)
+		return 0;
+
+	return min(ras->ras_hist_nr, ras->ras_hist_confidence);
+}
+
+/*
+ * Predict the start of the next requests by delta correlation: the last two
+ * offsets between request starts are searched for in the older ones, and
+ * the offsets which followed the latest match are replayed from the current
+ * request, as many times as needed. This finds sequential, strided and
+ * nested strided patterns alike, as long as their period fits in the
+ * history.
+ */
+static void ras_hist_predict(struct ll_readahead_state *ras)
+{
+	unsigned long count = ras->ras_hist_count;
+	unsigned long base;
+	unsigned long period;
+	unsigned long j;
+	pgoff_t pred[LL_RA_HIST_PRED];
+	pgoff_t next = ras->ras_hist_start;
+	unsigned int issued = ras->ras_hist_issued;
+	unsigned int nr = 0;
+	unsigned int i;
+	long delta;
+
+	base = count > LL_RA_HIST_DELTAS ? count - LL_RA_HIST_DELTAS : 0;
+	if (count - base < 3)
+		goto out;
+
+	for (j = count - 2; j >= base + 1; j--) {
+		if (RAS_HIST_DELTA(ras, j - 1) == RAS_HIST_DELTA(ras, count - 2) &&
+		    RAS_HIST_DELTA(ras, j) == RAS_HIST_DELTA(ras, count - 1))
+			break;
+	}
+	if (j < base + 1)
+		goto out;
+
+	period = count - 1 - j;
+	for (i = 0; i < LL_RA_HIST_PRED; i++) {
+		delta = RAS_HIST_DELTA(ras, j + 1 + i % period);
+		/* rereading the same data or going before the file start */
+		if (delta == 0 || (delta < 0 && -delta > next))
+			break;
+		next += delta;
+		pred[nr++] = next;
+	}
+out:
+	/* keep what was read ahead for the predictions which still stand */
+	for (i = 0; i < issued && i < nr; i++) {
+		if (pred[i] != ras->ras_hist_pred[i])
+			break;
+	}
+	ras->ras_hist_issued = i;
+	ras->ras_hist_nr = nr;
+	if (nr > 0)
+		memcpy(ras->ras_hist_pred, pred, nr * sizeof(pred[0]));
+}
+
+/*
+ * Record a read in the history of \a ras, called with the ras_lock held
+ * before the read-ahead window is updated. Reads through mmap are not split
+ * into requests and are left to the default policy.
+ */
+static void ras_hist_update(struct ll_sb_info *sbi, struct inode *inode,
+			    struct ll_readahead_state *ras, unsigned long index,
+			    enum ras_update_flags flags)
+{
+	if (flags & LL_RAS_MMAP)
+		return;
+
+	if (ras->ras_request_index > 0) {
+		if (index > ras->ras_hist_end)
+			ras->ras_hist_end = index;
+		return;
+	}
+
+	/* first page of a new request, check the prediction */
+	if (ras->ras_hist_nr > 0) {
+		if (index == ras->ras_hist_pred[0]) {
+			ll_ra_stats_inc_sbi(sbi, RA_STAT_HISTORY_HIT);
+			if (ras->ras_hist_confidence < LL_RA_HIST_CONF_MAX)
+				ras->ras_hist_confidence++;
+			/* the following predictions move up by one */
+			ras->ras_hist_nr--;
+			memmove(ras->ras_hist_pred, ras->ras_hist_pred + 1,
+				ras->ras_hist_nr * sizeof(pgoff_t));
+			if (ras->ras_hist_issued > 0)
+				ras->ras_hist_issued--;
+		} else {
+			ll_ra_stats_inc_sbi(sbi, RA_STAT_HISTORY_MISS);
+			ras->ras_hist_confidence /= 2;
+			ras->ras_hist_issued = 0;
+		}
+	}
+
+	if (ras->ras_hist_pages != 0)
+		RAS_HIST_DELTA(ras, ras->ras_hist_count++) =
+			(long)(index - ras->ras_hist_start);
+	ras->ras_hist_pages = ras->ras_hist_end - ras->ras_hist_start + 1;
+	ras->ras_hist_start = index;
+	ras->ras_hist_end = index;
+
+	ras_hist_predict(ras);
+}
+
+/*
+ * Read ahead the requests predicted by the history policy which are not
+ * covered by the read-ahead window, each as large as the last request.
+ */
+static int ras_hist_readahead(const struct lu_env *env, struct cl_io *io,
+			      struct cl_page_list *queue,
+			      struct ll_readahead_state *ras, bool hit)
+{
+	struct ll_thread_info *lti = ll_env_info(env);
+	struct cl_attr *attr = vvp_env_thread_attr(env);
+	struct ra_io_arg *ria = &lti->lti_ria;
+	struct cl_object *clob = io->ci_obj;
+	struct inode *inode = vvp_object_inode(clob);
+	struct ll_sb_info *sbi = ll_i2sbi(inode);
+	pgoff_t pred[LL_RA_HIST_PRED];
+	pgoff_t window_start;
+	pgoff_t window_end;
+	pgoff_t end_index;
+	pgoff_t ra_end = 0;
+	unsigned long budget = sbi->ll_ra_info.ra_max_pages_per_file;
+	unsigned long pages;
+	unsigned long len;
+	unsigned int first;
+	unsigned int nr;
+	unsigned int i;
+	int count = 0;
+	int rc;
+	ENTRY;
+
+	spin_lock(&ras->ras_lock);
+	first = ras->ras_hist_issued;
+	nr = ras_hist_ready(ras);
+	if (first < nr) {
+		memcpy(pred + first, ras->ras_hist_pred + first,
+		       (nr - first) * sizeof(pred[0]));
+		ras->ras_hist_issued = nr;
+	}
+	pages = ras->ras_hist_pages;
+	window_start = ras->ras_window_start;
+	window_end = ras->ras_window_start + ras->ras_window_len;
+	spin_unlock(&ras->ras_lock);
+
+	if (first >= nr)
+		RETURN(0);
+
+	cl_object_attr_lock(clob);
+	rc = cl_object_attr_get(env, clob, attr);
+	cl_object_attr_unlock(clob);
+	if (rc != 0 || attr->cat_kms == 0)
+		RETURN(0);
+	end_index = (attr->cat_kms - 1) >> PAGE_SHIFT;
+
+	for (i = first; i < nr && budget >= pages; i++) {
+		/* beyond EOF, or already read ahead by the window */
+		if (pred[i] > end_index ||
+		    (pred[i] >= window_start && pred[i] + pages <= window_end))
+			continue;
+
+		memset(ria, 0, sizeof(*ria));
+		ria->ria_start = pred[i];
+		ria->ria_end = min(pred[i] + pages - 1, end_index);
+		ria->ria_eof = ria->ria_end == end_index;
+		/* the request is usually smaller than an RPC, keep it all */
+		ria->ria_end_min = ria->ria_end;
+		len = ria->ria_end - ria->ria_start + 1;
+
+		ria->ria_reserved = ll_ra_count_get(sbi, ria, len, 0);
+		if (ria->ria_reserved < len)
+			ll_ra_stats_inc(inode, RA_STAT_MAX_IN_FLIGHT);
+		if (ria->ria_reserved == 0)
+			break;
+
+		count += ll_read_ahead_pages(env, io, queue, ras, ria, &ra_end);
+		if (ria->ria_reserved != 0)
+			ll_ra_count_put(sbi, ria->ria_reserved);
+		budget -= len;
+	}
+
+	CDEBUG(D_READA, DFID": %d pages read ahead for predictions %u-%u of "
+	       "%lu pages, hit: %d\n", PFID(lu_object_fid(&clob->co_lu)),
+	       count, first, nr, pages, hit);
+	if (count > 0)
+		lprocfs_counter_add(sbi->ll_ra_stats, RA_STAT_HISTORY_PAGES,
+				    count);
+	RETURN(count);
+}
+
+/* whether predicted requests are still to be read ahead */
+static bool ras_hist_pending(struct ll_readahead_state *ras)
+{
+	return ras->ras_hist_issued < ras_hist_ready(ras);
+}
+
+/**
+ * Read-ahead policy, chosen for all the files of a mount point with the
+ * read_ahead_policy tunable. Every policy also runs the sequential and
+ * stride read-ahead window of ras_update_window() and ll_readahead().
+ */
+struct ll_ra_policy_ops {
+	const char	*rpo_name;
+	/* record the read of a page, called with the ras_lock held */
+	void		(*rpo_update)(struct ll_sb_info *sbi,
+				      struct inode *inode,
+				      struct ll_readahead_state *ras,
+				      unsigned long index,
+				      enum ras_update_flags flags);
+	/* read ahead pages not covered by the read-ahead window */
+	int		(*rpo_readahead)(const struct lu_env *env,
+					 struct cl_io *io,
+					 struct cl_page_list *queue,
+					 struct ll_readahead_state *ras,
+					 bool hit);
+	/* whether rpo_readahead() has pages to read ahead */
+	bool		(*rpo_pending)(struct ll_readahead_state *ras);
+};
+
+static const struct ll_ra_policy_ops ll_ra_policies[LL_RA_POLICY_MAX] = {
+	[LL_RA_POLICY_DEFAULT] = {
+		.rpo_name	= "default",
+	},
+	[LL_RA_POLICY_HISTORY] = {
+		.rpo_name	= "history",
+		.rpo_update	= ras_hist_update,
+		.rpo_readahead	= ras_hist_readahead,
+		.rpo_pending	= ras_hist_pending,
+	},
+};
+
+const char *ll_ra_policy_name(enum ll_ra_policy policy)
+{
+	LASSERT(policy < LL_RA_POLICY_MAX);
+	return ll_ra_policies[policy].rpo_name;
+}
+
+int ll_ra_policy_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < LL_RA_POLICY_MAX; i++) {
+		if (strcmp(name, ll_ra_policies[i].rpo_name) == 0)
+			return i;
+	}
+	return -EINVAL;
+}
+
+static inline const struct ll_ra_policy_ops *
+ll_ra_policy_ops(struct ll_sb_info *sbi)
+{
+	return &ll_ra_policies[sbi->ll_ra_info.ra_policy];
+}
+
+static void ras_update(struct ll_sb_info *sbi, struct inode *inode,
+		       struct ll_readahead_state *ras, unsigned long index,
+		       enum ras_update_flags flags)
+{
+	const struct ll_ra_policy_ops *ops = ll_ra_policy_ops(sbi);
+
+	spin_lock(&ras->ras_lock);
+	if (ops->rpo_update != NULL)
+		ops->rpo_update(sbi, inode, ras, index, flags);
+	ras_update_window(sbi, inode, ras, index, flags);
 	spin_unlock(&ras->ras_lock);
-	return;
 }
 
 int ll_writepage(struct page *vmpage, struct writeback_control *wbc)
@@ -1107,6 +1730,10 @@ static int ll_io_read_page(const struct lu_env *env, struct cl_io *io,
 
 	cl_2queue_init(queue);
 	if (uptodate) {
+		if (vpg->vpg_ra_async) {
+			ll_ra_stats_inc_sbi(sbi, RA_STAT_ASYNC_HIT);
+			vpg->vpg_ra_async = 0;
+		}
 		vpg->vpg_ra_used = 1;
 		cl_page_export(env, page, 1);
 		cl_page_disown(env, io, page);
@@ -1116,10 +1743,14 @@ static int ll_io_read_page(const struct lu_env *env, struct cl_io *io,
 
 	if (sbi->ll_ra_info.ra_max_pages_per_file > 0 &&
 	    sbi->ll_ra_info.ra_max_pages > 0) {
+		const struct ll_ra_policy_ops *ops = ll_ra_policy_ops(sbi);
 		int rc2;
 
 		rc2 = ll_readahead(env, io, &queue->c2_qin, ras,
-				   uptodate);
+				   uptodate, file);
+		if (ops->rpo_readahead != NULL)
+			rc2 += ops->rpo_readahead(env, io, &queue->c2_qin, ras,
+						  uptodate);
 		CDEBUG(D_READA, DFID "%d pages read ahead at %lu\n",
 		       PFID(ll_inode2fid(inode)), rc2, vvp_index(vpg));
 	}
@@ -1157,8 +1788,11 @@ int ll_readpage(struct file *file, struct page *vmpage)
 		struct inode *inode = file_inode(file);
 		struct ll_file_data *fd = LUSTRE_FPRIVATE(file);
 		struct ll_readahead_state *ras = &fd->fd_ras;
+		const struct ll_ra_policy_ops *ops;
 		struct lu_env  *local_env = NULL;
+		struct ra_io_arg ria;
 		struct vvp_page *vpg;
+		int ra = 0;
 
 		result = -ENODATA;
 
@@ -1191,11 +1825,27 @@ int ll_readpage(struct file *file, struct page *vmpage)
 			vpg->vpg_ra_updated = 1;
 
 			/* Check if we can issue a readahead RPC, if that is
-			 * the case, we can't do fast IO because we will need
-			 * a cl_io to issue the RPC. */
-			if (ras->ras_window_start + ras->ras_window_len <
-			    ras->ras_next_readahead + PTLRPC_MAX_BRW_PAGES) {
+			 * the case, we need a cl_io, which ll_ra_fast() sets
+			 * up once the page is unlocked. */
+			ops = ll_ra_policy_ops(ll_i2sbi(inode));
+			if (ops->rpo_pending == NULL ||
+			    !ops->rpo_pending(ras)) {
+				if (ras->ras_window_start +
+				    ras->ras_window_len >=
+				    ras->ras_next_readahead +
+				    PTLRPC_MAX_BRW_PAGES)
+					ra = ll_ra_fast_window(env, file, ras,
+							       &ria);
+			} else {
+				ra = -EAGAIN;
+			}
+			if (ra >= 0) {
 				/* export the page and skip io stack */
+				if (vpg->vpg_ra_async) {
+					ll_ra_stats_inc(inode,
+							RA_STAT_ASYNC_HIT);
+					vpg->vpg_ra_async = 0;
+				}
 				vpg->vpg_ra_used = 1;
 				cl_page_export(env, page, 1);
 				result = 0;
@@ -1210,6 +1860,9 @@ int ll_readpage(struct file *file, struct page *vmpage)
 		if (local_env)
 			cl_env_percpu_put(local_env);
 
+		if (ra > 0)
+			ll_ra_fast(file, ras, &ria);
+
 		RETURN(result);
 	}
 
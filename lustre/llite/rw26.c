@@ -192,6 +192,7 @@ ll_direct_IO_seg(const struct lu_env *env, struct cl_io *io, int rw,
 	size_t page_size = cl_page_size(obj);
 	size_t orig_size = size;
 	bool do_io;
+	bool cached = false;
 	int io_pages = 0;
 
 	ENTRY;
@@ -225,6 +226,8 @@ ll_direct_IO_seg(const struct lu_env *env, struct cl_io *io, int rw,
 			void *src;
 			void *dst;
 
+			cached = true;
+
 			src_page = (rw == WRITE) ? pages[i] : vmpage;
 			dst_page = (rw == WRITE) ? vmpage : pages[i];
 
@@ -268,11 +271,16 @@ ll_direct_IO_seg(const struct lu_env *env, struct cl_io *io, int rw,
 		file_offset += page_size;
 	}
 
-	if (rc == 0 && io_pages) {
+	/* Transient pages are handed over to the transfer without waiting
+	 * for them if the IO issuer collects the completions, cached pages
+	 * have to be released by this thread. */
+	if (rc == 0 && io_pages && io->ci_aio != NULL && !cached)
+		rc = cl_dio_submit(env, io, rw == READ ? CRT_READ : CRT_WRITE,
+				   queue, io->ci_aio);
+	else if (rc == 0 && io_pages)
 		rc = cl_io_submit_sync(env, io,
 				       rw == READ ? CRT_READ : CRT_WRITE,
 				       queue, 0);
-	}
 	if (rc == 0)
 		rc = orig_size;
 
@@ -303,6 +311,60 @@ static void ll_free_user_pages(struct page **pages, int npages, int do_dirty)
 #endif
 }
 
+/* pinned user pages of a direct IO, released once it is transferred */
+struct ll_dio_pages {
+	struct cl_dio_hold	 ldp_hold;
+	struct page		**ldp_pages;
+	int			 ldp_count;
+	/* the pages were read into and have to be dirtied */
+	int			 ldp_dirty;
+};
+
+static void ll_dio_pages_release(const struct lu_env *env,
+				 struct cl_dio_hold *hold)
+{
+	struct ll_dio_pages *ldp = container_of(hold, struct ll_dio_pages,
+						ldp_hold);
+
+	ll_free_user_pages(ldp->ldp_pages, ldp->ldp_count, ldp->ldp_dirty);
+	OBD_FREE_PTR(ldp);
+}
+
+/*
+ * Does a direct IO segment from the \a page_count pinned user pages \a pages,
+ * an array of \a max_pages, and releases them.  The pages of an IO which is
+ * not waited for chunk by chunk are released once it is fully transferred.
+ */
+static ssize_t
+ll_direct_IO_pages(const struct lu_env *env, struct cl_io *io, int rw,
+		   struct inode *inode, size_t size, loff_t file_offset,
+		   struct page **pages, int page_count, int max_pages)
+{
+	ssize_t rc;
+
+	if (io->ci_aio != NULL) {
+		struct ll_dio_pages *ldp;
+
+		OBD_ALLOC_PTR(ldp);
+		if (ldp == NULL) {
+			ll_free_user_pages(pages, max_pages, 0);
+			return -ENOMEM;
+		}
+		ldp->ldp_pages = pages;
+		ldp->ldp_count = max_pages;
+		ldp->ldp_dirty = rw == READ;
+		cl_dio_hold_add(io->ci_aio, &ldp->ldp_hold, inode,
+				ll_dio_pages_release);
+	}
+
+	rc = ll_direct_IO_seg(env, io, rw, inode, size, file_offset, pages,
+			      page_count);
+	if (io->ci_aio == NULL)
+		ll_free_user_pages(pages, max_pages, rw == READ);
+
+	return rc;
+}
+
 #ifdef KMALLOC_MAX_SIZE
 #define MAX_MALLOC KMALLOC_MAX_SIZE
 #else
@@ -395,12 +457,9 @@ ll_direct_IO(
 		if (likely(result > 0)) {
 			int n = DIV_ROUND_UP(result + offs, PAGE_SIZE);
 
-			result = ll_direct_IO_seg(env, io, iov_iter_rw(iter),
-						  inode, result, file_offset,
-						  pages, n);
-			ll_free_user_pages(pages, n,
-					   iov_iter_rw(iter) == READ);
-
+			result = ll_direct_IO_pages(env, io, iov_iter_rw(iter),
+						    inode, result, file_offset,
+						    pages, n, n);
 		}
 		if (unlikely(result <= 0)) {
 			/* If we can't allocate a large enough buffer
@@ -438,6 +497,134 @@ out:
 
 	return tot_bytes ? : result;
 }
+
+/* Bytes of a hybrid IO bounced through kernel pages per transfer */
+#define LL_HYBRID_IO_BATCH	(4UL << 20)
+
+/**
+ * Does the page aligned range of a buffered IO through the direct IO path.
+ *
+ * The user data are bounced through kernel pages, so that the user buffer
+ * does not need to be aligned, and transferred as transient pages, without
+ * page cache insertion nor grant accounting.  The pages written are released
+ * by their transfer completion, the read ones are copied out once transferred.
+ */
+ssize_t ll_hybrid_io(const struct lu_env *env, struct cl_io *io, int rw)
+{
+	struct kiocb *iocb = &io->u.ci_rw.rw_iocb;
+	struct iov_iter *iter = &io->u.ci_rw.rw_iter;
+	struct inode *inode = file_inode(iocb->ki_filp);
+	size_t max = min_t(size_t, iov_iter_count(iter), LL_HYBRID_IO_BATCH);
+	int max_pages = DIV_ROUND_UP(max, PAGE_SIZE);
+	struct page **pages;
+	loff_t pos = iocb->ki_pos;
+	ssize_t tot_bytes = 0;
+	ssize_t result = 0;
+	ENTRY;
+
+	LASSERT(!(pos & ~PAGE_MASK));
+
+	OBD_ALLOC_LARGE(pages, max_pages * sizeof(*pages));
+	if (pages == NULL)
+		RETURN(-ENOMEM);
+
+	/* transient pages are read under the inode mutex, see ll_direct_IO() */
+	if (rw == READ)
+		inode_lock(inode);
+	else
+		file_update_time(iocb->ki_filp);
+
+	while (iov_iter_count(iter) > 0) {
+		size_t count = min_t(size_t, iov_iter_count(iter), max);
+		size_t bytes = 0;
+		int err = 0;
+		int n = 0;
+		int i;
+
+		if (rw == READ) {
+			if (pos >= i_size_read(inode))
+				break;
+			if (pos + count > i_size_read(inode))
+				count = i_size_read(inode) - pos;
+		}
+
+		while (n < DIV_ROUND_UP(count, PAGE_SIZE)) {
+			pages[n] = alloc_page(GFP_NOFS);
+			if (pages[n] == NULL) {
+				err = -ENOMEM;
+				break;
+			}
+			if (rw == WRITE &&
+			    copy_page_from_iter(pages[n], 0, PAGE_SIZE,
+						iter) != PAGE_SIZE) {
+				/* only full pages are written */
+				put_page(pages[n]);
+				err = -EFAULT;
+				break;
+			}
+			n++;
+		}
+		if (n == 0) {
+			result = err;
+			break;
+		}
+
+		if (rw == WRITE)
+			count = (size_t)n << PAGE_SHIFT;
+		else
+			count = min_t(size_t, count, (size_t)n << PAGE_SHIFT);
+
+		result = ll_direct_IO_seg(env, io, rw, inode, count, pos,
+					  pages, n);
+		for (i = 0; i < n; i++) {
+			if (result > 0 && rw == READ)
+				bytes += copy_page_to_iter(pages[i], 0,
+						min_t(size_t, PAGE_SIZE,
+						      count - bytes), iter);
+			/* a page still in transfer is pinned by its cl_page */
+			put_page(pages[i]);
+		}
+		if (result <= 0)
+			break;
+
+		if (rw == WRITE)
+			bytes = count;
+		tot_bytes += bytes;
+		pos += bytes;
+		if (bytes < count) {
+			result = -EFAULT;
+			break;
+		}
+		/* the user buffer is consumed up to the failure */
+		if (err != 0) {
+			result = err;
+			break;
+		}
+	}
+
+	if (rw == READ)
+		inode_unlock(inode);
+	OBD_FREE_LARGE(pages, max_pages * sizeof(*pages));
+
+	if (tot_bytes > 0) {
+		struct vvp_io *vio = vvp_env_io(env);
+
+		iocb->ki_pos = pos;
+		if (rw == WRITE) {
+			ll_inode_size_lock(inode);
+			if (pos > i_size_read(inode))
+				i_size_write(inode, pos);
+			ll_inode_size_unlock(inode);
+			/* no commit async for direct IO */
+			vio->u.write.vui_written += tot_bytes;
+		}
+		ll_stats_ops_tally(ll_i2sbi(inode), rw == READ ?
+				   LPROC_LL_HYBRID_READ_BYTES :
+				   LPROC_LL_HYBRID_WRITE_BYTES, tot_bytes);
+	}
+
+	RETURN(tot_bytes ? : result);
+}
 #else /* !HAVE_DIRECTIO_ITER && !HAVE_IOV_ITER_RW */
 
 static inline int ll_get_user_pages(int rw, unsigned long user_addr,
@@ -533,10 +720,10 @@ ll_direct_IO(int rw, struct kiocb *iocb, const struct iovec *iov,
                         if (likely(page_count > 0)) {
                                 if (unlikely(page_count <  max_pages))
 					bytes = page_count << PAGE_SHIFT;
-				result = ll_direct_IO_seg(env, io, rw, inode,
-							  bytes, file_offset,
-							  pages, page_count);
-                                ll_free_user_pages(pages, max_pages, rw==READ);
+				result = ll_direct_IO_pages(env, io, rw, inode,
+							    bytes, file_offset,
+							    pages, page_count,
+							    max_pages);
                         } else if (page_count == 0) {
                                 GOTO(out, result = -EFAULT);
                         } else {
@@ -578,6 +765,12 @@ out:
 
 	RETURN(tot_bytes ? tot_bytes : result);
 }
+
+ssize_t ll_hybrid_io(const struct lu_env *env, struct cl_io *io, int rw)
+{
+	/* ll_hybrid_io_eligible() never selects it without iov_iter */
+	return -EOPNOTSUPP;
+}
 #endif /* HAVE_DIRECTIO_ITER || HAVE_IOV_ITER_RW */
 
 /**
@@ -195,6 +195,7 @@ static void __exit lustre_exit(void)
 
 	lprocfs_remove(&proc_lustre_fs_root);
 
+	ll_ra_async_fini();
 	ll_xattr_fini();
 	cl_env_put(cl_inode_fini_env, &cl_inode_fini_refcheck);
 	vvp_global_fini();
@@ -116,6 +116,8 @@ struct vvp_io {
 	pgoff_t	vui_ra_count;
 	/* Set when vui_ra_{start,count} have been initialized. */
 	bool		vui_ra_valid;
+	/* Set when a buffered IO goes through the direct IO path */
+	bool		vui_hybrid;
 };
 
 extern struct lu_device_type vvp_device_type;
@@ -230,7 +232,9 @@ struct vvp_page {
 	struct cl_page_slice vpg_cl;
 	unsigned	vpg_defer_uptodate:1,
 			vpg_ra_updated:1,
-			vpg_ra_used:1;
+			vpg_ra_used:1,
+			/* read ahead by a read-ahead worker */
+			vpg_ra_async:1;
 	/** VM page */
 	struct page	*vpg_page;
 };
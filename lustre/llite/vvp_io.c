@@ -798,8 +798,11 @@ static int vvp_io_read_start(const struct lu_env *env,
 			 "ki_pos %lld [%lld, %lld)\n",
 			 io->u.ci_rw.rw_iocb.ki_pos,
 			 range->cir_pos, range->cir_pos + range->cir_count);
-		result = generic_file_read_iter(&io->u.ci_rw.rw_iocb,
-						&io->u.ci_rw.rw_iter);
+		if (vio->vui_hybrid)
+			result = ll_hybrid_io(env, io, READ);
+		else
+			result = generic_file_read_iter(&io->u.ci_rw.rw_iocb,
+							&io->u.ci_rw.rw_iter);
 		break;
 	case IO_SPLICE:
 		result = generic_file_splice_read(file, &pos,
@@ -1075,8 +1078,11 @@ static int vvp_io_write_start(const struct lu_env *env,
 	 */
 	if (lock_inode)
 		inode_lock(inode);
-	result = __generic_file_write_iter(&io->u.ci_rw.rw_iocb,
-					   &io->u.ci_rw.rw_iter);
+	if (vio->vui_hybrid)
+		result = ll_hybrid_io(env, io, WRITE);
+	else
+		result = __generic_file_write_iter(&io->u.ci_rw.rw_iocb,
+						   &io->u.ci_rw.rw_iter);
 	if (lock_inode)
 		inode_unlock(inode);
 
@@ -1705,6 +1705,92 @@ lmv_enqueue(struct obd_export *exp, struct ldlm_enqueue_info *einfo,
 	RETURN(rc);
 }
 
+/**
+ * Enqueue inodebits locks on objects possibly located on several MDTs.
+ *
+ * The items are grouped by MDT, each group is sent in one RPC.  Since
+ * the groups are granted independently, all-or-nothing semantics are only
+ * available when all the objects are on the same MDT.
+ *
+ * \retval 0		the per-lock status is in lei_rc of each item
+ * \retval -EXDEV	all-or-nothing enqueue spanning several MDTs
+ * \retval negative	errno if no lock could be enqueued
+ */
+static int
+lmv_enqueue_multi(struct obd_export *exp, struct ldlm_enqueue_info *einfo,
+		  struct ldlm_enqueue_item *items, int count,
+		  __u64 extra_lock_flags)
+{
+	struct obd_device *obd = exp->exp_obd;
+	struct lmv_obd *lmv = &obd->u.lmv;
+	struct ldlm_enqueue_item *group;
+	struct lmv_tgt_desc **tgts;
+	struct lu_fid fid;
+	int done = 0;
+	int rc = 0;
+	int i;
+	int j;
+	int n;
+	ENTRY;
+
+	if (count <= 0 || count > LDLM_MULTI_ENQUEUE_MAX)
+		RETURN(-EINVAL);
+
+	OBD_ALLOC(tgts, sizeof(*tgts) * count);
+	if (tgts == NULL)
+		RETURN(-ENOMEM);
+	OBD_ALLOC(group, sizeof(*group) * count);
+	if (group == NULL)
+		GOTO(out_tgts, rc = -ENOMEM);
+
+	for (i = 0; i < count; i++) {
+		fid_extract_from_res_name(&fid, &items[i].lei_res_id);
+		tgts[i] = lmv_find_target(lmv, &fid);
+		if (IS_ERR(tgts[i]))
+			GOTO(out, rc = PTR_ERR(tgts[i]));
+		if ((extra_lock_flags & LDLM_FL_ALL_OR_NOTHING) &&
+		    tgts[i] != tgts[0])
+			GOTO(out, rc = -EXDEV);
+	}
+
+	while (done < count) {
+		struct lmv_tgt_desc *tgt = NULL;
+
+		/* gather the items of the next MDT not yet done */
+		for (i = 0, n = 0; i < count; i++) {
+			if (tgts[i] == NULL)
+				continue;
+			if (tgt == NULL)
+				tgt = tgts[i];
+			if (tgts[i] == tgt)
+				group[n++] = items[i];
+		}
+
+		CDEBUG(D_INODE, "ENQUEUE %d locks -> mds #%u\n", n,
+		       tgt->ltd_idx);
+		rc = md_enqueue_multi(tgt->ltd_exp, einfo, group, n,
+				      extra_lock_flags);
+
+		for (i = 0, j = 0; i < count; i++) {
+			if (tgts[i] != tgt)
+				continue;
+			items[i] = group[j++];
+			if (rc != 0)
+				items[i].lei_rc = rc;
+			tgts[i] = NULL;
+		}
+		done += n;
+	}
+	/* the per-lock status tells what each MDT did */
+	rc = 0;
+out:
+	OBD_FREE(group, sizeof(*group) * count);
+out_tgts:
+	OBD_FREE(tgts, sizeof(*tgts) * count);
+
+	RETURN(rc);
+}
+
 static int
 lmv_getattr_name(struct obd_export *exp,struct md_op_data *op_data,
 		 struct ptlrpc_request **preq)
@@ -2253,6 +2339,87 @@ static struct lu_dirent *lmv_dirent_next(struct lmv_dir_ctxt *ctxt)
 	return ent;
 }
 
+/**
+ * Prefetch the UPDATE locks of the stripes of a directory
+ *
+ * Reading a striped directory takes a PR UPDATE lock on every stripe, which
+ * costs one enqueue RPC per stripe.  Enqueue the missing locks in one RPC per
+ * MDT instead, without waiting on conflicts, and keep them unused in the LRU
+ * where stripe_dirent_next() will find them.  Whatever is not granted here is
+ * enqueued by md_read_page() as before.
+ *
+ * \param[in] exp	obd export refer to LMV
+ * \param[in] op_data	hold those MD parameters of read_entry
+ * \param[in] cb_op	ldlm callback being used in enqueue in mdc_read_entry
+ */
+static void lmv_striped_prefetch_locks(struct obd_export *exp,
+				       struct md_op_data *op_data,
+				       struct md_callback *cb_op)
+{
+	struct lmv_obd *lmv = &exp->exp_obd->u.lmv;
+	struct lmv_stripe_md *lsm = op_data->op_mea1;
+	struct ldlm_enqueue_info einfo = {
+		.ei_type	= LDLM_IBITS,
+		.ei_mode	= LCK_PR,
+		.ei_cb_bl	= cb_op->md_blocking_ast,
+		.ei_cb_cp	= ldlm_completion_ast,
+	};
+	union ldlm_policy_data policy = {
+		.l_inodebits = { .bits = MDS_INODELOCK_UPDATE }
+	};
+	struct ldlm_enqueue_item *items;
+	struct lustre_handle lockh;
+	int count = 0;
+	int rc;
+	int i;
+	ENTRY;
+
+	OBD_ALLOC(items, sizeof(*items) * LDLM_MULTI_ENQUEUE_MAX);
+	if (items == NULL)
+		RETURN_EXIT;
+
+	for (i = 0; i < lsm->lsm_md_stripe_count; i++) {
+		struct lmv_oinfo *oinfo = &lsm->lsm_md_oinfo[i];
+		struct lmv_tgt_desc *tgt;
+
+		tgt = lmv_get_target(lmv, oinfo->lmo_mds, NULL);
+		if (IS_ERR(tgt) || tgt->ltd_exp == NULL ||
+		    !exp_connect_multi_enqueue(tgt->ltd_exp))
+			continue;
+
+		if (md_lock_match(tgt->ltd_exp, LDLM_FL_BLOCK_GRANTED |
+				  LDLM_FL_TEST_LOCK, &oinfo->lmo_fid,
+				  LDLM_IBITS, &policy, LCK_CR | LCK_CW |
+				  LCK_PR | LCK_PW, &lockh) != 0)
+			continue;
+
+		fid_build_reg_res_name(&oinfo->lmo_fid,
+				       &items[count].lei_res_id);
+		items[count].lei_policy = policy;
+		items[count].lei_mode = LCK_PR;
+		if (++count == LDLM_MULTI_ENQUEUE_MAX)
+			break;
+	}
+
+	/* a single missing lock is enqueued by md_read_page() just as well */
+	if (count < 2)
+		GOTO(out, rc = 0);
+
+	rc = lmv_enqueue_multi(exp, &einfo, items, count, 0);
+	if (rc != 0)
+		GOTO(out, rc);
+
+	for (i = 0; i < count; i++) {
+		if (items[i].lei_rc == 0)
+			ldlm_lock_decref(&items[i].lei_lockh, LCK_PR);
+	}
+	EXIT;
+out:
+	CDEBUG(D_INODE, "dir "DFID" prefetched %d stripe locks: rc = %d\n",
+	       PFID(&op_data->op_fid1), count, rc);
+	OBD_FREE(items, sizeof(*items) * LDLM_MULTI_ENQUEUE_MAX);
+}
+
 /**
  * Build dir entry page for striped directory
  *
@@ -2321,6 +2488,10 @@ static int lmv_striped_read_page(struct obd_export *exp,
 	ctxt->ldc_hash = offset;
 	ctxt->ldc_count = stripe_count;
 
+	/* all the stripes are read to fill the first page */
+	if (offset == 0)
+		lmv_striped_prefetch_locks(exp, op_data, cb_op);
+
 	while (1) {
 		next = lmv_dirent_next(ctxt);
 
@@ -3181,6 +3352,7 @@ struct md_ops lmv_md_ops = {
         .m_close                = lmv_close,
         .m_create               = lmv_create,
         .m_enqueue              = lmv_enqueue,
+	.m_enqueue_multi	= lmv_enqueue_multi,
         .m_getattr              = lmv_getattr,
         .m_getxattr             = lmv_getxattr,
         .m_getattr_name         = lmv_getattr_name,
@@ -550,6 +550,9 @@ static int lov_io_rw_iter_init(const struct lu_env *env,
 			io->ci_need_write_intent = 1;
 			RETURN(-ENODATA);
 		}
+		/* the range is within a stripe, which is done by one task */
+		range->cir_lane = lov_comp_index(index,
+				lov_stripe_number(lsm, index, range->cir_pos));
 		RETURN(0);
 	}
 
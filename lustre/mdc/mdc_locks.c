@@ -899,6 +899,32 @@ int mdc_enqueue(struct obd_export *exp, struct ldlm_enqueue_info *einfo,
 				op_data, lockh, extra_lock_flags);
 }
 
+/**
+ * Enqueue inodebits locks on several objects of this MDT in one RPC.
+ *
+ * The locks are granted only if they do not conflict, the MDT never makes
+ * the request wait, so this is suited to prefetching locks a caller would
+ * otherwise take one by one.  The status of each lock is in its item.
+ */
+int mdc_enqueue_multi(struct obd_export *exp, struct ldlm_enqueue_info *einfo,
+		      struct ldlm_enqueue_item *items, int count,
+		      __u64 extra_lock_flags)
+{
+	struct obd_device *obddev = class_exp2obd(exp);
+	int rc;
+	ENTRY;
+
+	rc = obd_get_request_slot(&obddev->u.cli);
+	if (rc != 0)
+		RETURN(rc);
+
+	rc = ldlm_cli_enqueue_multi(exp, einfo, items, count,
+				    extra_lock_flags);
+	obd_put_request_slot(&obddev->u.cli);
+
+	RETURN(rc);
+}
+
 static int mdc_finish_intent_lock(struct obd_export *exp,
                                   struct ptlrpc_request *request,
                                   struct md_op_data *op_data,
@@ -2611,6 +2611,7 @@ static struct md_ops mdc_md_ops = {
         .m_close            = mdc_close,
         .m_create           = mdc_create,
         .m_enqueue          = mdc_enqueue,
+	.m_enqueue_multi    = mdc_enqueue_multi,
         .m_getattr          = mdc_getattr,
         .m_getattr_name     = mdc_getattr_name,
         .m_intent_lock      = mdc_intent_lock,
@@ -38,6 +38,7 @@
 #define DEBUG_SUBSYSTEM S_CLASS
 
 #include <linux/sched.h>
+#include <linux/hash.h>
 #include <linux/list.h>
 #include <obd_class.h>
 #include <obd_support.h>
@@ -738,51 +739,102 @@ int cl_io_cancel(const struct lu_env *env, struct cl_io *io,
         return result;
 }
 
-static
-struct cl_io_pt *cl_io_submit_pt(struct cl_io *io, loff_t pos, size_t count)
+/* buckets of the lane table of a parallel IO, keyed by cl_io_range::cir_lane */
+#define CL_IO_PT_LANE_BITS	6
+#define CL_IO_PT_LANES		(1 << CL_IO_PT_LANE_BITS)
+
+/**
+ * Adds the current range of the parallel IO \a io to the list of its ranges
+ * ending at \a tail, and to the lane of its stripe, which is looked up in
+ * the lane table \a lanes allocated with the first range.
+ */
+static int cl_io_add_pt(struct cl_io *io, struct cl_io_pt ***tail,
+			struct cl_io_pt ***lanes)
 {
+	struct cl_io_range *range = &io->u.ci_rw.rw_range;
+	struct cl_io_pt **bucket;
 	struct cl_io_pt *pt;
-	int rc;
+	struct cl_io_pt *lane;
+
+	if (*lanes == NULL) {
+		OBD_ALLOC(*lanes, sizeof(**lanes) * CL_IO_PT_LANES);
+		if (*lanes == NULL)
+			return -ENOMEM;
+	}
 
 	OBD_ALLOC(pt, sizeof(*pt));
 	if (pt == NULL)
-		RETURN(ERR_PTR(-ENOMEM));
+		return -ENOMEM;
 
-	pt->cip_next = NULL;
 	init_sync_kiocb(&pt->cip_iocb, io->u.ci_rw.rw_file);
-	pt->cip_iocb.ki_pos = pos;
+	pt->cip_iocb.ki_pos = range->cir_pos;
 #ifdef HAVE_KIOCB_KI_LEFT
-	pt->cip_iocb.ki_left = count;
+	pt->cip_iocb.ki_left = range->cir_count;
 #elif defined(HAVE_KI_NBYTES)
-	pt->cip_iocb.ki_nbytes = count;
+	pt->cip_iocb.ki_nbytes = range->cir_count;
 #endif
 	pt->cip_iter = io->u.ci_rw.rw_iter;
-	iov_iter_truncate(&pt->cip_iter, count);
+	iov_iter_truncate(&pt->cip_iter, range->cir_count);
 	pt->cip_file   = io->u.ci_rw.rw_file;
 	pt->cip_iot    = io->ci_type;
-	pt->cip_pos    = pos;
-	pt->cip_count  = count;
+	pt->cip_lane   = range->cir_lane;
+	pt->cip_pos    = range->cir_pos;
+	pt->cip_count  = range->cir_count;
 	pt->cip_result = 0;
 
-	rc = cfs_ptask_init(&pt->cip_task, io->u.ci_rw.rw_ptask, pt,
-			    PTF_ORDERED | PTF_COMPLETE |
-			    PTF_USER_MM | PTF_RETRY, smp_processor_id());
-	if (rc)
-		GOTO(out_error, rc);
+	bucket = &(*lanes)[hash_32(pt->cip_lane, CL_IO_PT_LANE_BITS)];
+	for (lane = *bucket; lane != NULL; lane = lane->cip_lane_hnext) {
+		if (lane->cip_lane == pt->cip_lane)
+			break;
+	}
+	if (lane != NULL) {
+		lane->cip_lane_tail->cip_lane_next = pt;
+		lane->cip_lane_tail = pt;
+	} else {
+		pt->cip_lane_tail = pt;
+		pt->cip_lane_hnext = *bucket;
+		*bucket = pt;
+	}
 
-	CDEBUG(D_VFSTRACE, "submit %s range: [%llu, %llu)\n",
-		io->ci_type == CIT_READ ? "read" : "write",
-		pos, pos + count);
+	**tail = pt;
+	*tail = &pt->cip_next;
 
-	rc = cfs_ptask_submit(&pt->cip_task, cl_io_engine);
-	if (rc)
-		GOTO(out_error, rc);
+	return 0;
+}
 
-	RETURN(pt);
+/**
+ * Starts a task for each lane of the parallel IO ranges \a head. A lane
+ * which cannot be handed over to a task is done by the caller.
+ */
+static void cl_io_submit_pt(struct cl_io *io, struct cl_io_pt *head)
+{
+	struct cl_io_pt *pt;
+	int rc;
 
-out_error:
-	OBD_FREE(pt, sizeof(*pt));
-	RETURN(ERR_PTR(rc));
+	for (pt = head; pt != NULL; pt = pt->cip_next) {
+		if (pt->cip_lane_tail == NULL)
+			continue;
+
+		rc = cfs_ptask_init(&pt->cip_task, io->u.ci_rw.rw_ptask, pt,
+				    PTF_ORDERED | PTF_COMPLETE |
+				    PTF_USER_MM | PTF_RETRY,
+				    smp_processor_id());
+		if (rc == 0) {
+			CDEBUG(D_VFSTRACE, "submit %s lane %d from: "
+			       "[%llu, %llu)\n",
+			       io->ci_type == CIT_READ ? "read" : "write",
+			       pt->cip_lane, pt->cip_pos,
+			       pt->cip_pos + pt->cip_count);
+			rc = cfs_ptask_submit(&pt->cip_task, cl_io_engine);
+		}
+		if (rc != 0) {
+			CDEBUG(D_VFSTRACE, "lane %d done inline: rc = %d\n",
+			       pt->cip_lane, rc);
+			pt->cip_task.pt_result = io->u.ci_rw.rw_ptask(
+							&pt->cip_task);
+			complete(&pt->cip_task.pt_completion);
+		}
+	}
 }
 
 /**
@@ -803,15 +855,23 @@ out_error:
  *    - cl_io_iter_fini()
  *
  * repeatedly until there is no more io to do.
+ *
+ * A parallel IO only collects its ranges, but the last one, which is done by
+ * the caller. The ranges of each stripe (lane) are then done in file order
+ * by a task of their own, so that a stripe object is driven by one thread
+ * and all the stripes of the IO are driven at once. The IO is done up to the
+ * first range that is not fully done, as a short IO is.
  */
 int cl_io_loop(const struct lu_env *env, struct cl_io *io)
 {
 	struct cl_io_pt *pt = NULL, *head = NULL;
 	struct cl_io_pt **tail = &head;
+	struct cl_io_pt **lanes = NULL;
 	loff_t pos;
 	size_t count;
 	size_t last_chunk_count = 0;
 	bool short_io = false;
+	bool submitted = false;
 	int rc = 0;
 	ENTRY;
 
@@ -830,19 +890,21 @@ int cl_io_loop(const struct lu_env *env, struct cl_io *io)
 		count = io->u.ci_rw.rw_range.cir_count;
 
 		if (io->ci_pio) {
-			/* submit this range for parallel execution */
-			pt = cl_io_submit_pt(io, pos, count);
-			if (IS_ERR(pt)) {
+			/* collect this range for parallel execution */
+			rc = cl_io_add_pt(io, &tail, &lanes);
+			if (rc) {
 				cl_io_iter_fini(env, io);
-				rc = PTR_ERR(pt);
 				break;
 			}
-
-			*tail = pt;
-			tail = &pt->cip_next;
 		} else {
 			size_t nob = io->ci_nob;
 
+			/* the lanes run along with the last range */
+			if (head != NULL && !submitted) {
+				cl_io_submit_pt(io, head);
+				submitted = true;
+			}
+
 			CDEBUG(D_VFSTRACE,
 				"execute type %u range: [%llu, %llu) nob: %zu %s\n",
 				io->ci_type, pos, pos + count, nob,
@@ -884,29 +946,35 @@ int cl_io_loop(const struct lu_env *env, struct cl_io *io)
 		io->ci_type, io->ci_nob, rc,
 		io->ci_continue ? "continue" : "stop");
 
-	while (head != NULL) {
+	/* the ranges collected before an error are still done, so that the
+	 * caller can account and resume from them */
+	if (head != NULL && !submitted)
+		cl_io_submit_pt(io, head);
+
+	for (pt = head; pt != NULL; pt = pt->cip_next) {
 		int rc2;
 
-		pt = head;
-		head = head->cip_next;
+		if (pt->cip_lane_tail == NULL)
+			continue;
 
 		rc2 = cfs_ptask_wait_for(&pt->cip_task);
 		LASSERTF(!rc2, "wait for task error: %d\n", rc2);
+	}
+
+	while (head != NULL) {
+		pt = head;
+		head = head->cip_next;
 
-		rc2 = cfs_ptask_result(&pt->cip_task);
 		CDEBUG(D_VFSTRACE,
-			"done %s range: [%llu, %llu) ret: %zd, rc: %d\n",
+			"done %s lane %d range: [%llu, %llu) ret: %zd, rc: %d\n",
 			pt->cip_iot == CIT_READ ? "read" : "write",
-			pt->cip_pos, pt->cip_pos + pt->cip_count,
-			pt->cip_result, rc2);
-		if (rc2)
-			rc = rc ? rc : rc2;
+			pt->cip_lane, pt->cip_pos, pt->cip_pos + pt->cip_count,
+			pt->cip_result, pt->cip_rc);
 		if (!short_io) {
-			if (!rc2) /* IO is done by this task successfully */
-				io->ci_nob += pt->cip_result;
+			io->ci_nob += pt->cip_result;
 			if (pt->cip_result < pt->cip_count) {
-				/* short IO happened.
-				 * Not necessary to be an error */
+				/* short IO happened, not necessarily an
+				 * error, what follows does not count */
 				CDEBUG(D_VFSTRACE,
 					"incomplete range: [%llu, %llu) "
 					"last_chunk_count: %zu\n",
@@ -914,12 +982,17 @@ int cl_io_loop(const struct lu_env *env, struct cl_io *io)
 					pt->cip_pos + pt->cip_count,
 					last_chunk_count);
 				io->ci_nob -= last_chunk_count;
+				if (rc == 0)
+					rc = pt->cip_rc;
 				short_io = true;
 			}
 		}
 		OBD_FREE(pt, sizeof(*pt));
 	}
 
+	if (lanes != NULL)
+		OBD_FREE(lanes, sizeof(*lanes) * CL_IO_PT_LANES);
+
 	CDEBUG(D_VFSTRACE, "return nob: %zu (%s io), rc: %d\n",
 		io->ci_nob, short_io ? "short" : "full", rc);
 
@@ -1360,3 +1433,136 @@ void cl_sync_io_note(const struct lu_env *env, struct cl_sync_io *anchor,
 	EXIT;
 }
 EXPORT_SYMBOL(cl_sync_io_note);
+
+/**
+ * Releases the pages of a direct IO once they all have been transferred,
+ * then its holds.  The pages are owned by nobody at this point, and the IO
+ * issuer may be gone, so they are unlinked from the list by hand.
+ */
+static void cl_aio_end(const struct lu_env *env, struct cl_sync_io *anchor)
+{
+	struct cl_dio_aio *aio = container_of(anchor, typeof(*aio), cda_sync);
+	struct cl_page_list *plist = &aio->cda_pages;
+	struct cl_page *page;
+	struct cl_page *temp;
+	ssize_t ret = anchor->csi_sync_rc ?: aio->cda_bytes;
+	ENTRY;
+
+	cl_page_list_for_each_safe(page, temp, plist) {
+		list_del_init(&page->cp_batch);
+		--plist->pl_nr;
+		lu_ref_del_at(&page->cp_reference, &page->cp_queue_ref,
+			      "queue", plist);
+		/* the transfer is over, the page can't be found anymore */
+		cl_page_delete(env, page);
+		cl_page_put(env, page);
+	}
+	LASSERT(plist->pl_nr == 0);
+
+	/* the data landed, the user pages and the locks can go */
+	while (!list_empty(&aio->cda_holds)) {
+		struct cl_dio_hold *hold;
+
+		hold = list_entry(aio->cda_holds.next, typeof(*hold),
+				  cdh_linkage);
+		list_del_init(&hold->cdh_linkage);
+		hold->cdh_release(env, hold);
+	}
+
+	if (aio->cda_done != NULL)
+		aio->cda_done(aio, ret);
+
+	if (aio->cda_iocb != NULL) {
+		/* AIO: the issuer has returned -EIOCBQUEUED already */
+		aio_complete(aio->cda_iocb, ret, 0);
+		cl_aio_free(aio);
+	} else {
+		cl_sync_io_end(env, anchor);
+	}
+	EXIT;
+}
+
+/**
+ * Allocates the state of a direct IO, holding the reference of the IO issuer.
+ *
+ * \a iocb is the IO to complete once all the pages are transferred if it is
+ * not synchronous, the issuer has to wait for cl_dio_aio::cda_sync otherwise.
+ */
+struct cl_dio_aio *cl_aio_alloc(struct kiocb *iocb)
+{
+	struct cl_dio_aio *aio;
+
+	OBD_ALLOC_PTR(aio);
+	if (aio != NULL) {
+		cl_sync_io_init(&aio->cda_sync, 1, cl_aio_end);
+		cl_page_list_init(&aio->cda_pages);
+		INIT_LIST_HEAD(&aio->cda_holds);
+		if (!is_sync_kiocb(iocb))
+			aio->cda_iocb = iocb;
+		aio->cda_start = ktime_get();
+	}
+	return aio;
+}
+EXPORT_SYMBOL(cl_aio_alloc);
+
+void cl_aio_free(struct cl_dio_aio *aio)
+{
+	if (aio != NULL)
+		OBD_FREE_PTR(aio);
+}
+EXPORT_SYMBOL(cl_aio_free);
+
+/**
+ * Submits the pages of a direct IO without waiting for them.
+ *
+ * The pages sent are moved from \a queue to cl_dio_aio::cda_pages, and are
+ * released by the completion of the last one; the pages left in the incoming
+ * list of \a queue are still owned by \a io.
+ */
+int cl_dio_submit(const struct lu_env *env, struct cl_io *io,
+		  enum cl_req_type iot, struct cl_2queue *queue,
+		  struct cl_dio_aio *aio)
+{
+	struct cl_sync_io *anchor = &aio->cda_sync;
+	struct cl_page *pg;
+	int rc;
+	ENTRY;
+
+	cl_page_list_for_each(pg, &queue->c2_qin) {
+		LASSERT(pg->cp_sync_io == NULL);
+		pg->cp_sync_io = anchor;
+	}
+	atomic_add(queue->c2_qin.pl_nr, &anchor->csi_sync_nr);
+
+	rc = cl_io_submit_rw(env, io, iot, queue);
+	if (rc != 0)
+		LASSERT(list_empty(&queue->c2_qout.pl_pages));
+
+	/* the issuer reference keeps the count above zero */
+	cl_page_list_for_each(pg, &queue->c2_qin) {
+		pg->cp_sync_io = NULL;
+		atomic_dec(&anchor->csi_sync_nr);
+	}
+	cl_page_list_splice(&queue->c2_qout, &aio->cda_pages);
+
+	RETURN(rc);
+}
+EXPORT_SYMBOL(cl_dio_submit);
+
+/**
+ * Adds \a hold, taken by the layer object \a owner, to the direct IO \a aio.
+ *
+ * \a release is called once all the pages of the IO are transferred, from
+ * the completion of the last one or from the IO issuer.  Only the IO issuer
+ * adds holds, under its reference on \a aio.
+ */
+void cl_dio_hold_add(struct cl_dio_aio *aio, struct cl_dio_hold *hold,
+		     const void *owner,
+		     void (*release)(const struct lu_env *env,
+				     struct cl_dio_hold *hold))
+{
+	hold->cdh_owner = owner;
+	hold->cdh_release = release;
+	list_add_tail(&hold->cdh_linkage, &aio->cda_holds);
+}
+EXPORT_SYMBOL(cl_dio_hold_add);
@@ -488,6 +488,24 @@ int cl_site_init(struct cl_site *s, struct cl_device *d)
                 cache_stats_init(&s->cs_pages, "pages");
                 for (i = 0; i < ARRAY_SIZE(s->cs_pages_state); ++i)
 			atomic_set(&s->cs_pages_state[0], 0);
+#ifdef HAVE_PERCPU_COUNTER_INIT_GFP_FLAG
+		result = percpu_counter_init(&s->cs_page_desc_bytes, 0,
+					     GFP_KERNEL);
+		if (result == 0) {
+			result = percpu_counter_init(&s->cs_page_desc_nr, 0,
+						     GFP_KERNEL);
+#else
+		result = percpu_counter_init(&s->cs_page_desc_bytes, 0);
+		if (result == 0) {
+			result = percpu_counter_init(&s->cs_page_desc_nr, 0);
+#endif
+			if (result != 0)
+				percpu_counter_destroy(&s->cs_page_desc_bytes);
+		}
+		if (result != 0) {
+			lu_site_fini(&s->cs_lu);
+			return result;
+		}
 		cl_env_percpu_refill();
 	}
 	return result;
@@ -499,6 +517,8 @@ EXPORT_SYMBOL(cl_site_init);
  */
 void cl_site_fini(struct cl_site *s)
 {
+	percpu_counter_destroy(&s->cs_page_desc_nr);
+	percpu_counter_destroy(&s->cs_page_desc_bytes);
         lu_site_fini(&s->cs_lu);
 }
 EXPORT_SYMBOL(cl_site_fini);
@@ -521,6 +541,8 @@ int cl_site_stats_print(const struct cl_site *site, struct seq_file *m)
 		[CPS_PAGEIN]	= "r",
 		[CPS_FREEING]	= "f"
 	};
+	s64 bytes;
+	s64 nr;
 	size_t i;
 
 /*
@@ -528,6 +550,7 @@ int cl_site_stats_print(const struct cl_site *site, struct seq_file *m)
 pages: ...... ...... ...... ...... ...... [...... ...... ...... ......]
 locks: ...... ...... ...... ...... ...... [...... ...... ...... ...... ......]
   env: ...... ...... ...... ...... ......
+descriptors: ...... bytes ...... pages ...... bytes/GiB
  */
 	lu_site_stats_seq_print(&site->cs_lu, m);
 	cache_stats_print(&site->cs_pages, m, 1);
@@ -538,6 +561,13 @@ locks: ...... ...... ...... ...... ...... [...... ...... ...... ...... ......]
 	seq_printf(m, "]\n");
 	cache_stats_print(&cl_env_stats, m, 0);
 	seq_printf(m, "\n");
+
+	/* the memory it costs to cache 1GiB of file data */
+	bytes = percpu_counter_sum_positive(&site->cs_page_desc_bytes);
+	nr = percpu_counter_sum_positive(&site->cs_page_desc_nr);
+	seq_printf(m, "descriptors: %lld bytes %lld pages %llu bytes/GiB\n",
+		   bytes, nr, nr == 0 ? 0ULL :
+		   div64_u64((u64)bytes << (30 - PAGE_SHIFT), nr));
 	return 0;
 }
 EXPORT_SYMBOL(cl_site_stats_print);
@@ -1105,6 +1135,7 @@ void cl_global_fini(void)
 	cl_io_engine = NULL;
 	cl_env_percpu_fini();
 	lu_context_key_degister(&cl_key);
+	cl_page_kmem_fini();
 	lu_kmem_fini(cl_object_caches);
 	OBD_FREE(cl_envs, sizeof(*cl_envs) * num_possible_cpus());
 }
@@ -142,10 +142,104 @@ cl_page_at_trusted(const struct cl_page *page,
 	RETURN(NULL);
 }
 
+/*
+ * cl_page descriptors are allocated from caches of their exact size, rather
+ * than rounded up to the next kmalloc size, which wastes up to a third of
+ * the memory of the descriptors with the usual stacks. There are only a few
+ * different sizes, one per layout type, and a cache is never destroyed
+ * before the module is unloaded, so a descriptor size is always allocated
+ * from the same cache.
+ */
+#define CL_PAGE_KMEM_MAX	16
+
+static struct kmem_cache *cl_page_kmem_array[CL_PAGE_KMEM_MAX];
+static unsigned short cl_page_kmem_size_array[CL_PAGE_KMEM_MAX];
+static char cl_page_kmem_name[CL_PAGE_KMEM_MAX][16];
+static DEFINE_MUTEX(cl_page_kmem_mutex);
+
+static struct kmem_cache *cl_page_kmem_find(unsigned short bufsize, int *idx)
+{
+	int i;
+
+	for (i = 0; i < CL_PAGE_KMEM_MAX; i++) {
+		unsigned short size = ACCESS_ONCE(cl_page_kmem_size_array[i]);
+
+		if (size == 0)
+			break;
+		if (size == bufsize) {
+			/* pairs with smp_wmb() in cl_page_kmem_get() */
+			smp_rmb();
+			return cl_page_kmem_array[i];
+		}
+	}
+	*idx = i;
+
+	return NULL;
+}
+
+/**
+ * Returns the cache of descriptors of \a bufsize bytes, creating it if
+ * needed, or NULL if all the caches are taken and kmalloc() has to be used.
+ */
+static struct kmem_cache *cl_page_kmem_get(unsigned short bufsize)
+{
+	struct kmem_cache *cache;
+	int idx;
+
+	cache = cl_page_kmem_find(bufsize, &idx);
+	if (likely(cache != NULL))
+		return cache;
+
+	mutex_lock(&cl_page_kmem_mutex);
+	cache = cl_page_kmem_find(bufsize, &idx);
+	if (cache == NULL && idx < CL_PAGE_KMEM_MAX) {
+		snprintf(cl_page_kmem_name[idx], sizeof(cl_page_kmem_name[0]),
+			 "cl_page_kmem-%u", bufsize);
+		cache = kmem_cache_create(cl_page_kmem_name[idx], bufsize, 0,
+					  SLAB_HWCACHE_ALIGN, NULL);
+		if (cache == NULL) {
+			cache = ERR_PTR(-ENOMEM);
+		} else {
+			cl_page_kmem_array[idx] = cache;
+			smp_wmb();
+			ACCESS_ONCE(cl_page_kmem_size_array[idx]) = bufsize;
+		}
+	}
+	mutex_unlock(&cl_page_kmem_mutex);
+
+	return cache;
+}
+
+void cl_page_kmem_fini(void)
+{
+	int i;
+
+	for (i = 0; i < CL_PAGE_KMEM_MAX; i++) {
+		if (cl_page_kmem_array[i] == NULL)
+			break;
+		kmem_cache_destroy(cl_page_kmem_array[i]);
+		cl_page_kmem_array[i] = NULL;
+		cl_page_kmem_size_array[i] = 0;
+	}
+}
+
+static void cl_page_desc_account(struct cl_object *obj,
+				 struct kmem_cache *cache, int bufsize, int nr)
+{
+	struct cl_site *site = cl_object_site(obj);
+
+	percpu_counter_add(&site->cs_page_desc_nr, nr);
+	percpu_counter_add(&site->cs_page_desc_bytes,
+			   nr * (cache != NULL ? kmem_cache_size(cache) :
+				 roundup_pow_of_two(bufsize)));
+}
+
 static void cl_page_free(const struct lu_env *env, struct cl_page *page)
 {
 	struct cl_object *obj  = page->cp_obj;
 	int pagesize = cl_object_header(obj)->coh_page_bufsize;
+	struct kmem_cache *cache;
+	int idx;
 
 	PASSERT(env, page, list_empty(&page->cp_batch));
 	PASSERT(env, page, page->cp_owner == NULL);
@@ -163,10 +257,15 @@ static void cl_page_free(const struct lu_env *env, struct cl_page *page)
 	}
 	cs_page_dec(obj, CS_total);
 	cs_pagestate_dec(obj, page->cp_state);
+	cache = cl_page_kmem_find(pagesize, &idx);
+	cl_page_desc_account(obj, cache, pagesize, -1);
 	lu_object_ref_del_at(&obj->co_lu, &page->cp_obj_ref, "cl_page", page);
 	cl_object_put(env, obj);
 	lu_ref_fini(&page->cp_reference);
-	OBD_FREE(page, pagesize);
+	if (cache != NULL)
+		OBD_SLAB_FREE(page, cache, pagesize);
+	else
+		OBD_FREE(page, pagesize);
 	EXIT;
 }
 
@@ -185,14 +284,22 @@ struct cl_page *cl_page_alloc(const struct lu_env *env,
 		struct cl_object *o, pgoff_t ind, struct page *vmpage,
 		enum cl_page_type type)
 {
+	int bufsize = cl_object_header(o)->coh_page_bufsize;
 	struct cl_page          *page;
 	struct lu_object_header *head;
+	struct kmem_cache	*cache;
 
 	ENTRY;
-	OBD_ALLOC_GFP(page, cl_object_header(o)->coh_page_bufsize,
-			GFP_NOFS);
+	cache = cl_page_kmem_get(bufsize);
+	if (IS_ERR(cache))
+		RETURN(ERR_CAST(cache));
+	if (cache != NULL)
+		OBD_SLAB_ALLOC_GFP(page, cache, bufsize, GFP_NOFS);
+	else
+		OBD_ALLOC_GFP(page, bufsize, GFP_NOFS);
 	if (page != NULL) {
 		int result = 0;
+		cl_page_desc_account(o, cache, bufsize, 1);
 		atomic_set(&page->cp_ref, 1);
 		page->cp_obj = o;
 		cl_object_get(o);
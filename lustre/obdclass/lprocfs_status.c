@@ -848,6 +848,10 @@ static const char *obd_connect_names[] = {
 	/* flags2 names */
 	"file_secctx",
 	"lockaheadv2",
+	"bl_ast_batch",
+	"lock_replay_batch",
+	"multi_enqueue",
+	"multi_brw",
 	NULL
 };
 
@@ -1680,6 +1684,7 @@ void lprocfs_init_mps_stats(int num_private_stats, struct lprocfs_stats *stats)
         LPROCFS_MD_OP_INIT(num_private_stats, stats, close);
         LPROCFS_MD_OP_INIT(num_private_stats, stats, create);
         LPROCFS_MD_OP_INIT(num_private_stats, stats, enqueue);
+	LPROCFS_MD_OP_INIT(num_private_stats, stats, enqueue_multi);
         LPROCFS_MD_OP_INIT(num_private_stats, stats, getattr);
         LPROCFS_MD_OP_INIT(num_private_stats, stats, getattr_name);
         LPROCFS_MD_OP_INIT(num_private_stats, stats, intent_lock);
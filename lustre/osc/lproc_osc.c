@@ -178,15 +178,34 @@ static int osc_cached_mb_seq_show(struct seq_file *m, void *v)
 {
 	struct obd_device *dev = m->private;
 	struct client_obd *cli = &dev->u.cli;
+	struct cl_lru_shard *cls;
 	int shift = 20 - PAGE_SHIFT;
+	__u64 contended = 0;
+	__u64 waits = atomic64_read(&cli->cl_lru_reclaim_waits);
+	int i;
+
+	cfs_percpt_for_each(cls, i, cli->cl_lru)
+		contended += cls->cls_contended;
 
 	seq_printf(m, "used_mb: %ld\n"
 		   "busy_cnt: %ld\n"
-		   "reclaim: %llu\n",
+		   "reclaim: %llu\n"
+		   "lru_shards: %d\n"
+		   "lru_contended: %llu\n"
+		   "reclaim_waits: %llu\n"
+		   "reclaim_avg_us: %llu\n"
+		   "reclaim_max_us: %llu\n",
 		   (atomic_long_read(&cli->cl_lru_in_list) +
 		    atomic_long_read(&cli->cl_lru_busy)) >> shift,
 		    atomic_long_read(&cli->cl_lru_busy),
-		   cli->cl_lru_reclaim);
+		   (__u64)atomic64_read(&cli->cl_lru_reclaim),
+		   cfs_percpt_number(cli->cl_lru),
+		   contended, waits,
+		   waits == 0 ? 0 :
+		   div_u64(div64_u64(atomic64_read(&cli->cl_lru_reclaim_ns),
+				     waits), NSEC_PER_USEC),
+		   div_u64(atomic64_read(&cli->cl_lru_reclaim_max_ns),
+			   NSEC_PER_USEC));
 
 	return 0;
 }
@@ -591,6 +610,82 @@ static int osc_unstable_stats_seq_show(struct seq_file *m, void *v)
 }
 LPROC_SEQ_FOPS_RO(osc_unstable_stats);
 
+static int osc_write_pacing_seq_show(struct seq_file *m, void *v)
+{
+	struct obd_device *dev = m->private;
+
+	seq_printf(m, "%d\n", dev->u.cli.cl_write_pacing);
+	return 0;
+}
+
+static ssize_t osc_write_pacing_seq_write(struct file *file,
+					  const char __user *buffer,
+					  size_t count, loff_t *off)
+{
+	struct obd_device *dev = ((struct seq_file *)file->private_data)->private;
+	struct client_obd *cli = &dev->u.cli;
+	int rc;
+	__s64 val;
+
+	rc = lprocfs_str_to_s64(buffer, count, &val);
+	if (rc)
+		return rc;
+	if (val < 0 || val > 1)
+		return -ERANGE;
+
+	spin_lock(&cli->cl_loi_list_lock);
+	if (cli->cl_write_pacing != val) {
+		/* rates are only sampled while pacing, start afresh */
+		memset(&cli->cl_pace_done, 0, sizeof(cli->cl_pace_done));
+		memset(&cli->cl_pace_grant, 0, sizeof(cli->cl_pace_grant));
+		cli->cl_pace_next = ktime_set(0, 0);
+		cli->cl_pace_charge = 0;
+		cli->cl_write_pacing = val;
+	}
+	spin_unlock(&cli->cl_loi_list_lock);
+
+	return count;
+}
+LPROC_SEQ_FOPS(osc_write_pacing);
+
+static int osc_write_pacing_stats_seq_show(struct seq_file *m, void *v)
+{
+	struct obd_device *dev = m->private;
+	struct client_obd *cli = &dev->u.cli;
+
+	spin_lock(&cli->cl_loi_list_lock);
+	seq_printf(m, "rpc_done_bytes_per_sec:      %llu\n"
+		   "grant_consume_bytes_per_sec: %llu\n"
+		   "avail_grant_bytes:           %lu\n"
+		   "paced_writers:               %llu\n"
+		   "paced_usec:                  %llu\n"
+		   "grant_starved_writers:       %llu\n"
+		   "grant_starved_usec:          %llu\n",
+		   cli->cl_pace_done.cpr_bps, cli->cl_pace_grant.cpr_bps,
+		   cli->cl_avail_grant, cli->cl_pace_count, cli->cl_pace_us,
+		   cli->cl_starve_count, cli->cl_starve_us);
+	spin_unlock(&cli->cl_loi_list_lock);
+	return 0;
+}
+
+static ssize_t osc_write_pacing_stats_seq_write(struct file *file,
+						const char __user *buffer,
+						size_t count, loff_t *off)
+{
+	struct obd_device *dev = ((struct seq_file *)file->private_data)->private;
+	struct client_obd *cli = &dev->u.cli;
+
+	spin_lock(&cli->cl_loi_list_lock);
+	cli->cl_pace_count = 0;
+	cli->cl_pace_us = 0;
+	cli->cl_starve_count = 0;
+	cli->cl_starve_us = 0;
+	spin_unlock(&cli->cl_loi_list_lock);
+
+	return count;
+}
+LPROC_SEQ_FOPS(osc_write_pacing_stats);
+
 LPROC_SEQ_FOPS_RO_TYPE(osc, connect_flags);
 LPROC_SEQ_FOPS_RO_TYPE(osc, server_uuid);
 LPROC_SEQ_FOPS_RO_TYPE(osc, conn_uuid);
@@ -656,6 +751,10 @@ struct lprocfs_vars lprocfs_osc_obd_vars[] = {
 	  .fops	=	&osc_pinger_recov_fops		},
 	{ .name	=	"unstable_stats",
 	  .fops	=	&osc_unstable_stats_fops	},
+	{ .name	=	"write_pacing",
+	  .fops	=	&osc_write_pacing_fops		},
+	{ .name	=	"write_pacing_stats",
+	  .fops	=	&osc_write_pacing_stats_fops	},
 	{ NULL }
 };
 
@@ -753,6 +852,22 @@ static int osc_rpc_stats_seq_show(struct seq_file *seq, void *v)
                         break;
         }
 
+	seq_printf(seq, "\n\t\t\t\t\t\t\twrite\n");
+	seq_printf(seq, "objects per rpc                             |");
+	seq_printf(seq, "       rpcs   %% cum %%\n");
+
+	write_tot = lprocfs_oh_sum(&cli->cl_write_objs_hist);
+
+	write_cum = 0;
+	for (i = 0; i < OBD_HIST_MAX && write_cum < write_tot; i++) {
+		unsigned long w = cli->cl_write_objs_hist.oh_buckets[i];
+
+		write_cum += w;
+		seq_printf(seq, "%d:\t\t\t\t\t    | %10lu %3lu %3lu\n",
+			   1 << i, w, pct(w, write_tot),
+			   pct(write_cum, write_tot));
+	}
+
 	spin_unlock(&cli->cl_loi_list_lock);
 
         return 0;
@@ -773,6 +888,7 @@ static ssize_t osc_rpc_stats_seq_write(struct file *file,
         lprocfs_oh_clear(&cli->cl_write_page_hist);
         lprocfs_oh_clear(&cli->cl_read_offset_hist);
         lprocfs_oh_clear(&cli->cl_write_offset_hist);
+	lprocfs_oh_clear(&cli->cl_write_objs_hist);
 
         return len;
 }
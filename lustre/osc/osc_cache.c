@@ -1450,6 +1450,10 @@ static void __osc_unreserve_grant(struct client_obd *cli,
 	 * chunk, we can save one extent tax. If extent tax is greater than
 	 * one chunk, we can save more grant by adding a new chunk */
 	cli->cl_reserved_grant -= reserved;
+	/* only the grant kept for the pages is charged to the writers */
+	if (cli->cl_write_pacing)
+		cli->cl_pace_charge -= min_t(__u64, cli->cl_pace_charge,
+					     min(reserved, unused));
 	if (unused > reserved) {
 		cli->cl_avail_grant += reserved;
 		cli->cl_lost_grant  += unused - reserved;
@@ -1520,6 +1524,130 @@ static void osc_exit_cache(struct client_obd *cli, struct osc_async_page *oap)
 	spin_unlock(&cli->cl_loi_list_lock);
 }
 
+/* shortest time over which a rate is sampled */
+#define OSC_PACE_SAMPLE_US	(100 * USEC_PER_MSEC)
+/* a flow idle for longer is sampled again from scratch */
+#define OSC_PACE_IDLE_US	USEC_PER_SEC
+/* longest delay of a paced writer, the same as the kernel's dirty page
+ * balancing */
+#define OSC_PACE_MAX_PAUSE_NS	(200 * NSEC_PER_MSEC)
+
+/**
+ * Accounts \a bytes in the flow \a rate, whose smoothed rate is updated once
+ * per sample period.
+ *
+ * Caller must hold loi_list_lock.
+ */
+void osc_pace_rate_add(struct cl_pace_rate *rate, __u64 bytes)
+{
+	ktime_t now = ktime_get();
+	s64 elapsed = ktime_us_delta(now, rate->cpr_stamp);
+	__u64 sample;
+
+	if (ktime_to_ns(rate->cpr_stamp) == 0 || elapsed > OSC_PACE_IDLE_US) {
+		rate->cpr_stamp = now;
+		rate->cpr_bytes = bytes;
+		return;
+	}
+
+	rate->cpr_bytes += bytes;
+	if (elapsed < OSC_PACE_SAMPLE_US)
+		return;
+
+	sample = div64_u64(rate->cpr_bytes * USEC_PER_SEC, elapsed);
+	if (rate->cpr_bps == 0)
+		rate->cpr_bps = sample;
+	else
+		rate->cpr_bps = (rate->cpr_bps * 7 + sample) >> 3;
+	rate->cpr_stamp = now;
+	rate->cpr_bytes = 0;
+}
+
+/**
+ * Returns how long, in nanoseconds, the next writer should be delayed before
+ * consuming more grant.
+ *
+ * Writers are not delayed while they consume grant no faster than the write
+ * RPCs return it, or while at least half of the grant of the OSC is
+ * available. Otherwise they are let in at the rate the write RPCs complete,
+ * scaled down linearly as the available grant drops to none, so that the
+ * cache fills up smoothly instead of writers stopping all at once when the
+ * grant runs out. A virtual clock spreads the delays over all the writers,
+ * and is charged with all the grant consumed since the last call, see
+ * osc_enter_cache_try().
+ *
+ * Caller must hold loi_list_lock.
+ */
+static s64 osc_enter_cache_pace(struct client_obd *cli)
+{
+	__u64 done = cli->cl_pace_done.cpr_bps;
+	__u64 limit = cli->cl_avail_grant + cli->cl_dirty_grant;
+	__u64 bytes = cli->cl_pace_charge;
+	__u64 ratio;
+	__u64 rate;
+	ktime_t now;
+	s64 pause;
+
+	cli->cl_pace_charge = 0;
+	if (!cli->cl_write_pacing || done == 0 ||
+	    cli->cl_pace_grant.cpr_bps <= done ||
+	    cli->cl_avail_grant >= limit / 2)
+		return 0;
+
+	/* available grant over half the grant, in 1/1024th */
+	ratio = div64_u64((__u64)cli->cl_avail_grant << 10, limit / 2);
+	rate = max_t(__u64, (done * ratio) >> 10, 1);
+
+	now = ktime_get();
+	if (ktime_before(cli->cl_pace_next, now))
+		cli->cl_pace_next = now;
+	cli->cl_pace_next = ktime_add_ns(cli->cl_pace_next,
+				div64_u64(bytes * NSEC_PER_SEC, rate));
+
+	pause = ktime_to_ns(ktime_sub(cli->cl_pace_next, now));
+	if (pause > OSC_PACE_MAX_PAUSE_NS) {
+		cli->cl_pace_next = ktime_add_ns(now, OSC_PACE_MAX_PAUSE_NS);
+		pause = OSC_PACE_MAX_PAUSE_NS;
+	}
+
+	/* shorter delays are left to the next writers */
+	if (pause < NSEC_PER_SEC / HZ)
+		return 0;
+
+	return pause;
+}
+
+/**
+ * Delays the writer as osc_enter_cache_pace() says, before it consumes more
+ * grant. Memory reclaim is never delayed.
+ *
+ * Caller must hold loi_list_lock, which is dropped while sleeping.
+ */
+static void osc_enter_cache_pause(struct client_obd *cli)
+{
+	ktime_t start;
+	s64 pause;
+
+	if (!cli->cl_write_pacing || (current->flags & PF_MEMALLOC))
+		return;
+
+	pause = osc_enter_cache_pace(cli);
+	if (pause == 0)
+		return;
+
+	start = ktime_get();
+	spin_unlock(&cli->cl_loi_list_lock);
+
+	CDEBUG(D_CACHE, "%s: pacing writer for %lld ns\n",
+	       cli_name(cli), pause);
+	schedule_timeout_killable(usecs_to_jiffies(div_u64(pause,
+							   NSEC_PER_USEC)));
+
+	spin_lock(&cli->cl_loi_list_lock);
+	cli->cl_pace_count++;
+	cli->cl_pace_us += ktime_us_delta(ktime_get(), start);
+}
+
 /**
  * Non-blocking version of osc_enter_cache() that consumes grant only when it
  * is available.
@@ -1544,6 +1672,10 @@ static int osc_enter_cache_try(struct client_obd *cli,
 			atomic_long_inc(&obd_dirty_transit_pages);
 			oap->oap_brw_flags |= OBD_BRW_NOCACHE;
 		}
+		if (cli->cl_write_pacing && bytes > 0) {
+			osc_pace_rate_add(&cli->cl_pace_grant, bytes);
+			cli->cl_pace_charge += bytes;
+		}
 		rc = 1;
 	} else {
 		__osc_unreserve_grant(cli, bytes, bytes);
@@ -1575,7 +1707,9 @@ static int osc_enter_cache(const struct lu_env *env, struct client_obd *cli,
 	struct lov_oinfo	*loi = osc->oo_oinfo;
 	struct osc_cache_waiter	 ocw;
 	struct l_wait_info	 lwi;
+	ktime_t			 start = ktime_set(0, 0);
 	int			 rc = -EDQUOT;
+	bool			 starved = false;
 	ENTRY;
 
 	lwi = LWI_TIMEOUT_INTR(cfs_time_seconds(AT_OFF ? obd_timeout : at_max),
@@ -1594,6 +1728,9 @@ static int osc_enter_cache(const struct lu_env *env, struct client_obd *cli,
 		GOTO(out, rc = -EDQUOT);
 	}
 
+	/* slow down before the grant runs out */
+	osc_enter_cache_pause(cli);
+
 	/* Hopefully normal case - cache space and write credits available */
 	if (osc_enter_cache_try(cli, oap, bytes, 0)) {
 		OSC_DUMP_GRANT(D_CACHE, cli, "granted from cache\n");
@@ -1610,6 +1747,12 @@ static int osc_enter_cache(const struct lu_env *env, struct client_obd *cli,
 	ocw.ocw_oap   = oap;
 	ocw.ocw_grant = bytes;
 	while (cli->cl_dirty_pages > 0 || cli->cl_w_in_flight > 0) {
+		/* only the writers which do wait are starved */
+		if (!starved) {
+			start = ktime_get();
+			cli->cl_starve_count++;
+			starved = true;
+		}
 		list_add_tail(&ocw.ocw_entry, &cli->cl_cache_waiters);
 		ocw.ocw_rc = 0;
 		spin_unlock(&cli->cl_loi_list_lock);
@@ -1638,6 +1781,8 @@ static int osc_enter_cache(const struct lu_env *env, struct client_obd *cli,
 			break;
 		}
 	}
+	if (starved)
+		cli->cl_starve_us += ktime_us_delta(ktime_get(), start);
 
 	switch (rc) {
 	case 0:
@@ -2025,40 +2170,36 @@ static inline unsigned osc_max_write_chunks(const struct client_obd *cli)
  * 4. If urgent list is not empty, goto 2;
  * 5. Traverse the extent tree from the 1st extent;
  * 6. Above steps exit if there is no space in this RPC.
+ *
+ * The extents are added to the RPC described by \a data, which may already
+ * hold extents of other objects.
  */
-static unsigned int get_write_extents(struct osc_object *obj,
-				      struct list_head *rpclist)
+static void get_write_extents(struct osc_object *obj,
+			      struct extent_rpc_data *data)
 {
 	struct client_obd *cli = osc_cli(obj);
 	struct osc_extent *ext;
-	struct extent_rpc_data data = {
-		.erd_rpc_list	= rpclist,
-		.erd_page_count	= 0,
-		.erd_max_pages	= cli->cl_max_pages_per_rpc,
-		.erd_max_chunks	= osc_max_write_chunks(cli),
-		.erd_max_extents = 256,
-	};
 
 	LASSERT(osc_object_is_locked(obj));
 	while (!list_empty(&obj->oo_hp_exts)) {
 		ext = list_entry(obj->oo_hp_exts.next, struct osc_extent,
 				 oe_link);
 		LASSERT(ext->oe_state == OES_CACHE);
-		if (!try_to_add_extent_for_io(cli, ext, &data))
-			return data.erd_page_count;
-		EASSERT(ext->oe_nr_pages <= data.erd_max_pages, ext);
+		if (!try_to_add_extent_for_io(cli, ext, data))
+			return;
+		EASSERT(ext->oe_nr_pages <= data->erd_max_pages, ext);
 	}
-	if (data.erd_page_count == data.erd_max_pages)
-		return data.erd_page_count;
+	if (data->erd_page_count == data->erd_max_pages)
+		return;
 
 	while (!list_empty(&obj->oo_urgent_exts)) {
 		ext = list_entry(obj->oo_urgent_exts.next,
 				 struct osc_extent, oe_link);
-		if (!try_to_add_extent_for_io(cli, ext, &data))
-			return data.erd_page_count;
+		if (!try_to_add_extent_for_io(cli, ext, data))
+			return;
 	}
-	if (data.erd_page_count == data.erd_max_pages)
-		return data.erd_page_count;
+	if (data->erd_page_count == data->erd_max_pages)
+		return;
 
 	/* One key difference between full extents and other extents: full
 	 * extents can usually only be added if the rpclist was empty, so if we
@@ -2068,11 +2209,11 @@ static unsigned int get_write_extents(struct osc_object *obj,
 	while (!list_empty(&obj->oo_full_exts)) {
 		ext = list_entry(obj->oo_full_exts.next,
 				 struct osc_extent, oe_link);
-		if (!try_to_add_extent_for_io(cli, ext, &data))
+		if (!try_to_add_extent_for_io(cli, ext, data))
 			break;
 	}
-	if (data.erd_page_count == data.erd_max_pages)
-		return data.erd_page_count;
+	if (data->erd_page_count == data->erd_max_pages)
+		return;
 
 	ext = first_extent(obj);
 	while (ext != NULL) {
@@ -2083,12 +2224,95 @@ static unsigned int get_write_extents(struct osc_object *obj,
 			continue;
 		}
 
-		if (!try_to_add_extent_for_io(cli, ext, &data))
-			return data.erd_page_count;
+		if (!try_to_add_extent_for_io(cli, ext, data))
+			return;
 
 		ext = next_extent(ext);
 	}
-	return data.erd_page_count;
+}
+
+/**
+ * Move the extents of \a osc added after \a last to an RPC by
+ * get_write_extents() to the states in which osc_send_write_rpc() makes them
+ * ready.
+ */
+static void osc_write_extents_taken(struct osc_object *osc,
+				    struct list_head *rpclist,
+				    struct list_head *last,
+				    unsigned int page_count)
+{
+	struct list_head *pos;
+	struct osc_extent *ext;
+
+	LASSERT(osc_object_is_locked(osc));
+	osc_update_pending(osc, OBD_BRW_WRITE, -page_count);
+
+	for (pos = last->next; pos != rpclist; pos = pos->next) {
+		ext = list_entry(pos, struct osc_extent, oe_link);
+		LASSERT(ext->oe_state == OES_CACHE ||
+			ext->oe_state == OES_LOCK_DONE);
+		if (ext->oe_state == OES_CACHE)
+			osc_extent_state_set(ext, OES_LOCKING);
+		else
+			osc_extent_state_set(ext, OES_RPC);
+	}
+}
+
+#define list_to_obj(list, item) ({					      \
+	struct list_head *__tmp = (list)->next;				      \
+	list_del_init(__tmp);					      \
+	list_entry(__tmp, struct osc_object, oo_##item);		      \
+})
+
+/**
+ * Fill the room left in a write RPC with the extents of other objects ready
+ * for IO, if the server can write several objects in one RPC.
+ *
+ * This helps with many small files written to the same OST, which would
+ * otherwise each need its own RPC. The objects are taken from the ready list
+ * and pinned in \a objs until the RPC is built, the extents of each object
+ * follow each other in \a data->erd_rpc_list.
+ */
+static void osc_get_multi_write_extents(struct client_obd *cli,
+					struct osc_object *osc,
+					struct extent_rpc_data *data,
+					struct osc_object **objs, int *nr)
+{
+	struct list_head *rpclist = data->erd_rpc_list;
+	struct list_head *last;
+	struct osc_extent *first;
+	struct osc_object *obj;
+	unsigned int count;
+
+	first = list_entry(rpclist->next, struct osc_extent, oe_link);
+	if (first->oe_srvlock || first->oe_no_merge ||
+	    !imp_connect_multi_brw(cli->cl_import))
+		return;
+
+	spin_lock(&cli->cl_loi_list_lock);
+	while (*nr < PTLRPC_MAX_BRW_OBJS - 1 &&
+	       data->erd_page_count < data->erd_max_pages &&
+	       data->erd_max_extents > 0 &&
+	       !list_empty(&cli->cl_loi_ready_list)) {
+		obj = list_to_obj(&cli->cl_loi_ready_list, ready_item);
+		if (obj == osc)
+			continue;
+		cl_object_get(osc2cl(obj));
+		objs[(*nr)++] = obj;
+		spin_unlock(&cli->cl_loi_list_lock);
+
+		last = rpclist->prev;
+		count = data->erd_page_count;
+		osc_object_lock(obj);
+		get_write_extents(obj, data);
+		count = data->erd_page_count - count;
+		if (count > 0)
+			osc_write_extents_taken(obj, rpclist, last, count);
+		osc_object_unlock(obj);
+
+		spin_lock(&cli->cl_loi_list_lock);
+	}
+	spin_unlock(&cli->cl_loi_list_lock);
 }
 
 static int
@@ -2100,34 +2324,41 @@ __must_hold(osc)
 	struct osc_extent *ext;
 	struct osc_extent *tmp;
 	struct osc_extent *first = NULL;
+	struct osc_object *objs[PTLRPC_MAX_BRW_OBJS - 1];
+	struct extent_rpc_data data = {
+		.erd_rpc_list	= &rpclist,
+		.erd_page_count	= 0,
+		.erd_max_pages	= cli->cl_max_pages_per_rpc,
+		.erd_max_chunks	= osc_max_write_chunks(cli),
+		.erd_max_extents = 256,
+	};
 	unsigned int page_count = 0;
 	int srvlock = 0;
+	int nr = 0;
+	int i;
 	int rc = 0;
 	ENTRY;
 
 	LASSERT(osc_object_is_locked(osc));
 
-	page_count = get_write_extents(osc, &rpclist);
+	get_write_extents(osc, &data);
+	page_count = data.erd_page_count;
 	LASSERT(equi(page_count == 0, list_empty(&rpclist)));
 
 	if (list_empty(&rpclist))
 		RETURN(0);
 
-	osc_update_pending(osc, OBD_BRW_WRITE, -page_count);
-
-	list_for_each_entry(ext, &rpclist, oe_link) {
-		LASSERT(ext->oe_state == OES_CACHE ||
-			ext->oe_state == OES_LOCK_DONE);
-		if (ext->oe_state == OES_CACHE)
-			osc_extent_state_set(ext, OES_LOCKING);
-		else
-			osc_extent_state_set(ext, OES_RPC);
-	}
+	osc_write_extents_taken(osc, &rpclist, &rpclist, page_count);
 
 	/* we're going to grab page lock, so release object lock because
 	 * lock order is page lock -> object lock. */
 	osc_object_unlock(osc);
 
+	if (data.erd_page_count < data.erd_max_pages) {
+		osc_get_multi_write_extents(cli, osc, &data, objs, &nr);
+		page_count = data.erd_page_count;
+	}
+
 	list_for_each_entry_safe(ext, tmp, &rpclist, oe_link) {
 		if (ext->oe_state == OES_LOCKING) {
 			rc = osc_extent_make_ready(env, ext);
@@ -2151,6 +2382,11 @@ __must_hold(osc)
 		LASSERT(list_empty(&rpclist));
 	}
 
+	for (i = 0; i < nr; i++) {
+		osc_list_maint(cli, objs[i]);
+		cl_object_put(env, osc2cl(objs[i]));
+	}
+
 	osc_object_lock(osc);
 	RETURN(rc);
 }
@@ -2206,12 +2442,6 @@ __must_hold(osc)
 	RETURN(rc);
 }
 
-#define list_to_obj(list, item) ({					      \
-	struct list_head *__tmp = (list)->next;				      \
-	list_del_init(__tmp);					      \
-	list_entry(__tmp, struct osc_object, oo_##item);		      \
-})
-
 /* This is called by osc_check_rpcs() to find which objects have pages that
  * we could be sending.  These lists are maintained by osc_makes_rpc(). */
 static struct osc_object *osc_next_obj(struct client_obd *cli)
@@ -2463,6 +2693,9 @@ int osc_queue_async_io(const struct lu_env *env, struct cl_io *io,
 
 		/* it doesn't need any grant to dirty this page */
 		spin_lock(&cli->cl_loi_list_lock);
+		/* growing the extent consumes grant as well */
+		if (grants > 0)
+			osc_enter_cache_pause(cli);
 		rc = osc_enter_cache_try(cli, oap, grants, 0);
 		spin_unlock(&cli->cl_loi_list_lock);
 		if (rc == 0) { /* try failed */
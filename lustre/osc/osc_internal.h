@@ -42,6 +42,7 @@ extern unsigned int osc_reqpool_maxreqcount;
 extern struct ptlrpc_request_pool *osc_rq_pool;
 
 void osc_wake_cache_waiters(struct client_obd *cli);
+void osc_pace_rate_add(struct cl_pace_rate *rate, __u64 bytes);
 int osc_shrink_grant_to_target(struct client_obd *cli, __u64 target_bytes);
 void osc_update_next_shrink(struct client_obd *cli);
 
@@ -79,6 +80,8 @@ int osc_ladvise_base(struct obd_export *exp, struct obdo *oa,
 int osc_process_config_base(struct obd_device *obd, struct lustre_cfg *cfg);
 int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
 		  struct list_head *ext_list, int cmd);
+int osc_lru_setup(struct client_obd *cli);
+void osc_lru_cleanup(struct client_obd *cli);
 long osc_lru_shrink(const struct lu_env *env, struct client_obd *cli,
 		   long target, bool force);
 unsigned long osc_lru_reserve(struct client_obd *cli, unsigned long npages);
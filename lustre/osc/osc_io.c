@@ -37,6 +37,7 @@
 
 #define DEBUG_SUBSYSTEM S_OSC
 
+#include <lustre_fid.h>
 #include <lustre_obdo.h>
 #include <lustre_osc.h>
 
@@ -97,6 +98,88 @@ static int osc_io_read_ahead(const struct lu_env *env,
 	RETURN(result);
 }
 
+/* reference on a DLM lock held until the pages of a direct IO are sent */
+struct osc_dio_hold {
+	struct cl_dio_hold	odh_hold;
+	struct lustre_handle	odh_lockh;
+	enum ldlm_mode		odh_mode;
+	/* pages covered by the lock */
+	pgoff_t			odh_start;
+	pgoff_t			odh_end;
+};
+
+static void osc_dio_hold_release(const struct lu_env *env,
+				 struct cl_dio_hold *hold)
+{
+	struct osc_dio_hold *odh = container_of(hold, struct osc_dio_hold,
+						odh_hold);
+
+	ldlm_lock_decref(&odh->odh_lockh, odh->odh_mode);
+	OBD_FREE_PTR(odh);
+}
+
+/**
+ * Takes a reference on the DLM lock covering page \a index of \a osc for the
+ * direct IO \a aio, unless the IO holds one already.
+ *
+ * The IO loop releases the locks of a chunk while its pages may still be in
+ * transfer; the reference keeps the lock from being cancelled, and another
+ * client from accessing the pages, until they all are transferred.
+ */
+static int osc_io_dio_hold(const struct lu_env *env, struct cl_dio_aio *aio,
+			   struct osc_object *osc, pgoff_t index,
+			   enum cl_req_type crt)
+{
+	struct osc_thread_info *info = osc_env_info(env);
+	struct ldlm_res_id *resname = &info->oti_resname;
+	union ldlm_policy_data *policy = &info->oti_policy;
+	struct osc_dio_hold *odh;
+	struct cl_dio_hold *hold;
+	struct ldlm_lock *dlmlock;
+	enum ldlm_mode mode;
+	__u64 flags = LDLM_FL_BLOCK_GRANTED | LDLM_FL_CBPENDING;
+
+	list_for_each_entry(hold, &aio->cda_holds, cdh_linkage) {
+		if (hold->cdh_owner != osc)
+			continue;
+		odh = container_of(hold, struct osc_dio_hold, odh_hold);
+		if (odh->odh_start <= index && index <= odh->odh_end)
+			return 0;
+	}
+
+	OBD_ALLOC_PTR(odh);
+	if (odh == NULL)
+		return -ENOMEM;
+
+	ostid_build_res_name(&osc->oo_oinfo->loi_oi, resname);
+	osc_index2policy(policy, osc2cl(osc), index, index);
+	policy->l_extent.gid = LDLM_GID_ANY;
+	/* CBPENDING: the lock of the IO may be being cancelled already */
+	mode = osc_match_base(osc_export(osc), resname, LDLM_EXTENT, policy,
+			      crt == CRT_WRITE ? LCK_PW | LCK_GROUP :
+			      LCK_PR | LCK_PW | LCK_GROUP,
+			      &flags, osc, &odh->odh_lockh, 0);
+	if (mode <= 0) {
+		/* nothing to keep if the IO is not covered by a lock */
+		OBD_FREE_PTR(odh);
+		return 0;
+	}
+
+	odh->odh_mode = mode;
+	odh->odh_start = odh->odh_end = index;
+	dlmlock = ldlm_handle2lock(&odh->odh_lockh);
+	if (dlmlock != NULL) {
+		odh->odh_start = cl_index(osc2cl(osc),
+				dlmlock->l_policy_data.l_extent.start);
+		odh->odh_end = cl_index(osc2cl(osc),
+				dlmlock->l_policy_data.l_extent.end);
+		LDLM_LOCK_PUT(dlmlock);
+	}
+	cl_dio_hold_add(aio, &odh->odh_hold, osc, osc_dio_hold_release);
+
+	return 0;
+}
+
 /**
  * An implementation of cl_io_operations::cio_io_submit() method for osc
  * layer. Iterates over pages in the in-queue, prepares each for io by calling
@@ -150,6 +233,16 @@ static int osc_io_submit(const struct lu_env *env,
 		oap = &opg->ops_oap;
 		LASSERT(osc == oap->oap_obj);
 
+		/* the pages of a direct IO are not waited for before the
+		 * locks of the IO are released */
+		if (io->ci_aio != NULL && !(brw_flags & OBD_BRW_SRVLOCK) &&
+		    page->cp_sync_io == &io->ci_aio->cda_sync) {
+			result = osc_io_dio_hold(env, io->ci_aio, osc,
+						 osc_index(opg), crt);
+			if (result != 0)
+				break;
+		}
+
 		if (!list_empty(&oap->oap_pending_item) ||
 		    !list_empty(&oap->oap_rpc_item)) {
 			CDEBUG(D_CACHE, "Busy oap %p page %p for submit.\n",
@@ -423,12 +423,57 @@ int lru_queue_work(const struct lu_env *env, void *data)
 	RETURN(0);
 }
 
+int osc_lru_setup(struct client_obd *cli)
+{
+	struct cl_lru_shard *cls;
+	int i;
+
+	cli->cl_lru = cfs_percpt_alloc(cfs_cpt_table, sizeof(*cls));
+	if (cli->cl_lru == NULL)
+		return -ENOMEM;
+
+	cfs_percpt_for_each(cls, i, cli->cl_lru) {
+		spin_lock_init(&cls->cls_lock);
+		INIT_LIST_HEAD(&cls->cls_list);
+	}
+
+	return 0;
+}
+
+void osc_lru_cleanup(struct client_obd *cli)
+{
+	if (cli->cl_lru == NULL)
+		return;
+
+	cfs_percpt_free(cli->cl_lru);
+	cli->cl_lru = NULL;
+}
+
+/**
+ * Lock LRU shard \a cpt of \a cli, counting how often it is contended.
+ */
+static struct cl_lru_shard *osc_lru_lock(struct client_obd *cli, int cpt)
+{
+	struct cl_lru_shard *cls = cli->cl_lru[cpt];
+
+	if (unlikely(!spin_trylock(&cls->cls_lock))) {
+		spin_lock(&cls->cls_lock);
+		cls->cls_contended++;
+	}
+
+	return cls;
+}
+
 void osc_lru_add_batch(struct client_obd *cli, struct list_head *plist)
 {
 	struct list_head lru = LIST_HEAD_INIT(lru);
 	struct osc_async_page *oap;
+	struct cl_lru_shard *cls;
+	time64_t now;
 	long npages = 0;
+	int cpt;
 
+	cpt = cfs_cpt_current(cfs_cpt_table, 0);
 	list_for_each_entry(oap, plist, oap_pending_item) {
 		struct osc_page *opg = oap2osc_page(oap);
 
@@ -437,26 +482,36 @@ void osc_lru_add_batch(struct client_obd *cli, struct list_head *plist)
 
 		++npages;
 		LASSERT(list_empty(&opg->ops_lru));
+		opg->ops_lru_cpt = cpt;
 		list_add(&opg->ops_lru, &lru);
 	}
 
 	if (npages > 0) {
-		spin_lock(&cli->cl_lru_list_lock);
-		list_splice_tail(&lru, &cli->cl_lru_list);
+		cls = osc_lru_lock(cli, cpt);
+		list_splice_tail(&lru, &cls->cls_list);
+		cls->cls_nr += npages;
+		spin_unlock(&cls->cls_lock);
+
 		atomic_long_sub(npages, &cli->cl_lru_busy);
 		atomic_long_add(npages, &cli->cl_lru_in_list);
-		cli->cl_lru_last_used = ktime_get_real_seconds();
-		spin_unlock(&cli->cl_lru_list_lock);
+		/* shared by all the CPUs, only dirty it once a second */
+		now = ktime_get_real_seconds();
+		if (cli->cl_lru_last_used != now)
+			cli->cl_lru_last_used = now;
 
 		if (waitqueue_active(&osc_lru_waitq))
 			(void)ptlrpcd_queue_work(cli->cl_lru_work);
 	}
 }
 
-static void __osc_lru_del(struct client_obd *cli, struct osc_page *opg)
+static void __osc_lru_del(struct client_obd *cli, struct cl_lru_shard *cls,
+			  struct osc_page *opg)
 {
+	assert_spin_locked(&cls->cls_lock);
+	LASSERT(cls->cls_nr > 0);
 	LASSERT(atomic_long_read(&cli->cl_lru_in_list) > 0);
 	list_del_init(&opg->ops_lru);
+	cls->cls_nr--;
 	atomic_long_dec(&cli->cl_lru_in_list);
 }
 
@@ -467,14 +522,15 @@ static void __osc_lru_del(struct client_obd *cli, struct osc_page *opg)
 static void osc_lru_del(struct client_obd *cli, struct osc_page *opg)
 {
 	if (opg->ops_in_lru) {
-		spin_lock(&cli->cl_lru_list_lock);
+		struct cl_lru_shard *cls = osc_lru_lock(cli, opg->ops_lru_cpt);
+
 		if (!list_empty(&opg->ops_lru)) {
-			__osc_lru_del(cli, opg);
+			__osc_lru_del(cli, cls, opg);
 		} else {
 			LASSERT(atomic_long_read(&cli->cl_lru_busy) > 0);
 			atomic_long_dec(&cli->cl_lru_busy);
 		}
-		spin_unlock(&cli->cl_lru_list_lock);
+		spin_unlock(&cls->cls_lock);
 
 		atomic_long_inc(cli->cl_lru_left);
 		/* this is a great place to release more LRU pages if
@@ -498,12 +554,13 @@ static void osc_lru_use(struct client_obd *cli, struct osc_page *opg)
 	/* If page is being transferred for the first time,
 	 * ops_lru should be empty */
 	if (opg->ops_in_lru) {
-		spin_lock(&cli->cl_lru_list_lock);
+		struct cl_lru_shard *cls = osc_lru_lock(cli, opg->ops_lru_cpt);
+
 		if (!list_empty(&opg->ops_lru)) {
-			__osc_lru_del(cli, opg);
+			__osc_lru_del(cli, cls, opg);
 			atomic_long_inc(&cli->cl_lru_busy);
 		}
-		spin_unlock(&cli->cl_lru_list_lock);
+		spin_unlock(&cls->cls_lock);
 	}
 }
 
@@ -549,6 +606,10 @@ static inline bool lru_page_busy(struct client_obd *cli, struct cl_page *page)
 
 /**
  * Drop @target of pages from LRU at most.
+ *
+ * The LRU shards are scanned in turn starting from the one of the local CPU
+ * partition, so that threads reclaiming pages at the same time mostly work on
+ * different shards.
  */
 long osc_lru_shrink(const struct lu_env *env, struct client_obd *cli,
 		   long target, bool force)
@@ -556,11 +617,16 @@ long osc_lru_shrink(const struct lu_env *env, struct client_obd *cli,
 	struct cl_io *io;
 	struct cl_object *clobj = NULL;
 	struct cl_page **pvec;
+	struct cl_lru_shard *cls;
 	struct osc_page *opg;
+	bool stop = false;
 	long count = 0;
-	int maxscan = 0;
+	long maxscan = 0;
 	int index = 0;
+	int ncpt;
+	int cpt;
 	int rc = 0;
+	int i;
 	ENTRY;
 
 	LASSERT(atomic_long_read(&cli->cl_lru_in_list) >= 0);
@@ -579,96 +645,109 @@ long osc_lru_shrink(const struct lu_env *env, struct client_obd *cli,
 		}
 	} else {
 		atomic_inc(&cli->cl_lru_shrinkers);
+		atomic64_inc(&cli->cl_lru_reclaim);
 	}
 
 	pvec = (struct cl_page **)osc_env_info(env)->oti_pvec;
 	io = &osc_env_info(env)->oti_io;
 
-	spin_lock(&cli->cl_lru_list_lock);
-	if (force)
-		cli->cl_lru_reclaim++;
-	maxscan = min(target << 1, atomic_long_read(&cli->cl_lru_in_list));
-	while (!list_empty(&cli->cl_lru_list)) {
-		struct cl_page *page;
-		bool will_free = false;
+	ncpt = cfs_percpt_number(cli->cl_lru);
+	cpt = cfs_cpt_current(cfs_cpt_table, 0);
+	for (i = 0; i < ncpt && !stop; i++) {
+		cls = cli->cl_lru[(cpt + i) % ncpt];
+		if (cls->cls_nr == 0)
+			continue;
 
-		if (!force && atomic_read(&cli->cl_lru_shrinkers) > 1)
-			break;
+		spin_lock(&cls->cls_lock);
+		maxscan = min((target - count) << 1, cls->cls_nr);
+		while (!list_empty(&cls->cls_list)) {
+			struct cl_page *page;
+			bool will_free = false;
 
-		if (--maxscan < 0)
-			break;
+			if (!force && atomic_read(&cli->cl_lru_shrinkers) > 1) {
+				stop = true;
+				break;
+			}
 
-		opg = list_entry(cli->cl_lru_list.next, struct osc_page,
-				 ops_lru);
-		page = opg->ops_cl.cpl_page;
-		if (lru_page_busy(cli, page)) {
-			list_move_tail(&opg->ops_lru, &cli->cl_lru_list);
-			continue;
-		}
+			if (--maxscan < 0)
+				break;
 
-		LASSERT(page->cp_obj != NULL);
-		if (clobj != page->cp_obj) {
-			struct cl_object *tmp = page->cp_obj;
+			opg = list_entry(cls->cls_list.next, struct osc_page,
+					 ops_lru);
+			page = opg->ops_cl.cpl_page;
+			if (lru_page_busy(cli, page)) {
+				list_move_tail(&opg->ops_lru, &cls->cls_list);
+				continue;
+			}
 
-			cl_object_get(tmp);
-			spin_unlock(&cli->cl_lru_list_lock);
+			LASSERT(page->cp_obj != NULL);
+			if (clobj != page->cp_obj) {
+				struct cl_object *tmp = page->cp_obj;
 
-			if (clobj != NULL) {
-				discard_pagevec(env, io, pvec, index);
-				index = 0;
+				cl_object_get(tmp);
+				spin_unlock(&cls->cls_lock);
 
-				cl_io_fini(env, io);
-				cl_object_put(env, clobj);
-				clobj = NULL;
-			}
+				if (clobj != NULL) {
+					discard_pagevec(env, io, pvec, index);
+					index = 0;
 
-			clobj = tmp;
-			io->ci_obj = clobj;
-			io->ci_ignore_layout = 1;
-			rc = cl_io_init(env, io, CIT_MISC, clobj);
+					cl_io_fini(env, io);
+					cl_object_put(env, clobj);
+					clobj = NULL;
+				}
 
-			spin_lock(&cli->cl_lru_list_lock);
+				clobj = tmp;
+				io->ci_obj = clobj;
+				io->ci_ignore_layout = 1;
+				rc = cl_io_init(env, io, CIT_MISC, clobj);
 
-			if (rc != 0)
-				break;
+				spin_lock(&cls->cls_lock);
 
-			++maxscan;
-			continue;
-		}
+				if (rc != 0) {
+					stop = true;
+					break;
+				}
 
-		if (cl_page_own_try(env, io, page) == 0) {
-			if (!lru_page_busy(cli, page)) {
-				/* remove it from lru list earlier to avoid
-				 * lock contention */
-				__osc_lru_del(cli, opg);
-				opg->ops_in_lru = 0; /* will be discarded */
-
-				cl_page_get(page);
-				will_free = true;
-			} else {
-				cl_page_disown(env, io, page);
+				++maxscan;
+				continue;
 			}
-		}
 
-		if (!will_free) {
-			list_move_tail(&opg->ops_lru, &cli->cl_lru_list);
-			continue;
-		}
+			if (cl_page_own_try(env, io, page) == 0) {
+				if (!lru_page_busy(cli, page)) {
+					/* remove it from lru list earlier to
+					 * avoid lock contention */
+					__osc_lru_del(cli, cls, opg);
+					opg->ops_in_lru = 0; /* will be discarded */
+
+					cl_page_get(page);
+					will_free = true;
+				} else {
+					cl_page_disown(env, io, page);
+				}
+			}
 
-		/* Don't discard and free the page with cl_lru_list held */
-		pvec[index++] = page;
-		if (unlikely(index == OTI_PVEC_SIZE)) {
-			spin_unlock(&cli->cl_lru_list_lock);
-			discard_pagevec(env, io, pvec, index);
-			index = 0;
+			if (!will_free) {
+				list_move_tail(&opg->ops_lru, &cls->cls_list);
+				continue;
+			}
 
-			spin_lock(&cli->cl_lru_list_lock);
-		}
+			/* Don't discard and free the page with cls_lock held */
+			pvec[index++] = page;
+			if (unlikely(index == OTI_PVEC_SIZE)) {
+				spin_unlock(&cls->cls_lock);
+				discard_pagevec(env, io, pvec, index);
+				index = 0;
 
-		if (++count >= target)
-			break;
+				spin_lock(&cls->cls_lock);
+			}
+
+			if (++count >= target) {
+				stop = true;
+				break;
+			}
+		}
+		spin_unlock(&cls->cls_lock);
 	}
-	spin_unlock(&cli->cl_lru_list_lock);
 
 	if (clobj != NULL) {
 		discard_pagevec(env, io, pvec, index);
@@ -693,10 +772,15 @@ long osc_lru_shrink(const struct lu_env *env, struct client_obd *cli,
  */
 static long osc_lru_reclaim(struct client_obd *cli, unsigned long npages)
 {
+	struct client_obd *self = cli;
 	struct lu_env *env;
 	struct cl_client_cache *cache = cli->cl_cache;
+	ktime_t start = ktime_get();
 	int max_scans;
 	__u16 refcheck;
+	s64 max;
+	s64 old;
+	s64 ns;
 	long rc = 0;
 	ENTRY;
 
@@ -760,6 +844,19 @@ out:
 	cl_env_put(env, &refcheck);
 	CDEBUG(D_CACHE, "%s: cli %p freed %ld pages.\n",
 		cli_name(cli), cli, rc);
+
+	/* IO threads of all the CPUs may be reclaiming at once */
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	atomic64_inc(&self->cl_lru_reclaim_waits);
+	atomic64_add(ns, &self->cl_lru_reclaim_ns);
+	max = atomic64_read(&self->cl_lru_reclaim_max_ns);
+	while (ns > max) {
+		old = atomic64_cmpxchg(&self->cl_lru_reclaim_max_ns, max, ns);
+		if (old == max)
+			break;
+		max = old;
+	}
+
 	return rc;
 }
 
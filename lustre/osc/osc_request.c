@@ -58,8 +58,18 @@ struct ptlrpc_request_pool *osc_rq_pool;
 static unsigned int osc_reqpool_mem_max = 5;
 module_param(osc_reqpool_mem_max, uint, 0444);
 
+/* Objects of a multi-object write RPC, the pages of each object follow the
+ * ones of the previous object in the page array */
+struct osc_brw_multi {
+	u32			  bm_count;
+	u32			  bm_pages[PTLRPC_MAX_BRW_OBJS];
+	/* obdos of all objects but the first one, which uses aa_oa */
+	struct obdo		  bm_oa[PTLRPC_MAX_BRW_OBJS - 1];
+};
+
 struct osc_brw_async_args {
 	struct obdo		 *aa_oa;
+	struct osc_brw_multi	 *aa_multi;
 	int			  aa_requested_nob;
 	int			  aa_nio_count;
 	u32			  aa_page_count;
@@ -106,6 +116,9 @@ struct osc_enqueue_args {
 static void osc_release_ppga(struct brw_page **ppga, size_t count);
 static int brw_interpret(const struct lu_env *env, struct ptlrpc_request *req,
 			 void *data, int rc);
+static int osc_build_one_rpc(const struct lu_env *env, struct client_obd *cli,
+			     struct list_head *ext_list, int cmd,
+			     struct list_head *leftover);
 
 void osc_pack_req_body(struct ptlrpc_request *req, struct obdo *oa)
 {
@@ -1109,17 +1122,30 @@ static u32 osc_checksum_bulk(int nob, size_t pg_count,
 	return cksum;
 }
 
+/* number of pages of the \a idx-th object in the page array of a BRW */
+static inline u32 osc_brw_obj_pages(struct osc_brw_multi *multi, int idx,
+				    u32 page_count)
+{
+	return multi != NULL ? multi->bm_pages[idx] : page_count;
+}
+
 static int
 osc_brw_prep_request(int cmd, struct client_obd *cli, struct obdo *oa,
-		     u32 page_count, struct brw_page **pga,
-		     struct ptlrpc_request **reqp, int resend)
+		     struct osc_brw_multi *multi, u32 page_count,
+		     struct brw_page **pga, struct ptlrpc_request **reqp,
+		     int resend)
 {
         struct ptlrpc_request   *req;
         struct ptlrpc_bulk_desc *desc;
         struct ost_body         *body;
         struct obd_ioobj        *ioobj;
         struct niobuf_remote    *niobuf;
+	struct obdo		*mbody = NULL;
         int niocount, i, requested_nob, opc, rc;
+	int nobj = multi != NULL ? multi->bm_count : 1;
+	int k;
+	u32 start;
+	u32 end;
         struct osc_brw_async_args *aa;
         struct req_capsule      *pill;
         struct brw_page *pg_prev;
@@ -1134,24 +1160,35 @@ osc_brw_prep_request(int cmd, struct client_obd *cli, struct obdo *oa,
 		opc = OST_WRITE;
 		req = ptlrpc_request_alloc_pool(cli->cl_import,
 						osc_rq_pool,
+						multi != NULL ?
+						&RQF_OST_BRW_WRITE_MULTI :
 						&RQF_OST_BRW_WRITE);
 	} else {
+		LASSERT(multi == NULL);
 		opc = OST_READ;
 		req = ptlrpc_request_alloc(cli->cl_import, &RQF_OST_BRW_READ);
 	}
         if (req == NULL)
                 RETURN(-ENOMEM);
 
-        for (niocount = i = 1; i < page_count; i++) {
-                if (!can_merge_pages(pga[i - 1], pga[i]))
-                        niocount++;
-        }
+	/* a niobuf never spans two objects */
+	for (niocount = i = k = 0; k < nobj; k++) {
+		end = i + osc_brw_obj_pages(multi, k, page_count);
+		for (niocount++, i++; i < end; i++) {
+			if (!can_merge_pages(pga[i - 1], pga[i]))
+				niocount++;
+		}
+	}
+	LASSERT(i == page_count);
 
         pill = &req->rq_pill;
         req_capsule_set_size(pill, &RMF_OBD_IOOBJ, RCL_CLIENT,
-                             sizeof(*ioobj));
+			     nobj * sizeof(*ioobj));
         req_capsule_set_size(pill, &RMF_NIOBUF_REMOTE, RCL_CLIENT,
                              niocount * sizeof(*niobuf));
+	if (multi != NULL)
+		req_capsule_set_size(pill, &RMF_OST_MULTI_BODY, RCL_CLIENT,
+				     (nobj - 1) * sizeof(*mbody));
 
         rc = ptlrpc_request_pack(req, LUSTRE_OST_VERSION, opc);
         if (rc) {
@@ -1180,55 +1217,74 @@ osc_brw_prep_request(int cmd, struct client_obd *cli, struct obdo *oa,
         ioobj = req_capsule_client_get(pill, &RMF_OBD_IOOBJ);
         niobuf = req_capsule_client_get(pill, &RMF_NIOBUF_REMOTE);
         LASSERT(body != NULL && ioobj != NULL && niobuf != NULL);
+	if (multi != NULL) {
+		mbody = req_capsule_client_get(pill, &RMF_OST_MULTI_BODY);
+		LASSERT(mbody != NULL);
+	}
 
 	lustre_set_wire_obdo(&req->rq_import->imp_connect_data, &body->oa, oa);
 
-	obdo_to_ioobj(oa, ioobj);
-	ioobj->ioo_bufcnt = niocount;
-	/* The high bits of ioo_max_brw tells server _maximum_ number of bulks
-	 * that might be send for this request.  The actual number is decided
-	 * when the RPC is finally sent in ptlrpc_register_bulk(). It sends
-	 * "max - 1" for old client compatibility sending "0", and also so the
-	 * the actual maximum is a power-of-two number, not one less. LU-1431 */
-	ioobj_max_brw_set(ioobj, desc->bd_md_max_brw);
 	LASSERT(page_count > 0);
-	pg_prev = pga[0];
-        for (requested_nob = i = 0; i < page_count; i++, niobuf++) {
-                struct brw_page *pg = pga[i];
-		int poff = pg->off & ~PAGE_MASK;
-
-                LASSERT(pg->count > 0);
-                /* make sure there is no gap in the middle of page array */
-		LASSERTF(page_count == 1 ||
-			 (ergo(i == 0, poff + pg->count == PAGE_SIZE) &&
-			  ergo(i > 0 && i < page_count - 1,
-			       poff == 0 && pg->count == PAGE_SIZE)   &&
-			  ergo(i == page_count - 1, poff == 0)),
-			 "i: %d/%d pg: %p off: %llu, count: %u\n",
-			 i, page_count, pg, pg->off, pg->count);
-                LASSERTF(i == 0 || pg->off > pg_prev->off,
-			 "i %d p_c %u pg %p [pri %lu ind %lu] off %llu"
-			 " prev_pg %p [pri %lu ind %lu] off %llu\n",
-                         i, page_count,
-                         pg->pg, page_private(pg->pg), pg->pg->index, pg->off,
-                         pg_prev->pg, page_private(pg_prev->pg),
-                         pg_prev->pg->index, pg_prev->off);
-                LASSERT((pga[0]->flag & OBD_BRW_SRVLOCK) ==
-                        (pg->flag & OBD_BRW_SRVLOCK));
-
-		desc->bd_frag_ops->add_kiov_frag(desc, pg->pg, poff, pg->count);
-                requested_nob += pg->count;
-
-                if (i > 0 && can_merge_pages(pg_prev, pg)) {
-                        niobuf--;
-			niobuf->rnb_len += pg->count;
-		} else {
-			niobuf->rnb_offset = pg->off;
-			niobuf->rnb_len    = pg->count;
-			niobuf->rnb_flags  = pg->flag;
-                }
-                pg_prev = pg;
-        }
+	for (requested_nob = i = k = 0; k < nobj; k++, ioobj++) {
+		struct obdo *koa = k == 0 ? oa : &multi->bm_oa[k - 1];
+
+		if (k > 0)
+			lustre_set_wire_obdo(&req->rq_import->imp_connect_data,
+					     &mbody[k - 1], koa);
+		obdo_to_ioobj(koa, ioobj);
+		ioobj->ioo_bufcnt = 0;
+		/* The high bits of ioo_max_brw tells server _maximum_ number
+		 * of bulks that might be send for this request.  The actual
+		 * number is decided when the RPC is finally sent in
+		 * ptlrpc_register_bulk(). It sends "max - 1" for old client
+		 * compatibility sending "0", and also so the the actual
+		 * maximum is a power-of-two number, not one less. LU-1431 */
+		ioobj_max_brw_set(ioobj, desc->bd_md_max_brw);
+
+		start = i;
+		end = i + osc_brw_obj_pages(multi, k, page_count);
+		pg_prev = pga[start];
+		for (; i < end; i++, niobuf++) {
+			struct brw_page *pg = pga[i];
+			int poff = pg->off & ~PAGE_MASK;
+
+			LASSERT(pg->count > 0);
+			/* make sure there is no gap in the middle of the
+			 * pages of an object */
+			LASSERTF(end - start == 1 ||
+				 (ergo(i == start,
+				       poff + pg->count == PAGE_SIZE) &&
+				  ergo(i > start && i < end - 1,
+				       poff == 0 && pg->count == PAGE_SIZE) &&
+				  ergo(i == end - 1, poff == 0)),
+				 "i: %d/%d pg: %p off: %llu, count: %u\n",
+				 i, page_count, pg, pg->off, pg->count);
+			LASSERTF(i == start || pg->off > pg_prev->off,
+				 "i %d p_c %u pg %p [pri %lu ind %lu] off %llu"
+				 " prev_pg %p [pri %lu ind %lu] off %llu\n",
+				 i, page_count, pg->pg, page_private(pg->pg),
+				 pg->pg->index, pg->off, pg_prev->pg,
+				 page_private(pg_prev->pg),
+				 pg_prev->pg->index, pg_prev->off);
+			LASSERT((pga[0]->flag & OBD_BRW_SRVLOCK) ==
+				(pg->flag & OBD_BRW_SRVLOCK));
+
+			desc->bd_frag_ops->add_kiov_frag(desc, pg->pg, poff,
+							 pg->count);
+			requested_nob += pg->count;
+
+			if (i > start && can_merge_pages(pg_prev, pg)) {
+				niobuf--;
+				niobuf->rnb_len += pg->count;
+			} else {
+				niobuf->rnb_offset = pg->off;
+				niobuf->rnb_len    = pg->count;
+				niobuf->rnb_flags  = pg->flag;
+				ioobj->ioo_bufcnt++;
+			}
+			pg_prev = pg;
+		}
+	}
 
         LASSERTF((void *)(niobuf - niocount) ==
                 req_capsule_client_get(&req->rq_pill, &RMF_NIOBUF_REMOTE),
@@ -1242,6 +1298,14 @@ osc_brw_prep_request(int cmd, struct client_obd *cli, struct obdo *oa,
                         body->oa.o_flags = 0;
                 }
                 body->oa.o_flags |= OBD_FL_RECOV_RESEND;
+		/* the grant of the other objects was consumed as well */
+		for (k = 0; k < nobj - 1; k++) {
+			if ((mbody[k].o_valid & OBD_MD_FLFLAGS) == 0) {
+				mbody[k].o_valid |= OBD_MD_FLFLAGS;
+				mbody[k].o_flags = 0;
+			}
+			mbody[k].o_flags |= OBD_FL_RECOV_RESEND;
+		}
         }
 
         if (osc_should_shrink_grant(cli))
@@ -1297,6 +1361,7 @@ osc_brw_prep_request(int cmd, struct client_obd *cli, struct obdo *oa,
         CLASSERT(sizeof(*aa) <= sizeof(req->rq_async_args));
         aa = ptlrpc_req_async_args(req);
         aa->aa_oa = oa;
+	aa->aa_multi = multi;
         aa->aa_requested_nob = requested_nob;
         aa->aa_nio_count = niocount;
         aa->aa_page_count = page_count;
@@ -1307,9 +1372,10 @@ osc_brw_prep_request(int cmd, struct client_obd *cli, struct obdo *oa,
 
 	*reqp = req;
 	niobuf = req_capsule_client_get(pill, &RMF_NIOBUF_REMOTE);
-	CDEBUG(D_RPCTRACE, "brw rpc %p - object "DOSTID" offset %lld<>%lld\n",
-		req, POSTID(&oa->o_oi), niobuf[0].rnb_offset,
-		niobuf[niocount - 1].rnb_offset + niobuf[niocount - 1].rnb_len);
+	CDEBUG(D_RPCTRACE, "brw rpc %p - object "DOSTID" offset %lld<>%lld, "
+	       "%d objects\n", req, POSTID(&oa->o_oi), niobuf[0].rnb_offset,
+	       niobuf[niocount - 1].rnb_offset + niobuf[niocount - 1].rnb_len,
+	       nobj);
         RETURN(0);
 
  out:
@@ -1610,8 +1676,8 @@ static int osc_brw_redo_request(struct ptlrpc_request *request,
 
 	rc = osc_brw_prep_request(lustre_msg_get_opc(request->rq_reqmsg) ==
 				OST_WRITE ? OBD_BRW_WRITE : OBD_BRW_READ,
-				  aa->aa_cli, aa->aa_oa, aa->aa_page_count,
-				  aa->aa_ppga, &new_req, 1);
+				  aa->aa_cli, aa->aa_oa, aa->aa_multi,
+				  aa->aa_page_count, aa->aa_ppga, &new_req, 1);
         if (rc)
                 RETURN(rc);
 
@@ -1666,6 +1732,60 @@ static int osc_brw_redo_request(struct ptlrpc_request *request,
 	RETURN(0);
 }
 
+/**
+ * A multi-object write failed as a whole, although the error may concern
+ * only one of its objects. Write the objects again by one RPC each, so that
+ * only the pages of the objects in error fail.
+ *
+ * The extents of \a aa are moved to the new RPCs, or finished with an error
+ * if they cannot be built.
+ */
+static void osc_brw_split_request(const struct lu_env *env,
+				  struct ptlrpc_request *request,
+				  struct osc_brw_async_args *aa, int rc)
+{
+	struct list_head ext_list = LIST_HEAD_INIT(ext_list);
+	struct list_head leftover = LIST_HEAD_INIT(leftover);
+	struct osc_async_page *oap;
+	struct osc_async_page *tmp;
+	struct osc_extent *ext;
+	struct osc_object *obj;
+	ENTRY;
+
+	DEBUG_REQ(D_ERROR, request, "write of %u objects failed: rc = %d, "
+		  "writing them one by one", aa->aa_multi->bm_count, rc);
+
+	/* the pages are added to the new RPCs by osc_build_one_rpc() */
+	list_for_each_entry_safe(oap, tmp, &aa->aa_oaps, oap_rpc_item) {
+		list_del_init(&oap->oap_rpc_item);
+		if (oap->oap_request != NULL) {
+			ptlrpc_req_finished(oap->oap_request);
+			oap->oap_request = NULL;
+		}
+	}
+
+	/* the extents are grouped by object */
+	while (!list_empty(&aa->aa_exts)) {
+		ext = list_first_entry(&aa->aa_exts, struct osc_extent,
+				       oe_link);
+		obj = ext->oe_obj;
+		do {
+			list_move_tail(&ext->oe_link, &ext_list);
+			if (list_empty(&aa->aa_exts))
+				break;
+			ext = list_first_entry(&aa->aa_exts, struct osc_extent,
+					       oe_link);
+		} while (ext->oe_obj == obj);
+
+		/* a failure finishes the extents of that object only */
+		osc_build_one_rpc(env, aa->aa_cli, &ext_list, OBD_BRW_WRITE,
+				  &leftover);
+		LASSERT(list_empty(&ext_list));
+		LASSERT(list_empty(&leftover));
+	}
+	EXIT;
+}
+
 /*
  * ugh, we want disk allocation on the target to happen in offset order.  we'll
  * follow sedgewicks advice and stick to the dead simple shellsort -- it'll do
@@ -1680,6 +1800,15 @@ static void sort_brw_pages(struct brw_page **array, int num)
 
         if (num == 1)
                 return;
+
+	/* pages of sequential writes are mostly queued in order already */
+	for (i = 1; i < num; i++) {
+		if (array[i - 1]->off > array[i]->off)
+			break;
+	}
+	if (i == num)
+		return;
+
         for (stride = 1; stride < num ; stride = (stride * 3) + 1)
                 ;
 
@@ -1703,6 +1832,59 @@ static void osc_release_ppga(struct brw_page **ppga, size_t count)
         OBD_FREE(ppga, sizeof(*ppga) * count);
 }
 
+/* Update the attributes of the object of page \a last, the last one written
+ * or read to this object by \a req, and those returned by the server in
+ * \a oa if not NULL */
+static void osc_brw_update_attr(const struct lu_env *env,
+				struct ptlrpc_request *req, struct obdo *oa,
+				struct osc_async_page *last)
+{
+	struct cl_attr *attr = &osc_env_info(env)->oti_attr;
+	struct cl_object *obj = osc2cl(last->oap_obj);
+	unsigned long valid = 0;
+
+	cl_object_attr_lock(obj);
+	if (oa != NULL && oa->o_valid & OBD_MD_FLBLOCKS) {
+		attr->cat_blocks = oa->o_blocks;
+		valid |= CAT_BLOCKS;
+	}
+	if (oa != NULL && oa->o_valid & OBD_MD_FLMTIME) {
+		attr->cat_mtime = oa->o_mtime;
+		valid |= CAT_MTIME;
+	}
+	if (oa != NULL && oa->o_valid & OBD_MD_FLATIME) {
+		attr->cat_atime = oa->o_atime;
+		valid |= CAT_ATIME;
+	}
+	if (oa != NULL && oa->o_valid & OBD_MD_FLCTIME) {
+		attr->cat_ctime = oa->o_ctime;
+		valid |= CAT_CTIME;
+	}
+
+	if (lustre_msg_get_opc(req->rq_reqmsg) == OST_WRITE) {
+		struct lov_oinfo *loi = cl2osc(obj)->oo_oinfo;
+		loff_t last_off = last->oap_count + last->oap_obj_off +
+			last->oap_page_off;
+
+		/* Change file size if this is an out of quota or
+		 * direct IO write and it extends the file size */
+		if (loi->loi_lvb.lvb_size < last_off) {
+			attr->cat_size = last_off;
+			valid |= CAT_SIZE;
+		}
+		/* Extend KMS if it's not a lockless write */
+		if (loi->loi_kms < last_off &&
+		    oap2osc_page(last)->ops_srvlock == 0) {
+			attr->cat_kms = last_off;
+			valid |= CAT_KMS;
+		}
+	}
+
+	if (valid != 0)
+		cl_object_attr_update(env, obj, attr, valid);
+	cl_object_attr_unlock(obj);
+}
+
 static int brw_interpret(const struct lu_env *env,
                          struct ptlrpc_request *req, void *data, int rc)
 {
@@ -1739,58 +1921,26 @@ static int brw_interpret(const struct lu_env *env,
 			rc = -EIO;
 	}
 
-	if (rc == 0) {
-		struct obdo *oa = aa->aa_oa;
-		struct cl_attr *attr = &osc_env_info(env)->oti_attr;
-		unsigned long valid = 0;
-		struct cl_object *obj;
-		struct osc_async_page *last;
-
-		last = brw_page2oap(aa->aa_ppga[aa->aa_page_count - 1]);
-		obj = osc2cl(last->oap_obj);
-
-		cl_object_attr_lock(obj);
-		if (oa->o_valid & OBD_MD_FLBLOCKS) {
-			attr->cat_blocks = oa->o_blocks;
-			valid |= CAT_BLOCKS;
-		}
-		if (oa->o_valid & OBD_MD_FLMTIME) {
-			attr->cat_mtime = oa->o_mtime;
-			valid |= CAT_MTIME;
-		}
-		if (oa->o_valid & OBD_MD_FLATIME) {
-			attr->cat_atime = oa->o_atime;
-			valid |= CAT_ATIME;
-		}
-		if (oa->o_valid & OBD_MD_FLCTIME) {
-			attr->cat_ctime = oa->o_ctime;
-			valid |= CAT_CTIME;
-		}
-
-		if (lustre_msg_get_opc(req->rq_reqmsg) == OST_WRITE) {
-			struct lov_oinfo *loi = cl2osc(obj)->oo_oinfo;
-			loff_t last_off = last->oap_count + last->oap_obj_off +
-				last->oap_page_off;
+	if (rc < 0 && rc != -EINTR && aa->aa_multi != NULL &&
+	    req->rq_import_generation == req->rq_import->imp_generation)
+		osc_brw_split_request(env, req, aa, rc);
 
-			/* Change file size if this is an out of quota or
-			 * direct IO write and it extends the file size */
-			if (loi->loi_lvb.lvb_size < last_off) {
-				attr->cat_size = last_off;
-				valid |= CAT_SIZE;
-			}
-			/* Extend KMS if it's not a lockless write */
-			if (loi->loi_kms < last_off &&
-			    oap2osc_page(last)->ops_srvlock == 0) {
-				attr->cat_kms = last_off;
-				valid |= CAT_KMS;
-			}
+	if (rc == 0) {
+		int nobj = aa->aa_multi != NULL ? aa->aa_multi->bm_count : 1;
+		u32 end = 0;
+		int i;
+
+		/* the reply only has the attributes of the first object */
+		for (i = 0; i < nobj; i++) {
+			end += osc_brw_obj_pages(aa->aa_multi, i,
+						 aa->aa_page_count);
+			osc_brw_update_attr(env, req, i == 0 ? aa->aa_oa : NULL,
+					    brw_page2oap(aa->aa_ppga[end - 1]));
 		}
-
-		if (valid != 0)
-			cl_object_attr_update(env, obj, attr, valid);
-		cl_object_attr_unlock(obj);
 	}
 	OBDO_FREE(aa->aa_oa);
+	if (aa->aa_multi != NULL)
+		OBD_FREE_PTR(aa->aa_multi);
 
 	if (lustre_msg_get_opc(req->rq_reqmsg) == OST_WRITE && rc == 0)
 		osc_inc_unstable_pages(req);
@@ -1809,10 +1959,15 @@ static int brw_interpret(const struct lu_env *env,
 	/* We need to decrement before osc_ap_completion->osc_wake_cache_waiters
 	 * is called so we know whether to go to sync BRWs or wait for more
 	 * RPCs to complete */
-	if (lustre_msg_get_opc(req->rq_reqmsg) == OST_WRITE)
+	if (lustre_msg_get_opc(req->rq_reqmsg) == OST_WRITE) {
 		cli->cl_w_in_flight--;
-	else
+		/* the grant of the pages written comes back */
+		if (cli->cl_write_pacing && rc == 0)
+			osc_pace_rate_add(&cli->cl_pace_done,
+					  req->rq_bulk->bd_nob_transferred);
+	} else {
 		cli->cl_r_in_flight--;
+	}
 	osc_wake_cache_waiters(cli);
 	spin_unlock(&cli->cl_loi_list_lock);
 
@@ -1839,20 +1994,96 @@ static void brw_commit(struct ptlrpc_request *req)
 }
 
 /**
- * Build an RPC by the list of extent @ext_list. The caller must ensure
- * that the total pages in this list are NOT over max pages per RPC.
- * Extents in the list must be in OES_RPC state.
+ * Move the extents of the objects which cannot be written by the same RPC as
+ * the first object of @ext_list to @leftover, and fill the obdos of the
+ * objects kept in @multi.
+ *
+ * A multi-object write only carries the quota state of the first object back
+ * to the client, so all objects must have the same owner.
  */
-int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
-		  struct list_head *ext_list, int cmd)
+static int osc_brw_multi_prep(const struct lu_env *env,
+			      struct list_head *ext_list, struct obdo *oa,
+			      struct cl_req_attr *crattr,
+			      struct osc_brw_multi **multip,
+			      struct list_head *leftover)
+{
+	struct osc_brw_multi *multi = NULL;
+	struct osc_object *first = NULL;
+	struct osc_object *prev = NULL;
+	struct osc_extent *ext;
+	struct osc_extent *tmp;
+	struct obdo *koa;
+	bool skip = false;
+
+	list_for_each_entry_safe(ext, tmp, ext_list, oe_link) {
+		if (first == NULL)
+			first = ext->oe_obj;
+
+		if (ext->oe_obj == prev) {
+			if (skip)
+				list_move_tail(&ext->oe_link, leftover);
+			continue;
+		}
+		prev = ext->oe_obj;
+		if (prev == first)
+			continue;
+
+		if (multi == NULL) {
+			OBD_ALLOC_PTR(multi);
+			if (multi == NULL)
+				return -ENOMEM;
+			multi->bm_count = 1;
+		}
+
+		skip = multi->bm_count == PTLRPC_MAX_BRW_OBJS;
+		if (!skip) {
+			koa = &multi->bm_oa[multi->bm_count - 1];
+			crattr->cra_page = oap2cl_page(list_first_entry(
+						&ext->oe_pages,
+						struct osc_async_page,
+						oap_pending_item));
+			crattr->cra_oa = koa;
+			cl_req_attr_set(env, osc2cl(prev), crattr);
+			skip = koa->o_uid != oa->o_uid ||
+			       koa->o_gid != oa->o_gid ||
+			       koa->o_projid != oa->o_projid;
+			if (skip)
+				memset(koa, 0, sizeof(*koa));
+			else
+				multi->bm_count++;
+		}
+		if (skip)
+			list_move_tail(&ext->oe_link, leftover);
+	}
+
+	/* all other objects were left over */
+	if (multi != NULL && multi->bm_count == 1) {
+		OBD_FREE_PTR(multi);
+		multi = NULL;
+	}
+
+	*multip = multi;
+	return 0;
+}
+
+/**
+ * Build one RPC from the extents of @ext_list, see osc_build_rpc(). The
+ * extents of the objects which cannot share the RPC of the first one are
+ * moved to @leftover.
+ */
+static int osc_build_one_rpc(const struct lu_env *env, struct client_obd *cli,
+			     struct list_head *ext_list, int cmd,
+			     struct list_head *leftover)
 {
 	struct ptlrpc_request		*req = NULL;
 	struct osc_extent		*ext;
 	struct brw_page			**pga = NULL;
 	struct osc_brw_async_args	*aa = NULL;
 	struct obdo			*oa = NULL;
+	struct osc_brw_multi		*multi = NULL;
 	struct osc_async_page		*oap;
 	struct osc_object		*obj = NULL;
+	struct osc_object		*prev = NULL;
 	struct cl_req_attr		*crattr = NULL;
 	loff_t				starting_offset = OBD_OBJECT_EOF;
 	loff_t				ending_offset = 0;
@@ -1862,6 +2093,7 @@ int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
 	bool				soft_sync = false;
 	bool				interrupted = false;
 	int				i;
+	int				k;
 	int				grant = 0;
 	int				rc;
 	struct list_head		rpc_list = LIST_HEAD_INIT(rpc_list);
@@ -1869,14 +2101,52 @@ int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
 	ENTRY;
 	LASSERT(!list_empty(ext_list));
 
+	ext = list_first_entry(ext_list, struct osc_extent, oe_link);
+	obj = ext->oe_obj;
+
+	OBDO_ALLOC(oa);
+	if (oa == NULL)
+		GOTO(out, rc = -ENOMEM);
+
+	crattr = &osc_env_info(env)->oti_req_attr;
+	memset(crattr, 0, sizeof(*crattr));
+	crattr->cra_type = (cmd & OBD_BRW_WRITE) ? CRT_WRITE : CRT_READ;
+	crattr->cra_flags = ~0ULL;
+	crattr->cra_page = oap2cl_page(list_first_entry(&ext->oe_pages,
+							struct osc_async_page,
+							oap_pending_item));
+	crattr->cra_oa = oa;
+	cl_req_attr_set(env, osc2cl(obj), crattr);
+
+	if (cmd == OBD_BRW_WRITE) {
+		rc = osc_brw_multi_prep(env, ext_list, oa, crattr, &multi,
+					leftover);
+		if (rc != 0)
+			GOTO(out, rc);
+	}
+
 	/* add pages into rpc_list to build BRW rpc */
+	k = 0;
 	list_for_each_entry(ext, ext_list, oe_link) {
 		LASSERT(ext->oe_state == OES_RPC);
+		LASSERT(multi != NULL || ext->oe_obj == obj);
+		if (multi != NULL && prev != NULL && ext->oe_obj != prev)
+			k++;
+		prev = ext->oe_obj;
 		mem_tight |= ext->oe_memalloc;
-		grant += ext->oe_grants;
 		page_count += ext->oe_nr_pages;
-		if (obj == NULL)
-			obj = ext->oe_obj;
+		if (k == 0) {
+			grant += ext->oe_grants;
+		} else {
+			multi->bm_oa[k - 1].o_grant_used += ext->oe_grants;
+			multi->bm_pages[k] += ext->oe_nr_pages;
+		}
+	}
+	if (multi != NULL) {
+		LASSERT(k + 1 == multi->bm_count);
+		multi->bm_pages[0] = page_count;
+		for (k = 1; k < multi->bm_count; k++)
+			multi->bm_pages[0] -= multi->bm_pages[k];
 	}
 
 	soft_sync = osc_over_unstable_soft_limit(cli);
@@ -1887,12 +2157,14 @@ int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
 	if (pga == NULL)
 		GOTO(out, rc = -ENOMEM);
 
-	OBDO_ALLOC(oa);
-	if (oa == NULL)
-		GOTO(out, rc = -ENOMEM);
-
 	i = 0;
+	prev = NULL;
 	list_for_each_entry(ext, ext_list, oe_link) {
+		if (ext->oe_obj != prev) {
+			prev = ext->oe_obj;
+			starting_offset = OBD_OBJECT_EOF;
+			ending_offset = 0;
+		}
 		list_for_each_entry(oap, &ext->oe_pages, oap_pending_item) {
 			if (mem_tight)
 				oap->oap_brw_flags |= OBD_BRW_MEMALLOC;
@@ -1922,19 +2194,19 @@ int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
 	/* first page in the list */
 	oap = list_entry(rpc_list.next, typeof(*oap), oap_rpc_item);
 
-	crattr = &osc_env_info(env)->oti_req_attr;
-	memset(crattr, 0, sizeof(*crattr));
-	crattr->cra_type = (cmd & OBD_BRW_WRITE) ? CRT_WRITE : CRT_READ;
-	crattr->cra_flags = ~0ULL;
-	crattr->cra_page = oap2cl_page(oap);
-	crattr->cra_oa = oa;
-	cl_req_attr_set(env, osc2cl(obj), crattr);
-
 	if (cmd == OBD_BRW_WRITE)
 		oa->o_grant_used = grant;
 
-	sort_brw_pages(pga, page_count);
-	rc = osc_brw_prep_request(cmd, cli, oa, page_count, pga, &req, 0);
+	if (multi == NULL) {
+		sort_brw_pages(pga, page_count);
+	} else {
+		for (i = k = 0; k < multi->bm_count; k++) {
+			sort_brw_pages(pga + i, multi->bm_pages[k]);
+			i += multi->bm_pages[k];
+		}
+	}
+	rc = osc_brw_prep_request(cmd, cli, oa, multi, page_count, pga, &req,
+				  0);
 	if (rc != 0) {
 		CERROR("prep_req failed: %d\n", rc);
 		GOTO(out, rc);
@@ -1953,6 +2225,7 @@ int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
 	 * the OST will not use BRW timestamps.  Sadly, there is no obvious
 	 * way to do this in a single call.  bug 10150 */
 	body = req_capsule_client_get(&req->rq_pill, &RMF_OST_BODY);
+	crattr->cra_page = oap2cl_page(oap);
 	crattr->cra_oa = &body->oa;
 	crattr->cra_flags = OBD_MD_FLMTIME|OBD_MD_FLCTIME|OBD_MD_FLATIME;
 	cl_req_attr_set(env, osc2cl(obj), crattr);
@@ -1966,7 +2239,7 @@ int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
 	list_splice_init(ext_list, &aa->aa_exts);
 
 	spin_lock(&cli->cl_loi_list_lock);
-	starting_offset >>= PAGE_SHIFT;
+	starting_offset = pga[0]->off >> PAGE_SHIFT;
 	if (cmd == OBD_BRW_READ) {
 		cli->cl_r_in_flight++;
 		lprocfs_oh_tally_log2(&cli->cl_read_page_hist, page_count);
@@ -1979,12 +2252,14 @@ int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
 		lprocfs_oh_tally(&cli->cl_write_rpc_hist, cli->cl_w_in_flight);
 		lprocfs_oh_tally_log2(&cli->cl_write_offset_hist,
 				      starting_offset + 1);
+		lprocfs_oh_tally_log2(&cli->cl_write_objs_hist,
+				      multi != NULL ? multi->bm_count : 1);
 	}
 	spin_unlock(&cli->cl_loi_list_lock);
 
-	DEBUG_REQ(D_INODE, req, "%d pages, aa %p. now %ur/%uw in flight",
-		  page_count, aa, cli->cl_r_in_flight,
-		  cli->cl_w_in_flight);
+	DEBUG_REQ(D_INODE, req, "%d pages, %d objects, aa %p. now %ur/%uw in "
+		  "flight", page_count, multi != NULL ? multi->bm_count : 1, aa,
+		  cli->cl_r_in_flight, cli->cl_w_in_flight);
 	OBD_FAIL_TIMEOUT(OBD_FAIL_OSC_DELAY_IO, cfs_fail_val);
 
 	ptlrpcd_add_req(req);
@@ -2000,10 +2275,13 @@ out:
 
 		if (oa)
 			OBDO_FREE(oa);
+		if (multi)
+			OBD_FREE_PTR(multi);
 		if (pga)
 			OBD_FREE(pga, sizeof(*pga) * page_count);
 		/* this should happen rarely and is pretty bad, it makes the
 		 * pending list not follow the dirty order */
+		list_splice_tail_init(leftover, ext_list);
 		while (!list_empty(ext_list)) {
 			ext = list_entry(ext_list->next, struct osc_extent,
 					 oe_link);
@@ -2014,6 +2292,33 @@ out:
 	RETURN(rc);
 }
 
+/**
+ * Build an RPC by the list of extent @ext_list. The caller must ensure
+ * that the total pages in this list are NOT over max pages per RPC.
+ * Extents in the list must be in OES_RPC state.
+ *
+ * The extents of several objects can be written by one RPC if the server
+ * supports it. They must then be grouped by object, the extents of other
+ * objects than the first one which cannot share its RPC are sent in
+ * further ones.
+ */
+int osc_build_rpc(const struct lu_env *env, struct client_obd *cli,
+		  struct list_head *ext_list, int cmd)
+{
+	struct list_head leftover = LIST_HEAD_INIT(leftover);
+	int rc;
+
+	while (1) {
+		rc = osc_build_one_rpc(env, cli, ext_list, cmd, &leftover);
+		if (rc != 0 || list_empty(&leftover))
+			break;
+		/* objects which could not be written with the first one */
+		list_splice_init(&leftover, ext_list);
+	}
+
+	return rc;
+}
+
 static int osc_set_lock_data(struct ldlm_lock *lock, void *data)
 {
         int set = 0;
@@ -2850,6 +3155,10 @@ int osc_setup(struct obd_device *obd, struct lustre_cfg *lcfg)
 	if (rc)
 		GOTO(out_ptlrpcd, rc);
 
+	rc = osc_lru_setup(cli);
+	if (rc)
+		GOTO(out_client_setup, rc);
+
 	handler = ptlrpcd_alloc_work(cli->cl_import, brw_queue_work, cli);
 	if (IS_ERR(handler))
 		GOTO(out_client_setup, rc = PTR_ERR(handler));
@@ -2931,6 +3240,7 @@ out_ptlrpcd_work:
 		cli->cl_lru_work = NULL;
 	}
 out_client_setup:
+	osc_lru_cleanup(cli);
 	client_obd_cleanup(obd);
 out_ptlrpcd:
 	ptlrpcd_decref();
@@ -2993,6 +3303,7 @@ int osc_cleanup(struct obd_device *obd)
 	/* free memory of osc quota cache */
 	osc_quota_cleanup(obd);
 
+	osc_lru_cleanup(cli);
 	rc = client_obd_cleanup(obd);
 
 	ptlrpcd_decref();
@@ -472,17 +472,32 @@ __must_hold(&req->rq_lock)
 }
 
 static struct kmem_cache *request_cache;
+/* small incoming requests copied out of request buffers */
+static struct kmem_cache *reqbuf_cache;
 
 int ptlrpc_request_cache_init(void)
 {
 	request_cache = kmem_cache_create("ptlrpc_cache",
 					  sizeof(struct ptlrpc_request),
 					  0, SLAB_HWCACHE_ALIGN, NULL);
-	return request_cache == NULL ? -ENOMEM : 0;
+	if (request_cache == NULL)
+		return -ENOMEM;
+
+	reqbuf_cache = kmem_cache_create("ptlrpc_reqbuf_cache",
+					 PTLRPC_REQ_COPY_MAX,
+					 0, SLAB_HWCACHE_ALIGN, NULL);
+	if (reqbuf_cache == NULL) {
+		kmem_cache_destroy(request_cache);
+		request_cache = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
 }
 
 void ptlrpc_request_cache_fini(void)
 {
+	kmem_cache_destroy(reqbuf_cache);
 	kmem_cache_destroy(request_cache);
 }
 
@@ -499,6 +514,19 @@ void ptlrpc_request_cache_free(struct ptlrpc_request *req)
 	OBD_SLAB_FREE_PTR(req, request_cache);
 }
 
+void *ptlrpc_reqbuf_cache_alloc(struct cfs_cpt_table *cptab, int cpt)
+{
+	void *buf;
+
+	OBD_SLAB_CPT_ALLOC(buf, reqbuf_cache, cptab, cpt, PTLRPC_REQ_COPY_MAX);
+	return buf;
+}
+
+void ptlrpc_reqbuf_cache_free(void *buf)
+{
+	OBD_SLAB_FREE(buf, reqbuf_cache, PTLRPC_REQ_COPY_MAX);
+}
+
 /**
  * Wind down request pool \a pool.
  * Frees all requests from the pool too
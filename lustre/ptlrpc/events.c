@@ -354,6 +354,7 @@ void request_in_callback(struct lnet_event *ev)
 	ptlrpc_req_add_history(svcpt, req);
 
 	if (ev->unlinked) {
+		rqbd->rqbd_unlink_time = ktime_get();
 		svcpt->scp_nrqbds_posted--;
 		CDEBUG(D_INFO, "Buffer complete: %d buffers still posted\n",
 		       svcpt->scp_nrqbds_posted);
@@ -377,12 +377,43 @@ static const struct req_msg_field *ldlm_enqueue_lvb_server[] = {
         &RMF_DLM_LVB
 };
 
+static const struct req_msg_field *ldlm_enqueue_replay_batch_client[] = {
+	&RMF_PTLRPC_BODY,
+	&RMF_DLM_REQ,
+	&RMF_DLM_REPLAY_REQ
+};
+
+static const struct req_msg_field *ldlm_enqueue_replay_batch_server[] = {
+	&RMF_PTLRPC_BODY,
+	&RMF_DLM_REP,
+	&RMF_DLM_LVB,
+	&RMF_DLM_REPLAY_REP
+};
+
+static const struct req_msg_field *ldlm_enqueue_multi_client[] = {
+	&RMF_PTLRPC_BODY,
+	&RMF_DLM_REQ,
+	&RMF_DLM_MULTI_REQ
+};
+
+static const struct req_msg_field *ldlm_enqueue_multi_server[] = {
+	&RMF_PTLRPC_BODY,
+	&RMF_DLM_REP,
+	&RMF_DLM_LVB,
+	&RMF_DLM_MULTI_REP
+};
+
 static const struct req_msg_field *ldlm_cp_callback_client[] = {
         &RMF_PTLRPC_BODY,
         &RMF_DLM_REQ,
         &RMF_DLM_LVB
 };
 
+static const struct req_msg_field *ldlm_bl_callback_batch_server[] = {
+	&RMF_PTLRPC_BODY,
+	&RMF_DLM_REQ
+};
+
 static const struct req_msg_field *ldlm_gl_callback_desc_client[] = {
 	&RMF_PTLRPC_BODY,
 	&RMF_DLM_REQ,
@@ -616,6 +647,15 @@ static const struct req_msg_field *ost_brw_client[] = {
         &RMF_CAPA1
 };
 
+static const struct req_msg_field *ost_brw_write_multi_client[] = {
+	&RMF_PTLRPC_BODY,
+	&RMF_OST_BODY,
+	&RMF_OBD_IOOBJ,
+	&RMF_NIOBUF_REMOTE,
+	&RMF_CAPA1,
+	&RMF_OST_MULTI_BODY
+};
+
 static const struct req_msg_field *ost_brw_read_server[] = {
         &RMF_PTLRPC_BODY,
         &RMF_OST_BODY
@@ -783,6 +823,7 @@ static struct req_format *req_formats[] = {
         &RQF_OST_DESTROY,
         &RQF_OST_BRW_READ,
         &RQF_OST_BRW_WRITE,
+	&RQF_OST_BRW_WRITE_MULTI,
         &RQF_OST_STATFS,
         &RQF_OST_SET_GRANT_INFO,
 	&RQF_OST_GET_INFO,
@@ -793,11 +834,14 @@ static struct req_format *req_formats[] = {
 	&RQF_OST_LADVISE,
 	&RQF_LDLM_ENQUEUE,
 	&RQF_LDLM_ENQUEUE_LVB,
+	&RQF_LDLM_ENQUEUE_REPLAY_BATCH,
+	&RQF_LDLM_ENQUEUE_MULTI,
 	&RQF_LDLM_CONVERT,
 	&RQF_LDLM_CANCEL,
 	&RQF_LDLM_CALLBACK,
         &RQF_LDLM_CP_CALLBACK,
         &RQF_LDLM_BL_CALLBACK,
+	&RQF_LDLM_BL_CALLBACK_BATCH,
         &RQF_LDLM_GL_CALLBACK,
 	&RQF_LDLM_GL_DESC_CALLBACK,
         &RQF_LDLM_INTENT,
@@ -1055,6 +1099,28 @@ struct req_msg_field RMF_DLM_REP =
                     sizeof(struct ldlm_reply), lustre_swab_ldlm_reply, NULL);
 EXPORT_SYMBOL(RMF_DLM_REP);
 
+struct req_msg_field RMF_DLM_REPLAY_REQ =
+	DEFINE_MSGF("dlm_replay_req", RMF_F_STRUCT_ARRAY,
+		    sizeof(struct ldlm_request), lustre_swab_ldlm_request,
+		    NULL);
+EXPORT_SYMBOL(RMF_DLM_REPLAY_REQ);
+
+struct req_msg_field RMF_DLM_REPLAY_REP =
+	DEFINE_MSGF("dlm_replay_rep", RMF_F_STRUCT_ARRAY,
+		    sizeof(struct ldlm_reply), lustre_swab_ldlm_reply, NULL);
+EXPORT_SYMBOL(RMF_DLM_REPLAY_REP);
+
+struct req_msg_field RMF_DLM_MULTI_REQ =
+	DEFINE_MSGF("dlm_multi_req", RMF_F_STRUCT_ARRAY,
+		    sizeof(struct ldlm_request), lustre_swab_ldlm_request,
+		    NULL);
+EXPORT_SYMBOL(RMF_DLM_MULTI_REQ);
+
+struct req_msg_field RMF_DLM_MULTI_REP =
+	DEFINE_MSGF("dlm_multi_rep", RMF_F_STRUCT_ARRAY,
+		    sizeof(struct ldlm_reply), lustre_swab_ldlm_reply, NULL);
+EXPORT_SYMBOL(RMF_DLM_MULTI_REP);
+
 struct req_msg_field RMF_LDLM_INTENT =
         DEFINE_MSGF("ldlm_intent", 0,
                     sizeof(struct ldlm_intent), lustre_swab_ldlm_intent, NULL);
@@ -1119,6 +1185,11 @@ struct req_msg_field RMF_OST_BODY =
 		    dump_ost_body);
 EXPORT_SYMBOL(RMF_OST_BODY);
 
+struct req_msg_field RMF_OST_MULTI_BODY =
+	DEFINE_MSGF("ost_multi_body", RMF_F_STRUCT_ARRAY,
+		    sizeof(struct obdo), lustre_swab_obdo, NULL);
+EXPORT_SYMBOL(RMF_OST_MULTI_BODY);
+
 struct req_msg_field RMF_OBD_IOOBJ =
         DEFINE_MSGF("obd_ioobj", RMF_F_STRUCT_ARRAY,
                     sizeof(struct obd_ioobj), lustre_swab_obd_ioobj, dump_ioo);
@@ -1260,6 +1331,16 @@ struct req_format {
 		size_t			     nr;
 		const struct req_msg_field **d;
 	} rf_fields[RCL_NR];
+	/**
+	 * Layout cache computed once by req_layout_init(), so the hot paths
+	 * don't have to walk the field descriptors of every request.
+	 */
+	struct {
+		/** declared size of each field, (__u32)-1 if variable */
+		__u32	rfl_sizes[REQ_MAX_FIELD_NR];
+		/** v2 message size with every fixed-size field present */
+		__u32	rfl_msg_size;
+	} rf_layout[RCL_NR];
 };
 
 #define DEFINE_REQ_FMT(name, client, client_nr, server, server_nr) {    \
@@ -1477,6 +1558,17 @@ struct req_format RQF_LDLM_ENQUEUE_LVB =
                         ldlm_enqueue_client, ldlm_enqueue_lvb_server);
 EXPORT_SYMBOL(RQF_LDLM_ENQUEUE_LVB);
 
+struct req_format RQF_LDLM_ENQUEUE_REPLAY_BATCH =
+	DEFINE_REQ_FMT0("LDLM_ENQUEUE_REPLAY_BATCH",
+			ldlm_enqueue_replay_batch_client,
+			ldlm_enqueue_replay_batch_server);
+EXPORT_SYMBOL(RQF_LDLM_ENQUEUE_REPLAY_BATCH);
+
+struct req_format RQF_LDLM_ENQUEUE_MULTI =
+	DEFINE_REQ_FMT0("LDLM_ENQUEUE_MULTI",
+			ldlm_enqueue_multi_client, ldlm_enqueue_multi_server);
+EXPORT_SYMBOL(RQF_LDLM_ENQUEUE_MULTI);
+
 struct req_format RQF_LDLM_CONVERT =
         DEFINE_REQ_FMT0("LDLM_CONVERT",
                         ldlm_enqueue_client, ldlm_enqueue_server);
@@ -1498,6 +1590,11 @@ struct req_format RQF_LDLM_BL_CALLBACK =
         DEFINE_REQ_FMT0("LDLM_BL_CALLBACK", ldlm_enqueue_client, empty);
 EXPORT_SYMBOL(RQF_LDLM_BL_CALLBACK);
 
+struct req_format RQF_LDLM_BL_CALLBACK_BATCH =
+	DEFINE_REQ_FMT0("LDLM_BL_CALLBACK_BATCH", ldlm_enqueue_client,
+			ldlm_bl_callback_batch_server);
+EXPORT_SYMBOL(RQF_LDLM_BL_CALLBACK_BATCH);
+
 struct req_format RQF_LDLM_GL_CALLBACK =
         DEFINE_REQ_FMT0("LDLM_GL_CALLBACK", ldlm_enqueue_client,
                         ldlm_gl_callback_server);
@@ -1672,6 +1769,11 @@ struct req_format RQF_OST_BRW_WRITE =
         DEFINE_REQ_FMT0("OST_BRW_WRITE", ost_brw_client, ost_brw_write_server);
 EXPORT_SYMBOL(RQF_OST_BRW_WRITE);
 
+struct req_format RQF_OST_BRW_WRITE_MULTI =
+	DEFINE_REQ_FMT0("OST_BRW_WRITE_MULTI", ost_brw_write_multi_client,
+			ost_brw_write_server);
+EXPORT_SYMBOL(RQF_OST_BRW_WRITE_MULTI);
+
 struct req_format RQF_OST_STATFS =
         DEFINE_REQ_FMT0("OST_STATFS", empty, obd_statfs_server);
 EXPORT_SYMBOL(RQF_OST_STATFS);
@@ -1723,7 +1825,7 @@ EXPORT_SYMBOL(RQF_OST_LADVISE);
 
 /**
  * Initializes the capsule abstraction by computing and setting the \a rf_idx
- * field of RQFs and the \a rmf_offset field of RMFs.
+ * and \a rf_layout fields of RQFs and the \a rmf_offset field of RMFs.
  */
 int req_layout_init(void)
 {
@@ -1737,6 +1839,9 @@ int req_layout_init(void)
                 rf->rf_idx = i;
                 for (j = 0; j < RCL_NR; ++j) {
                         LASSERT(rf->rf_fields[j].nr <= REQ_MAX_FIELD_NR);
+			rf->rf_layout[j].rfl_msg_size =
+				lustre_msg_hdr_size(LUSTRE_MSG_MAGIC_V2,
+						    rf->rf_fields[j].nr);
                         for (k = 0; k < rf->rf_fields[j].nr; ++k) {
                                 struct req_msg_field *field;
 
@@ -1749,6 +1854,12 @@ int req_layout_init(void)
                                  * combinations.
                                  */
                                 field->rmf_offset[i][j] = k + 1;
+
+				rf->rf_layout[j].rfl_sizes[k] =
+					(__u32)field->rmf_size;
+				if (field->rmf_size != -1)
+					rf->rf_layout[j].rfl_msg_size +=
+						cfs_size_round(field->rmf_size);
                         }
                 }
         }
@@ -1867,8 +1978,8 @@ size_t req_capsule_filled_sizes(struct req_capsule *pill,
 
         for (i = 0; i < fmt->rf_fields[loc].nr; ++i) {
                 if (pill->rc_area[loc][i] == -1) {
-                        pill->rc_area[loc][i] =
-                                            fmt->rf_fields[loc].d[i]->rmf_size;
+			pill->rc_area[loc][i] =
+				fmt->rf_layout[loc].rfl_sizes[i];
                         if (pill->rc_area[loc][i] == -1) {
                                 /*
                                  * Skip the following fields.
@@ -1934,6 +2045,18 @@ __u32 __req_capsule_offset(const struct req_capsule *pill,
         return offset;
 }
 
+/**
+ * Returns non-zero if the request or reply (\a loc) of \a pill came from a
+ * peer of different endianness.  Inlined so that the common same-endian case
+ * skips the per-field swab bookkeeping in swabber_dumper_helper() entirely.
+ */
+static inline int req_capsule_need_swab(const struct req_capsule *pill,
+					enum req_location loc)
+{
+	return loc == RCL_CLIENT ? ptlrpc_req_need_swab(pill->rc_req) :
+				   ptlrpc_rep_need_swab(pill->rc_req);
+}
+
 /**
  * Helper for __req_capsule_get(); swabs value / array of values and/or dumps
  * them if desired.
@@ -2080,9 +2203,12 @@ static void *__req_capsule_get(struct req_capsule *pill,
 			  field->rmf_name, offset, lustre_msg_bufcount(msg),
 			  fmt->rf_name, lustre_msg_buflen(msg, offset), len,
 			  rcl_names[loc]);
-        } else {
+	} else if (dump || req_capsule_need_swab(pill, loc)) {
                 swabber_dumper_helper(pill, field, loc, offset, value, len,
                                       dump, swabber);
+	} else if (field->rmf_flags & RMF_F_STRUCT_ARRAY) {
+		/* same check as swabber_dumper_helper() does for arrays */
+		LASSERT((len % field->rmf_size) == 0);
         }
 
         return value;
@@ -2326,6 +2452,10 @@ __u32 req_capsule_fmt_size(__u32 magic, const struct req_format *fmt,
 	__u32 size;
 	size_t i = 0;
 
+	/* precomputed by req_layout_init() */
+	if (likely(magic == LUSTRE_MSG_MAGIC_V2))
+		return fmt->rf_layout[loc].rfl_msg_size;
+
         /*
          * This function should probably LASSERT() that fmt has no fields with
          * RMF_F_STRUCT_ARRAY in rmf_flags, since we can't know here how many
@@ -337,6 +337,72 @@ ptlrpc_lprocfs_req_history_max_seq_write(struct file *file,
 }
 LPROC_SEQ_FOPS(ptlrpc_lprocfs_req_history_max);
 
+static int
+ptlrpc_lprocfs_req_buffer_stats_seq_show(struct seq_file *m, void *n)
+{
+	struct ptlrpc_service *svc = m->private;
+	struct ptlrpc_service_part *svcpt;
+	struct list_head *tmp;
+	int i;
+
+	seq_printf(m, "%-4s %8s %8s %8s %8s %8s %8s %12s %10s %10s %10s\n",
+		   "cpt", "total", "posted", "idle", "history", "busy",
+		   "copying", "copied", "reposts", "avg_us", "max_us");
+
+	ptlrpc_service_for_each_part(svcpt, i, svc) {
+		__u64 reposts;
+		__u64 avg_us;
+		int idle = 0;
+
+		spin_lock(&svcpt->scp_lock);
+		list_for_each(tmp, &svcpt->scp_rqbd_idle)
+			idle++;
+		reposts = svcpt->scp_rqbd_reposts;
+		avg_us = reposts == 0 ? 0 :
+			 div64_u64(svcpt->scp_rqbd_repost_us, reposts);
+
+		/* "busy" buffers are unlinked from LNet but still have
+		 * requests pinning them */
+		seq_printf(m, "%-4d %8d %8d %8d %8d %8d %8d %12llu %10llu "
+			   "%10llu %10llu\n", svcpt->scp_cpt,
+			   svcpt->scp_nrqbds_total, svcpt->scp_nrqbds_posted,
+			   idle, svcpt->scp_hist_nrqbds,
+			   svcpt->scp_nrqbds_total - svcpt->scp_nrqbds_posted -
+			   idle - svcpt->scp_hist_nrqbds,
+			   svcpt->scp_nreqs_copied,
+			   svcpt->scp_nreqs_copied_total, reposts, avg_us,
+			   svcpt->scp_rqbd_repost_max_us);
+		spin_unlock(&svcpt->scp_lock);
+	}
+
+	return 0;
+}
+
+static ssize_t
+ptlrpc_lprocfs_req_buffer_stats_seq_write(struct file *file,
+					  const char __user *buffer,
+					  size_t count, loff_t *off)
+{
+	struct seq_file *m = file->private_data;
+	struct ptlrpc_service *svc = m->private;
+	struct ptlrpc_service_part *svcpt;
+	int i;
+
+	/* any write clears the count of copied requests and the repost
+	 * latency statistics */
+	ptlrpc_service_for_each_part(svcpt, i, svc) {
+		spin_lock(&svcpt->scp_lock);
+		svcpt->scp_nreqs_copied_total = 0;
+		svcpt->scp_rqbd_reposts = 0;
+		svcpt->scp_rqbd_repost_us = 0;
+		svcpt->scp_rqbd_repost_max_us = 0;
+		spin_unlock(&svcpt->scp_lock);
+	}
+
+	return count;
+}
+LPROC_SEQ_FOPS(ptlrpc_lprocfs_req_buffer_stats);
+
 static ssize_t threads_min_show(struct kobject *kobj, struct attribute *attr,
 				char *buf)
 {
@@ -1096,11 +1162,47 @@ static ssize_t high_priority_ratio_store(struct kobject *kobj,
 }
 LUSTRE_RW_ATTR(high_priority_ratio);
 
+static ssize_t req_buffer_copy_size_show(struct kobject *kobj,
+					 struct attribute *attr,
+					 char *buf)
+{
+	struct ptlrpc_service *svc = container_of(kobj, struct ptlrpc_service,
+						  srv_kobj);
+
+	return sprintf(buf, "%d\n", svc->srv_req_copy_size);
+}
+
+static ssize_t req_buffer_copy_size_store(struct kobject *kobj,
+					  struct attribute *attr,
+					  const char *buffer,
+					  size_t count)
+{
+	struct ptlrpc_service *svc = container_of(kobj, struct ptlrpc_service,
+						  srv_kobj);
+	int rc;
+	unsigned long val;
+
+	rc = kstrtoul(buffer, 10, &val);
+	if (rc < 0)
+		return rc;
+
+	if (val > PTLRPC_REQ_COPY_MAX)
+		return -ERANGE;
+
+	spin_lock(&svc->srv_lock);
+	svc->srv_req_copy_size = val;
+	spin_unlock(&svc->srv_lock);
+
+	return count;
+}
+LUSTRE_RW_ATTR(req_buffer_copy_size);
+
 static struct attribute *ptlrpc_svc_attrs[] = {
 	&lustre_attr_threads_min.attr,
 	&lustre_attr_threads_started.attr,
 	&lustre_attr_threads_max.attr,
 	&lustre_attr_high_priority_ratio.attr,
+	&lustre_attr_req_buffer_copy_size.attr,
 	NULL,
 };
 
@@ -1150,6 +1252,9 @@ void ptlrpc_lprocfs_register_service(struct proc_dir_entry *entry,
 		{ .name = "req_buffer_history_max",
 		  .fops	= &ptlrpc_lprocfs_req_history_max_fops,
 		  .data	= svc },
+		{ .name = "req_buffer_stats",
+		  .fops	= &ptlrpc_lprocfs_req_buffer_stats_fops,
+		  .data	= svc },
 		{ .name = "timeouts",
 		  .fops = &ptlrpc_lprocfs_timeouts_fops,
 		  .data = svc },
@@ -37,6 +37,7 @@
 #define DEBUG_SUBSYSTEM S_RPC
 
 #include <linux/kthread.h>
+#include <linux/hash.h>
 #include <obd_support.h>
 #include <obd_class.h>
 #include "ptlrpc_internal.h"
@@ -51,6 +52,35 @@ static struct list_head pinger_imports =
 static struct list_head timeout_list =
 		LIST_HEAD_INIT(timeout_list);
 
+/*
+ * Imports are queued on a hashed timer wheel with one second slots, keyed
+ * by the time they are next due for a ping, so that each pinger wakeup only
+ * looks at the imports that expire in the slots elapsed since the last one
+ * instead of walking all of pinger_imports.  Due times are rounded up to
+ * PINGER_WHEEL_ALIGN seconds so that imports to the same server tend to
+ * fire together and their pings can be batched.  All of this is protected
+ * by pinger_mutex.
+ */
+#define PINGER_WHEEL_BITS	6
+#define PINGER_WHEEL_SIZE	(1 << PINGER_WHEEL_BITS)
+#define PINGER_WHEEL_MASK	(PINGER_WHEEL_SIZE - 1)
+#define PINGER_WHEEL_ALIGN	4
+/* an import is pinged once it is less than this many seconds from due */
+#define PINGER_PING_EARLY	5
+
+static struct list_head pinger_wheel[PINGER_WHEEL_SIZE];
+/* last time the wheel was advanced to */
+static time64_t pinger_wheel_time;
+/* PING_INTERVAL the wheel was filled with, rescan if obd_timeout changes */
+static unsigned int pinger_wheel_interval;
+
+/* Imports due in this pinger pass, hashed by server NID so that the imports
+ * to the same server are adjacent and can be pinged in one request set */
+#define PINGER_DUE_BITS		6
+#define PINGER_DUE_SIZE		(1 << PINGER_DUE_BITS)
+
+static struct list_head pinger_due[PINGER_DUE_SIZE];
+
 int ptlrpc_pinger_suppress_pings()
 {
 	return suppress_pings;
@@ -91,7 +121,7 @@ int ptlrpc_obd_ping(struct obd_device *obd)
 }
 EXPORT_SYMBOL(ptlrpc_obd_ping);
 
-static int ptlrpc_ping(struct obd_import *imp)
+static int ptlrpc_ping(struct obd_import *imp, struct ptlrpc_request_set *set)
 {
 	struct ptlrpc_request	*req;
 	ENTRY;
@@ -106,7 +136,10 @@ static int ptlrpc_ping(struct obd_import *imp)
 
 	DEBUG_REQ(D_INFO, req, "pinging %s->%s",
 		  imp->imp_obd->obd_uuid.uuid, obd2cli_tgt(imp->imp_obd));
-	ptlrpcd_add_req(req);
+	if (set != NULL)
+		ptlrpc_set_add_req(set, req);
+	else
+		ptlrpcd_add_req(req);
 
 	RETURN(0);
 }
@@ -180,8 +213,43 @@ void ptlrpc_pinger_ir_down(void)
 }
 EXPORT_SYMBOL(ptlrpc_pinger_ir_down);
 
+/**
+ * Return the request set batching the pings to the current server,
+ * allocating it if needed.  If that fails the ping is just sent on
+ * its own.
+ */
+static struct ptlrpc_request_set *
+pinger_batch_get(struct ptlrpc_request_set **setp)
+{
+	if (*setp == NULL)
+		*setp = ptlrpc_prep_set();
+
+	return *setp;
+}
+
+/**
+ * Hand a batch of pings to one ptlrpcd thread, which sends them back to
+ * back to the server.
+ */
+static void pinger_batch_send(struct ptlrpc_request_set **setp)
+{
+	struct ptlrpc_request_set *set = *setp;
+
+	if (set == NULL)
+		return;
+
+	if (!list_empty(&set->set_requests)) {
+		CDEBUG(D_INFO, "sending %d batched pings\n",
+		       atomic_read(&set->set_remaining));
+		ptlrpcd_add_rqset(set);
+	}
+	ptlrpc_set_destroy(set);
+	*setp = NULL;
+}
+
 static void ptlrpc_pinger_process_import(struct obd_import *imp,
-					 time64_t this_ping)
+					 time64_t this_ping,
+					 struct ptlrpc_request_set **setp)
 {
 	int level;
 	int force;
@@ -200,7 +268,7 @@ static void ptlrpc_pinger_process_import(struct obd_import *imp,
 
 	imp->imp_force_verify = 0;
 
-	if (imp->imp_next_ping - 5 >= this_ping && !force) {
+	if (imp->imp_next_ping - PINGER_PING_EARLY >= this_ping && !force) {
 		spin_unlock(&imp->imp_lock);
 		return;
 	}
@@ -233,15 +301,180 @@ static void ptlrpc_pinger_process_import(struct obd_import *imp,
 			spin_unlock(&imp->imp_lock);
 		}
 	} else if ((imp->imp_pingable && !suppress) || force_next || force) {
-		ptlrpc_ping(imp);
+		ptlrpc_ping(imp, pinger_batch_get(setp));
 	}
 }
 
+static lnet_nid_t pinger_import_nid(struct obd_import *imp)
+{
+	lnet_nid_t nid = LNET_NID_ANY;
+
+	spin_lock(&imp->imp_lock);
+	if (imp->imp_connection != NULL)
+		nid = imp->imp_connection->c_peer.nid;
+	spin_unlock(&imp->imp_lock);
+
+	return nid;
+}
+
+/**
+ * Queue \a imp on the timer wheel for the next time it may need a ping.
+ *
+ * imp_next_ping is updated whenever an RPC is sent on the import without
+ * touching the wheel, so the slot may turn out to be early, in which case
+ * the import is just queued again when its slot fires.  An import is never
+ * queued further than PING_INTERVAL away, which is how often the old pinger
+ * visited every import, so the recovery and forced verification checks in
+ * ptlrpc_pinger_process_import() still run at least that often.
+ */
+static void pinger_wheel_add(struct obd_import *imp, time64_t now)
+{
+	/* first second at which ptlrpc_pinger_process_import() will ping,
+	 * i.e. the one right after imp_next_ping - PINGER_PING_EARLY */
+	time64_t due = imp->imp_next_ping - PINGER_PING_EARLY + 1;
+
+	LASSERT(mutex_is_locked(&pinger_mutex));
+
+	if (due <= now)
+		due = now + PING_INTERVAL;
+	due = min_t(time64_t, due, now + PING_INTERVAL);
+	due = ALIGN(due, PINGER_WHEEL_ALIGN);
+	due = max(due, pinger_wheel_time + 1);
+
+	imp->imp_pinger_wheel_time = due;
+	list_move_tail(&imp->imp_pinger_wheel,
+		       &pinger_wheel[due & PINGER_WHEEL_MASK]);
+}
+
+/**
+ * Add \a imp to the imports due in this pass, next to the ones connected to
+ * the same server if any.
+ */
+static void pinger_due_add(struct obd_import *imp)
+{
+	lnet_nid_t nid = pinger_import_nid(imp);
+	struct list_head *head = &pinger_due[hash_64(nid, PINGER_DUE_BITS)];
+	struct list_head *pos = head->prev;
+	struct obd_import *tmp;
+
+	list_for_each_entry_reverse(tmp, head, imp_pinger_wheel) {
+		if (pinger_import_nid(tmp) == nid) {
+			pos = &tmp->imp_pinger_wheel;
+			break;
+		}
+	}
+	list_move(&imp->imp_pinger_wheel, pos);
+}
+
+/**
+ * Move the imports that expire by \a now from the timer wheel to the due
+ * lists, or all the imports if \a scan_all is set.
+ */
+static int pinger_wheel_collect(time64_t now, bool scan_all)
+{
+	struct obd_import *imp;
+	struct obd_import *tmp;
+	time64_t time;
+	int count = 0;
+
+	LASSERT(mutex_is_locked(&pinger_mutex));
+
+	if (scan_all) {
+		list_for_each_entry(imp, &pinger_imports, imp_pinger_chain) {
+			pinger_due_add(imp);
+			count++;
+		}
+		goto out;
+	}
+
+	/* a slot holds every PINGER_WHEEL_SIZE-th second, so no need to look
+	 * at more slots than that however long the pinger slept */
+	time = max(pinger_wheel_time + 1, now - PINGER_WHEEL_MASK);
+	for (; time <= now; time++) {
+		struct list_head *slot;
+
+		slot = &pinger_wheel[time & PINGER_WHEEL_MASK];
+		list_for_each_entry_safe(imp, tmp, slot, imp_pinger_wheel) {
+			if (imp->imp_pinger_wheel_time > now)
+				continue;
+			pinger_due_add(imp);
+			count++;
+		}
+	}
+out:
+	pinger_wheel_time = now;
+	pinger_wheel_interval = PING_INTERVAL;
+
+	return count;
+}
+
+/**
+ * Return the next time an import is queued on the timer wheel for,
+ * or the end of the ping interval if the wheel is empty.
+ */
+static time64_t pinger_wheel_next(time64_t now)
+{
+	time64_t end = now + min_t(time64_t, PING_INTERVAL, PINGER_WHEEL_SIZE);
+	time64_t time;
+
+	for (time = now + 1; time < end; time++)
+		if (!list_empty(&pinger_wheel[time & PINGER_WHEEL_MASK]))
+			break;
+
+	return time;
+}
+
+/**
+ * Process the imports due in this pass, batching the pings to each server,
+ * and queue them back on the timer wheel.
+ */
+static void pinger_process_due(time64_t this_ping)
+{
+	struct ptlrpc_request_set *set = NULL;
+	lnet_nid_t batch_nid = LNET_NID_ANY;
+	int i;
+
+	LASSERT(mutex_is_locked(&pinger_mutex));
+
+	for (i = 0; i < PINGER_DUE_SIZE; i++) {
+		while (!list_empty(&pinger_due[i])) {
+			struct obd_import *imp;
+			lnet_nid_t nid;
+
+			imp = list_entry(pinger_due[i].next, struct obd_import,
+					 imp_pinger_wheel);
+			list_del_init(&imp->imp_pinger_wheel);
+
+			nid = pinger_import_nid(imp);
+			if (nid != batch_nid) {
+				pinger_batch_send(&set);
+				batch_nid = nid;
+			}
+
+			ptlrpc_pinger_process_import(imp, this_ping, &set);
+			/* obd_timeout might have changed */
+			if (imp->imp_pingable && imp->imp_next_ping &&
+			    imp->imp_next_ping > this_ping + PING_INTERVAL)
+				ptlrpc_update_next_ping(imp, 0);
+
+			pinger_wheel_add(imp, this_ping);
+		}
+	}
+	pinger_batch_send(&set);
+}
+
 static int ptlrpc_pinger_main(void *arg)
 {
 	struct ptlrpc_thread *thread = (struct ptlrpc_thread *)arg;
+	bool scan_all = true;
+	int i;
 	ENTRY;
 
+	for (i = 0; i < PINGER_WHEEL_SIZE; i++)
+		INIT_LIST_HEAD(&pinger_wheel[i]);
+	for (i = 0; i < PINGER_DUE_SIZE; i++)
+		INIT_LIST_HEAD(&pinger_due[i]);
+
 	/* Record that the thread is running */
 	thread_set_flags(thread, SVC_RUNNING);
 	wake_up(&thread->t_ctl_waitq);
@@ -252,29 +485,29 @@ static int ptlrpc_pinger_main(void *arg)
 		struct l_wait_info lwi;
 		time64_t time_to_next_wake;
 		struct timeout_item *item;
-		struct list_head *iter;
+		time64_t next_slot;
+		int count;
 
 		mutex_lock(&pinger_mutex);
 		list_for_each_entry(item, &timeout_list, ti_chain)
                         item->ti_cb(item, item->ti_cb_data);
 
-		list_for_each(iter, &pinger_imports) {
-			struct obd_import *imp = list_entry(iter,
-							    struct obd_import,
-							    imp_pinger_chain);
-
-			ptlrpc_pinger_process_import(imp, this_ping);
-			/* obd_timeout might have changed */
-			if (imp->imp_pingable && imp->imp_next_ping &&
-			    imp->imp_next_ping > this_ping + PING_INTERVAL)
-				ptlrpc_update_next_ping(imp, 0);
-		}
+		/* the wheel must be rebuilt if obd_timeout has changed */
+		if (pinger_wheel_interval != PING_INTERVAL)
+			scan_all = true;
+		count = pinger_wheel_collect(this_ping, scan_all);
+		pinger_process_due(this_ping);
+		next_slot = pinger_wheel_next(this_ping);
 		mutex_unlock(&pinger_mutex);
+		CDEBUG(D_INFO, "processed %d imports%s\n", count,
+		       scan_all ? " (full scan)" : "");
+		scan_all = false;
 		/* update memory usage info */
 		obd_update_maxusage();
 
                 /* Wait until the next ping time, or until we're stopped. */
-                time_to_next_wake = pinger_check_timeout(this_ping);
+                time_to_next_wake = min(pinger_check_timeout(this_ping),
+					next_slot - ktime_get_seconds());
                 /* The ping sent by ptlrpc_send_rpc may get sent out
                    say .01 second after this.
                    ptlrpc_pinger_sending_on_import will then set the
@@ -295,13 +528,22 @@ static int ptlrpc_pinger_main(void *arg)
                         if (thread_test_and_clear_flags(thread, SVC_STOPPING)) {
                                 EXIT;
                                 break;
-                        } else {
-                                /* woken after adding import to reset timer */
-                                thread_test_and_clear_flags(thread, SVC_EVENT);
-                        }
+                        } else if (thread_test_and_clear_flags(thread,
+							       SVC_EVENT)) {
+				/* woken after adding import or an import
+				 * state change, check all of them */
+				scan_all = true;
+			}
                 }
         }
 
+	/* the wheel is set up again if the pinger is restarted */
+	mutex_lock(&pinger_mutex);
+	for (i = 0; i < PINGER_WHEEL_SIZE; i++)
+		while (!list_empty(&pinger_wheel[i]))
+			list_del_init(pinger_wheel[i].next);
+	mutex_unlock(&pinger_mutex);
+
 	thread_set_flags(thread, SVC_STOPPED);
 	wake_up(&thread->t_ctl_waitq);
 
@@ -426,6 +668,7 @@ int ptlrpc_pinger_del_import(struct obd_import *imp)
 
 	mutex_lock(&pinger_mutex);
 	list_del_init(&imp->imp_pinger_chain);
+	list_del_init(&imp->imp_pinger_wheel);
 	CDEBUG(D_HA, "removing pingable import %s->%s\n",
 	       imp->imp_obd->obd_uuid.uuid, obd2cli_tgt(imp->imp_obd));
 	/* if we remove from pinger we don't want recovery on this import */
@@ -79,6 +79,8 @@ int ptlrpc_request_cache_init(void);
 void ptlrpc_request_cache_fini(void);
 struct ptlrpc_request *ptlrpc_request_cache_alloc(gfp_t flags);
 void ptlrpc_request_cache_free(struct ptlrpc_request *req);
+void *ptlrpc_reqbuf_cache_alloc(struct cfs_cpt_table *cptab, int cpt);
+void ptlrpc_reqbuf_cache_free(void *buf);
 void ptlrpc_init_xid(void);
 void ptlrpc_set_add_new_req(struct ptlrpcd_ctl *pc,
 			    struct ptlrpc_request *req);
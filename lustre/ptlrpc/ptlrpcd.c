@@ -71,6 +71,8 @@ struct ptlrpcd {
 	int			pd_cursor;
 	int			pd_nthreads;
 	int			pd_groupsize;
+	/* other ptlrpcds, nearest CPT first, for remote stealing */
+	struct ptlrpcd		**pd_remotes;
 	struct ptlrpcd_ctl	pd_threads[0];
 };
 
@@ -137,6 +139,36 @@ module_param(ptlrpcd_cpts, charp, 0644);
 MODULE_PARM_DESC(ptlrpcd_cpts,
 		 "CPU partitions ptlrpcd threads should run in");
 
+/*
+ * ptlrpcd_steal_policy: Where an idle ptlrpcd thread looks for work once
+ * its partners have none.
+ *
+ * 0: partner threads only.
+ * 1: also the busiest thread in the same CPT (default).
+ * 2: also threads in the other CPTs, nearest CPT first.
+ */
+enum ptlrpcd_steal_policy {
+	PTLRPCD_STEAL_PARTNERS	= 0,
+	PTLRPCD_STEAL_CPT	= 1,
+	PTLRPCD_STEAL_REMOTE	= 2,
+};
+
+static int ptlrpcd_steal_policy = PTLRPCD_STEAL_CPT;
+module_param(ptlrpcd_steal_policy, int, 0644);
+MODULE_PARM_DESC(ptlrpcd_steal_policy,
+		 "Ptlrpcd work stealing: 0 partners, 1 CPT, 2 all CPTs");
+
+/*
+ * ptlrpcd_steal_depth: The number of queued requests at which a thread
+ * that is not a partner may take the queue, and an idle thread of the
+ * same CPT is woken to do so. Threads of other CPTs only take queues four
+ * times as deep, since the requests then lose their NUMA locality.
+ */
+static int ptlrpcd_steal_depth = 4;
+module_param(ptlrpcd_steal_depth, int, 0644);
+MODULE_PARM_DESC(ptlrpcd_steal_depth,
+		 "Queue depth from which non-partner ptlrpcd threads steal");
+
 /* ptlrpcds_cpt_idx maps cpt numbers to an index in the ptlrpcds array. */
 static int		*ptlrpcds_cpt_idx;
 
@@ -165,6 +197,28 @@ void ptlrpcd_wake(struct ptlrpc_request *req)
 }
 EXPORT_SYMBOL(ptlrpcd_wake);
 
+static inline struct ptlrpcd *ptlrpcd_cpt2pd(int cpt)
+{
+	return ptlrpcds[ptlrpcds_cpt_idx == NULL ? cpt : ptlrpcds_cpt_idx[cpt]];
+}
+
+/**
+ * Number of requests queued on \a pc: those it is processing plus those
+ * waiting to be picked up.
+ */
+static int ptlrpcd_queue_depth(struct ptlrpcd_ctl *pc)
+{
+	struct ptlrpc_request_set *set = READ_ONCE(pc->pc_set);
+
+	/* pc_set is only reset on ptlrpcd shutdown, once no more requests
+	 * are added, no need to lock */
+	if (unlikely(set == NULL))
+		return 0;
+
+	return atomic_read(&set->set_remaining) +
+	       atomic_read(&set->set_new_count);
+}
+
 static struct ptlrpcd_ctl *
 ptlrpcd_select_pc(struct ptlrpc_request *req)
 {
@@ -188,6 +242,15 @@ ptlrpcd_select_pc(struct ptlrpc_request *req)
 		idx = 0;
 	pd->pd_cursor = idx;
 
+	/* Of the next two threads in turn, prefer the less loaded one. */
+	if (ptlrpcd_steal_policy != PTLRPCD_STEAL_PARTNERS) {
+		int next = idx + 1 == pd->pd_nthreads ? 0 : idx + 1;
+
+		if (ptlrpcd_queue_depth(&pd->pd_threads[next]) <
+		    ptlrpcd_queue_depth(&pd->pd_threads[idx]))
+			idx = next;
+	}
+
 	return &pd->pd_threads[idx];
 }
 
@@ -259,6 +322,158 @@ static int ptlrpcd_steal_rqset(struct ptlrpc_request_set *des,
 	return rc;
 }
 
+static inline void ptlrpc_reqset_get(struct ptlrpc_request_set *set)
+{
+	atomic_inc(&set->set_refcount);
+}
+
+/**
+ * Take the new requests of \a victim if it has at least \a min_depth of
+ * them queued. Return transferred RPCs count.
+ */
+static int ptlrpcd_steal_from(struct ptlrpcd_ctl *pc,
+			      struct ptlrpcd_ctl *victim, int min_depth)
+{
+	struct ptlrpc_request_set *ps;
+	int rc = 0;
+
+	spin_lock(&victim->pc_lock);
+	ps = victim->pc_set;
+	if (ps == NULL) {
+		spin_unlock(&victim->pc_lock);
+		return 0;
+	}
+
+	ptlrpc_reqset_get(ps);
+	spin_unlock(&victim->pc_lock);
+
+	if (atomic_read(&ps->set_new_count) >= min_depth) {
+		rc = ptlrpcd_steal_rqset(pc->pc_set, ps);
+		if (rc > 0) {
+			pc->pc_stolen_reqs += rc;
+			CDEBUG(D_RPCTRACE, "transfer %d async RPCs [%s->%s]\n",
+			       rc, victim->pc_name, pc->pc_name);
+		}
+	}
+	ptlrpc_reqset_put(ps);
+
+	return rc;
+}
+
+/**
+ * Find the thread of \a pd with the most new requests queued, at least
+ * \a min_depth of them.
+ */
+static struct ptlrpcd_ctl *ptlrpcd_busiest(struct ptlrpcd *pd,
+					   struct ptlrpcd_ctl *pc,
+					   int min_depth)
+{
+	struct ptlrpcd_ctl *busiest = NULL;
+	int depth;
+	int i;
+
+	for (i = 0; i < pd->pd_nthreads; i++) {
+		struct ptlrpcd_ctl *victim = &pd->pd_threads[i];
+
+		if (victim == pc)
+			continue;
+
+		/* racy, but stealing rechecks under the set lock */
+		spin_lock(&victim->pc_lock);
+		depth = victim->pc_set == NULL ? 0 :
+			atomic_read(&victim->pc_set->set_new_count);
+		spin_unlock(&victim->pc_lock);
+
+		if (depth >= min_depth) {
+			busiest = victim;
+			min_depth = depth + 1;
+		}
+	}
+
+	return busiest;
+}
+
+/**
+ * Called by an idle thread whose partners have no work: take the queue of
+ * the busiest thread of the same CPT, then if allowed of the busiest thread
+ * of the nearest CPT which has a deep enough queue.
+ */
+static int ptlrpcd_steal_dynamic(struct ptlrpcd_ctl *pc)
+{
+	struct ptlrpcd *pd = ptlrpcd_cpt2pd(pc->pc_cpt);
+	struct ptlrpcd **remotes;
+	struct ptlrpcd_ctl *victim;
+	int depth = max(ptlrpcd_steal_depth, 1);
+	int rc;
+	int i;
+
+	victim = ptlrpcd_busiest(pd, pc, depth);
+	if (victim != NULL) {
+		rc = ptlrpcd_steal_from(pc, victim, depth);
+		if (rc > 0) {
+			pc->pc_steal_local++;
+			return rc;
+		}
+	}
+
+	if (ptlrpcd_steal_policy < PTLRPCD_STEAL_REMOTE)
+		return 0;
+
+	remotes = READ_ONCE(pd->pd_remotes);
+	if (remotes == NULL)
+		return 0;
+	/* paired with the smp_wmb() of ptlrpcd_remotes_init() */
+	smp_rmb();
+
+	depth *= 4;
+	for (i = 0; i < ptlrpcds_num - 1; i++) {
+		victim = ptlrpcd_busiest(remotes[i], pc, depth);
+		if (victim == NULL)
+			continue;
+
+		rc = ptlrpcd_steal_from(pc, victim, depth);
+		if (rc > 0) {
+			pc->pc_steal_remote++;
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Wake one idle thread of the CPT of \a pc, which just queued a request,
+ * once its queue is deep enough to be stolen by non-partner threads.
+ */
+static void ptlrpcd_wake_idle(struct ptlrpcd_ctl *pc)
+{
+	struct ptlrpc_request_set *set = READ_ONCE(pc->pc_set);
+	struct ptlrpcd *pd;
+	bool woken = false;
+	int i;
+
+	if (ptlrpcd_steal_policy == PTLRPCD_STEAL_PARTNERS ||
+	    pc->pc_index < 0 || set == NULL ||
+	    atomic_read(&set->set_new_count) != max(ptlrpcd_steal_depth, 1))
+		return;
+
+	pd = ptlrpcd_cpt2pd(pc->pc_cpt);
+	for (i = 0; i < pd->pd_nthreads && !woken; i++) {
+		struct ptlrpcd_ctl *idle = &pd->pd_threads[i];
+
+		if (idle == pc || ptlrpcd_queue_depth(idle) != 0)
+			continue;
+
+		/* the idle thread may be shutting down */
+		spin_lock(&idle->pc_lock);
+		if (idle->pc_set != NULL) {
+			wake_up(&idle->pc_set->set_waitq);
+			woken = true;
+		}
+		spin_unlock(&idle->pc_lock);
+	}
+}
+
 /**
  * Requests that are added to the ptlrpcd queue are sent via
  * ptlrpcd_check->ptlrpc_check_set().
@@ -299,14 +514,10 @@ void ptlrpcd_add_req(struct ptlrpc_request *req)
 		  req, pc->pc_name, pc->pc_index);
 
 	ptlrpc_set_add_new_req(pc, req);
+	ptlrpcd_wake_idle(pc);
 }
 EXPORT_SYMBOL(ptlrpcd_add_req);
 
-static inline void ptlrpc_reqset_get(struct ptlrpc_request_set *set)
-{
-	atomic_inc(&set->set_refcount);
-}
-
 /**
  * Check if there is more work to do on ptlrpcd set.
  * Returns 1 if yes.
@@ -380,7 +591,6 @@ static int ptlrpcd_check(struct lu_env *env, struct ptlrpcd_ctl *pc)
                  * work from our partner threads. */
                 if (rc == 0 && pc->pc_npartners > 0) {
                         struct ptlrpcd_ctl *partner;
-                        struct ptlrpc_request_set *ps;
                         int first = pc->pc_cursor;
 
                         do {
@@ -390,27 +600,14 @@ static int ptlrpcd_check(struct lu_env *env, struct ptlrpcd_ctl *pc)
                                 if (partner == NULL)
                                         continue;
 
-				spin_lock(&partner->pc_lock);
-				ps = partner->pc_set;
-				if (ps == NULL) {
-					spin_unlock(&partner->pc_lock);
-					continue;
-				}
-
-				ptlrpc_reqset_get(ps);
-				spin_unlock(&partner->pc_lock);
-
-				if (atomic_read(&ps->set_new_count)) {
-					rc = ptlrpcd_steal_rqset(set, ps);
-					if (rc > 0)
-						CDEBUG(D_RPCTRACE, "transfer %d"
-						       " async RPCs [%d->%d]\n",
-						       rc, partner->pc_index,
-						       pc->pc_index);
-				}
-				ptlrpc_reqset_put(ps);
+				rc = ptlrpcd_steal_from(pc, partner, 1);
 			} while (rc == 0 && pc->pc_cursor != first);
 		}
+
+		/* Then from any busy thread, if allowed. */
+		if (rc == 0 && pc->pc_index >= 0 &&
+		    ptlrpcd_steal_policy != PTLRPCD_STEAL_PARTNERS)
+			rc = ptlrpcd_steal_dynamic(pc);
 	}
 
 	RETURN(rc || test_bit(LIOD_STOP, &pc->pc_flags));
@@ -593,6 +790,60 @@ out:
 	RETURN(rc);
 }
 
+/*
+ * Build the list of the other ptlrpcds for each ptlrpcd, sorted by CPT
+ * distance, which threads walk when stealing work from other CPTs.
+ */
+static int ptlrpcd_remotes_init(void)
+{
+	struct ptlrpcd	**remotes;
+	struct ptlrpcd	*pd;
+	struct ptlrpcd	*tmp;
+	unsigned int	dist;
+	int		n;
+	int		i;
+	int		j;
+	int		k;
+	ENTRY;
+
+	if (ptlrpcds_num < 2)
+		RETURN(0);
+
+	for (i = 0; i < ptlrpcds_num; i++) {
+		pd = ptlrpcds[i];
+		OBD_CPT_ALLOC(remotes, cfs_cpt_table, pd->pd_cpt,
+			      sizeof(*remotes) * (ptlrpcds_num - 1));
+		if (remotes == NULL)
+			RETURN(-ENOMEM);
+
+		/* insertion sort, there are only a few CPTs */
+		for (n = 0, j = 0; j < ptlrpcds_num; j++) {
+			if (j == i)
+				continue;
+
+			tmp = ptlrpcds[j];
+			dist = cfs_cpt_distance(cfs_cpt_table, pd->pd_cpt,
+						tmp->pd_cpt);
+			for (k = n; k > 0; k--) {
+				if (cfs_cpt_distance(cfs_cpt_table, pd->pd_cpt,
+						     remotes[k - 1]->pd_cpt) <=
+				    dist)
+					break;
+				remotes[k] = remotes[k - 1];
+			}
+			remotes[k] = tmp;
+			n++;
+		}
+
+		/* threads of this CPT are already running, paired with the
+		 * smp_rmb() of ptlrpcd_steal_dynamic() */
+		smp_wmb();
+		WRITE_ONCE(pd->pd_remotes, remotes);
+	}
+
+	RETURN(0);
+}
+
 int ptlrpcd_start(struct ptlrpcd_ctl *pc)
 {
 	struct task_struct	*task;
@@ -684,6 +935,62 @@ out:
         EXIT;
 }
 
+static void ptlrpcd_seq_show_ctl(struct seq_file *m, struct ptlrpcd_ctl *pc)
+{
+	int remaining = 0;
+	int new = 0;
+
+	spin_lock(&pc->pc_lock);
+	if (pc->pc_set != NULL) {
+		remaining = atomic_read(&pc->pc_set->set_remaining);
+		new = atomic_read(&pc->pc_set->set_new_count);
+	}
+	spin_unlock(&pc->pc_lock);
+
+	seq_printf(m, "%-16s %8d %8d %12lu %12lu %12lu\n", pc->pc_name,
+		   remaining, new, pc->pc_steal_local, pc->pc_steal_remote,
+		   pc->pc_stolen_reqs);
+}
+
+static int ptlrpcd_stats_seq_show(struct seq_file *m, void *v)
+{
+	int i;
+	int j;
+
+	seq_printf(m, "%-16s %8s %8s %12s %12s %12s\n", "thread", "active",
+		   "new", "steal_local", "steal_remote", "stolen_reqs");
+	ptlrpcd_seq_show_ctl(m, &ptlrpcd_rcv);
+	for (i = 0; i < ptlrpcds_num; i++)
+		for (j = 0; j < ptlrpcds[i]->pd_nthreads; j++)
+			ptlrpcd_seq_show_ctl(m, &ptlrpcds[i]->pd_threads[j]);
+
+	return 0;
+}
+LPROC_SEQ_FOPS_RO(ptlrpcd_stats);
+
+static bool ptlrpcd_proc_registered;
+
+static void ptlrpcd_proc_init(void)
+{
+	int rc;
+
+	rc = lprocfs_seq_create(proc_lustre_root, "ptlrpcd_stats", 0444,
+				&ptlrpcd_stats_fops, NULL);
+	if (rc)
+		CWARN("Error adding the ptlrpcd_stats file: rc = %d\n", rc);
+	else
+		ptlrpcd_proc_registered = true;
+}
+
+static void ptlrpcd_proc_fini(void)
+{
+	if (!ptlrpcd_proc_registered)
+		return;
+
+	lprocfs_remove_proc_entry("ptlrpcd_stats", proc_lustre_root);
+	ptlrpcd_proc_registered = false;
+}
+
 static void ptlrpcd_fini(void)
 {
 	int	i;
@@ -691,14 +998,30 @@ static void ptlrpcd_fini(void)
 	int	ncpts;
 	ENTRY;
 
+	ptlrpcd_proc_fini();
+
 	if (ptlrpcds != NULL) {
+		/* Threads may steal from any CPT, so stop all of them before
+		 * freeing anything. */
 		for (i = 0; i < ptlrpcds_num; i++) {
 			if (ptlrpcds[i] == NULL)
 				break;
 			for (j = 0; j < ptlrpcds[i]->pd_nthreads; j++)
 				ptlrpcd_stop(&ptlrpcds[i]->pd_threads[j], 0);
+		}
+		for (i = 0; i < ptlrpcds_num; i++) {
+			if (ptlrpcds[i] == NULL)
+				break;
 			for (j = 0; j < ptlrpcds[i]->pd_nthreads; j++)
 				ptlrpcd_free(&ptlrpcds[i]->pd_threads[j]);
+		}
+		for (i = 0; i < ptlrpcds_num; i++) {
+			if (ptlrpcds[i] == NULL)
+				break;
+			if (ptlrpcds[i]->pd_remotes != NULL)
+				OBD_FREE(ptlrpcds[i]->pd_remotes,
+					 sizeof(ptlrpcds[0]) *
+					 (ptlrpcds_num - 1));
 			OBD_FREE(ptlrpcds[i], ptlrpcds[i]->pd_size);
 			ptlrpcds[i] = NULL;
 		}
@@ -931,6 +1254,12 @@ static int ptlrpcd_init(void)
 				GOTO(out, rc);
 		}
 	}
+
+	rc = ptlrpcd_remotes_init();
+	if (rc < 0)
+		GOTO(out, rc);
+
+	ptlrpcd_proc_init();
 out:
 	if (rc != 0)
 		ptlrpcd_fini();
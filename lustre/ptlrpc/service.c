@@ -102,6 +102,7 @@ ptlrpc_free_rqbd(struct ptlrpc_request_buffer_desc *rqbd)
 	struct ptlrpc_service_part *svcpt = rqbd->rqbd_svcpt;
 
 	LASSERT(rqbd->rqbd_refcount == 0);
+	LASSERT(rqbd->rqbd_ncopied == 0);
 	LASSERT(list_empty(&rqbd->rqbd_reqs));
 
 	spin_lock(&svcpt->scp_lock);
@@ -456,6 +457,19 @@ ptlrpc_server_post_idle_rqbds(struct ptlrpc_service_part *svcpt)
 		if (rc != 0)
 			break;
 
+		if (ktime_to_ns(rqbd->rqbd_unlink_time) != 0) {
+			__u64 us = ktime_us_delta(ktime_get(),
+						  rqbd->rqbd_unlink_time);
+
+			rqbd->rqbd_unlink_time = ktime_set(0, 0);
+			spin_lock(&svcpt->scp_lock);
+			svcpt->scp_rqbd_reposts++;
+			svcpt->scp_rqbd_repost_us += us;
+			if (us > svcpt->scp_rqbd_repost_max_us)
+				svcpt->scp_rqbd_repost_max_us = us;
+			spin_unlock(&svcpt->scp_lock);
+		}
+
 		posted = 1;
 	}
 
@@ -847,6 +861,12 @@ static void ptlrpc_server_free_request(struct ptlrpc_request *req)
 
 	sptlrpc_svc_ctx_decref(req);
 
+	if (req->rq_reqbuf_copied) {
+		ptlrpc_reqbuf_cache_free(req->rq_reqbuf);
+		req->rq_reqbuf = NULL;
+		req->rq_reqbuf_copied = 0;
+	}
+
 	if (req != &req->rq_rqbd->rqbd_req) {
 		/* NB request buffers use an embedded
 		 * req if the incoming req unlinked the
@@ -855,6 +875,130 @@ static void ptlrpc_server_free_request(struct ptlrpc_request *req)
 	}
 }
 
+/**
+ * Request buffer \a rqbd has no more requests referring to its buffer: put it
+ * into history, and cull some history back into the idle list so it can be
+ * reposted.  Called with svcpt::scp_lock held, which is dropped on return.
+ */
+static void ptlrpc_server_rqbd_release(struct ptlrpc_service_part *svcpt,
+				       struct ptlrpc_request_buffer_desc *rqbd)
+{
+	struct ptlrpc_service	*svc = svcpt->scp_service;
+	struct ptlrpc_request	*req;
+	struct list_head	*tmp;
+	struct list_head	*nxt;
+
+	assert_spin_locked(&svcpt->scp_lock);
+	LASSERT(rqbd->rqbd_refcount == 0);
+
+	/* request buffer is now idle: add to history */
+	list_del(&rqbd->rqbd_list);
+
+	list_add_tail(&rqbd->rqbd_list, &svcpt->scp_hist_rqbds);
+	svcpt->scp_hist_nrqbds++;
+
+	/* cull some history?
+	 * I expect only about 1 or 2 rqbds need to be recycled here */
+	while (svcpt->scp_hist_nrqbds > svc->srv_hist_nrqbds_cpt_max) {
+		rqbd = list_entry(svcpt->scp_hist_rqbds.next,
+				  struct ptlrpc_request_buffer_desc,
+				  rqbd_list);
+
+		list_del(&rqbd->rqbd_list);
+		svcpt->scp_hist_nrqbds--;
+
+		/* remove rqbd's reqs from svc's req history while
+		 * I've got the service lock */
+		list_for_each(tmp, &rqbd->rqbd_reqs) {
+			req = list_entry(tmp, struct ptlrpc_request,
+					 rq_list);
+			/* Track the highest culled req seq */
+			if (req->rq_history_seq >
+			    svcpt->scp_hist_seq_culled) {
+				svcpt->scp_hist_seq_culled =
+					req->rq_history_seq;
+			}
+			list_del(&req->rq_history_list);
+		}
+
+		spin_unlock(&svcpt->scp_lock);
+
+		list_for_each_safe(tmp, nxt, &rqbd->rqbd_reqs) {
+			req = list_entry(rqbd->rqbd_reqs.next,
+					 struct ptlrpc_request,
+					 rq_list);
+			list_del(&req->rq_list);
+			ptlrpc_server_free_request(req);
+		}
+
+		spin_lock(&svcpt->scp_lock);
+		/*
+		 * now all reqs including the embedded req has been
+		 * disposed, schedule request buffer for re-use
+		 * or free it to drain some in excess.  A descriptor
+		 * still referred to by copied-out requests can't be
+		 * freed, so it is reposted instead.
+		 */
+		LASSERT(atomic_read(&rqbd->rqbd_req.rq_refcount) == 0);
+		if (svcpt->scp_nrqbds_posted >=
+		    svc->srv_nbuf_per_group &&
+		    rqbd->rqbd_ncopied == 0 &&
+		    !test_req_buffer_pressure) {
+			/* like in ptlrpc_free_rqbd() */
+			svcpt->scp_nrqbds_total--;
+			OBD_FREE_LARGE(rqbd->rqbd_buffer,
+				       svc->srv_buf_size);
+			OBD_FREE_PTR(rqbd);
+		} else {
+			list_add_tail(&rqbd->rqbd_list,
+				      &svcpt->scp_rqbd_idle);
+		}
+	}
+
+	spin_unlock(&svcpt->scp_lock);
+}
+
+/**
+ * Copy a small incoming request out of its request buffer, so that the
+ * buffer is not pinned while the request is being processed and can be
+ * reposted as soon as the other requests in it are done.  Requests are
+ * copied into a per-CPT slab; larger requests and the request embedded
+ * in the rqbd keep referring to the buffer.
+ *
+ * The request keeps pointing to the rqbd descriptor to find its service
+ * partition, so the descriptor is not freed until rqbd_ncopied drops to 0.
+ */
+static void ptlrpc_server_copy_reqbuf(struct ptlrpc_service_part *svcpt,
+				      struct ptlrpc_request *req)
+{
+	struct ptlrpc_service			*svc = svcpt->scp_service;
+	struct ptlrpc_request_buffer_desc	*rqbd = req->rq_rqbd;
+	int					 size;
+	void					*buf;
+
+	size = ACCESS_ONCE(svc->srv_req_copy_size);
+	if (size == 0 || req == &rqbd->rqbd_req ||
+	    req->rq_reqdata_len == 0 || req->rq_reqdata_len > size)
+		return;
+
+	buf = ptlrpc_reqbuf_cache_alloc(svc->srv_cptable, svcpt->scp_cpt);
+	if (buf == NULL)
+		return;
+
+	memcpy(buf, req->rq_reqbuf, req->rq_reqdata_len);
+	req->rq_reqbuf = buf;
+	req->rq_reqbuf_copied = 1;
+
+	spin_lock(&svcpt->scp_lock);
+	rqbd->rqbd_ncopied++;
+	svcpt->scp_nreqs_copied++;
+	svcpt->scp_nreqs_copied_total++;
+	if (--rqbd->rqbd_refcount == 0)
+		ptlrpc_server_rqbd_release(svcpt, rqbd);
+	else
+		spin_unlock(&svcpt->scp_lock);
+}
+
 /**
  * drop a reference count of the request. if it reaches 0, we either
  * put it into history list, or free it immediately.
@@ -863,10 +1007,6 @@ void ptlrpc_server_drop_request(struct ptlrpc_request *req)
 {
 	struct ptlrpc_request_buffer_desc *rqbd = req->rq_rqbd;
 	struct ptlrpc_service_part	  *svcpt = rqbd->rqbd_svcpt;
-	struct ptlrpc_service		  *svc = svcpt->scp_service;
-	int				   refcount;
-	struct list_head			  *tmp;
-	struct list_head			  *nxt;
 
 	if (!atomic_dec_and_test(&req->rq_refcount))
 		return;
@@ -895,72 +1035,28 @@ void ptlrpc_server_drop_request(struct ptlrpc_request *req)
 
 	spin_lock(&svcpt->scp_lock);
 
-	list_add(&req->rq_list, &rqbd->rqbd_reqs);
-
-	refcount = --(rqbd->rqbd_refcount);
-	if (refcount == 0) {
-		/* request buffer is now idle: add to history */
-		list_del(&rqbd->rqbd_list);
+	if (req->rq_reqbuf_copied) {
+		/* the request no longer refers to the buffer, so it can't
+		 * be kept in history with it, free it now */
+		LASSERT(rqbd->rqbd_ncopied > 0);
+		rqbd->rqbd_ncopied--;
+		svcpt->scp_nreqs_copied--;
+		list_del_init(&req->rq_history_list);
 
-		list_add_tail(&rqbd->rqbd_list, &svcpt->scp_hist_rqbds);
-		svcpt->scp_hist_nrqbds++;
-
-		/* cull some history?
-		 * I expect only about 1 or 2 rqbds need to be recycled here */
-		while (svcpt->scp_hist_nrqbds > svc->srv_hist_nrqbds_cpt_max) {
-			rqbd = list_entry(svcpt->scp_hist_rqbds.next,
-					  struct ptlrpc_request_buffer_desc,
-					  rqbd_list);
-
-			list_del(&rqbd->rqbd_list);
-			svcpt->scp_hist_nrqbds--;
-
-			/* remove rqbd's reqs from svc's req history while
-			 * I've got the service lock */
-			list_for_each(tmp, &rqbd->rqbd_reqs) {
-				req = list_entry(tmp, struct ptlrpc_request,
-						 rq_list);
-				/* Track the highest culled req seq */
-				if (req->rq_history_seq >
-				    svcpt->scp_hist_seq_culled) {
-					svcpt->scp_hist_seq_culled =
-						req->rq_history_seq;
-				}
-				list_del(&req->rq_history_list);
-			}
+		/* Track the highest culled req seq */
+		if (req->rq_history_seq > svcpt->scp_hist_seq_culled)
+			svcpt->scp_hist_seq_culled = req->rq_history_seq;
 
-			spin_unlock(&svcpt->scp_lock);
+		spin_unlock(&svcpt->scp_lock);
 
-			list_for_each_safe(tmp, nxt, &rqbd->rqbd_reqs) {
-				req = list_entry(rqbd->rqbd_reqs.next,
-						 struct ptlrpc_request,
-						 rq_list);
-				list_del(&req->rq_list);
-				ptlrpc_server_free_request(req);
-			}
+		ptlrpc_server_free_request(req);
+		return;
+	}
 
-			spin_lock(&svcpt->scp_lock);
-			/*
-			 * now all reqs including the embedded req has been
-			 * disposed, schedule request buffer for re-use
-			 * or free it to drain some in excess.
-			 */
-			LASSERT(atomic_read(&rqbd->rqbd_req.rq_refcount) == 0);
-			if (svcpt->scp_nrqbds_posted >=
-			    svc->srv_nbuf_per_group &&
-			    !test_req_buffer_pressure) {
-				/* like in ptlrpc_free_rqbd() */
-				svcpt->scp_nrqbds_total--;
-				OBD_FREE_LARGE(rqbd->rqbd_buffer,
-					       svc->srv_buf_size);
-				OBD_FREE_PTR(rqbd);
-			} else {
-				list_add_tail(&rqbd->rqbd_list,
-					      &svcpt->scp_rqbd_idle);
-			}
-		}
+	list_add(&req->rq_list, &rqbd->rqbd_reqs);
 
-		spin_unlock(&svcpt->scp_lock);
+	if (--rqbd->rqbd_refcount == 0) {
+		ptlrpc_server_rqbd_release(svcpt, rqbd);
 	} else if (req->rq_reply_state && req->rq_reply_state->rs_prealloc) {
 		/* If we are low on memory, we are not interested in history */
 		list_del(&req->rq_list);
@@ -1882,6 +1978,9 @@ ptlrpc_server_handle_req_in(struct ptlrpc_service_part *svcpt,
 	 * concerned */
 	spin_unlock(&svcpt->scp_lock);
 
+	/* must be done before the message is unpacked in place */
+	ptlrpc_server_copy_reqbuf(svcpt, req);
+
         /* go through security check/transform */
         rc = sptlrpc_svc_unwrap_request(req);
         switch (rc) {
@@ -1312,6 +1312,14 @@ void lustre_assert_wire_constants(void)
 		 OBD_CONNECT2_FILE_SECCTX);
 	LASSERTF(OBD_CONNECT2_LOCKAHEAD == 0x2ULL, "found 0x%.16llxULL\n",
 		 OBD_CONNECT2_LOCKAHEAD);
+	LASSERTF(OBD_CONNECT2_BL_AST_BATCH == 0x4ULL, "found 0x%.16llxULL\n",
+		 OBD_CONNECT2_BL_AST_BATCH);
+	LASSERTF(OBD_CONNECT2_LOCK_REPLAY_BATCH == 0x8ULL,
+		 "found 0x%.16llxULL\n", OBD_CONNECT2_LOCK_REPLAY_BATCH);
+	LASSERTF(OBD_CONNECT2_MULTI_ENQUEUE == 0x10ULL, "found 0x%.16llxULL\n",
+		 OBD_CONNECT2_MULTI_ENQUEUE);
+	LASSERTF(OBD_CONNECT2_MULTI_BRW == 0x20ULL, "found 0x%.16llxULL\n",
+		 OBD_CONNECT2_MULTI_BRW);
 	LASSERTF(OBD_CKSUM_CRC32 == 0x00000001UL, "found 0x%.8xUL\n",
 		(unsigned)OBD_CKSUM_CRC32);
 	LASSERTF(OBD_CKSUM_ADLER == 0x00000002UL, "found 0x%.8xUL\n",
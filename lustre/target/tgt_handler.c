@@ -185,12 +185,93 @@ out:
 }
 EXPORT_SYMBOL(tgt_validate_obdo);
 
+/*
+ * A multi-object BRW write packs one ioobj per object, the obdo of the first
+ * object in the ost_body and those of the other objects, in the same order,
+ * in the RMF_OST_MULTI_BODY array. Check them and set the object IDs in the
+ * ioobjs as done for the first one.
+ */
+static int tgt_multi_brw_unpack(struct tgt_session_info *tsi,
+				struct obd_ioobj *ioo, int obj_count,
+				struct niobuf_remote *rnb)
+{
+	struct req_capsule	*pill = tsi->tsi_pill;
+	struct lu_nodemap	*nodemap;
+	struct obdo		*oa;
+	int			 niocount = 0;
+	int			 npages = 0;
+	int			 rc = 0;
+	int			 i;
+
+	ENTRY;
+
+	if (!exp_connect_multi_brw(tsi->tsi_exp) ||
+	    pill->rc_fmt != &RQF_OST_BRW_WRITE ||
+	    obj_count > PTLRPC_MAX_BRW_OBJS) {
+		CERROR("%s: too many ioobjs (%d)\n", tgt_name(tsi->tsi_tgt),
+		       obj_count);
+		RETURN(-EPROTO);
+	}
+
+	req_capsule_extend(pill, &RQF_OST_BRW_WRITE_MULTI);
+	if (req_capsule_get_size(pill, &RMF_OST_MULTI_BODY, RCL_CLIENT) !=
+	    (obj_count - 1) * sizeof(*oa))
+		RETURN(-EPROTO);
+
+	oa = req_capsule_client_get(pill, &RMF_OST_MULTI_BODY);
+	if (oa == NULL)
+		RETURN(-EPROTO);
+
+	for (i = 0; i < obj_count; i++)
+		niocount += ioo[i].ioo_bufcnt;
+	if (niocount > PTLRPC_MAX_BRW_PAGES ||
+	    req_capsule_get_size(pill, &RMF_NIOBUF_REMOTE, RCL_CLIENT) <
+	    niocount * sizeof(*rnb))
+		RETURN(-EPROTO);
+
+	/* the local buffers of all objects must fit in one bulk, and lockless
+	 * IO would need several server locks taken in a safe order */
+	for (i = 0; i < niocount; i++) {
+		if (rnb[i].rnb_len == 0 ||
+		    rnb[i].rnb_flags & OBD_BRW_SRVLOCK)
+			RETURN(-EPROTO);
+		npages += ((rnb[i].rnb_offset + rnb[i].rnb_len - 1) >>
+			   PAGE_SHIFT) - (rnb[i].rnb_offset >> PAGE_SHIFT) + 1;
+	}
+	if (npages > PTLRPC_MAX_BRW_PAGES)
+		RETURN(-EPROTO);
+
+	nodemap = nodemap_get_from_exp(tsi->tsi_exp);
+	if (IS_ERR(nodemap))
+		RETURN(PTR_ERR(nodemap));
+
+	for (i = 1; i < obj_count; i++, oa++) {
+		if (ioo[i].ioo_bufcnt == 0 || !(oa->o_valid & OBD_MD_FLID))
+			GOTO(out, rc = -EPROTO);
+
+		rc = tgt_validate_obdo(tsi, oa);
+		if (rc != 0)
+			GOTO(out, rc);
+
+		oa->o_uid = nodemap_map_id(nodemap, NODEMAP_UID,
+					   NODEMAP_CLIENT_TO_FS, oa->o_uid);
+		oa->o_gid = nodemap_map_id(nodemap, NODEMAP_GID,
+					   NODEMAP_CLIENT_TO_FS, oa->o_gid);
+		ioo[i].ioo_oid = oa->o_oi;
+	}
+	EXIT;
+out:
+	nodemap_putref(nodemap);
+	return rc;
+}
+
 static int tgt_io_data_unpack(struct tgt_session_info *tsi, struct ost_id *oi)
 {
 	unsigned		 max_brw;
 	struct niobuf_remote	*rnb;
 	struct obd_ioobj	*ioo;
 	int			 obj_count;
+	int			 rc;
 
 	ENTRY;
 
@@ -218,9 +299,9 @@ static int tgt_io_data_unpack(struct tgt_session_info *tsi, struct ost_id *oi)
 		CERROR("%s: short ioobj\n", tgt_name(tsi->tsi_tgt));
 		RETURN(-EPROTO);
 	} else if (obj_count > 1) {
-		CERROR("%s: too many ioobjs (%d)\n", tgt_name(tsi->tsi_tgt),
-		       obj_count);
-		RETURN(-EPROTO);
+		rc = tgt_multi_brw_unpack(tsi, ioo, obj_count, rnb);
+		if (rc < 0)
+			RETURN(rc);
 	}
 
 	if (ioo->ioo_bufcnt == 0) {
@@ -2124,10 +2205,14 @@ int tgt_brw_write(struct tgt_session_info *tsi)
 	struct niobuf_local	*local_nb;
 	struct obd_ioobj	*ioo;
 	struct ost_body		*body, *repbody;
+	struct obdo		*multi_oa = NULL;
 	struct l_wait_info	 lwi;
 	struct lustre_handle	 lockh = {0};
 	__u32			*rcs;
 	int			 objcount, niocount, npages;
+	int			 obj_pages[PTLRPC_MAX_BRW_OBJS];
+	int			 prepared;
+	int			 brw_rc;
 	int			 rc, i, j;
 	enum cksum_types cksum_type = OBD_CKSUM_CRC32;
 	bool			 no_reply = false, mmap;
@@ -2233,11 +2318,29 @@ int tgt_brw_write(struct tgt_session_info *tsi)
 		GOTO(out_lock, rc = -ENOMEM);
 	repbody->oa = body->oa;
 
-	npages = PTLRPC_MAX_BRW_PAGES;
-	rc = obd_preprw(tsi->tsi_env, OBD_BRW_WRITE, exp, &repbody->oa,
-			objcount, ioo, remote_nb, &npages, local_nb);
-	if (rc < 0)
-		GOTO(out_lock, rc);
+	/* the objects of a multi-object write are prepared one after the
+	 * other, their local buffers following each other in one bulk */
+	if (objcount > 1)
+		multi_oa = req_capsule_client_get(&req->rq_pill,
+						  &RMF_OST_MULTI_BODY);
+	for (prepared = npages = j = 0; prepared < objcount; prepared++) {
+		struct obdo *oa = prepared == 0 ? &repbody->oa :
+						  &multi_oa[prepared - 1];
+
+		obj_pages[prepared] = PTLRPC_MAX_BRW_PAGES - npages;
+		rc = obd_preprw(tsi->tsi_env, OBD_BRW_WRITE, exp, oa, 1,
+				&ioo[prepared], remote_nb + j,
+				&obj_pages[prepared], local_nb + npages);
+		if (rc < 0)
+			break;
+		npages += obj_pages[prepared];
+		j += ioo[prepared].ioo_bufcnt;
+	}
+	if (rc < 0) {
+		if (prepared == 0)
+			GOTO(out_lock, rc);
+		GOTO(skip_transfer, rc);
+	}
 
 	desc = ptlrpc_prep_bulk_exp(req, npages, ioobj_max_brw_get(ioo),
 				    PTLRPC_BULK_GET_SINK | PTLRPC_BULK_BUF_KIOV,
@@ -2290,9 +2393,27 @@ skip_transfer:
 		}
 	}
 
-	/* Must commit after prep above in all cases */
-	rc = obd_commitrw(tsi->tsi_env, OBD_BRW_WRITE, exp, &repbody->oa,
-			  objcount, ioo, remote_nb, npages, local_nb, rc);
+	/* Each object is committed in its own transaction, so let every one
+	 * of them take a transno and update last_rcvd; the reply carries the
+	 * last one, which the client waits on before dropping its pages */
+	if (prepared > 1)
+		tgt_th_info(tsi->tsi_env)->tti_mult_trans =
+					!req_is_replay(req);
+
+	/* Must commit after prep above in all cases, each object is written
+	 * even if another one fails and the first error is returned */
+	for (i = npages = j = 0, brw_rc = rc; i < prepared; i++) {
+		struct obdo *oa = i == 0 ? &repbody->oa : &multi_oa[i - 1];
+		int rc2;
+
+		rc2 = obd_commitrw(tsi->tsi_env, OBD_BRW_WRITE, exp, oa, 1,
+				   &ioo[i], remote_nb + j, obj_pages[i],
+				   local_nb + npages, brw_rc);
+		if (i == 0 || (rc == 0 && rc2 != 0))
+			rc = rc2;
+		npages += obj_pages[i];
+		j += ioo[i].ioo_bufcnt;
+	}
 	if (rc == -ENOTCONN)
 		/* quota acquire process has been given up because
 		 * either the client has been evicted or the client
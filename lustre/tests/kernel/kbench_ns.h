@@ -0,0 +1,72 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+
+/* Fixture of the ldlm benchmark modules: a private server namespace where
+ * the benchmarks grant local locks. */
+
+#ifndef _KBENCH_NS_H
+#define _KBENCH_NS_H
+
+#include <obd_support.h>
+#include <obd.h>
+#include <lustre_dlm.h>
+
+#ifdef HAVE_SERVER_SUPPORT
+
+/**
+ * Run \a run on a new server namespace of \a type, named \a name-\a run_id,
+ * and free the namespace once done.
+ *
+ * \retval the result of \a run, or a negative error
+ */
+static inline int kbench_ns_run(const char *name, int run_id,
+				enum ldlm_ns_type type,
+				int (*run)(struct ldlm_namespace *ns))
+{
+	struct obd_device *obd;
+	struct ldlm_namespace *ns;
+	int rc;
+
+	/* the namespace and its pool only need a name and the pool lock */
+	OBD_ALLOC_PTR(obd);
+	if (obd == NULL)
+		return -ENOMEM;
+	snprintf(obd->obd_name, sizeof(obd->obd_name), "%s-%u", name, run_id);
+	rwlock_init(&obd->obd_pool_lock);
+
+	ns = ldlm_namespace_new(obd, obd->obd_name, LDLM_NAMESPACE_SERVER,
+				LDLM_NAMESPACE_GREEDY, type);
+	if (ns == NULL)
+		GOTO(out_obd, rc = -ENOMEM);
+
+	rc = run(ns);
+
+	ldlm_namespace_free(ns, NULL, 1);
+out_obd:
+	OBD_FREE_PTR(obd);
+
+	return rc;
+}
+
+#endif /* HAVE_SERVER_SUPPORT */
+
+#endif /* _KBENCH_NS_H */
@@ -0,0 +1,196 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+
+/* Microbenchmark for the footprint of ldlm locks.
+ *
+ * Prints the memory used by one million locks, then grants one local PR
+ * inodebits lock on each of nr_locks resources of a private server namespace,
+ * as an MDS does for the files cached by its clients, and matches them in a
+ * loop, going over all the resources so that the locks are mostly out of the
+ * CPU cache.  The results are printed to the console, the module is never
+ * actually loaded. */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+
+#include <obd_support.h>
+#include <obd.h>
+#include <lustre_dlm.h>
+
+#include "kbench_ns.h"
+
+/* Random ID passed by userspace, and printed in messages, used to
+ * separate different runs of that module. */
+static int run_id;
+module_param(run_id, int, 0644);
+MODULE_PARM_DESC(run_id, "run ID");
+
+static int nr_locks = 100000;
+module_param(nr_locks, int, 0644);
+MODULE_PARM_DESC(nr_locks, "number of locks to grant");
+
+static int iterations = 10;
+module_param(iterations, int, 0644);
+MODULE_PARM_DESC(iterations, "number of match loops over all the locks");
+
+#define PREFIX "lustre_klocks_%u:"
+
+#ifdef HAVE_SERVER_SUPPORT
+
+static void klocks_res_id(struct ldlm_res_id *res_id, int i)
+{
+	memset(res_id, 0, sizeof(*res_id));
+	res_id->name[0] = 0x4b4c4f434b53ULL;
+	res_id->name[1] = i;
+}
+
+static int klocks_run(struct ldlm_namespace *ns)
+{
+	union ldlm_policy_data policy = {
+		.l_inodebits = { .bits = MDS_INODELOCK_LOOKUP }
+	};
+	struct lustre_handle *handles;
+	struct lustre_handle lockh;
+	struct ldlm_res_id res_id;
+	enum ldlm_mode mode;
+	ktime_t start;
+	__u64 enqueue_ns;
+	__u64 match_ns;
+	__u64 flags;
+	int granted;
+	int misses = 0;
+	int rc = 0;
+	int i;
+	int j;
+
+	OBD_ALLOC_LARGE(handles, sizeof(*handles) * nr_locks);
+	if (handles == NULL)
+		return -ENOMEM;
+
+	start = ktime_get();
+	for (granted = 0; granted < nr_locks; granted++) {
+		klocks_res_id(&res_id, granted);
+		flags = LDLM_FL_ATOMIC_CB;
+		rc = ldlm_cli_enqueue_local(ns, &res_id, LDLM_IBITS, &policy,
+					    LCK_PR, &flags, ldlm_blocking_ast,
+					    ldlm_completion_ast, NULL, NULL, 0,
+					    LVB_T_NONE, NULL,
+					    &handles[granted]);
+		if (rc != ELDLM_OK) {
+			pr_err(PREFIX " cannot enqueue lock %d: rc = %d\n",
+			       run_id, granted, rc);
+			GOTO(out, rc = -EIO);
+		}
+		/* keep the lock granted but unused, as a client's one */
+		ldlm_lock_decref(&handles[granted], LCK_PR);
+	}
+	enqueue_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < nr_locks; j++) {
+			klocks_res_id(&res_id, j);
+			mode = ldlm_lock_match(ns, LDLM_FL_BLOCK_GRANTED,
+					       &res_id, LDLM_IBITS, &policy,
+					       LCK_PR, &lockh, 0);
+			if (mode == 0) {
+				misses++;
+				continue;
+			}
+			ldlm_lock_decref(&lockh, mode);
+		}
+	}
+	match_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	pr_err(PREFIX " %d locks: enqueue %llu ns/op, match+decref %llu "
+	       "ns/op, %d misses\n", run_id, nr_locks,
+	       div_u64(enqueue_ns, nr_locks),
+	       div_u64(match_ns, (__u64)nr_locks * iterations), misses);
+	if (misses != 0)
+		rc = -ESTALE;
+out:
+	for (i = 0; i < granted; i++) {
+		/* take a reference back to cancel the lock */
+		klocks_res_id(&res_id, i);
+		mode = ldlm_lock_match(ns, LDLM_FL_BLOCK_GRANTED, &res_id,
+				       LDLM_IBITS, &policy, LCK_PR, &lockh, 0);
+		if (mode != 0)
+			ldlm_lock_decref_and_cancel(&lockh, mode);
+	}
+	OBD_FREE_LARGE(handles, sizeof(*handles) * nr_locks);
+
+	return rc;
+}
+
+static int klocks_test(void)
+{
+	return kbench_ns_run("klocks", run_id, LDLM_NS_TYPE_MDT, klocks_run);
+}
+
+#else /* !HAVE_SERVER_SUPPORT */
+
+static int klocks_test(void)
+{
+	pr_err(PREFIX " local locks need server support\n", run_id);
+	return -EOPNOTSUPP;
+}
+
+#endif /* HAVE_SERVER_SUPPORT */
+
+static int __init klocks_init(void)
+{
+	size_t size = ALIGN(sizeof(struct ldlm_lock), L1_CACHE_BYTES);
+	int rc;
+
+	if (nr_locks <= 0 || iterations <= 0) {
+		pr_err(PREFIX " invalid nr_locks %d or iterations %d\n",
+		       run_id, nr_locks, iterations);
+		goto out;
+	}
+
+	/* the lock slab is cache line aligned */
+	pr_err(PREFIX " struct ldlm_lock %zu bytes, %zu allocated, %zu MiB "
+	       "per million locks\n", run_id, sizeof(struct ldlm_lock), size,
+	       (size * 1000000) >> 20);
+
+	rc = klocks_test();
+	if (rc == 0)
+		pr_err(PREFIX " all tests done\n", run_id);
+	else
+		pr_err(PREFIX " test failed: rc = %d\n", run_id, rc);
+out:
+	/* Don't load. */
+	return -EINVAL;
+}
+
+static void __exit klocks_exit(void)
+{
+}
+
+MODULE_AUTHOR("OpenSFS, Inc. <http://www.lustre.org/>");
+MODULE_DESCRIPTION("Lustre lock footprint benchmark module");
+MODULE_VERSION(LUSTRE_VERSION_STRING);
+MODULE_LICENSE("GPL");
+
+module_init(klocks_init);
+module_exit(klocks_exit);
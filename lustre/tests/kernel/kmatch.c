@@ -0,0 +1,210 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+
+/* Microbenchmark for ldlm_lock_match() on a single hot resource.
+ *
+ * Grants one local PR extent lock in a private server namespace, then starts
+ * a thread on every online CPU matching and releasing it in a loop, which is
+ * what concurrent readers of one file do to the client lock of that file.
+ * Locks cannot be granted locally in a client namespace, so this measures
+ * the match hint skipping the interval tree walk; the hint of a server lock
+ * is still checked under the resource lock, unlike that of a client lock.
+ * The results are printed to the console, the module is never actually
+ * loaded. */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+
+#include <obd_support.h>
+#include <obd.h>
+#include <lustre_dlm.h>
+
+#include "kbench_ns.h"
+
+/* Random ID passed by userspace, and printed in messages, used to
+ * separate different runs of that module. */
+static int run_id;
+module_param(run_id, int, 0644);
+MODULE_PARM_DESC(run_id, "run ID");
+
+static int iterations = 1000000;
+module_param(iterations, int, 0644);
+MODULE_PARM_DESC(iterations, "number of match/decref loops per thread");
+
+#define PREFIX "lustre_kmatch_%u:"
+
+#ifdef HAVE_SERVER_SUPPORT
+
+static struct ldlm_res_id kmatch_res_id = { .name = { 0x4b4d41544348ULL } };
+
+struct kmatch_thread {
+	struct ldlm_namespace	*kmt_ns;
+	struct completion	 kmt_done;
+	__u64			 kmt_ns_total;
+	int			 kmt_misses;
+};
+
+static int kmatch_thread_main(void *arg)
+{
+	struct kmatch_thread *kmt = arg;
+	union ldlm_policy_data policy = {
+		.l_extent = { .start = 0, .end = PAGE_SIZE - 1 }
+	};
+	struct lustre_handle lockh;
+	enum ldlm_mode mode;
+	ktime_t start;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		mode = ldlm_lock_match(kmt->kmt_ns, LDLM_FL_BLOCK_GRANTED,
+				       &kmatch_res_id, LDLM_EXTENT, &policy,
+				       LCK_PR, &lockh, 0);
+		if (mode == 0) {
+			kmt->kmt_misses++;
+			continue;
+		}
+		ldlm_lock_decref(&lockh, mode);
+	}
+	kmt->kmt_ns_total = ktime_to_ns(ktime_sub(ktime_get(), start));
+	complete(&kmt->kmt_done);
+
+	return 0;
+}
+
+static int kmatch_run(struct ldlm_namespace *ns)
+{
+	struct kmatch_thread *threads;
+	struct task_struct *task;
+	union ldlm_policy_data policy = {
+		.l_extent = { .start = 0, .end = OBD_OBJECT_EOF }
+	};
+	struct lustre_handle lockh;
+	__u64 flags = LDLM_FL_ATOMIC_CB;
+	__u64 total = 0;
+	int nr_threads = 0;
+	int misses = 0;
+	int cpu;
+	int rc;
+	int i;
+
+	rc = ldlm_cli_enqueue_local(ns, &kmatch_res_id, LDLM_EXTENT, &policy,
+				    LCK_PR, &flags, ldlm_blocking_ast,
+				    ldlm_completion_ast, NULL, NULL, 0,
+				    LVB_T_NONE, NULL, &lockh);
+	if (rc != ELDLM_OK) {
+		pr_err(PREFIX " cannot enqueue lock: rc = %d\n", run_id, rc);
+		return -EIO;
+	}
+
+	OBD_ALLOC(threads, sizeof(*threads) * num_online_cpus());
+	if (threads == NULL)
+		GOTO(out_lock, rc = -ENOMEM);
+
+	for_each_online_cpu(cpu) {
+		struct kmatch_thread *kmt = &threads[nr_threads];
+
+		if (nr_threads == num_online_cpus())
+			break;
+
+		kmt->kmt_ns = ns;
+		init_completion(&kmt->kmt_done);
+		task = kthread_create(kmatch_thread_main, kmt, "kmatch_%d",
+				      cpu);
+		if (IS_ERR(task)) {
+			rc = PTR_ERR(task);
+			pr_err(PREFIX " cannot start thread: rc = %d\n",
+			       run_id, rc);
+			break;
+		}
+		kthread_bind(task, cpu);
+		wake_up_process(task);
+		nr_threads++;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		wait_for_completion(&threads[i].kmt_done);
+		total += threads[i].kmt_ns_total;
+		misses += threads[i].kmt_misses;
+	}
+
+	if (nr_threads > 0)
+		pr_err(PREFIX " %d threads: match+decref %llu ns/op, "
+		       "%d misses\n", run_id, nr_threads,
+		       div_u64(total, (__u64)nr_threads * iterations), misses);
+	if (misses != 0)
+		rc = -ESTALE;
+
+	OBD_FREE(threads, sizeof(*threads) * num_online_cpus());
+out_lock:
+	ldlm_lock_decref_and_cancel(&lockh, LCK_PR);
+
+	return rc;
+}
+
+static int kmatch_test(void)
+{
+	return kbench_ns_run("kmatch", run_id, LDLM_NS_TYPE_OST, kmatch_run);
+}
+
+#else /* !HAVE_SERVER_SUPPORT */
+
+static int kmatch_test(void)
+{
+	pr_err(PREFIX " local locks need server support\n", run_id);
+	return -EOPNOTSUPP;
+}
+
+#endif /* HAVE_SERVER_SUPPORT */
+
+static int __init kmatch_init(void)
+{
+	int rc;
+
+	if (iterations <= 0) {
+		pr_err(PREFIX " invalid iterations %d\n", run_id, iterations);
+		goto out;
+	}
+
+	rc = kmatch_test();
+	if (rc == 0)
+		pr_err(PREFIX " all tests done\n", run_id);
+	else
+		pr_err(PREFIX " test failed: rc = %d\n", run_id, rc);
+out:
+	/* Don't load. */
+	return -EINVAL;
+}
+
+static void __exit kmatch_exit(void)
+{
+}
+
+MODULE_AUTHOR("OpenSFS, Inc. <http://www.lustre.org/>");
+MODULE_DESCRIPTION("Lustre lock match benchmark module");
+MODULE_VERSION(LUSTRE_VERSION_STRING);
+MODULE_LICENSE("GPL");
+
+module_init(kmatch_init);
+module_exit(kmatch_exit);
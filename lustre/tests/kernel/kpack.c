@@ -0,0 +1,236 @@
+/*
+ * GPL HEADER START
+ *
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 for more details (a copy is included
+ * in the LICENSE file that accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; If not, see
+ * http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * GPL HEADER END
+ */
+
+/* Microbenchmark for lustre_msg packing and req_capsule field access.
+ *
+ * Packs a representative MDS (LDLM_INTENT_GETATTR) and OST (OST_BRW_WRITE)
+ * request message in a loop, then fetches every field of it through the
+ * req_capsule layer, once as a same-endian peer would and once forcing the
+ * swab path.  The results are printed to the console, the module is never
+ * actually loaded. */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+
+#include <obd_support.h>
+#include <lustre_net.h>
+#include <lustre_req_layout.h>
+
+/* Random ID passed by userspace, and printed in messages, used to
+ * separate different runs of that module. */
+static int run_id;
+module_param(run_id, int, 0644);
+MODULE_PARM_DESC(run_id, "run ID");
+
+static int iterations = 100000;
+module_param(iterations, int, 0644);
+MODULE_PARM_DESC(iterations, "number of pack/unpack loops per test");
+
+#define PREFIX "lustre_kpack_%u:"
+
+#define KPACK_NAME	"kpack_benchmark_file_name"
+#define KPACK_NIOBUFS	16
+
+struct kpack_test {
+	const char		 *kt_name;
+	struct req_format	 *kt_fmt;
+	/* set the size of variable fields of the request */
+	void			(*kt_set_sizes)(struct req_capsule *pill);
+	/* fetch every field of the request */
+	int			(*kt_get_fields)(struct req_capsule *pill);
+};
+
+static void kpack_getattr_sizes(struct req_capsule *pill)
+{
+	req_capsule_set_size(pill, &RMF_NAME, RCL_CLIENT, sizeof(KPACK_NAME));
+}
+
+static int kpack_getattr_fields(struct req_capsule *pill)
+{
+	if (req_capsule_client_get(pill, &RMF_PTLRPC_BODY) == NULL ||
+	    req_capsule_client_get(pill, &RMF_DLM_REQ) == NULL ||
+	    req_capsule_client_get(pill, &RMF_LDLM_INTENT) == NULL ||
+	    req_capsule_client_get(pill, &RMF_MDT_BODY) == NULL ||
+	    req_capsule_client_get(pill, &RMF_CAPA1) == NULL ||
+	    req_capsule_client_get(pill, &RMF_NAME) == NULL)
+		return -EPROTO;
+	return 0;
+}
+
+static void kpack_brw_sizes(struct req_capsule *pill)
+{
+	req_capsule_set_size(pill, &RMF_NIOBUF_REMOTE, RCL_CLIENT,
+			     KPACK_NIOBUFS * sizeof(struct niobuf_remote));
+}
+
+static int kpack_brw_fields(struct req_capsule *pill)
+{
+	if (req_capsule_client_get(pill, &RMF_PTLRPC_BODY) == NULL ||
+	    req_capsule_client_get(pill, &RMF_OST_BODY) == NULL ||
+	    req_capsule_client_get(pill, &RMF_OBD_IOOBJ) == NULL ||
+	    req_capsule_client_get(pill, &RMF_NIOBUF_REMOTE) == NULL ||
+	    req_capsule_client_get(pill, &RMF_CAPA1) == NULL)
+		return -EPROTO;
+	return 0;
+}
+
+static struct kpack_test kpack_tests[] = {
+	{
+		.kt_name	= "mds_intent_getattr",
+		.kt_fmt		= &RQF_LDLM_INTENT_GETATTR,
+		.kt_set_sizes	= kpack_getattr_sizes,
+		.kt_get_fields	= kpack_getattr_fields,
+	},
+	{
+		.kt_name	= "ost_brw_write",
+		.kt_fmt		= &RQF_OST_BRW_WRITE,
+		.kt_set_sizes	= kpack_brw_sizes,
+		.kt_get_fields	= kpack_brw_fields,
+	},
+};
+
+static int kpack_run(struct kpack_test *kt, struct ptlrpc_request *req)
+{
+	struct req_capsule *pill = &req->rq_pill;
+	struct lustre_msg *msg;
+	ktime_t start;
+	__u64 pack_ns;
+	__u64 get_ns;
+	__u64 swab_ns;
+	char *name;
+	int count;
+	int size;
+	int rc;
+	int i;
+
+	req_capsule_init(pill, req, RCL_CLIENT);
+	req_capsule_set(pill, kt->kt_fmt);
+	kt->kt_set_sizes(pill);
+	count = req_capsule_filled_sizes(pill, RCL_CLIENT);
+	size = lustre_msg_size_v2(count, pill->rc_area[RCL_CLIENT]);
+
+	OBD_ALLOC_LARGE(msg, size);
+	if (msg == NULL)
+		return -ENOMEM;
+	req->rq_reqmsg = msg;
+
+	/* pack: format the message and compute the layout from scratch */
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		req_capsule_init_area(pill);
+		kt->kt_set_sizes(pill);
+		count = req_capsule_filled_sizes(pill, RCL_CLIENT);
+		lustre_init_msg_v2(msg, count, pill->rc_area[RCL_CLIENT],
+				   NULL);
+	}
+	pack_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (req_capsule_has_field(pill, &RMF_NAME, RCL_CLIENT)) {
+		name = req_capsule_client_sized_get(pill, &RMF_NAME,
+						    sizeof(KPACK_NAME));
+		if (name != NULL)
+			strlcpy(name, KPACK_NAME, sizeof(KPACK_NAME));
+	}
+
+	/* unpack from a same-endian peer */
+	req->rq_req_swab_mask = 0;
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		rc = kt->kt_get_fields(pill);
+		if (rc != 0)
+			GOTO(out, rc);
+	}
+	get_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	/* unpack with the message swabbed field by field, the swabbers just
+	 * flip zeroes so the message stays valid across loops */
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		req->rq_req_swab_mask = 1U << MSG_PTLRPC_HEADER_OFF;
+		rc = kt->kt_get_fields(pill);
+		if (rc != 0)
+			GOTO(out, rc);
+	}
+	swab_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	req->rq_req_swab_mask = 0;
+
+	pr_err(PREFIX " %s: msg %d bytes, %d fields: pack %llu ns/op, "
+	       "unpack %llu ns/op, unpack+swab %llu ns/op\n", run_id,
+	       kt->kt_name, size, count, div_u64(pack_ns, iterations),
+	       div_u64(get_ns, iterations), div_u64(swab_ns, iterations));
+	rc = 0;
+out:
+	if (rc != 0)
+		pr_err(PREFIX " %s: cannot get fields: rc = %d\n", run_id,
+		       kt->kt_name, rc);
+	req->rq_reqmsg = NULL;
+	req_capsule_fini(pill);
+	OBD_FREE_LARGE(msg, size);
+
+	return rc;
+}
+
+static int __init kpack_init(void)
+{
+	struct ptlrpc_request *req;
+	int rc;
+	int i;
+
+	if (iterations <= 0) {
+		pr_err(PREFIX " invalid iterations %d\n", run_id, iterations);
+		goto out;
+	}
+
+	OBD_ALLOC_PTR(req);
+	if (req == NULL) {
+		pr_err(PREFIX " cannot allocate request\n", run_id);
+		goto out;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(kpack_tests); i++) {
+		rc = kpack_run(&kpack_tests[i], req);
+		if (rc != 0)
+			break;
+		/* let req_capsule_init() start from scratch */
+		req->rq_pill_init = 0;
+	}
+
+	OBD_FREE_PTR(req);
+	if (i == ARRAY_SIZE(kpack_tests))
+		pr_err(PREFIX " all tests done\n", run_id);
+out:
+	/* Don't load. */
+	return -EINVAL;
+}
+
+static void __exit kpack_exit(void)
+{
+}
+
+MODULE_AUTHOR("OpenSFS, Inc. <http://www.lustre.org/>");
+MODULE_DESCRIPTION("Lustre message packing benchmark module");
+MODULE_VERSION(LUSTRE_VERSION_STRING);
+MODULE_LICENSE("GPL");
+
+module_init(kpack_init);
+module_exit(kpack_exit);
@@ -4598,6 +4598,45 @@ test_120() {
 }
 run_test 120 "DNE fail abort should stop both normal and DNE replay"
 
+test_121() {
+	[ $(lustre_version_code $SINGLEMDS) -lt $(version_code 2.10.55) ] &&
+		skip "Need MDS version at least 2.10.55" && return 0
+
+	local nsdir="ldlm.namespaces.*MDT0000-mdc-*"
+	local inflight=$($LCTL get_param -n ldlm.lock_replay_max_inflight)
+	local batch=$($LCTL get_param -n ldlm.lock_replay_batch)
+	local cancel=$($LCTL get_param -n ldlm.cancel_unused_locks_before_replay)
+	local nr=500
+	local before
+	local after
+
+	$LCTL get_param mdc.$FSNAME-MDT0000-mdc-*.import |
+		grep -q "lock_replay_batch" ||
+		echo "server does not support batched lock replay"
+
+	test_mkdir $DIR/$tdir
+	createmany -o $DIR/$tdir/f $nr || error "createmany failed"
+	cancel_lru_locks mdc
+	stat $DIR/$tdir/f* > /dev/null || error "stat failed"
+	before=$($LCTL get_param -n $nsdir.lock_count)
+
+	# few RPCs in flight, so that the pipeline has to refill
+	stack_trap "$LCTL set_param -n \
+		ldlm.cancel_unused_locks_before_replay=$cancel \
+		ldlm.lock_replay_max_inflight=$inflight \
+		ldlm.lock_replay_batch=$batch" EXIT
+	$LCTL set_param -n ldlm.cancel_unused_locks_before_replay=0 \
+		ldlm.lock_replay_max_inflight=2 ldlm.lock_replay_batch=16
+	fail $SINGLEMDS
+	after=$($LCTL get_param -n $nsdir.lock_count)
+
+	echo "locks before recovery: $before, after: $after"
+	[ $after -ge $before ] || error "only $after of $before locks replayed"
+	stat $DIR/$tdir/f* > /dev/null || error "stat after recovery failed"
+	unlinkmany $DIR/$tdir/f $nr || error "unlinkmany failed"
+}
+run_test 121 "pipelined and batched lock replay"
+
 complete $SECONDS
 check_and_cleanup_lustre
 exit_status
@@ -10029,6 +10029,53 @@ test_134b() {
 }
 run_test 134b "Server rejects lock request when reaching lock_limit_mb"
 
+test_134c() {
+	remote_mds_nodsh && skip "remote MDS with nodsh" && return
+	[[ $(lustre_version_code $SINGLEMDS) -lt $(version_code 2.10.55) ]] &&
+		skip "Need MDS version at least 2.10.55" && return
+
+	mkdir -p $DIR/$tdir || error "failed to create $DIR/$tdir"
+	cancel_lru_locks mdc
+
+	local stats="ldlm.lock_reclaim_stats"
+	local nr=1000
+	createmany -o $DIR/$tdir/f $nr ||
+		error "failed to create $nr files in $DIR/$tdir"
+
+	do_facet mds1 $LCTL get_param $stats
+	local revoked=$(do_facet mds1 $LCTL get_param -n $stats |
+			awk '/^revoked:/ { print $2 }')
+	local reenq=$(do_facet mds1 $LCTL get_param -n $stats |
+		      awk '/^reenqueued:/ { print $2 }')
+
+	#define OBD_FAIL_LDLM_WATERMARK_LOW     0x327
+	do_facet mds1 $LCTL set_param fail_loc=0x327
+	do_facet mds1 $LCTL set_param fail_val=500
+	touch $DIR/$tdir/m
+	do_facet mds1 $LCTL set_param fail_loc=0
+	do_facet mds1 $LCTL set_param fail_val=0
+
+	echo "sleep 5 seconds ..."
+	sleep 5
+	# take the revoked locks again
+	ls -l $DIR/$tdir > /dev/null || error "ls $DIR/$tdir failed"
+
+	do_facet mds1 $LCTL get_param $stats
+	local revoked2=$(do_facet mds1 $LCTL get_param -n $stats |
+			 awk '/^revoked:/ { print $2 }')
+	local reenq2=$(do_facet mds1 $LCTL get_param -n $stats |
+		       awk '/^reenqueued:/ { print $2 }')
+
+	[ $revoked2 -gt $revoked ] ||
+		error "no lock reclaimed, before:$revoked, after:$revoked2"
+	[ $reenq2 -gt $reenq ] ||
+		error "no re-enqueue counted, before:$reenq, after:$reenq2"
+
+	rm $DIR/$tdir/m
+	unlinkmany $DIR/$tdir/f $nr
+}
+run_test 134c "Server counts locks re-enqueued after reclaim"
+
 test_140() { #bug-17379
 	[ $PARALLEL == "yes" ] && skip "skip parallel run" && return
 	test_mkdir $DIR/$tdir
@@ -16437,6 +16484,837 @@ test_411() {
 }
 run_test 411 "Slab allocation error with cgroup does not LBUG"
 
+test_412() {
+	[[ $(lustre_version_code mds1) -lt $(version_code 2.10.55) ]] &&
+		skip "Need MDS version at least 2.10.55" && return
+
+	local param=mds.MDS.mdt.req_buffer_copy_size
+	local old=$(do_facet mds1 $LCTL get_param -n $param)
+
+	stack_trap "do_facet mds1 $LCTL set_param -n $param=$old" EXIT
+	do_facet mds1 $LCTL set_param $param=8192 &&
+		error "copy size larger than 4096 should be refused"
+	do_facet mds1 $LCTL set_param $param=4096 ||
+		error "set $param failed"
+
+	do_facet mds1 $LCTL set_param mds.MDS.mdt.req_buffer_stats=clear
+	test_mkdir $DIR/$tdir
+	createmany -o $DIR/$tdir/f 1000 || error "createmany failed"
+	unlinkmany $DIR/$tdir/f 1000 || error "unlinkmany failed"
+
+	do_facet mds1 $LCTL get_param mds.MDS.mdt.req_buffer_stats
+	local copied=$(do_facet mds1 $LCTL get_param -n \
+		       mds.MDS.mdt.req_buffer_stats |
+		       awk '$1 ~ /^[0-9]+$/ { sum += $8 } END { print sum }')
+	[ ${copied:-0} -gt 0 ] || error "no request copied out of rqbds"
+}
+run_test 412 "small MDS requests are copied out of request buffers"
+
+# Run the benchmark module tests/kernel/$1.ko with the module parameters
+# given in the other arguments and print the messages it logged.  The module
+# runs the benchmark at insertion time and then refuses to load, so insmod
+# always fails.
+run_kernel_bench() {
+	local name=$1
+	local run_id=$RANDOM
+
+	shift
+	insmod $LUSTRE/tests/kernel/$name.ko run_id=$run_id "$@" &> /dev/null
+	dmesg | grep "lustre_${name}_$run_id:" || true
+}
+
+test_413() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local log
+
+	log=$(run_kernel_bench kpack iterations=${KPACK_ITERATIONS:-100000})
+	echo "$log"
+	grep -q "all tests done" <<< "$log" ||
+		error "message packing benchmark failed"
+}
+run_test 413 "lustre_msg pack/unpack microbenchmark"
+
+ptlrpcd_steals() {
+	$LCTL get_param -n ptlrpcd_stats |
+		awk '/^ptlrpcd_/ { sum += $4 + $5 } END { print sum + 0 }'
+}
+
+test_414() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+	which taskset > /dev/null 2>&1 ||
+		{ skip "taskset not installed" && return; }
+
+	local param=/sys/module/ptlrpc/parameters
+	local policy=$(cat $param/ptlrpcd_steal_policy)
+	local depth=$(cat $param/ptlrpcd_steal_depth)
+	local before
+	local after
+
+	echo "ptlrpcd_steal_policy=$policy"
+	$LCTL get_param -n ptlrpcd_stats | grep -q "^ptlrpcd_rcv" ||
+		error "ptlrpcd_rcv missing from ptlrpcd_stats"
+	[ $($LCTL get_param -n ptlrpcd_stats | grep -c "^ptlrpcd_") -gt 2 ] ||
+		{ skip "needs more than one ptlrpcd thread" && return; }
+
+	# queue all the requests from one CPU, the other threads can only
+	# get work by stealing it
+	stack_trap "echo $policy > $param/ptlrpcd_steal_policy" EXIT
+	stack_trap "echo $depth > $param/ptlrpcd_steal_depth" EXIT
+	echo 2 > $param/ptlrpcd_steal_policy
+	echo 1 > $param/ptlrpcd_steal_depth
+
+	test_mkdir $DIR/$tdir
+	$LFS setstripe -c -1 $DIR/$tdir || error "setstripe failed"
+	before=$(ptlrpcd_steals)
+	for i in $(seq 16); do
+		taskset -c 0 dd if=/dev/zero of=$DIR/$tdir/$tfile.$i bs=1M \
+			count=16 oflag=direct 2>/dev/null &
+	done
+	wait
+	sync
+	after=$(ptlrpcd_steals)
+
+	$LCTL get_param ptlrpcd_stats
+	[ $after -gt $before ] ||
+		error "no request stolen from the busy ptlrpcd: $before/$after"
+	rm -rf $DIR/$tdir
+}
+run_test 414 "ptlrpcd queue depth and work stealing statistics"
+
+test_415() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+	[ $(cat /sys/module/ptlrpc/parameters/suppress_pings) -eq 0 ] ||
+		{ skip "pings are suppressed" && return; }
+
+	local timeout=$($LCTL get_param -n timeout)
+	local interval=$((timeout / 4))
+	local osc
+	local before
+	local after
+
+	[ $interval -gt 0 ] || interval=1
+	[ $interval -le 60 ] ||
+		{ skip "ping interval $interval too long" && return; }
+
+	declare -A pings
+	for osc in $($LCTL list_param osc.$FSNAME-OST*); do
+		pings[$osc]=$($LCTL get_param -n $osc.stats |
+			      awk '/^obd_ping/ { print $2 }')
+	done
+
+	# every import must still be pinged within its ping interval, no
+	# matter which timer wheel slot it is queued on
+	echo "waiting $((interval * 2 + 5))s for pings"
+	sleep $((interval * 2 + 5))
+
+	for osc in ${!pings[@]}; do
+		before=${pings[$osc]:-0}
+		after=$($LCTL get_param -n $osc.stats |
+			awk '/^obd_ping/ { print $2 }')
+		[ ${after:-0} -gt $before ] ||
+			error "$osc not pinged: $before -> ${after:-0}"
+	done
+}
+run_test 415 "all imports are pinged within the ping interval"
+
+enc_pool_accesses() {
+	$LCTL get_param -n sptlrpc.encrypt_page_pools |
+		awk '/^cache access:/ { sum += $3 } END { print sum + 0 }'
+}
+
+test_416() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local pools=$($LCTL get_param -n sptlrpc.encrypt_page_pools)
+	local ncpts=$(awk '/^partitions:/ { print $2 }' <<< "$pools")
+	local before
+	local after
+
+	echo "$pools"
+	[ -n "$ncpts" ] || error "no partitions in encrypt_page_pools"
+	[ $(grep -c "^cpt:" <<< "$pools") -eq $ncpts ] ||
+		error "expect $ncpts per-CPT pools"
+	[ $(grep -c "^borrowed pages:" <<< "$pools") -eq $ncpts ] ||
+		error "missing borrowed pages statistics"
+
+	# the pools only serve the bulk encryption of the skpi flavor
+	$SHARED_KEY || { skip "needs SHARED_KEY for bulk encryption" &&
+			 return; }
+	if [ "$SK_FLAVOR" != "skpi" ]; then
+		stack_trap "set_rule $FSNAME any cli2ost $SK_FLAVOR;
+			    wait_flavor cli2ost $SK_FLAVOR" EXIT
+		set_rule $FSNAME any cli2ost skpi
+		wait_flavor cli2ost skpi || error "cannot switch to skpi"
+	fi
+
+	before=$(enc_pool_accesses)
+	dd if=/dev/zero of=$DIR/$tfile bs=1M count=16 conv=fsync ||
+		error "cannot write $tfile"
+	cancel_lru_locks osc
+	cat $DIR/$tfile > /dev/null || error "cannot read $tfile"
+	after=$(enc_pool_accesses)
+
+	$LCTL get_param sptlrpc.encrypt_page_pools
+	[ $after -gt $before ] ||
+		error "encrypted bulk IO did not use the pools: $before/$after"
+	rm -f $DIR/$tfile
+}
+run_test 416 "per-CPT encryption page pool statistics"
+
+test_417() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+	which taskset > /dev/null 2>&1 || { skip_env "no taskset"; return; }
+
+	local nsdir="ldlm.namespaces.*-MDT0000-mdc-*"
+	local ncpus=$(grep -c ^processor /proc/cpuinfo)
+	local nr=50
+	local unused
+	local cpu
+
+	cancel_lru_locks mdc
+	test_mkdir $DIR/$tdir
+	createmany -o $DIR/$tdir/f $((nr * ncpus)) ||
+		error "failed to create files in $DIR/$tdir"
+	cancel_lru_locks mdc
+
+	# cache unused locks from every CPU, so on every LRU shard
+	for cpu in $(seq 0 $((ncpus - 1))); do
+		taskset -c $cpu stat $(seq -f "$DIR/$tdir/f%g" $((cpu * nr)) \
+			$((cpu * nr + nr - 1))) > /dev/null ||
+			error "stat on cpu $cpu failed"
+	done
+	unused=$($LCTL get_param -n $nsdir.lock_unused_count)
+	echo "$unused unused locks cached from $ncpus cpus"
+	[ $unused -ge $((nr * ncpus)) ] ||
+		error "only $unused unused locks, expect $((nr * ncpus))"
+
+	# locks used again while in LRU must be canceled all the same
+	stat $(seq -f "$DIR/$tdir/f%g" 0 $((nr * ncpus / 2 - 1))) > /dev/null
+	$LCTL set_param -n $nsdir.lru_size=clear
+	unused=$($LCTL get_param -n $nsdir.lock_unused_count)
+	[ $unused -eq 0 ] || error "$unused locks left after clear"
+
+	unlinkmany $DIR/$tdir/f $((nr * ncpus))
+}
+run_test 417 "unused locks cached on every CPU are all in LRU"
+
+test_418() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local log
+
+	log=$(run_kernel_bench kmatch iterations=${KMATCH_ITERATIONS:-1000000})
+	echo "$log"
+	grep -q "local locks need server" <<< "$log" &&
+		skip "client built without server support" && return
+	grep -q "all tests done" <<< "$log" ||
+		error "lock match benchmark failed"
+}
+run_test 418 "ldlm_lock_match() hint on one hot resource"
+
+test_419() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local nsdir="ldlm.namespaces.*-MDT0000-mdc-*"
+	local nr=50
+	local before
+	local after
+
+	test_mkdir $DIR/$tdir
+	createmany -o $DIR/$tdir/f $nr ||
+		error "failed to create files in $DIR/$tdir"
+	cancel_lru_locks mdc
+	stat $DIR/$tdir/f* > /dev/null || error "stat failed"
+
+	before=$($LCTL get_param -n $nsdir.pool.stats |
+		 awk '/^lru_reenqueue/ { sum += $2 } END { print sum + 0 }')
+	$LCTL set_param -n $nsdir.lru_size=clear
+	# locks canceled from LRU and taken again right after are counted
+	stat $DIR/$tdir/f* > /dev/null || error "stat failed"
+	after=$($LCTL get_param -n $nsdir.pool.stats |
+		awk '/^lru_reenqueue/ { sum += $2 } END { print sum + 0 }')
+	$LCTL get_param $nsdir.pool.stats | grep "^lru_"
+	[ $after -gt $before ] ||
+		error "no re-enqueue counted: before $before, after $after"
+
+	unlinkmany $DIR/$tdir/f $nr
+}
+run_test 419 "count locks re-enqueued after LRU cancel"
+
+test_420() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local log
+
+	log=$(run_kernel_bench klocks nr_locks=${KLOCKS_NR_LOCKS:-100000})
+	echo "$log"
+	grep -q "local locks need server" <<< "$log" &&
+		skip "client built without server support" && return
+	grep -q "all tests done" <<< "$log" ||
+		error "lock footprint benchmark failed"
+}
+run_test 420 "ldlm lock footprint and match over many resources"
+
+mdc_enqueue_multi() {
+	$LCTL get_param -n mdc.*-MDT$(printf %04x $1)-mdc-*.md_stats |
+		awk '/^enqueue_multi/ { sum += $2 } END { print sum+0 }'
+}
+
+mdc_lock_count() {
+	$LCTL get_param -n ldlm.namespaces.*-MDT$(printf %04x $1)-mdc-*.lock_count |
+		awk '{ sum += $1 } END { print sum+0 }'
+}
+
+test_421() {
+	[ $MDSCOUNT -lt 2 ] && skip "needs >= 2 MDTs" && return
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+	[[ $(lustre_version_code $SINGLEMDS) -lt $(version_code 2.10.55) ]] &&
+		skip "Need MDS version at least 2.10.55" && return
+
+	local stripes=$((MDSCOUNT * 2))
+
+	test_mkdir -p $DIR/$tdir
+	$LFS mkdir -c $stripes $DIR/$tdir/striped ||
+		error "create striped dir failed"
+	createmany -o $DIR/$tdir/striped/f 100 || error "create files failed"
+
+	local mdts=$(seq 0 $((MDSCOUNT - 1)))
+	local before=()
+	local after=()
+	local mdt
+	local i
+
+	cancel_lru_locks mdc
+	$LCTL set_param -n mdc.*.md_stats=clear
+	for mdt in $mdts; do
+		before[$mdt]=$(mdc_lock_count $mdt)
+	done
+	ls $DIR/$tdir/striped | wc -l | grep -q "^100$" ||
+		error "wrong number of entries"
+
+	# each MDT holding stripes gets one batched enqueue with a lock
+	# for every stripe it holds
+	for mdt in $mdts; do
+		i=$(mdc_enqueue_multi $mdt)
+		[ $i -eq 1 ] ||
+			error "$i multi-lock enqueues to mdt$mdt, expect 1"
+		after[$mdt]=$(mdc_lock_count $mdt)
+		i=$((after[$mdt] - before[$mdt]))
+		[ $i -ge $((stripes / MDSCOUNT)) ] ||
+			error "$i new locks on mdt$mdt for $((stripes / MDSCOUNT)) stripes"
+	done
+
+	# the prefetched locks are cached, a new listing enqueues nothing
+	$LCTL set_param -n mdc.*.md_stats=clear
+	ls $DIR/$tdir/striped > /dev/null
+	for mdt in $mdts; do
+		i=$(mdc_enqueue_multi $mdt)
+		[ $i -eq 0 ] || error "$i enqueues to mdt$mdt with locks cached"
+		i=$(mdc_lock_count $mdt)
+		[ $i -eq ${after[$mdt]} ] ||
+			error "mdt$mdt locks went from ${after[$mdt]} to $i"
+	done
+}
+run_test 421 "striped dir readdir enqueues stripe locks in batches"
+
+lru_contended() {
+	$LCTL get_param -n osc.*-osc-*.osc_cached_mb |
+		awk '/^lru_contended:/ { sum += $2 } END { print sum + 0 }'
+}
+
+test_422() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local cache_limit=64
+	local nfiles=8
+	local used=0
+	local before
+	local after
+	local i
+
+	trap cleanup_101a EXIT
+	$LCTL set_param -n llite.*.max_cached_mb $cache_limit
+
+	test_mkdir $DIR/$tdir
+	$LFS setstripe -c -1 $DIR/$tdir || error "setstripe failed"
+	for i in $(seq $nfiles); do
+		dd if=/dev/zero of=$DIR/$tdir/f$i bs=1M count=$cache_limit \
+			2>/dev/null || error "write f$i failed"
+	done
+	cancel_lru_locks osc
+
+	before=$(lru_contended)
+	# read all the files at once, each thread fills its own LRU shard
+	for i in $(seq $nfiles); do
+		dd if=$DIR/$tdir/f$i of=/dev/null bs=1M 2>/dev/null &
+	done
+	wait
+	after=$(lru_contended)
+
+	$LCTL get_param osc.*-osc-*.osc_cached_mb
+	for i in $($LCTL get_param -n osc.*-osc-*.osc_cached_mb |
+		   awk '/^used_mb/ { print $2 }'); do
+		used=$((used + i))
+	done
+	cleanup_101a
+
+	[ $used -le $cache_limit ] ||
+		error "$used MB cached with max_cached_mb=$cache_limit"
+	$LCTL get_param -n osc.*-osc-*.osc_cached_mb | grep -q "^lru_shards" ||
+		error "no LRU shard stats"
+	# the readers fill the LRU at once, and have to reclaim from the
+	# shards of one another once it is full
+	[ $(grep -c ^processor /proc/cpuinfo) -lt 2 ] ||
+		[ $after -gt $before ] ||
+		error "LRU shard contention not counted: $before/$after"
+}
+run_test 422 "parallel reads stay within max_cached_mb with sharded LRU"
+
+test_423() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local file=$DIR/$tfile
+	local samples
+	local bytes
+	local op
+
+	$LFS setstripe -c -1 -S 1M $file || error "setstripe failed"
+	dd if=/dev/urandom of=$TMP/$tfile bs=1M count=16 ||
+		error "cannot create $TMP/$tfile"
+	$LCTL set_param -n llite.*.stats=0
+
+	# one direct IO over all the stripes, each has chunks in flight
+	dd if=$TMP/$tfile of=$file bs=16M oflag=direct ||
+		error "direct write failed"
+	cancel_lru_locks osc
+	dd if=$file of=$TMP/$tfile.2 bs=16M iflag=direct ||
+		error "direct read failed"
+	cmp $TMP/$tfile $TMP/$tfile.2 || error "data mismatch"
+	rm -f $TMP/$tfile $TMP/$tfile.2
+
+	$LCTL get_param llite.*.stats | grep direct_
+	for op in direct_read_bytes direct_write_bytes; do
+		bytes=$($LCTL get_param -n llite.*.stats |
+			awk '/^'$op'/ { print $7 }')
+		[ "$bytes" == "16777216" ] ||
+			error "$op is '$bytes', expected 16777216"
+	done
+	# one sample of the transfer time per direct IO
+	samples=$($LCTL get_param -n llite.*.stats |
+		  awk '/^direct_io_usecs/ { print $2 }')
+	[ "$samples" == "2" ] ||
+		error "direct_io_usecs has '$samples' samples, expected 2"
+
+	# the same through AIO, which returns before the pages are transferred
+	which fio > /dev/null 2>&1 ||
+		{ echo "fio not found, skip the AIO case"; return 0; }
+	$LCTL set_param -n llite.*.stats=0
+	fio --name=$tfile --filename=$file --ioengine=libaio --direct=1 \
+		--rw=write --bs=4M --iodepth=4 --size=16M --verify=crc32c \
+		--verify_fatal=1 || error "AIO direct write and verify failed"
+
+	for op in direct_read_bytes direct_write_bytes; do
+		bytes=$($LCTL get_param -n llite.*.stats |
+			awk '/^'$op'/ { print $7 }')
+		[ "$bytes" == "16777216" ] ||
+			error "AIO $op is '$bytes', expected 16777216"
+	done
+}
+run_test 423 "direct IO over all the stripes of a file"
+
+cleanup_424() {
+	trap 0
+	$LCTL set_param -n llite.*.hybrid_io_read_threshold_bytes=0 \
+		llite.*.hybrid_io_write_threshold_bytes=0
+	rm -f $DIR/$tfile $TMP/$tfile $TMP/$tfile.2
+}
+
+# busy time of all the CPUs of the client, in USER_HZ
+cpu_busy_424() {
+	awk '/^cpu / { print $2 + $3 + $4 + $7 + $8 }' /proc/stat
+}
+
+# run "$@", print its throughput over $1 MB and the client CPU time used
+bench_424() {
+	local mb=$1
+	local start=$(date +%s.%N)
+	local cpu=$(cpu_busy_424)
+	local secs
+
+	shift
+	"$@" 2>/dev/null || return 1
+	secs=$(bc <<< "$(date +%s.%N) - $start")
+	echo "$(bc <<< "$mb / $secs") MB/s," \
+		"$(( $(cpu_busy_424) - cpu )) CPU ticks"
+}
+
+test_424() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local file=$DIR/$tfile
+	local mb=256
+	local mode
+	local bytes
+	local out
+	local op
+
+	trap cleanup_424 EXIT
+	$LFS setstripe -c -1 $file || error "setstripe failed"
+
+	# single stream throughput and client CPU use, buffered then hybrid
+	for mode in buffered hybrid; do
+		[ $mode == hybrid ] &&
+			$LCTL set_param -n \
+				llite.*.hybrid_io_read_threshold_bytes=1M \
+				llite.*.hybrid_io_write_threshold_bytes=1M
+		cancel_lru_locks osc
+		out=$(bench_424 $mb dd if=/dev/zero of=$file bs=4M \
+			count=$((mb / 4)) conv=notrunc) ||
+			error "$mode write failed"
+		echo "$mode write: $out"
+		cancel_lru_locks osc
+		out=$(bench_424 $mb dd if=$file of=/dev/null bs=4M) ||
+			error "$mode read failed"
+		echo "$mode read: $out"
+	done
+
+	# unaligned head and tail go through the page cache
+	$LCTL set_param -n llite.*.stats=0
+	dd if=/dev/urandom of=$TMP/$tfile bs=1M count=8 ||
+		error "cannot create $TMP/$tfile"
+	dd if=$TMP/$tfile of=$file bs=$((3 * 1048576 + 17)) seek=1 \
+		oflag=seek_bytes conv=notrunc || error "unaligned write failed"
+	cancel_lru_locks osc
+	dd if=$file of=$TMP/$tfile.2 bs=$((3 * 1048576 + 17)) skip=1 \
+		iflag=skip_bytes count=3 ||
+		error "unaligned read failed"
+	truncate -s $((8 * 1048576)) $TMP/$tfile.2
+	cmp $TMP/$tfile $TMP/$tfile.2 || error "data mismatch"
+
+	$LCTL get_param llite.*.stats | grep hybrid_
+	for op in hybrid_read_bytes hybrid_write_bytes; do
+		bytes=$($LCTL get_param -n llite.*.stats |
+			awk '/^'$op'/ { print $7 }')
+		[ -n "$bytes" ] && [ $bytes -gt 0 ] ||
+			error "no $op after streaming IO"
+	done
+	cleanup_424
+}
+run_test 424 "hybrid buffered/direct IO for large streaming reads and writes"
+
+test_425() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+	$LCTL get_param -n osc.$FSNAME-OST0000-osc-[^M]*.connect_flags |
+		grep -q multi_brw || { skip "no multi_brw support" && return; }
+
+	local osc=$FSNAME-OST0000-osc-[^M]*
+	local max_rpcs=$($LCTL get_param -n osc.$osc.max_rpcs_in_flight)
+	local multi
+	local i
+
+	test_mkdir $DIR/$tdir
+	$LFS setstripe -c 1 -i 0 $DIR/$tdir || error "setstripe failed"
+	for i in $(seq 100); do
+		echo "$tfile.$i" > $DIR/$tdir/$tfile.$i ||
+			error "cannot write $tfile.$i"
+	done
+
+	# with a single RPC in flight the files queue up and should be
+	# written by RPCs carrying several objects
+	$LCTL set_param -n osc.$osc.max_rpcs_in_flight=1
+	$LCTL set_param -n osc.$osc.rpc_stats=0
+	sync
+	$LCTL set_param -n osc.$osc.max_rpcs_in_flight=$max_rpcs
+
+	$LCTL get_param -n osc.$osc.rpc_stats |
+		sed -n '/^objects per rpc/,$p'
+	multi=$($LCTL get_param -n osc.$osc.rpc_stats |
+		sed -n '/^objects per rpc/,$p' |
+		awk -F'|' '$1 + 0 > 1 { sum += $2 } END { print sum + 0 }')
+	[ $multi -gt 0 ] || error "no RPC wrote several objects"
+
+	for i in $(seq 100); do
+		[ "$(cat $DIR/$tdir/$tfile.$i)" == "$tfile.$i" ] ||
+			error "bad data in $tfile.$i"
+	done
+	cancel_lru_locks osc
+	for i in $(seq 100); do
+		[ "$(cat $DIR/$tdir/$tfile.$i)" == "$tfile.$i" ] ||
+			error "bad data in $tfile.$i after cache drop"
+	done
+	rm -rf $DIR/$tdir
+}
+run_test 425 "write many small files of one OST with multi-object RPCs"
+
+ra_misses_426() {
+	$LCTL get_param -n llite.*.read_ahead_stats |
+		awk '/^misses/ { sum += $2 } END { print sum + 0 }'
+}
+
+test_426() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local policy=$($LCTL get_param -n llite.*.read_ahead_policy | head -1)
+	local cmd="o"
+	local default_miss
+	local history_miss
+	local hits
+	local b
+
+	# three reads at growing gaps in each MiB, no single stride
+	for b in $(seq 0 31); do
+		cmd+="z$((b * 1048576))r4096"
+		cmd+="z$((b * 1048576 + 65536))r4096"
+		cmd+="z$((b * 1048576 + 196608))r4096"
+	done
+	cmd+="c"
+
+	$LFS setstripe -c 1 $DIR/$tfile || error "setstripe failed"
+	dd if=/dev/zero of=$DIR/$tfile bs=1M count=32 ||
+		error "cannot write $tfile"
+
+	$LCTL set_param -n llite.*.read_ahead_policy=default
+	cancel_lru_locks osc
+	$LCTL set_param -n llite.*.read_ahead_stats=0
+	$MULTIOP $DIR/$tfile $cmd || error "multiop default failed"
+	default_miss=$(ra_misses_426)
+
+	$LCTL set_param -n llite.*.read_ahead_policy=history
+	cancel_lru_locks osc
+	$LCTL set_param -n llite.*.read_ahead_stats=0
+	$MULTIOP $DIR/$tfile $cmd || error "multiop history failed"
+	history_miss=$(ra_misses_426)
+	$LCTL get_param llite.*.read_ahead_stats
+	$LCTL set_param -n llite.*.read_ahead_policy=$policy
+
+	hits=$($LCTL get_param -n llite.*.read_ahead_stats |
+		awk '/^history prediction hits/ { sum += $4 }
+		     END { print sum + 0 }')
+	[ $hits -gt 0 ] || error "no history prediction hit"
+	echo "misses: default $default_miss, history $history_miss"
+	[ $history_miss -lt $default_miss ] ||
+		error "history misses $history_miss >= default $default_miss"
+
+	$LCTL set_param llite.*.read_ahead_policy=bogus &&
+		error "bogus read_ahead_policy accepted"
+	rm -f $DIR/$tfile
+}
+run_test 426 "history read-ahead policy for nested stride reads"
+
+test_427() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local async=$($LCTL get_param -n llite.*.read_ahead_async | head -n 1)
+	local pages
+
+	$LFS setstripe -c $OSTCOUNT -S 1M $DIR/$tfile ||
+		error "setstripe failed"
+	dd if=/dev/urandom of=$TMP/$tfile bs=1M count=64 ||
+		error "cannot write $TMP/$tfile"
+	cp $TMP/$tfile $DIR/$tfile || error "cannot copy to $tfile"
+
+	$LCTL set_param -n llite.*.read_ahead_async=1
+	cancel_lru_locks osc
+	$LCTL set_param -n llite.*.read_ahead_stats=0
+	cmp $TMP/$tfile $DIR/$tfile || error "data mismatch with async ra"
+	$LCTL get_param llite.*.read_ahead_stats
+	$LCTL set_param -n llite.*.read_ahead_async=$async
+
+	pages=$($LCTL get_param -n llite.*.read_ahead_stats |
+		awk '/^async read-ahead pages/ { sum += $4 }
+		     END { print sum + 0 }')
+	[ $pages -gt 0 ] || error "no page read ahead by the workers"
+
+	rm -f $DIR/$tfile $TMP/$tfile
+}
+run_test 427 "asynchronous read-ahead by background workers"
+
+test_428() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local page_size=$(get_page_size client)
+	local line
+	local pages
+	local per_gib
+
+	dd if=/dev/zero of=$DIR/$tfile bs=1M count=64 ||
+		error "cannot write $tfile"
+	cat $DIR/$tfile > /dev/null || error "cannot read $tfile"
+
+	line=$($LCTL get_param -n llite.*.site | grep "^descriptors:" |
+		head -n 1)
+	echo "$line"
+	pages=$(echo $line | awk '{ print $4 }')
+	per_gib=$(echo $line | awk '{ print $6 }')
+	[ -n "$per_gib" ] || error "no descriptor statistics"
+	(( pages >= 64 * 1048576 / page_size )) ||
+		error "$pages descriptors for 64MiB of cached data"
+	# a descriptor takes at most 512 bytes, see cl_object_page_init()
+	(( per_gib > 0 && per_gib <= 512 * 1073741824 / page_size )) ||
+		error "bad descriptor memory $per_gib bytes/GiB"
+
+	rm -f $DIR/$tfile
+}
+run_test 428 "page descriptor memory statistics"
+
+test_429() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local fast_read=$($LCTL get_param -n llite.*.fast_read | head -n 1)
+	local async=$($LCTL get_param -n llite.*.read_ahead_async | head -n 1)
+	local windows
+	local val
+
+	$LFS setstripe -c 1 $DIR/$tfile || error "setstripe failed"
+	dd if=/dev/urandom of=$TMP/$tfile bs=1M count=32 ||
+		error "cannot write $TMP/$tfile"
+	cp $TMP/$tfile $DIR/$tfile || error "cannot copy to $tfile"
+
+	stack_trap "$LCTL set_param -n llite.*.fast_read=$fast_read" EXIT
+	stack_trap "$LCTL set_param -n llite.*.read_ahead_async=$async" EXIT
+	$LCTL set_param -n llite.*.fast_read=1
+	# fast reads read ahead by themselves, or through the workers
+	for val in 0 1; do
+		$LCTL set_param -n llite.*.read_ahead_async=$val
+		cancel_lru_locks osc
+		$LCTL set_param -n llite.*.read_ahead_stats=0
+		# small reads, so that most of them are fast reads
+		dd if=$DIR/$tfile of=$DIR/$tfile.2 bs=4k ||
+			error "cannot read $tfile"
+		$LCTL get_param llite.*.read_ahead_stats
+
+		cmp $TMP/$tfile $DIR/$tfile.2 ||
+			error "data mismatch with fast read, async=$val"
+		windows=$($LCTL get_param -n llite.*.read_ahead_stats |
+			awk '/^fast read read-ahead windows/ { sum += $5 }
+			     END { print sum + 0 }')
+		[ $windows -gt 0 ] ||
+			error "fast reads did not read ahead, async=$val"
+	done
+
+	rm -f $DIR/$tfile $DIR/$tfile.2 $TMP/$tfile
+}
+run_test 429 "fast read reads ahead without the normal read path"
+
+test_430() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+	[ $OSTCOUNT -lt 2 ] && skip "needs >= 2 OSTs" && return
+
+	local pio=$($LCTL get_param -n llite.*.pio | head -n 1)
+	local size
+
+	$LFS setstripe -c $OSTCOUNT -S 1M $DIR/$tfile ||
+		error "setstripe failed"
+	dd if=/dev/urandom of=$TMP/$tfile bs=1M count=33 ||
+		error "cannot write $TMP/$tfile"
+
+	$LCTL set_param -n llite.*.pio=1
+	dd if=$TMP/$tfile of=$DIR/$tfile bs=16M ||
+		error "parallel write failed"
+	cancel_lru_locks osc
+	cmp $TMP/$tfile $DIR/$tfile || error "data mismatch after write"
+
+	# short read: the read ends at EOF, in the middle of a stripe
+	$TRUNCATE $DIR/$tfile $((10 * 1048576 + 4096 * 3)) ||
+		error "truncate failed"
+	cancel_lru_locks osc
+	size=$(dd if=$DIR/$tfile bs=16M count=1 2>/dev/null | wc -c)
+	[ $size -eq $((10 * 1048576 + 4096 * 3)) ] ||
+		error "parallel read returned $size bytes"
+	cmp -n $size $TMP/$tfile $DIR/$tfile ||
+		error "data mismatch after short read"
+
+	# a failed range makes the IO short, the rest is written again
+	# define OBD_FAIL_LLITE_PTASK_IO_FAIL 0x140d
+	$LCTL set_param fail_loc=0x140d
+	dd if=$TMP/$tfile of=$DIR/$tfile bs=16M conv=notrunc
+	$LCTL set_param fail_loc=0
+	$LCTL set_param -n llite.*.pio=$pio
+	cancel_lru_locks osc
+	cmp $TMP/$tfile $DIR/$tfile || error "data mismatch after short write"
+
+	rm -f $DIR/$tfile $TMP/$tfile
+}
+run_test 430 "parallel IO split by stripe"
+
+test_431() {
+	[[ $(lustre_version_code client) -lt $(version_code 2.10.55) ]] &&
+		skip "Need client version at least 2.10.55" && return
+
+	local osc=$FSNAME-OST0000-osc-[^M]*
+	local pacing=$($LCTL get_param -n osc.$osc.write_pacing)
+	local dirty=$($LCTL get_param -n osc.$osc.max_dirty_mb)
+	local starved=()
+	local stats
+	local count
+	local val
+
+	$LFS setstripe -c 1 -i 0 $DIR/$tfile || error "setstripe failed"
+	$LCTL set_param osc.$osc.write_pacing=2 &&
+		error "bad write_pacing value accepted"
+
+	stack_trap "$LCTL set_param -n osc.$osc.write_pacing=$pacing" EXIT
+	$LCTL set_param -n osc.$osc.write_pacing=1
+	$LCTL set_param -n osc.$osc.write_pacing_stats=0
+	dd if=/dev/zero of=$DIR/$tfile bs=1M count=256 conv=fsync ||
+		error "cannot write $tfile"
+	stats=$($LCTL get_param -n osc.$osc.write_pacing_stats)
+	echo "$stats"
+	count=$(awk '/^rpc_done_bytes_per_sec:/ { print $2 }' <<< "$stats")
+	[ -n "$count" ] && [ $count -gt 0 ] ||
+		error "write RPC completion rate not sampled"
+
+	# the writers are paced once the grant left is small, so that fewer
+	# of them run out of grant than without pacing
+	stack_trap "$LCTL set_param -n osc.$osc.max_dirty_mb=$dirty" EXIT
+	$LCTL set_param -n osc.$osc.max_dirty_mb=4
+	for val in 0 1; do
+		$LCTL set_param -n osc.$osc.write_pacing=$val
+		# sample the write RPC rate again after the switch
+		$LCTL set_param -n osc.$osc.cur_grant_bytes=1M
+		dd if=/dev/zero of=$DIR/$tfile bs=64k count=1024 conv=fsync ||
+			error "cannot write $tfile"
+
+		$LCTL set_param -n osc.$osc.cur_grant_bytes=1M
+		$LCTL set_param -n osc.$osc.write_pacing_stats=0
+		dd if=/dev/zero of=$DIR/$tfile bs=64k count=4096 conv=fsync ||
+			error "cannot write $tfile"
+		stats=$($LCTL get_param -n osc.$osc.write_pacing_stats)
+		echo "write_pacing=$val"
+		echo "$stats"
+		starved[$val]=$(awk '/^grant_starved_writers:/ { print $2 }' \
+				   <<< "$stats")
+	done
+	count=$(awk '/^paced_writers:/ { print $2 }' <<< "$stats")
+	[ -n "$count" ] && [ $count -gt 0 ] ||
+		error "no writer paced under a small grant"
+	[ ${starved[1]} -lt ${starved[0]} ] ||
+		error "pacing did not reduce starved writers:" \
+		      "${starved[1]} >= ${starved[0]}"
+
+	rm -f $DIR/$tfile
+}
+run_test 431 "grant-aware write pacing"
+
 prep_801() {
 	[[ $(lustre_version_code mds1) -lt $(version_code 2.9.55) ]] ||
 	[[ $(lustre_version_code ost1) -lt $(version_code 2.9.55) ]] &&
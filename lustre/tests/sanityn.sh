@@ -4007,6 +4007,146 @@ test_93() {
 }
 run_test 93 "alloc_rr should not allocate on same ost"
 
+test_94() {
+	[[ $(lustre_version_code ost1) -lt $(version_code 2.10.55) ]] &&
+		skip "Need OST version at least 2.10.55" && return
+	$LCTL get_param -n osc.*.connect_flags | grep -q bl_ast_batch ||
+		{ skip "no batched blocking AST on server"; return 0; }
+	$LCTL get_param -n osc.*.connect_flags | grep -q lockaheadv2 ||
+		{ skip "no lockahead on server"; return 0; }
+
+	local nlocks=32
+	local locks1
+	local locks2
+	local blk1
+	local blk2
+	local i
+
+	$SETSTRIPE -c 1 -i 0 $DIR1/$tfile || error "setstripe failed"
+	cancel_lru_locks osc
+
+	locks1=$($LCTL get_param -n ldlm.namespaces.*-osc-*.lock_count |
+		 awk '{ sum += $1 } END { print sum }')
+	# non-overlapping write locks on the first mount
+	for ((i = 0; i < nlocks; i++)); do
+		$LFS ladvise -a lockahead -m WRITE -s $((i * 1048576)) \
+			-e $((i * 1048576 + 4095)) $DIR1/$tfile ||
+			error "lockahead $i failed"
+	done
+	sleep 1
+	locks2=$($LCTL get_param -n ldlm.namespaces.*-osc-*.lock_count |
+		 awk '{ sum += $1 } END { print sum }')
+	(( locks2 - locks1 >= nlocks / 2 )) ||
+		{ skip "only $((locks2 - locks1)) lockahead locks"; return 0; }
+
+	blk1=$($LCTL get_param -n ldlm.services.ldlm_cbd.stats |
+	       awk '/ldlm_bl_callback/ { print $2 }')
+	# one conflicting lock from the second mount for all of them
+	$TRUNCATE $DIR2/$tfile 0 || error "truncate failed"
+	blk2=$($LCTL get_param -n ldlm.services.ldlm_cbd.stats |
+	       awk '/ldlm_bl_callback/ { print $2 }')
+
+	echo "$((locks2 - locks1)) locks, $((${blk2:-0} - ${blk1:-0})) BL ASTs"
+	(( ${blk2:-0} - ${blk1:-0} < (locks2 - locks1) / 2 )) ||
+		error "$((blk2 - blk1)) BL ASTs for $((locks2 - locks1)) locks"
+	rm -f $DIR1/$tfile
+}
+run_test 94 "blocking ASTs for many locks are batched"
+
+# write interleaved 1MiB chunks to one object from both mounts, print the
+# blocking ASTs and the time it took
+test_95_strided() {
+	local file=$1
+	local chunks=$2
+	local blk1
+	local blk2
+	local start
+	local i
+
+	cancel_lru_locks osc
+	blk1=$($LCTL get_param -n ldlm.services.ldlm_cbd.stats |
+	       awk '/ldlm_bl_callback/ { print $2 }')
+	start=$SECONDS
+	for ((i = 0; i < chunks; i += 2)); do
+		dd if=/dev/zero of=$DIR1/$file bs=1M count=1 seek=$i \
+			conv=notrunc 2>/dev/null || exit 1
+	done &
+	local pid1=$!
+	for ((i = 1; i < chunks; i += 2)); do
+		dd if=/dev/zero of=$DIR2/$file bs=1M count=1 seek=$i \
+			conv=notrunc 2>/dev/null || exit 1
+	done &
+	local pid2=$!
+	wait $pid1 || return 1
+	wait $pid2 || return 1
+	blk2=$($LCTL get_param -n ldlm.services.ldlm_cbd.stats |
+	       awk '/ldlm_bl_callback/ { print $2 }')
+	echo $((${blk2:-0} - ${blk1:-0})) $((SECONDS - start))
+}
+
+test_95() {
+	[[ $(lustre_version_code ost1) -lt $(version_code 2.10.55) ]] &&
+		skip "Need OST version at least 2.10.55" && return
+	remote_ost_nodsh && skip "remote OST with nodsh" && return
+
+	local param="ldlm.namespaces.filter-*.contended_extent_align"
+	local old=$(do_facet ost1 $LCTL get_param -n $param | head -n 1)
+	local chunks=256
+	local plain
+	local aligned
+
+	[ -n "$old" ] || { skip "no contended_extent_align on OST"; return 0; }
+
+	$SETSTRIPE -c 1 -i 0 $DIR1/$tfile || error "setstripe failed"
+
+	do_facet ost1 $LCTL set_param -n $param=0
+	plain=($(test_95_strided $tfile $chunks))
+	do_facet ost1 $LCTL set_param -n $param=1
+	aligned=($(test_95_strided $tfile $chunks))
+	do_facet ost1 $LCTL set_param -n $param=$old
+
+	[ ${#plain[@]} -eq 2 ] && [ ${#aligned[@]} -eq 2 ] ||
+		error "strided writes failed"
+	echo "plain: ${plain[0]} BL ASTs in ${plain[1]}s," \
+	     "aligned: ${aligned[0]} BL ASTs in ${aligned[1]}s"
+	(( ${aligned[0]} <= ${plain[0]} )) ||
+		error "${aligned[0]} BL ASTs aligned, ${plain[0]} without"
+	rm -f $DIR1/$tfile
+}
+run_test 95 "contention-aware extent locks for strided shared-file writes"
+
+test_96() {
+	[[ $(lustre_version_code ost1) -lt $(version_code 2.10.55) ]] &&
+		skip "Need OST version at least 2.10.55" && return
+	remote_ost_nodsh && skip "remote OST with nodsh" && return
+
+	local stats="ldlm.waiting_locks_stats"
+	local before
+	local after
+
+	do_facet ost1 $LCTL get_param -n $stats ||
+		error "cannot read $stats"
+	# sum of the "added" column over all CPTs
+	before=$(do_facet ost1 $LCTL get_param -n $stats |
+		 awk 'NR > 1 { sum += $4 } END { print sum + 0 }')
+
+	$SETSTRIPE -c 1 -i 0 $DIR1/$tfile || error "setstripe failed"
+	for i in $(seq 10); do
+		dd if=/dev/zero of=$DIR1/$tfile bs=4k count=1 conv=notrunc \
+			2>/dev/null || error "write from $DIR1 failed"
+		dd if=/dev/zero of=$DIR2/$tfile bs=4k count=1 conv=notrunc \
+			2>/dev/null || error "write from $DIR2 failed"
+	done
+
+	do_facet ost1 $LCTL get_param -n $stats
+	after=$(do_facet ost1 $LCTL get_param -n $stats |
+		awk 'NR > 1 { sum += $4 } END { print sum + 0 }')
+	(( after > before )) ||
+		error "no lock waited for a callback ($before -> $after)"
+	rm -f $DIR1/$tfile
+}
+run_test 96 "waiting locks timer wheel statistics"
+
 log "cleanup: ======================================================"
 
 # kill and wait in each test only guarentee script finish, but command in script
@@ -5542,6 +5542,30 @@ group descriptors corrupted"
 	return 1
 }
 
+# Commands stacked by stack_trap() for the test running
+declare -a STACK_TRAPS
+
+# Runs the commands stacked by stack_trap(), the last one first
+run_stack_traps() {
+	local i
+
+	trap - EXIT
+	for ((i = ${#STACK_TRAPS[@]} - 1; i >= 0; i--)); do
+		eval "${STACK_TRAPS[i]}"
+	done
+	STACK_TRAPS=()
+}
+
+# Runs the command $1 once the test is over, whether it passes or fails,
+# after the commands stacked after it.  Only EXIT is supported as $2.
+stack_trap() {
+	local sig=${2:-EXIT}
+
+	[ "$sig" == "EXIT" ] || error "stack_trap: $sig is not supported"
+	STACK_TRAPS+=("$1")
+	trap run_stack_traps EXIT
+}
+
 #
 # Run a single test function and cleanup after it.
 #
@@ -5563,6 +5587,7 @@ run_one() {
 
 	banner "test $testnum: $message"
 	test_${testnum} || error "test_$testnum failed with $?"
+	run_stack_traps
 	cd $SAVE_PWD
 	reset_fail_loc
 	check_grant ${testnum} || error "check_grant $testnum failed with $?"
@@ -595,6 +595,10 @@ check_obd_connect_data(void)
 	CHECK_DEFINE_64X(OBD_CONNECT_FLAGS2);
 	CHECK_DEFINE_64X(OBD_CONNECT2_FILE_SECCTX);
 	CHECK_DEFINE_64X(OBD_CONNECT2_LOCKAHEAD);
+	CHECK_DEFINE_64X(OBD_CONNECT2_BL_AST_BATCH);
+	CHECK_DEFINE_64X(OBD_CONNECT2_LOCK_REPLAY_BATCH);
+	CHECK_DEFINE_64X(OBD_CONNECT2_MULTI_ENQUEUE);
+	CHECK_DEFINE_64X(OBD_CONNECT2_MULTI_BRW);
 
 	CHECK_VALUE_X(OBD_CKSUM_CRC32);
 	CHECK_VALUE_X(OBD_CKSUM_ADLER);